@@ -21,17 +21,24 @@
 #include <time.h>
 
 #define NANOS_IN_SECOND 1000000000
+#define CACHE_LINE_SIZE_IN_BYTES 64
 
 #define SLASSERT(x)   do {\
     assert(SL_RESULT_SUCCESS == (x));\
     (void) (x);\
     } while (0)
 
+enum SampleFormat {
+  SAMPLE_FORMAT_I16,
+  SAMPLE_FORMAT_FLOAT
+};
+
 struct AudioStreamFormat {
   uint32_t   frame_rate;
   uint32_t   frames_per_buffer;
   uint16_t   num_audio_channels;
   uint16_t   num_buffers;
+  uint16_t   num_render_ahead_buffers; // buffers rendered in advance but not yet enqueued
 };
 
 int64_t timestamp_to_nanos(timespec ts);
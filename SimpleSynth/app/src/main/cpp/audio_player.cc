@@ -15,17 +15,20 @@
  */
 
 #include <assert.h>
-#include <unistd.h>
-#include <sched.h>
+#include <stdlib.h>
 #include <cstring>
 
 #include <android/log.h>
 
 #include "audio_player.h"
 #include "android_log.h"
+#include "rt_log.h"
+#include "thread_affinity.h"
+#include "trace.h"
 
 #define MILLIHERTZ_IN_HERTZ 1000
 #define JAVA_PROXY_AVAILABLE_FROM_API_LEVEL 24
+#define FLOAT_OUTPUT_AVAILABLE_FROM_API_LEVEL 21
 
 void SLPlayerCallback(SLAndroidSimpleBufferQueueItf buffer_queue_itf, void *context) {
   (static_cast<AudioPlayer *>(context))->processSLCallback(buffer_queue_itf);
@@ -38,37 +41,74 @@ AudioPlayer::AudioPlayer(SLEngineItf engine_itf,
                          int api_level) :
     renderer_(renderer),
     stream_format_(stream_format),
+    callback_count_(0),
+    queue_depth_(0),
+    min_queue_depth_(0),
+    empty_queue_count_(0),
     is_thread_affinity_set_(false) {
 
   assert(renderer_ != nullptr);
 
+  // The callback thread logs through RtLog's queue when it sets its affinity, this drains it
+  RtLog::start();
+
   LOGV("Creating AudioPlayer with frame rate %d, "
            "frames per buffer %d, "
-           "buffers %d",
+           "buffers %d, "
+           "render ahead buffers %d",
        stream_format.frame_rate,
        stream_format.frames_per_buffer,
-       stream_format.num_buffers);
+       stream_format.num_buffers,
+       stream_format.num_render_ahead_buffers);
 
   SLDataLocator_AndroidSimpleBufferQueue sl_data_locator_bufferqueue_source;
   SLDataFormat_PCM sl_data_format_pcm;
+  SLAndroidDataFormat_PCM_EX sl_data_format_pcm_float;
   SLDataSource sl_data_source;
   SLDataLocator_OutputMix sl_data_locator_output_mix;
   SLDataSink sl_data_sink;
 
-  initAudioBuffer(stream_format_.frames_per_buffer,
-                  stream_format_.num_audio_channels,
-                  audio_buffer_);
   initDataLocatorBufferQueue((SLuint32) stream_format_.num_buffers,
                              &sl_data_locator_bufferqueue_source);
-  initDataFormat((SLuint32) stream_format_.frame_rate,
-                 (SLuint32) stream_format_.num_audio_channels,
-                 &sl_data_format_pcm);
-  initDataSource(&sl_data_locator_bufferqueue_source, &sl_data_format_pcm, &sl_data_source);
   initDataLocatorOutputMix(output_mix_object_itf, &sl_data_locator_output_mix);
   initDataSink(&sl_data_locator_output_mix, &sl_data_sink);
 
-  // Now we have a data source and sink we are able to create the OpenSL Player
-  createPlayer(engine_itf, &sl_data_source, &sl_data_sink, &sl_player_object_itf_);
+  SLresult result = SL_RESULT_FEATURE_UNSUPPORTED;
+
+  // Float samples can be passed straight to the mixer from API 21, which avoids quantizing the
+  // renderer's output to 16 bits and keeps any headroom above full scale. If the player can't be
+  // created with float samples the renderer's 16-bit output is used instead.
+  if (api_level >= FLOAT_OUTPUT_AVAILABLE_FROM_API_LEVEL) {
+    initDataFormatFloat((SLuint32) stream_format_.frame_rate,
+                        (SLuint32) stream_format_.num_audio_channels,
+                        &sl_data_format_pcm_float);
+    initDataSource(&sl_data_locator_bufferqueue_source,
+                   &sl_data_format_pcm_float,
+                   &sl_data_source);
+    result = createPlayer(engine_itf, &sl_data_source, &sl_data_sink, &sl_player_object_itf_);
+
+    if (result == SL_RESULT_SUCCESS) {
+      sample_format_ = SAMPLE_FORMAT_FLOAT;
+      bytes_per_sample_ = sizeof(float);
+    } else {
+      LOGW("Unable to create player with float samples, using 16-bit samples instead");
+    }
+  }
+
+  if (result != SL_RESULT_SUCCESS) {
+    initDataFormat((SLuint32) stream_format_.frame_rate,
+                   (SLuint32) stream_format_.num_audio_channels,
+                   &sl_data_format_pcm);
+    initDataSource(&sl_data_locator_bufferqueue_source, &sl_data_format_pcm, &sl_data_source);
+    result = createPlayer(engine_itf, &sl_data_source, &sl_data_sink, &sl_player_object_itf_);
+    assert(SL_RESULT_SUCCESS == result);
+  }
+
+  initAudioBuffers(stream_format_.num_buffers + stream_format_.num_render_ahead_buffers,
+                   stream_format_.frames_per_buffer * stream_format_.num_audio_channels *
+                       bytes_per_sample_);
+
+  // Now we have created the OpenSL Player it can be realized
   realizePlayer(sl_player_object_itf_);
 
   // If the API level is 24+ we can obtain the newer Android configuration interface which
@@ -93,17 +133,28 @@ AudioPlayer::~AudioPlayer() {
     (*sl_player_object_itf_)->Destroy(sl_player_object_itf_);
     sl_player_object_itf_ = nullptr;
   }
-  delete[] audio_buffer_;
+  free(audio_buffers_);
+  RtLog::stop();
 }
 
-void AudioPlayer::initAudioBuffer(int frames_per_buffer,
-                                  int num_audio_channels,
-                                  int16_t *&audio_buffer) {
+void AudioPlayer::initAudioBuffers(int num_buffers, int bytes_per_buffer) {
+
+  // Each buffer starts on its own cache line so rendering into one buffer never touches a line
+  // which the device may still be reading from another
+  audio_buffer_stride_ = ((bytes_per_buffer + CACHE_LINE_SIZE_IN_BYTES - 1) /
+                          CACHE_LINE_SIZE_IN_BYTES) * CACHE_LINE_SIZE_IN_BYTES;
+  int total_bytes = num_buffers * audio_buffer_stride_;
 
-  int samples_per_buffer = frames_per_buffer * num_audio_channels;
-  audio_buffer = new int16_t[samples_per_buffer];
-  memset(audio_buffer, 0, samples_per_buffer * sizeof(int16_t));
-  LOGV("audio buffer array allocated %d samples", samples_per_buffer);
+  void *audio_buffers = nullptr;
+  int result = posix_memalign(&audio_buffers, CACHE_LINE_SIZE_IN_BYTES, (size_t) total_bytes);
+  assert(result == 0);
+  (void) result;
+
+  audio_buffers_ = static_cast<uint8_t *>(audio_buffers);
+  memset(audio_buffers_, 0, (size_t) total_bytes);
+  num_audio_buffers_ = num_buffers;
+  audio_buffer_sizes_.assign((size_t) num_buffers, 0);
+  LOGV("%d audio buffers allocated of %d bytes", num_buffers, bytes_per_buffer);
 }
 
 void AudioPlayer::initDataLocatorBufferQueue(SLuint32 num_buffers,
@@ -133,8 +184,25 @@ void AudioPlayer::initDataFormat(SLuint32 frame_rate,
   data_format->endianness = SL_BYTEORDER_LITTLEENDIAN;
 }
 
+void AudioPlayer::initDataFormatFloat(SLuint32 frame_rate,
+                                      SLuint32 num_channels,
+                                      SLAndroidDataFormat_PCM_EX *data_format) {
+
+  data_format->formatType = SL_ANDROID_DATAFORMAT_PCM_EX;
+  data_format->numChannels = num_channels;
+
+  // Note: unlike SLDataFormat_PCM this property is correctly named, but it still expects the
+  // sample rate in milliHz
+  data_format->sampleRate = frame_rate * MILLIHERTZ_IN_HERTZ;
+  data_format->bitsPerSample = SL_PCMSAMPLEFORMAT_FIXED_32;
+  data_format->containerSize = SL_PCMSAMPLEFORMAT_FIXED_32;
+  data_format->channelMask = (SLuint32) (1 << num_channels) - 1;
+  data_format->endianness = SL_BYTEORDER_LITTLEENDIAN;
+  data_format->representation = SL_ANDROID_PCM_REPRESENTATION_FLOAT;
+}
+
 void AudioPlayer::initDataSource(SLDataLocator_AndroidSimpleBufferQueue *data_locator,
-                                 SLDataFormat_PCM *data_format,
+                                 void *data_format,
                                  SLDataSource *data_source) {
 
   data_source->pLocator = data_locator;
@@ -154,10 +222,10 @@ void AudioPlayer::initDataSink(SLDataLocator_OutputMix *data_locator, SLDataSink
   data_sink->pFormat = NULL;
 }
 
-void AudioPlayer::createPlayer(SLEngineItf engine_itf,
-                               SLDataSource *data_source,
-                               SLDataSink *data_sink,
-                               SLObjectItf *player_object_itf) {
+SLresult AudioPlayer::createPlayer(SLEngineItf engine_itf,
+                                   SLDataSource *data_source,
+                                   SLDataSink *data_sink,
+                                   SLObjectItf *player_object_itf) {
 
   // Note: Adding other output interfaces here may result in your audio being routed using the
   // normal path NOT the fast path
@@ -176,7 +244,7 @@ void AudioPlayer::createPlayer(SLEngineItf engine_itf,
       interfaceIds,
       interfacesRequired
   );
-  assert(SL_RESULT_SUCCESS == result);
+  return result;
 }
 
 void AudioPlayer::getAndroidConfigurationInterface(SLObjectItf player_object_itf,
@@ -235,8 +303,8 @@ void AudioPlayer::play() {
     LOGE("SLPlayItf was null");
   } else if (renderer_ == nullptr) {
     LOGE("Renderer was null");
-  } else if (audio_buffer_ == nullptr) {
-    LOGE("Audio buffer is null");
+  } else if (audio_buffers_ == nullptr) {
+    LOGE("Audio buffers are null");
   } else {
 
     // set the player's state to playing
@@ -246,18 +314,19 @@ void AudioPlayer::play() {
 
     (void) result;
 
-    // Enqueue buffers of audio data to kick off the callbacks
+    next_render_buffer_ = 0;
+    next_enqueue_buffer_ = 0;
+    callback_count_.store(0, std::memory_order_relaxed);
+    queue_depth_.store(stream_format_.num_buffers, std::memory_order_relaxed);
+    min_queue_depth_.store(stream_format_.num_buffers, std::memory_order_relaxed);
+    empty_queue_count_.store(0, std::memory_order_relaxed);
+
+    // Render every buffer, then enqueue enough to fill the queue and kick off the callbacks.
+    // The remaining buffers are the render ahead buffers.
+    for (int i = 0; i < num_audio_buffers_; i++) renderNextBuffer();
     for (int i = 0; i < stream_format_.num_buffers; i++) {
-      int samples_rendered = renderer_->render(
-          stream_format_.frames_per_buffer * stream_format_.num_audio_channels,
-          audio_buffer_);
-      LOGV("Enqueuing buffer %d, samples rendered %d ", i, samples_rendered);
-
-      result = (*sl_buffer_queue_itf_)->Enqueue(
-          sl_buffer_queue_itf_,
-          audio_buffer_,
-          samples_rendered * sizeof(audio_buffer_[0]));
-      assert(SL_RESULT_SUCCESS == result);
+      LOGV("Enqueuing buffer %d, bytes rendered %d ", i, audio_buffer_sizes_[i]);
+      enqueueNextBuffer(sl_buffer_queue_itf_);
     }
   }
 }
@@ -270,6 +339,16 @@ void AudioPlayer::stop() {
     SLresult result = (*sl_play_itf_)->SetPlayState(sl_play_itf_, SL_PLAYSTATE_STOPPED);
     assert(SL_RESULT_SUCCESS == result);
     LOGV("play state set to stopped");
+
+    // Stopping the player doesn't always clear the queue, make sure the next play() starts
+    // from an empty one
+    result = (*sl_buffer_queue_itf_)->Clear(sl_buffer_queue_itf_);
+    assert(SL_RESULT_SUCCESS == result);
+    (void) result;
+
+    LOGV("Callbacks %lld, minimum queue depth %d, callbacks with an empty queue %lld",
+         (long long) callback_count_.load(), min_queue_depth_.load(),
+         (long long) empty_queue_count_.load());
   }
 }
 
@@ -277,42 +356,74 @@ void AudioPlayer::processSLCallback(SLAndroidSimpleBufferQueueItf buffer_queue_i
 
   if (callback_cpu_ids_.size() > 0 && !is_thread_affinity_set_) setThreadAffinity();
 
+  updateBufferQueueStats(buffer_queue_itf);
+
+  // With render ahead buffers the next buffer is already rendered so it can be enqueued
+  // straight away, then the buffer the device has just finished with is rendered into. Without
+  // them these are the same buffer so it has to be rendered first.
+  if (stream_format_.num_render_ahead_buffers == 0) {
+    renderNextBuffer();
+    enqueueNextBuffer(buffer_queue_itf);
+  } else {
+    enqueueNextBuffer(buffer_queue_itf);
+    renderNextBuffer();
+  }
+}
+
+void AudioPlayer::renderNextBuffer() {
+
   int num_requested_samples = stream_format_.frames_per_buffer *
                               stream_format_.num_audio_channels;
-  int num_rendered_samples = renderer_->render(num_requested_samples, audio_buffer_);
-  SLresult result = (*buffer_queue_itf)->Enqueue(buffer_queue_itf,
-                                                 audio_buffer_,
-                                                 num_rendered_samples * sizeof(int16_t));
-  assert(SL_RESULT_SUCCESS == result);
+  uint8_t *audio_buffer = audio_buffers_ + next_render_buffer_ * audio_buffer_stride_;
+  int num_rendered_samples = renderAudio(num_requested_samples, audio_buffer);
+  audio_buffer_sizes_[next_render_buffer_] = (SLuint32) (num_rendered_samples * bytes_per_sample_);
+  next_render_buffer_ = (next_render_buffer_ + 1) % num_audio_buffers_;
 }
 
-void AudioPlayer::setThreadAffinity() {
+void AudioPlayer::enqueueNextBuffer(SLAndroidSimpleBufferQueueItf buffer_queue_itf) {
 
-  pid_t current_thread_id = gettid();
-  cpu_set_t cpu_set;
-  CPU_ZERO(&cpu_set);
+  SLresult result = (*buffer_queue_itf)->Enqueue(
+      buffer_queue_itf,
+      audio_buffers_ + next_enqueue_buffer_ * audio_buffer_stride_,
+      audio_buffer_sizes_[next_enqueue_buffer_]);
+  assert(SL_RESULT_SUCCESS == result);
+  (void) result;
+  next_enqueue_buffer_ = (next_enqueue_buffer_ + 1) % num_audio_buffers_;
+}
 
-  // If the callback cpu ids aren't specified then bind to the current cpu
-  if (callback_cpu_ids_.empty()) {
-    int current_cpu_id = sched_getcpu();
-    LOGV("Current CPU ID is %d", current_cpu_id);
-    CPU_SET(current_cpu_id, &cpu_set);
-  } else {
+void AudioPlayer::updateBufferQueueStats(SLAndroidSimpleBufferQueueItf buffer_queue_itf) {
 
-    for (size_t i = 0; i < callback_cpu_ids_.size(); i++) {
-      int cpu_id = callback_cpu_ids_.at(i);
-      LOGV("CPU ID %d added to cores set", cpu_id);
-      CPU_SET(cpu_id, &cpu_set);
-    }
+  SLAndroidSimpleBufferQueueState state;
+  SLresult result = (*buffer_queue_itf)->GetState(buffer_queue_itf, &state);
+  if (result != SL_RESULT_SUCCESS) return;
+
+  // Only this thread writes the stats so they don't need read-modify-write operations
+  int32_t queue_depth = (int32_t) state.count;
+  queue_depth_.store(queue_depth, std::memory_order_relaxed);
+  Trace::setCounter("Buffer queue depth", queue_depth);
+  if (queue_depth < min_queue_depth_.load(std::memory_order_relaxed)) {
+    min_queue_depth_.store(queue_depth, std::memory_order_relaxed);
+  }
+  if (queue_depth == 0) {
+    empty_queue_count_.store(empty_queue_count_.load(std::memory_order_relaxed) + 1,
+                             std::memory_order_relaxed);
   }
+  callback_count_.store(callback_count_.load(std::memory_order_relaxed) + 1,
+                        std::memory_order_relaxed);
+}
+
+int AudioPlayer::renderAudio(int num_samples, uint8_t *audio_buffer) {
 
-  int result = sched_setaffinity(current_thread_id, sizeof(cpu_set_t), &cpu_set);
-  if (result == 0) {
-    LOGV("Thread affinity set");
+  if (sample_format_ == SAMPLE_FORMAT_FLOAT) {
+    return renderer_->render(num_samples, reinterpret_cast<float *>(audio_buffer));
   } else {
-    LOGW("Error setting thread affinity. Error no: %d", result);
+    return renderer_->render(num_samples, reinterpret_cast<int16_t *>(audio_buffer));
   }
+}
 
+void AudioPlayer::setThreadAffinity() {
+
+  set_current_thread_affinity(callback_cpu_ids_);
   is_thread_affinity_set_ = true;
 }
 
@@ -333,3 +444,14 @@ void AudioPlayer::acquireJavaProxy(SLAndroidConfigurationItfAPI24 config_itf, jo
 jobject AudioPlayer::getAudioTrack() {
   return java_proxy_;
 }
+
+SampleFormat AudioPlayer::getSampleFormat() {
+  return sample_format_;
+}
+
+void AudioPlayer::getBufferQueueStats(BufferQueueStats *stats) {
+  stats->callback_count = callback_count_.load(std::memory_order_relaxed);
+  stats->queue_depth = queue_depth_.load(std::memory_order_relaxed);
+  stats->min_queue_depth = min_queue_depth_.load(std::memory_order_relaxed);
+  stats->empty_queue_count = empty_queue_count_.load(std::memory_order_relaxed);
+}
@@ -21,6 +21,7 @@
 
 #include <SLES/OpenSLES.h>
 #include <SLES/OpenSLES_Android.h>
+#include <atomic>
 #include <vector>
 #include <jni.h>
 #include "audio_renderer.h"
@@ -28,6 +29,17 @@
 #include "OpenSLES_Android_API24.h"
 
 
+/**
+ * Buffer queue counters, updated on every callback. A queue depth of zero means the device has
+ * nothing left to play after the buffer which is about to be enqueued, so an underrun is likely.
+ */
+struct BufferQueueStats {
+  int64_t callback_count;
+  int32_t queue_depth;        // buffers still queued when the last callback was called
+  int32_t min_queue_depth;    // lowest queue depth seen since play()
+  int64_t empty_queue_count;  // callbacks which found the queue empty
+};
+
 typedef void (*sl_player_callback_function)(SLAndroidSimpleBufferQueueItf buffer_queue_itf,
                                             void *context);
 
@@ -52,12 +64,14 @@ public:
 
   jobject getAudioTrack();
 
+  SampleFormat getSampleFormat();
+
+  void getBufferQueueStats(BufferQueueStats *stats);
+
 private:
 
   // Methods
-  void initAudioBuffer(int frames_per_buffer,
-                       int num_audio_channels,
-                       int16_t *&audio_buffer);
+  void initAudioBuffers(int num_buffers, int bytes_per_buffer);
 
   void initDataLocatorBufferQueue(SLuint32 num_buffers,
                                   SLDataLocator_AndroidSimpleBufferQueue *data_locator);
@@ -66,8 +80,12 @@ private:
                       SLuint32 num_channels,
                       SLDataFormat_PCM *data_format);
 
+  void initDataFormatFloat(SLuint32 frame_rate,
+                           SLuint32 num_channels,
+                           SLAndroidDataFormat_PCM_EX *data_format);
+
   void initDataSource(SLDataLocator_AndroidSimpleBufferQueue *data_locator,
-                      SLDataFormat_PCM *data_format,
+                      void *data_format,
                       SLDataSource *data_source);
 
   void initDataLocatorOutputMix(SLObjectItf output_mix_itf,
@@ -76,10 +94,10 @@ private:
   void initDataSink(SLDataLocator_OutputMix *data_locator,
                     SLDataSink *data_sink);
 
-  void createPlayer(SLEngineItf engine_itf,
-                    SLDataSource *data_source,
-                    SLDataSink *data_sink,
-                    SLObjectItf *player_object_itf);
+  SLresult createPlayer(SLEngineItf engine_itf,
+                       SLDataSource *data_source,
+                       SLDataSink *data_sink,
+                       SLObjectItf *player_object_itf);
 
   void getAndroidConfigurationInterface(SLObjectItf player_object_itf,
                                         SLAndroidConfigurationItf *config_itf);
@@ -102,12 +120,37 @@ private:
 
   void acquireJavaProxy(SLAndroidConfigurationItfAPI24 config_itf, jobject *java_proxy);
 
+  int renderAudio(int num_samples, uint8_t *audio_buffer);
+
+  void renderNextBuffer();
+
+  void enqueueNextBuffer(SLAndroidSimpleBufferQueueItf buffer_queue_itf);
+
+  void updateBufferQueueStats(SLAndroidSimpleBufferQueueItf buffer_queue_itf);
+
   // Member variables
   AudioRenderer *renderer_ = nullptr;
   AudioStreamFormat stream_format_;
-  int16_t *audio_buffer_;
+  SampleFormat sample_format_ = SAMPLE_FORMAT_I16;
+  int bytes_per_sample_ = sizeof(int16_t);
   jobject java_proxy_ = nullptr;
 
+  // Audio buffers. There is one buffer for each buffer in the queue, plus the render ahead
+  // buffers. Buffers are rendered and enqueued in ring order so a buffer is only rendered into
+  // once the device has finished with it.
+  uint8_t *audio_buffers_ = nullptr;
+  int num_audio_buffers_ = 0;
+  int audio_buffer_stride_ = 0;       // bytes between buffers, a multiple of the cache line size
+  std::vector<SLuint32> audio_buffer_sizes_; // bytes rendered into each buffer
+  int next_render_buffer_ = 0;
+  int next_enqueue_buffer_ = 0;
+
+  // Buffer queue stats
+  std::atomic<int64_t> callback_count_;
+  std::atomic<int32_t> queue_depth_;
+  std::atomic<int32_t> min_queue_depth_;
+  std::atomic<int64_t> empty_queue_count_;
+
   // OpenSL objects
   SLObjectItf sl_player_object_itf_ = nullptr;
   SLAndroidConfigurationItf sl_android_config_itf_ = nullptr;
@@ -22,6 +22,8 @@
 class AudioRenderer {
 
 public:
+  virtual ~AudioRenderer() {}
+
   /**
     * Render signed 16-bit audio samples into the supplied audio buffer
     *
@@ -30,6 +32,16 @@ public:
     * @return number of samples which were actually rendered
     */
   virtual int render(int num_samples, int16_t *audio_buffer) = 0;
+
+  /**
+    * Render floating point audio samples into the supplied audio buffer. Full scale is -1.0 to
+    * 1.0 but samples are not clipped, so renderers in a chain keep any headroom above full scale.
+    *
+    * @param num_samples number of samples to render
+    * @param audio_buffer array into which samples should be rendered
+    * @return number of samples which were actually rendered
+    */
+  virtual int render(int num_samples, float *audio_buffer) = 0;
 };
 
 
@@ -20,6 +20,7 @@
 #include "audio_player.h"
 #include "synthesizer.h"
 #include "load_stabilizer.h"
+#include "pipelined_renderer.h"
 #include "android_log.h"
 
 // OpenSL ES interfaces
@@ -30,9 +31,22 @@ static SLObjectItf sl_output_mix_object_itf = nullptr;
 static LoadStabilizer *load_stabilizer;
 static Synthesizer *synth;
 static AudioPlayer *player;
+static PipelinedRenderer *pipelined_renderer = nullptr;
 static int api_level;
 
 #define NUM_AUDIO_CHANNELS 2 // 1 = mono, 2 = stereo
+#define NUM_RENDER_AHEAD_BUFFERS 0 // buffers rendered ahead of the queue, each adds a buffer of latency
+
+// Render on a producer thread instead of in the audio callback, see PipelinedRenderer
+#define USE_PRODUCER_THREAD false
+#define PRODUCER_THREAD_FILL_LEVEL_IN_BUFFERS 2
+#define PRODUCER_THREAD_MAX_FILL_LEVEL_IN_BUFFERS 8
+
+// How load stabilization pads each callback, see LoadStabilizer. Adaptive padding and render
+// ahead are opt in: render ahead makes control events heard a callback later, which shifts them
+// against the render times Synthesizer uses to place them.
+#define STABILIZATION_POLICY STABILIZATION_POLICY_FIXED
+#define PADDING_MODE PADDING_MODE_SPIN
 
 extern "C" {
 
@@ -108,15 +122,32 @@ JNIEXPORT jobject JNICALL Java_com_example_simplesynth_MainActivity_native_1crea
   format.frames_per_buffer = (uint32_t) j_frames_per_buffer;
   format.num_audio_channels = NUM_AUDIO_CHANNELS;
   format.num_buffers = (uint16_t) j_num_buffers;
+  format.num_render_ahead_buffers = NUM_RENDER_AHEAD_BUFFERS;
 
   synth = new Synthesizer(format.num_audio_channels, format.frame_rate);
 
   int64_t callback_period_ns = ((int64_t)format.frames_per_buffer * NANOS_IN_SECOND) / format.frame_rate;
-  load_stabilizer = new LoadStabilizer(synth, callback_period_ns);
+  load_stabilizer = new LoadStabilizer(synth,
+                                       callback_period_ns,
+                                       format.frames_per_buffer * format.num_audio_channels);
+  load_stabilizer->setStabilizationPolicy(STABILIZATION_POLICY);
+  load_stabilizer->setPaddingMode(PADDING_MODE);
+
+  AudioRenderer *player_renderer = load_stabilizer;
+  if (USE_PRODUCER_THREAD) {
+    pipelined_renderer = new PipelinedRenderer(
+        load_stabilizer,
+        format.num_audio_channels,
+        format.frames_per_buffer,
+        format.frames_per_buffer * PRODUCER_THREAD_MAX_FILL_LEVEL_IN_BUFFERS);
+    pipelined_renderer->setFillLevel(
+        format.frames_per_buffer * PRODUCER_THREAD_FILL_LEVEL_IN_BUFFERS);
+    player_renderer = pipelined_renderer;
+  }
 
   player = new AudioPlayer(sl_engine_engine_itf,
                            sl_output_mix_object_itf,
-                           load_stabilizer,
+                           player_renderer,
                            format,
                            api_level);
 
@@ -131,10 +162,12 @@ JNIEXPORT jobject JNICALL Java_com_example_simplesynth_MainActivity_native_1crea
       cpu_ids.push_back(elements[i]);
     }
     player->setCallbackThreadCPUIds(cpu_ids);
+    if (pipelined_renderer != nullptr) pipelined_renderer->setProducerThreadCPUIds(cpu_ids);
   }
 
   Trace::initialize();
 
+  if (pipelined_renderer != nullptr) pipelined_renderer->start();
   player->play();
   return player->getAudioTrack();
 }
@@ -146,6 +179,10 @@ Java_com_example_simplesynth_MainActivity_native_1destroyAudioPlayer(
 
   player->stop();
   delete player;
+  if (pipelined_renderer != nullptr) {
+    delete pipelined_renderer;
+    pipelined_renderer = nullptr;
+  }
   delete load_stabilizer;
   delete synth;
 }
@@ -15,31 +15,95 @@
  */
 
 #include <assert.h>
+#include <sched.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cstring>
 #include "load_stabilizer.h"
 #include "cpu_relax.h"
 #include "android_log.h"
 #include "audio_common.h"
 
 #define LOAD_GENERATION_STEP_SIZE_IN_NANOS 1000
+#define SPIN_RATE_CALIBRATION_DURATION_IN_NANOS 2000000
+#define SPIN_RATE_CALIBRATION_OPS_PER_STEP 1000
+// Spin rate used until calibration finishes. Underestimating is safe, each load generation step
+// just finishes early and the loop runs more steps, whereas overestimating would overshoot.
+#define INITIAL_SPIN_RATE_OPS_PER_NANO 0.1
+#define SPIN_RATE_DRIFT_WEIGHT (1.0 / 8)
+#define LOAD_ERROR_EWMA_WEIGHT (1.0 / 16)
 #define PERCENTAGE_OF_CALLBACK_TO_USE 0.8
 
-LoadStabilizer::LoadStabilizer(AudioRenderer *audio_renderer, int64_t callback_period_ns) :
+// Adaptive policy tuning
+#define RENDER_DURATION_EWMA_WEIGHT (1.0 / 16)
+#define RENDER_DURATION_PERCENTILE 0.95
+#define ADAPTIVE_TARGET_HEADROOM 1.25
+// Callbacks which start later than this fraction of the period into it are not padded, the
+// CPU is evidently busy enough already and padding would only make a missed deadline likelier
+#define BACKOFF_LATENESS_FRACTION 0.25
+
+// Relaxed increment for counters which only the audio thread writes
+static inline void increment(std::atomic<int64_t> &counter, int64_t amount = 1) {
+  counter.store(counter.load(std::memory_order_relaxed) + amount, std::memory_order_relaxed);
+}
+
+LoadStabilizer::LoadStabilizer(AudioRenderer *audio_renderer,
+                               int64_t callback_period_ns,
+                               int max_samples_per_render) :
     audio_renderer_(audio_renderer),
     callback_period_(callback_period_ns),
+    is_calibrated_(false),
     is_stabilization_enabled_(false),
-    callback_count_(0){
+    policy_(STABILIZATION_POLICY_FIXED),
+    padding_mode_(PADDING_MODE_SPIN),
+    callback_count_(0),
+    max_samples_per_render_(max_samples_per_render),
+    stats_callback_count_(0),
+    deadline_miss_count_(0),
+    backoff_count_(0),
+    stats_mean_render_duration_(0),
+    stats_percentile_render_duration_(0),
+    last_target_duration_(0),
+    total_load_duration_(0),
+    stats_mean_ready_duration_(0),
+    speculative_render_count_(0),
+    lookaside_hit_count_(0),
+    stats_mean_load_error_(0) {
 
   assert(callback_period_ns > 0);
 
+  long num_cpus = sysconf(_SC_NPROCESSORS_CONF);
+  if (num_cpus < 1) num_cpus = 1;
+  ops_per_nano_.assign((size_t) num_cpus, INITIAL_SPIN_RATE_OPS_PER_NANO);
+  calibrated_ops_per_nano_.assign((size_t) num_cpus, 0);
+  calibration_thread_ = std::thread(&LoadStabilizer::calibrateSpinRates, this);
+
+  // Big enough for the largest render in either sample format
+  lookaside_buffer_ = new uint8_t[max_samples_per_render_ * sizeof(float)];
+
   LOGV("Creating load stabilizer with callback period %lld", (long long)callback_period_);
 }
 
+LoadStabilizer::~LoadStabilizer() {
+  calibration_thread_.join();
+  delete[] lookaside_buffer_;
+}
+
 int LoadStabilizer::render(int num_samples, int16_t *audio_buffer) {
+  return renderStabilized(num_samples, audio_buffer);
+}
+
+int LoadStabilizer::render(int num_samples, float *audio_buffer) {
+  return renderStabilized(num_samples, audio_buffer);
+}
+
+template <typename T>
+int LoadStabilizer::renderStabilized(int num_samples, T *audio_buffer) {
 
   Trace::beginSection("LoadStabilizer::render start");
   int rendered_samples = 0;
 
-  if (is_stabilization_enabled_){
+  if (is_stabilization_enabled_.load(std::memory_order_relaxed)){
 
     int64_t start_time = get_time();
     if (callback_count_ == 0) callback_epoch_ = start_time;
@@ -59,29 +123,64 @@ int LoadStabilizer::render(int num_samples, int16_t *audio_buffer) {
     }
 
     int64_t started_late_duration = time_since_epoch - (periods_since_epoch * callback_period_);
-    int64_t target_duration = (int64_t)(callback_period_ *
-        PERCENTAGE_OF_CALLBACK_TO_USE) - started_late_duration;
+    int64_t target_duration = getTargetDuration(started_late_duration);
 
     Trace::beginSection("Actual load");
-    rendered_samples = audio_renderer_->render(num_samples, audio_buffer);
+    bool is_lookaside_hit;
+    rendered_samples = renderOrTakeLookaside(num_samples, audio_buffer, &is_lookaside_hit);
     Trace::endSection();
 
-    int64_t real_execution_duration = get_time() - start_time;
-    int64_t stabilizing_load_duration = target_duration - real_execution_duration;
+    int64_t render_end_time = get_time();
+    int64_t ready_duration = render_end_time - start_time;
+    if (!is_lookaside_hit) updateRenderDuration(ready_duration);
 
+    mean_ready_duration_ += (ready_duration - mean_ready_duration_) * RENDER_DURATION_EWMA_WEIGHT;
+    stats_mean_ready_duration_.store((int64_t) mean_ready_duration_, std::memory_order_relaxed);
+
+    int64_t stabilizing_load_duration = target_duration - ready_duration;
+    if (stabilizing_load_duration > 0 &&
+        padding_mode_.load(std::memory_order_relaxed) == PADDING_MODE_RENDER_AHEAD &&
+        !has_lookaside_ && num_samples <= max_samples_per_render_ &&
+        started_late_duration + ready_duration + mean_render_duration_ <=
+            callback_period_ * PERCENTAGE_OF_CALLBACK_TO_USE) {
+
+      // The next render is expected to finish comfortably inside this period, so do it now.
+      // This can overshoot an adaptive target once, after which this callback's render is a
+      // copy and the padding covers the next render.
+      Trace::beginSection("Speculative render");
+      renderLookaside<T>(num_samples);
+      Trace::endSection();
+
+      int64_t speculative_end_time = get_time();
+      updateRenderDuration(speculative_end_time - render_end_time);
+      increment(speculative_render_count_);
+      stabilizing_load_duration = target_duration - (speculative_end_time - start_time);
+    }
+
+    int64_t end_time = get_time();
     if (stabilizing_load_duration > 0){
       Trace::beginSection("Stabilizing load");
       generateLoad(stabilizing_load_duration);
       Trace::endSection();
+      int64_t load_end_time = get_time();
+      increment(total_load_duration_, load_end_time - end_time);
+      end_time = load_end_time;
+    }
+
+    if (started_late_duration + (end_time - start_time) > callback_period_) {
+      increment(deadline_miss_count_);
     }
 
     callback_count_++;
+    increment(stats_callback_count_);
 
   } else {
 
-    // just call the wrapped function directly, no load stabilization
+    // just call the wrapped function directly, no load stabilization. A block rendered ahead
+    // before stabilization was disabled is still played so no audio is skipped.
     Trace::beginSection("Actual load");
-    rendered_samples = audio_renderer_->render(num_samples, audio_buffer);
+    bool is_lookaside_hit;
+    rendered_samples = renderOrTakeLookaside(num_samples, audio_buffer, &is_lookaside_hit);
     Trace::endSection();
   }
 
@@ -90,35 +189,232 @@ int LoadStabilizer::render(int num_samples, int16_t *audio_buffer) {
   return rendered_samples;
 }
 
+/**
+ * Render into the audio buffer, or copy in the samples rendered ahead by the previous callback
+ */
+template <typename T>
+int LoadStabilizer::renderOrTakeLookaside(int num_samples, T *audio_buffer,
+                                          bool *is_lookaside_hit) {
+
+  *is_lookaside_hit = has_lookaside_ && lookaside_sample_size_ == sizeof(T) &&
+                      lookaside_requested_samples_ == num_samples;
+
+  // A lookaside block for a different format or size can't be used, which only happens if the
+  // player changes, so it is dropped
+  has_lookaside_ = false;
+
+  if (*is_lookaside_hit) {
+    memcpy(audio_buffer, lookaside_buffer_, lookaside_rendered_samples_ * sizeof(T));
+    increment(lookaside_hit_count_);
+    return lookaside_rendered_samples_;
+  }
+  return audio_renderer_->render(num_samples, audio_buffer);
+}
+
+template <typename T>
+void LoadStabilizer::renderLookaside(int num_samples) {
+
+  lookaside_rendered_samples_ = audio_renderer_->render(
+      num_samples, reinterpret_cast<T *>(lookaside_buffer_));
+  lookaside_requested_samples_ = num_samples;
+  lookaside_sample_size_ = sizeof(T);
+  has_lookaside_ = true;
+}
+
+/**
+ * Work out how long this callback should take in total, including the render, measured from
+ * when it started
+ */
+int64_t LoadStabilizer::getTargetDuration(int64_t started_late_duration) {
+
+  int64_t max_target_duration = (int64_t) (callback_period_ * PERCENTAGE_OF_CALLBACK_TO_USE);
+  int64_t target_duration = max_target_duration;
+
+  if (policy_.load(std::memory_order_relaxed) == STABILIZATION_POLICY_ADAPTIVE) {
+
+    if (started_late_duration > callback_period_ * BACKOFF_LATENESS_FRACTION) {
+      increment(backoff_count_);
+      target_duration = 0;
+    } else {
+      // Pad to the render duration which is rarely exceeded, never less than the average
+      int64_t estimate = std::max(percentile_render_duration_, (int64_t) mean_render_duration_);
+      target_duration = std::min((int64_t) (estimate * ADAPTIVE_TARGET_HEADROOM),
+                                 max_target_duration);
+    }
+  }
+
+  target_duration -= started_late_duration;
+  last_target_duration_.store(target_duration, std::memory_order_relaxed);
+  return target_duration;
+}
+
+void LoadStabilizer::updateRenderDuration(int64_t render_duration) {
+
+  if (render_duration_count_ == 0) {
+    mean_render_duration_ = render_duration;
+  } else {
+    mean_render_duration_ += (render_duration - mean_render_duration_) *
+                             RENDER_DURATION_EWMA_WEIGHT;
+  }
+
+  render_durations_[render_duration_count_ % RENDER_DURATION_WINDOW_SIZE] = render_duration;
+  render_duration_count_++;
+
+  // Select the percentile from a copy of the window, nth_element is linear and doesn't allocate
+  int window_size = std::min(render_duration_count_, RENDER_DURATION_WINDOW_SIZE);
+  std::copy(render_durations_, render_durations_ + window_size, sorted_render_durations_);
+  int percentile_index = (int) ((window_size - 1) * RENDER_DURATION_PERCENTILE);
+  std::nth_element(sorted_render_durations_,
+                   sorted_render_durations_ + percentile_index,
+                   sorted_render_durations_ + window_size);
+  percentile_render_duration_ = sorted_render_durations_[percentile_index];
+
+  // Stop the count wrapping, keeping the window index in step
+  if (render_duration_count_ == 2 * RENDER_DURATION_WINDOW_SIZE) {
+    render_duration_count_ = RENDER_DURATION_WINDOW_SIZE;
+  }
+
+  stats_mean_render_duration_.store((int64_t) mean_render_duration_, std::memory_order_relaxed);
+  stats_percentile_render_duration_.store(percentile_render_duration_,
+                                          std::memory_order_relaxed);
+}
+
+static inline void spin(int num_ops) {
+  for (int i = 0; i < num_ops; i++){
+    cpu_relax();
+  }
+}
+
+// Measure how many cpu_relax operations the current CPU executes per nanosecond
+static double measure_spin_rate() {
+
+  int64_t start_time = get_time();
+  int64_t end_time = start_time;
+  int64_t total_ops = 0;
+
+  while (end_time - start_time < SPIN_RATE_CALIBRATION_DURATION_IN_NANOS) {
+    spin(SPIN_RATE_CALIBRATION_OPS_PER_STEP);
+    total_ops += SPIN_RATE_CALIBRATION_OPS_PER_STEP;
+    end_time = get_time();
+  }
+  return (double) total_ops / (end_time - start_time);
+}
+
+/**
+ * Runs on the calibration thread. Measure the spin rate of every CPU by moving the thread to each
+ * one in turn. CPUs which the thread can't be moved to, e.g. because they are offline, use the
+ * rate of the CPU the thread started on until load generation runs on them.
+ */
+void LoadStabilizer::calibrateSpinRates() {
+
+  double default_rate = measure_spin_rate();
+  for (double &rate : calibrated_ops_per_nano_) rate = default_rate;
+
+  cpu_set_t original_cpu_set;
+  if (sched_getaffinity(0, sizeof(cpu_set_t), &original_cpu_set) == 0) {
+
+    for (int cpu_id = 0; cpu_id < (int) calibrated_ops_per_nano_.size(); cpu_id++) {
+      cpu_set_t cpu_set;
+      CPU_ZERO(&cpu_set);
+      CPU_SET(cpu_id, &cpu_set);
+      if (sched_setaffinity(0, sizeof(cpu_set_t), &cpu_set) != 0) continue;
+
+      calibrated_ops_per_nano_[cpu_id] = measure_spin_rate();
+      LOGV("CPU %d spin rate %f ops per nanosecond", cpu_id, calibrated_ops_per_nano_[cpu_id]);
+    }
+
+    sched_setaffinity(0, sizeof(cpu_set_t), &original_cpu_set);
+  }
+
+  is_calibrated_.store(true, std::memory_order_release);
+}
+
+/**
+ * Runs on the audio thread. Replace the initial estimates with the calibrated rates the first
+ * time they are available. The vectors are the same size so nothing is allocated.
+ */
+void LoadStabilizer::takeCalibratedSpinRates() {
+
+  if (has_calibrated_ops_per_nano_ || !is_calibrated_.load(std::memory_order_acquire)) return;
+  std::copy(calibrated_ops_per_nano_.begin(), calibrated_ops_per_nano_.end(),
+            ops_per_nano_.begin());
+  has_calibrated_ops_per_nano_ = true;
+}
+
+bool LoadStabilizer::isCalibrated() {
+  return is_calibrated_.load(std::memory_order_acquire);
+}
+
+double LoadStabilizer::getCalibratedSpinRate(int cpu_id) {
+  if (!isCalibrated() || cpu_id < 0 || cpu_id >= (int) calibrated_ops_per_nano_.size()) return 0;
+  return calibrated_ops_per_nano_[cpu_id];
+}
+
 // Generates a stabilizing load by executing cpu instructions for the specified time
 void LoadStabilizer::generateLoad(int64_t duration_in_nanos){
 
+  takeCalibratedSpinRates();
+
   int64_t current_time = get_time();
   int64_t deadline_time = current_time + duration_in_nanos;
 
-  // ops_per_step gives us an estimated number of operations which need to be run to fully utilize
-  // the CPU for a fixed amount of time (specified by LOAD_GENERATION_STEP_SIZE_IN_NANOS).
-  // After each step the ops_per_step value is re-calculated based on the actual time taken to
-  // execute those operations.
-  int ops_per_step = (int)(ops_per_nano_ * LOAD_GENERATION_STEP_SIZE_IN_NANOS);
-  int64_t step_duration = 0;
-  int64_t previous_time = 0;
+  // The CPU is looked up once per call, sched_getcpu may be a system call. A migration part way
+  // through only affects the remaining steps, which correct themselves as they are measured.
+  int cpu_id = sched_getcpu();
+  if (cpu_id < 0 || cpu_id >= (int) ops_per_nano_.size()) cpu_id = 0;
+  double &ops_per_nano = ops_per_nano_[cpu_id];
 
-  while (current_time <= deadline_time){
+  // ops_per_step gives us an estimated number of operations which need to be run to fully utilize
+  // the CPU for a fixed amount of time (specified by LOAD_GENERATION_STEP_SIZE_IN_NANOS), or
+  // until the deadline if that is sooner. After each step the spin rate for this CPU is corrected
+  // towards the rate measured over the step.
+  while (current_time < deadline_time){
 
-    for (int i = 0; i < ops_per_step; i++){
-      cpu_relax();
-    }
+    int64_t step_target = std::min(deadline_time - current_time,
+                                   (int64_t) LOAD_GENERATION_STEP_SIZE_IN_NANOS);
+    int ops_per_step = std::max((int) (ops_per_nano * step_target), 1);
+    spin(ops_per_step);
 
-    previous_time = current_time;
+    int64_t previous_time = current_time;
     current_time = get_time();
-    step_duration = current_time - previous_time;
-    ops_per_nano_ = ops_per_step / step_duration;
-    ops_per_step = (int)(ops_per_nano_ * LOAD_GENERATION_STEP_SIZE_IN_NANOS);
+    int64_t step_duration = current_time - previous_time;
+    // Short final steps are dominated by the cost of reading the clock, so they aren't used
+    if (step_target == LOAD_GENERATION_STEP_SIZE_IN_NANOS && step_duration > 0) {
+      double measured_ops_per_nano = (double) ops_per_step / step_duration;
+      ops_per_nano += (measured_ops_per_nano - ops_per_nano) * SPIN_RATE_DRIFT_WEIGHT;
+    }
   }
+
+  mean_load_error_ += ((current_time - deadline_time) - mean_load_error_) * LOAD_ERROR_EWMA_WEIGHT;
+  stats_mean_load_error_.store((int64_t) mean_load_error_, std::memory_order_relaxed);
 }
 
 void LoadStabilizer::setStabilizationEnabled(bool is_enabled){
   LOGV("Load stabilization set to %d", is_enabled);
-  is_stabilization_enabled_ = is_enabled;
+  is_stabilization_enabled_.store(is_enabled, std::memory_order_relaxed);
+}
+
+void LoadStabilizer::setStabilizationPolicy(StabilizationPolicy policy){
+  LOGV("Load stabilization policy set to %d", policy);
+  policy_.store(policy, std::memory_order_relaxed);
+}
+
+void LoadStabilizer::setPaddingMode(PaddingMode mode){
+  LOGV("Load stabilization padding mode set to %d", mode);
+  padding_mode_.store(mode, std::memory_order_relaxed);
+}
+
+void LoadStabilizer::getStats(LoadStabilizerStats *stats){
+  stats->callback_count = stats_callback_count_.load(std::memory_order_relaxed);
+  stats->deadline_miss_count = deadline_miss_count_.load(std::memory_order_relaxed);
+  stats->backoff_count = backoff_count_.load(std::memory_order_relaxed);
+  stats->mean_render_duration = stats_mean_render_duration_.load(std::memory_order_relaxed);
+  stats->percentile_render_duration =
+      stats_percentile_render_duration_.load(std::memory_order_relaxed);
+  stats->last_target_duration = last_target_duration_.load(std::memory_order_relaxed);
+  stats->total_load_duration = total_load_duration_.load(std::memory_order_relaxed);
+  stats->mean_ready_duration = stats_mean_ready_duration_.load(std::memory_order_relaxed);
+  stats->speculative_render_count = speculative_render_count_.load(std::memory_order_relaxed);
+  stats->lookaside_hit_count = lookaside_hit_count_.load(std::memory_order_relaxed);
+  stats->mean_load_error = stats_mean_load_error_.load(std::memory_order_relaxed);
 }
@@ -17,25 +17,157 @@
 #ifndef SIMPLESYNTH_LOAD_STABILIZER_H
 #define SIMPLESYNTH_LOAD_STABILIZER_H
 
+#include <stddef.h>
 #include <SLES/OpenSLES_Android.h>
+#include <atomic>
+#include <thread>
+#include <vector>
 #include "trace.h"
 #include "audio_renderer.h"
 
+// Number of recent render durations used to estimate the render cost percentile
+#define RENDER_DURATION_WINDOW_SIZE 128
+
+/**
+ * How the stabilizing load is sized.
+ *
+ * FIXED pads every callback to a fixed fraction of the callback period. ADAPTIVE pads to just
+ * above a high percentile of the measured render duration, which is enough to stop the CPU
+ * governor from lowering the clock under the renderer but burns less CPU when rendering is cheap.
+ */
+enum StabilizationPolicy {
+  STABILIZATION_POLICY_FIXED,
+  STABILIZATION_POLICY_ADAPTIVE
+};
+
+/**
+ * What the stabilizing load does.
+ *
+ * SPIN burns the padding time in a cpu_relax loop. RENDER_AHEAD spends it rendering the next
+ * callback's samples into a lookaside buffer, which the next callback copies instead of
+ * rendering, and only spins for whatever time is left. Either way the CPU stays busy, but render
+ * ahead turns the padding into headroom for the next callback. The cost is that control events
+ * sent to the renderer during the padding are heard one callback later.
+ */
+enum PaddingMode {
+  PADDING_MODE_SPIN,
+  PADDING_MODE_RENDER_AHEAD
+};
+
+/**
+ * Render cost and padding statistics, all durations are in nanoseconds
+ */
+struct LoadStabilizerStats {
+  int64_t callback_count;
+  int64_t deadline_miss_count;    // callbacks which finished after the end of their period
+  int64_t backoff_count;          // callbacks which started too late to be padded
+  int64_t mean_render_duration;   // exponentially weighted moving average
+  int64_t percentile_render_duration;
+  int64_t last_target_duration;
+  int64_t total_load_duration;    // time spent spinning to generate stabilizing load
+  int64_t mean_ready_duration;    // average time from callback start until its samples are ready
+  int64_t speculative_render_count;
+  int64_t lookaside_hit_count;    // callbacks served from the lookaside buffer
+  int64_t mean_load_error;        // average overshoot of the stabilizing load past its deadline
+};
+
 class LoadStabilizer : public AudioRenderer {
 
 public:
-  LoadStabilizer(AudioRenderer *audio_renderer, int64_t callback_period_ns);
+  /**
+   * @param audio_renderer renderer to stabilize
+   * @param callback_period_ns time between callbacks
+   * @param max_samples_per_render largest render which can be done ahead of time
+   */
+  LoadStabilizer(AudioRenderer *audio_renderer,
+                 int64_t callback_period_ns,
+                 int max_samples_per_render);
+  ~LoadStabilizer();
   int render(int num_samples, int16_t *audio_buffer);
+  int render(int num_samples, float *audio_buffer);
   void generateLoad(int64_t duration_in_nanos);
+
+  /**
+   * @return true once the spin rate of every CPU has been measured. Until then load generation
+   * starts from a deliberately low estimate and corrects it as it runs.
+   */
+  bool isCalibrated();
+
+  /**
+   * @return cpu_relax operations per nanosecond measured on cpu_id, or 0 if calibration hasn't
+   * finished or the CPU couldn't be measured
+   */
+  double getCalibratedSpinRate(int cpu_id);
   void setStabilizationEnabled(bool is_enabled);
+  void setStabilizationPolicy(StabilizationPolicy policy);
+  void setPaddingMode(PaddingMode mode);
+  void getStats(LoadStabilizerStats *stats);
 
 private:
+  template <typename T>
+  int renderStabilized(int num_samples, T *audio_buffer);
+
+  template <typename T>
+  int renderOrTakeLookaside(int num_samples, T *audio_buffer, bool *is_lookaside_hit);
+
+  template <typename T>
+  void renderLookaside(int num_samples);
+
+  void calibrateSpinRates();
+  void takeCalibratedSpinRates();
+
+  void updateRenderDuration(int64_t render_duration);
+  int64_t getTargetDuration(int64_t started_late_duration);
+
   AudioRenderer *audio_renderer_;
   int64_t callback_period_;
-  double ops_per_nano_ = 1;
-  bool is_stabilization_enabled_;
+  // cpu_relax operations per nanosecond for each CPU, measured at startup and corrected by every
+  // load generation step which runs on that CPU. Cores of different types and clock speeds
+  // differ, so a single estimate is wrong whenever the callback thread migrates. Audio thread
+  // only once constructed.
+  std::vector<double> ops_per_nano_;
+
+  // Calibration runs on its own thread, so the thread creating the stabilizer isn't blocked and
+  // keeps its affinity. calibrated_ops_per_nano_ is only read once is_calibrated_ is set.
+  std::thread calibration_thread_;
+  std::vector<double> calibrated_ops_per_nano_;
+  std::atomic<bool> is_calibrated_;
+  bool has_calibrated_ops_per_nano_ = false; // audio thread only
+  std::atomic<bool> is_stabilization_enabled_;
+  std::atomic<int> policy_;
+  std::atomic<int> padding_mode_;
   int64_t callback_count_;
   int64_t callback_epoch_;
+
+  // Render cost estimates, audio thread only
+  double mean_render_duration_ = 0;
+  int64_t render_durations_[RENDER_DURATION_WINDOW_SIZE];
+  int64_t sorted_render_durations_[RENDER_DURATION_WINDOW_SIZE];
+  int render_duration_count_ = 0;
+  int64_t percentile_render_duration_ = 0;
+
+  // Lookaside buffer, audio thread only
+  int max_samples_per_render_;
+  uint8_t *lookaside_buffer_ = nullptr;
+  bool has_lookaside_ = false;
+  size_t lookaside_sample_size_ = 0;
+  int lookaside_requested_samples_ = 0;
+  int lookaside_rendered_samples_ = 0;
+  double mean_ready_duration_ = 0;
+
+  // Stats, written by the audio thread and read by any thread
+  std::atomic<int64_t> stats_callback_count_;
+  std::atomic<int64_t> deadline_miss_count_;
+  std::atomic<int64_t> backoff_count_;
+  std::atomic<int64_t> stats_mean_render_duration_;
+  std::atomic<int64_t> stats_percentile_render_duration_;
+  std::atomic<int64_t> last_target_duration_;
+  std::atomic<int64_t> total_load_duration_;
+  std::atomic<int64_t> stats_mean_ready_duration_;
+  std::atomic<int64_t> speculative_render_count_;
+  std::atomic<int64_t> lookaside_hit_count_;
+  double mean_load_error_ = 0;
+  std::atomic<int64_t> stats_mean_load_error_;
 };
 
 #endif //SIMPLESYNTH_LOAD_STABILIZER_H
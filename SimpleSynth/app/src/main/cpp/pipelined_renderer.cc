@@ -0,0 +1,201 @@
+/*
+ * Copyright 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <assert.h>
+#include <errno.h>
+#include <cstring>
+#include "pipelined_renderer.h"
+#include "sample_conversion.h"
+#include "thread_affinity.h"
+#include "audio_common.h"
+#include "android_log.h"
+#include "trace.h"
+
+PipelinedRenderer::PipelinedRenderer(AudioRenderer *audio_renderer,
+                                     int num_audio_channels,
+                                     int frames_per_block,
+                                     int max_fill_level_in_frames) :
+    audio_renderer_(audio_renderer),
+    num_audio_channels_(num_audio_channels),
+    samples_per_block_(frames_per_block * num_audio_channels),
+    max_fill_level_in_frames_(max_fill_level_in_frames),
+    // A whole block must fit on top of the maximum fill level
+    ring_buffer_((max_fill_level_in_frames + frames_per_block) * num_audio_channels),
+    is_running_(false),
+    target_fill_level_(frames_per_block),
+    signal_time_(0),
+    underflow_count_(0),
+    last_producer_lateness_(0),
+    max_producer_lateness_(0) {
+
+  assert(audio_renderer_ != nullptr);
+  assert(frames_per_block > 0 && max_fill_level_in_frames >= frames_per_block);
+
+  render_buffer_ = new float[samples_per_block_];
+  conversion_buffer_ = new float[samples_per_block_];
+  sem_init(&space_available_, 0, 0);
+
+  LOGV("Creating pipelined renderer with blocks of %d frames, maximum fill level %d frames",
+       frames_per_block, max_fill_level_in_frames);
+}
+
+PipelinedRenderer::~PipelinedRenderer() {
+  stop();
+  sem_destroy(&space_available_);
+  delete[] render_buffer_;
+  delete[] conversion_buffer_;
+}
+
+void PipelinedRenderer::start() {
+
+  if (is_running_.load()) return;
+
+  // Fill the ring before the first callback so it doesn't start with an underflow
+  refill();
+  signal_time_.store(0);
+
+  is_running_.store(true);
+  producer_thread_ = std::thread(&PipelinedRenderer::runProducer, this);
+}
+
+void PipelinedRenderer::stop() {
+
+  if (!is_running_.exchange(false)) return;
+
+  sem_post(&space_available_);
+  producer_thread_.join();
+}
+
+void PipelinedRenderer::runProducer() {
+
+  set_current_thread_real_time_priority();
+  if (!producer_cpu_ids_.empty()) set_current_thread_affinity(producer_cpu_ids_);
+
+  while (is_running_.load(std::memory_order_acquire)) {
+
+    if (sem_wait(&space_available_) != 0) {
+      assert(errno == EINTR);
+      continue;
+    }
+    if (!is_running_.load(std::memory_order_acquire)) break;
+
+    refill();
+
+    int64_t signal_time = signal_time_.exchange(0, std::memory_order_relaxed);
+    if (signal_time != 0) {
+      int64_t lateness = get_time() - signal_time;
+      last_producer_lateness_.store(lateness, std::memory_order_relaxed);
+      if (lateness > max_producer_lateness_.load(std::memory_order_relaxed)) {
+        max_producer_lateness_.store(lateness, std::memory_order_relaxed);
+      }
+    }
+  }
+}
+
+void PipelinedRenderer::refill() {
+
+  Trace::beginSection("PipelinedRenderer::refill");
+
+  int32_t target_samples = target_fill_level_.load(std::memory_order_relaxed) *
+                           num_audio_channels_;
+  int32_t fill_level = ring_buffer_.getFillLevel();
+
+  while (fill_level < target_samples &&
+         ring_buffer_.getCapacity() - fill_level >= samples_per_block_) {
+
+    int rendered_samples = audio_renderer_->render(samples_per_block_, render_buffer_);
+    fill_level += ring_buffer_.write(render_buffer_, rendered_samples);
+  }
+  Trace::setCounter("Pipeline fill level", fill_level / num_audio_channels_);
+
+  Trace::endSection();
+}
+
+int PipelinedRenderer::render(int num_samples, float *audio_buffer) {
+
+  Trace::beginSection("PipelinedRenderer::render");
+  readSamples(num_samples, audio_buffer);
+  signalProducer();
+  Trace::endSection();
+  return num_samples;
+}
+
+int PipelinedRenderer::render(int num_samples, int16_t *audio_buffer) {
+
+  Trace::beginSection("PipelinedRenderer::render");
+
+  // Convert a block at a time through the conversion buffer. The ring holds interleaved samples
+  // so they are converted as a single channel.
+  int sample_count = 0;
+  while (sample_count < num_samples) {
+    int block_samples = num_samples - sample_count;
+    if (block_samples > samples_per_block_) block_samples = samples_per_block_;
+
+    readSamples(block_samples, conversion_buffer_);
+    convert_mono_float_to_int16(conversion_buffer_, audio_buffer + sample_count,
+                                block_samples, 1, 1.0f / INT16_TO_FLOAT_SCALE);
+    sample_count += block_samples;
+  }
+
+  signalProducer();
+  Trace::endSection();
+  return num_samples;
+}
+
+int PipelinedRenderer::readSamples(int num_samples, float *audio_buffer) {
+
+  int read_samples = ring_buffer_.read(audio_buffer, num_samples);
+  if (read_samples < num_samples) {
+
+    // The producer fell behind, play silence rather than stale samples
+    memset(audio_buffer + read_samples, 0, (num_samples - read_samples) * sizeof(float));
+    underflow_count_.store(underflow_count_.load(std::memory_order_relaxed) + 1,
+                           std::memory_order_relaxed);
+  }
+  return read_samples;
+}
+
+void PipelinedRenderer::signalProducer() {
+
+  // Only the first signal since the last refill is timed, so lateness covers the whole wait
+  int64_t no_signal = 0;
+  signal_time_.compare_exchange_strong(no_signal, get_time(), std::memory_order_relaxed);
+
+  // sem_post doesn't block and only makes a system call if the producer is waiting
+  sem_post(&space_available_);
+}
+
+void PipelinedRenderer::setFillLevel(int fill_level_in_frames) {
+
+  if (fill_level_in_frames < 0) fill_level_in_frames = 0;
+  if (fill_level_in_frames > max_fill_level_in_frames_) {
+    fill_level_in_frames = max_fill_level_in_frames_;
+  }
+  LOGV("Pipeline fill level set to %d frames", fill_level_in_frames);
+  target_fill_level_.store(fill_level_in_frames, std::memory_order_relaxed);
+}
+
+void PipelinedRenderer::setProducerThreadCPUIds(std::vector<int> cpu_ids) {
+  producer_cpu_ids_ = cpu_ids;
+}
+
+void PipelinedRenderer::getStats(PipelineStats *stats) {
+  stats->fill_level_in_frames = ring_buffer_.getFillLevel() / num_audio_channels_;
+  stats->target_fill_level_in_frames = target_fill_level_.load(std::memory_order_relaxed);
+  stats->underflow_count = underflow_count_.load(std::memory_order_relaxed);
+  stats->last_producer_lateness_ns = last_producer_lateness_.load(std::memory_order_relaxed);
+  stats->max_producer_lateness_ns = max_producer_lateness_.load(std::memory_order_relaxed);
+}
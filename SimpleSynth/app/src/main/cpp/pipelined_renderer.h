@@ -0,0 +1,115 @@
+/*
+ * Copyright 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SIMPLESYNTH_PIPELINED_RENDERER_H
+#define SIMPLESYNTH_PIPELINED_RENDERER_H
+
+#include <stdint.h>
+#include <semaphore.h>
+#include <atomic>
+#include <thread>
+#include <vector>
+#include "audio_renderer.h"
+#include "sample_ring_buffer.h"
+
+/**
+ * Counters for a PipelinedRenderer. Lateness is the time from the audio callback taking samples
+ * out of the ring to the producer thread refilling it to the target fill level.
+ */
+struct PipelineStats {
+  int32_t fill_level_in_frames;
+  int32_t target_fill_level_in_frames;
+  int64_t underflow_count;          // renders which ran out of samples and were padded with zeros
+  int64_t last_producer_lateness_ns;
+  int64_t max_producer_lateness_ns;
+};
+
+/**
+ * Runs another renderer on a dedicated producer thread, ahead of the audio callback.
+ *
+ * The producer renders blocks of frames_per_block frames into a SampleRingBuffer and keeps it
+ * topped up to the target fill level. render() only copies samples out of the ring and wakes the
+ * producer, so the callback's duration no longer depends on the cost of the wrapped renderer.
+ * The fill level is extra output latency, in exchange the producer can run late by up to that
+ * many frames before the callback runs out of samples.
+ *
+ * render() must only be called from one thread, usually the audio callback.
+ */
+class PipelinedRenderer : public AudioRenderer {
+
+public:
+  PipelinedRenderer(AudioRenderer *audio_renderer,
+                    int num_audio_channels,
+                    int frames_per_block,
+                    int max_fill_level_in_frames);
+
+  virtual ~PipelinedRenderer();
+
+  virtual int render(int num_samples, int16_t *audio_buffer);
+
+  virtual int render(int num_samples, float *audio_buffer);
+
+  /**
+   * Fill the ring to the target fill level and start the producer thread.
+   */
+  void start();
+
+  void stop();
+
+  /**
+   * Set how many frames the producer keeps rendered ahead of the callback. May be called from
+   * any thread while the producer is running.
+   */
+  void setFillLevel(int fill_level_in_frames);
+
+  /**
+   * Cores to bind the producer thread to, takes effect on the next start()
+   */
+  void setProducerThreadCPUIds(std::vector<int> cpu_ids);
+
+  void getStats(PipelineStats *stats);
+
+private:
+  void runProducer();
+
+  void refill();
+
+  int readSamples(int num_samples, float *audio_buffer);
+
+  void signalProducer();
+
+  AudioRenderer *audio_renderer_;
+  int num_audio_channels_;
+  int samples_per_block_;
+  int max_fill_level_in_frames_;
+  SampleRingBuffer ring_buffer_;
+  float *render_buffer_ = nullptr;      // producer thread only
+  float *conversion_buffer_ = nullptr;  // consumer thread only, used for int16 output
+
+  std::thread producer_thread_;
+  std::vector<int> producer_cpu_ids_;
+  sem_t space_available_;
+  std::atomic<bool> is_running_;
+  std::atomic<int32_t> target_fill_level_;
+
+  // Stats
+  std::atomic<int64_t> signal_time_;
+  std::atomic<int64_t> underflow_count_;
+  std::atomic<int64_t> last_producer_lateness_;
+  std::atomic<int64_t> max_producer_lateness_;
+};
+
+#endif //SIMPLESYNTH_PIPELINED_RENDERER_H
@@ -0,0 +1,226 @@
+/*
+ * Copyright 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <math.h>
+#include "sample_conversion.h"
+
+#if SAMPLE_CONVERSION_USE_NEON
+#include <arm_neon.h>
+#elif SAMPLE_CONVERSION_USE_SSE2
+#include <emmintrin.h>
+#endif
+
+// Number of frames converted by each iteration of the vectorized loops
+#define FRAMES_PER_VECTOR 8
+
+static inline int16_t float_to_int16(float sample, float scale) {
+
+  // NaN becomes silence, and clamping before the conversion keeps out of range values from
+  // wrapping around. The SIMD kernels do the same, so their output matches exactly.
+  float scaled = sample * scale;
+  if (isnan(scaled)) return 0;
+  scaled = fminf(fmaxf(scaled, (float) INT16_MIN), (float) INT16_MAX);
+  return (int16_t) scaled;
+}
+
+void convert_mono_float_to_int16_scalar(const float *source,
+                                        int16_t *destination,
+                                        int num_frames,
+                                        int num_channels,
+                                        float scale) {
+
+  int sample_count = 0;
+  for (int i = 0; i < num_frames; i++) {
+    int16_t value = float_to_int16(source[i], scale);
+    for (int j = 0; j < num_channels; j++) {
+      destination[sample_count] = value;
+      sample_count++;
+    }
+  }
+}
+
+#if SAMPLE_CONVERSION_USE_NEON
+
+static inline int16x8_t convert_vector(const float *source,
+                                       float32x4_t scale,
+                                       float32x4_t minimum,
+                                       float32x4_t maximum) {
+
+  float32x4_t low = vmulq_f32(vld1q_f32(source), scale);
+  float32x4_t high = vmulq_f32(vld1q_f32(source + 4), scale);
+
+  // Zero any NaN, NaN is the only value which isn't equal to itself
+  low = vreinterpretq_f32_u32(vandq_u32(vceqq_f32(low, low), vreinterpretq_u32_f32(low)));
+  high = vreinterpretq_f32_u32(vandq_u32(vceqq_f32(high, high), vreinterpretq_u32_f32(high)));
+  low = vminq_f32(vmaxq_f32(low, minimum), maximum);
+  high = vminq_f32(vmaxq_f32(high, minimum), maximum);
+
+  // vcvtq_s32_f32 truncates towards zero, matching the scalar cast
+  return vcombine_s16(vqmovn_s32(vcvtq_s32_f32(low)), vqmovn_s32(vcvtq_s32_f32(high)));
+}
+
+static int convert_vectorized(const float *source,
+                              int16_t *destination,
+                              int num_frames,
+                              int num_channels,
+                              float scale) {
+
+  const float32x4_t scale_vector = vdupq_n_f32(scale);
+  const float32x4_t minimum = vdupq_n_f32((float) INT16_MIN);
+  const float32x4_t maximum = vdupq_n_f32((float) INT16_MAX);
+
+  int frame = 0;
+  for (; frame + FRAMES_PER_VECTOR <= num_frames; frame += FRAMES_PER_VECTOR) {
+
+    int16x8_t value = convert_vector(source + frame, scale_vector, minimum, maximum);
+    int16_t *output = destination + frame * num_channels;
+
+    switch (num_channels) {
+      case 1:
+        vst1q_s16(output, value);
+        break;
+      case 2: {
+        int16x8x2_t channels = {{value, value}};
+        vst2q_s16(output, channels);
+        break;
+      }
+      case 4: {
+        int16x8x4_t channels = {{value, value, value, value}};
+        vst4q_s16(output, channels);
+        break;
+      }
+      default: {
+        int16_t values[FRAMES_PER_VECTOR];
+        vst1q_s16(values, value);
+        for (int i = 0; i < FRAMES_PER_VECTOR; i++) {
+          for (int j = 0; j < num_channels; j++) output[i * num_channels + j] = values[i];
+        }
+        break;
+      }
+    }
+  }
+  return frame;
+}
+
+#elif SAMPLE_CONVERSION_USE_SSE2
+
+static inline __m128i convert_vector(const float *source,
+                                     __m128 scale,
+                                     __m128 minimum,
+                                     __m128 maximum) {
+
+  __m128 low = _mm_mul_ps(_mm_loadu_ps(source), scale);
+  __m128 high = _mm_mul_ps(_mm_loadu_ps(source + 4), scale);
+
+  // Zero any NaN, _mm_cmpord_ps is false only when a lane is NaN
+  low = _mm_and_ps(_mm_cmpord_ps(low, low), low);
+  high = _mm_and_ps(_mm_cmpord_ps(high, high), high);
+  low = _mm_min_ps(_mm_max_ps(low, minimum), maximum);
+  high = _mm_min_ps(_mm_max_ps(high, minimum), maximum);
+
+  // _mm_cvttps_epi32 truncates towards zero, matching the scalar cast
+  return _mm_packs_epi32(_mm_cvttps_epi32(low), _mm_cvttps_epi32(high));
+}
+
+static int convert_vectorized(const float *source,
+                              int16_t *destination,
+                              int num_frames,
+                              int num_channels,
+                              float scale) {
+
+  const __m128 scale_vector = _mm_set1_ps(scale);
+  const __m128 minimum = _mm_set1_ps((float) INT16_MIN);
+  const __m128 maximum = _mm_set1_ps((float) INT16_MAX);
+
+  int frame = 0;
+  for (; frame + FRAMES_PER_VECTOR <= num_frames; frame += FRAMES_PER_VECTOR) {
+
+    __m128i value = convert_vector(source + frame, scale_vector, minimum, maximum);
+    __m128i *output = reinterpret_cast<__m128i *>(destination + frame * num_channels);
+
+    switch (num_channels) {
+      case 1:
+        _mm_storeu_si128(output, value);
+        break;
+      case 2:
+        _mm_storeu_si128(output, _mm_unpacklo_epi16(value, value));
+        _mm_storeu_si128(output + 1, _mm_unpackhi_epi16(value, value));
+        break;
+      case 4: {
+        __m128i low = _mm_unpacklo_epi16(value, value);
+        __m128i high = _mm_unpackhi_epi16(value, value);
+        _mm_storeu_si128(output, _mm_unpacklo_epi32(low, low));
+        _mm_storeu_si128(output + 1, _mm_unpackhi_epi32(low, low));
+        _mm_storeu_si128(output + 2, _mm_unpacklo_epi32(high, high));
+        _mm_storeu_si128(output + 3, _mm_unpackhi_epi32(high, high));
+        break;
+      }
+      default: {
+        int16_t values[FRAMES_PER_VECTOR];
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(values), value);
+        int16_t *samples = destination + frame * num_channels;
+        for (int i = 0; i < FRAMES_PER_VECTOR; i++) {
+          for (int j = 0; j < num_channels; j++) samples[i * num_channels + j] = values[i];
+        }
+        break;
+      }
+    }
+  }
+  return frame;
+}
+
+#endif
+
+void convert_mono_float_to_int16(const float *source,
+                                 int16_t *destination,
+                                 int num_frames,
+                                 int num_channels,
+                                 float scale) {
+
+  int converted_frames = 0;
+
+#if SAMPLE_CONVERSION_USE_NEON || SAMPLE_CONVERSION_USE_SSE2
+  converted_frames = convert_vectorized(source, destination, num_frames, num_channels, scale);
+#endif
+
+  // Convert any frames which don't fill a whole vector
+  convert_mono_float_to_int16_scalar(source + converted_frames,
+                                     destination + converted_frames * num_channels,
+                                     num_frames - converted_frames,
+                                     num_channels,
+                                     scale);
+}
+
+void interleave_mono_float(const float *source,
+                           float *destination,
+                           int num_frames,
+                           int num_channels,
+                           float scale) {
+
+  if (num_channels == 1) {
+    for (int i = 0; i < num_frames; i++) destination[i] = source[i] * scale;
+    return;
+  }
+
+  int sample_count = 0;
+  for (int i = 0; i < num_frames; i++) {
+    float value = source[i] * scale;
+    for (int j = 0; j < num_channels; j++) {
+      destination[sample_count] = value;
+      sample_count++;
+    }
+  }
+}
@@ -0,0 +1,76 @@
+/*
+ * Copyright 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SIMPLESYNTH_SAMPLE_CONVERSION_H
+#define SIMPLESYNTH_SAMPLE_CONVERSION_H
+
+#include <stdint.h>
+
+/**
+ * The SIMD implementation is chosen at compile time. NEON is used on ARM, SSE2 on x86 and a
+ * scalar loop everywhere else.
+ */
+#if defined(__ARM_NEON__) || defined(__ARM_NEON)
+#define SAMPLE_CONVERSION_USE_NEON 1
+#elif defined(__SSE2__)
+#define SAMPLE_CONVERSION_USE_SSE2 1
+#endif
+
+// Scale which maps the int16 range onto the -1.0 to 1.0 float range
+#define INT16_TO_FLOAT_SCALE (1.0f / 32768)
+
+/**
+ * Scale mono float samples, saturate them to the int16 range and write each one to every channel
+ * of an interleaved int16 buffer.
+ *
+ * Each output sample is (int16_t) clamp(source[i] * scale, INT16_MIN, INT16_MAX), with the
+ * fractional part truncated towards zero, or 0 if source[i] * scale is NaN. Every implementation
+ * produces bit-identical output.
+ * Mono, stereo and 4 channel layouts have vectorized interleaving, other channel counts
+ * vectorize only the conversion.
+ *
+ * @param source mono samples
+ * @param destination interleaved buffer of at least num_frames * num_channels samples
+ * @param num_frames number of frames to convert
+ * @param num_channels number of channels in destination
+ * @param scale gain applied before conversion, e.g. 32767 for full scale float input
+ */
+void convert_mono_float_to_int16(const float *source,
+                                 int16_t *destination,
+                                 int num_frames,
+                                 int num_channels,
+                                 float scale);
+
+/**
+ * Portable reference implementation of convert_mono_float_to_int16
+ */
+void convert_mono_float_to_int16_scalar(const float *source,
+                                        int16_t *destination,
+                                        int num_frames,
+                                        int num_channels,
+                                        float scale);
+
+/**
+ * Scale mono float samples and write each one to every channel of an interleaved float buffer.
+ * Samples are not clipped.
+ */
+void interleave_mono_float(const float *source,
+                           float *destination,
+                           int num_frames,
+                           int num_channels,
+                           float scale);
+
+#endif //SIMPLESYNTH_SAMPLE_CONVERSION_H
@@ -0,0 +1,76 @@
+/*
+ * Copyright 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <assert.h>
+#include <cstring>
+#include "sample_ring_buffer.h"
+
+SampleRingBuffer::SampleRingBuffer(int32_t capacity_in_samples) {
+
+  assert(capacity_in_samples > 0);
+
+  capacity_ = 1;
+  while (capacity_ < (uint32_t) capacity_in_samples) capacity_ <<= 1;
+  samples_ = new float[capacity_]();
+}
+
+SampleRingBuffer::~SampleRingBuffer() {
+  delete[] samples_;
+}
+
+int32_t SampleRingBuffer::write(const float *samples, int32_t num_samples) {
+
+  const uint32_t write_index = write_index_.load(std::memory_order_relaxed);
+  const uint32_t read_index = read_index_.load(std::memory_order_acquire);
+
+  uint32_t available = capacity_ - (write_index - read_index);
+  uint32_t count = ((uint32_t) num_samples < available) ? (uint32_t) num_samples : available;
+
+  // Copy up to the end of the array, then wrap around to the start
+  uint32_t offset = write_index & (capacity_ - 1);
+  uint32_t first_part = (count < capacity_ - offset) ? count : capacity_ - offset;
+  memcpy(samples_ + offset, samples, first_part * sizeof(float));
+  memcpy(samples_, samples + first_part, (count - first_part) * sizeof(float));
+
+  write_index_.store(write_index + count, std::memory_order_release);
+  return (int32_t) count;
+}
+
+int32_t SampleRingBuffer::read(float *samples, int32_t num_samples) {
+
+  const uint32_t read_index = read_index_.load(std::memory_order_relaxed);
+  const uint32_t write_index = write_index_.load(std::memory_order_acquire);
+
+  uint32_t available = write_index - read_index;
+  uint32_t count = ((uint32_t) num_samples < available) ? (uint32_t) num_samples : available;
+
+  uint32_t offset = read_index & (capacity_ - 1);
+  uint32_t first_part = (count < capacity_ - offset) ? count : capacity_ - offset;
+  memcpy(samples, samples_ + offset, first_part * sizeof(float));
+  memcpy(samples + first_part, samples_, (count - first_part) * sizeof(float));
+
+  read_index_.store(read_index + count, std::memory_order_release);
+  return (int32_t) count;
+}
+
+int32_t SampleRingBuffer::getFillLevel() const {
+  return (int32_t) (write_index_.load(std::memory_order_acquire) -
+                    read_index_.load(std::memory_order_acquire));
+}
+
+int32_t SampleRingBuffer::getCapacity() const {
+  return (int32_t) capacity_;
+}
@@ -0,0 +1,70 @@
+/*
+ * Copyright 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SIMPLESYNTH_SAMPLE_RING_BUFFER_H
+#define SIMPLESYNTH_SAMPLE_RING_BUFFER_H
+
+#include <stdint.h>
+#include <atomic>
+#include "audio_common.h"
+
+/**
+ * A wait-free single producer single consumer ring of float samples.
+ *
+ * Unlike SpscQueue, which copies one item at a time, samples are written and read in blocks
+ * with at most two memcpy calls so the consumer side is cheap enough for the audio callback.
+ * The capacity is rounded up to a power of two.
+ */
+class SampleRingBuffer {
+
+public:
+  SampleRingBuffer(int32_t capacity_in_samples);
+
+  ~SampleRingBuffer();
+
+  /**
+   * Producer only. Copy samples into the ring.
+   *
+   * @return number of samples written, less than num_samples if the ring was too full
+   */
+  int32_t write(const float *samples, int32_t num_samples);
+
+  /**
+   * Consumer only. Copy samples out of the ring.
+   *
+   * @return number of samples read, less than num_samples if the ring ran out
+   */
+  int32_t read(float *samples, int32_t num_samples);
+
+  /**
+   * Number of samples waiting to be read, exact when called from the producer or consumer while
+   * the other side is idle
+   */
+  int32_t getFillLevel() const;
+
+  int32_t getCapacity() const;
+
+private:
+  // See SpscQueue for the padding
+  std::atomic<uint32_t> write_index_ { 0 };
+  char write_index_padding_[CACHE_LINE_SIZE_IN_BYTES];
+  std::atomic<uint32_t> read_index_ { 0 };
+  char read_index_padding_[CACHE_LINE_SIZE_IN_BYTES];
+  uint32_t capacity_;
+  float *samples_ = nullptr;
+};
+
+#endif //SIMPLESYNTH_SAMPLE_RING_BUFFER_H
@@ -0,0 +1,113 @@
+/*
+ * Copyright 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SIMPLESYNTH_SPSC_QUEUE_H
+#define SIMPLESYNTH_SPSC_QUEUE_H
+
+#include <stdint.h>
+#include <atomic>
+#include "audio_common.h"
+
+/**
+ * A wait-free, fixed capacity, single producer single consumer queue.
+ *
+ * Exactly one thread may call push and exactly one (other) thread may call peek and pop. Items
+ * are copied in and out of preallocated storage so neither side ever allocates memory or takes
+ * a lock, which makes the queue suitable for passing data to and from the audio callback.
+ *
+ * @tparam T type of the items, this should be trivially copyable
+ * @tparam CAPACITY maximum number of items in the queue, must be a power of two
+ */
+template <typename T, uint32_t CAPACITY>
+class SpscQueue {
+
+  static_assert(CAPACITY > 0 && (CAPACITY & (CAPACITY - 1)) == 0,
+                "SpscQueue capacity must be a power of two");
+
+public:
+  /**
+   * Producer only. Add an item to the back of the queue.
+   *
+   * @return false if the queue was full, in which case the item was not added
+   */
+  bool push(const T &item) {
+
+    const uint32_t write_index = write_index_.load(std::memory_order_relaxed);
+    const uint32_t read_index = read_index_.load(std::memory_order_acquire);
+
+    // The indexes increase without bound and wrap around, so unsigned subtraction always gives
+    // the number of items in the queue
+    if (write_index - read_index >= CAPACITY) return false;
+
+    items_[write_index & (CAPACITY - 1)] = item;
+    write_index_.store(write_index + 1, std::memory_order_release);
+    return true;
+  }
+
+  /**
+   * Consumer only. Copy the item at the front of the queue without removing it.
+   *
+   * @return false if the queue was empty
+   */
+  bool peek(T *item) const {
+
+    const uint32_t read_index = read_index_.load(std::memory_order_relaxed);
+    const uint32_t write_index = write_index_.load(std::memory_order_acquire);
+    if (read_index == write_index) return false;
+
+    *item = items_[read_index & (CAPACITY - 1)];
+    return true;
+  }
+
+  /**
+   * Consumer only. Remove the item at the front of the queue.
+   *
+   * @param item receives the removed item, may be null
+   * @return false if the queue was empty
+   */
+  bool pop(T *item) {
+
+    const uint32_t read_index = read_index_.load(std::memory_order_relaxed);
+    const uint32_t write_index = write_index_.load(std::memory_order_acquire);
+    if (read_index == write_index) return false;
+
+    if (item != nullptr) *item = items_[read_index & (CAPACITY - 1)];
+    read_index_.store(read_index + 1, std::memory_order_release);
+    return true;
+  }
+
+  /**
+   * Approximate number of items in the queue, exact when called from the producer or consumer
+   * while the other side is idle
+   */
+  uint32_t size() const {
+    return write_index_.load(std::memory_order_acquire) -
+           read_index_.load(std::memory_order_acquire);
+  }
+
+private:
+  // Each index is written by only one side. Padding keeps them on separate cache lines, which
+  // stops the producer and consumer from invalidating each other's cache line on every operation.
+  // Padding is used rather than alignas because the queue may be a member of a heap allocated
+  // object and operator new doesn't guarantee over-alignment before C++17.
+  std::atomic<uint32_t> write_index_ { 0 };
+  char write_index_padding_[CACHE_LINE_SIZE_IN_BYTES];
+  std::atomic<uint32_t> read_index_ { 0 };
+  char read_index_padding_[CACHE_LINE_SIZE_IN_BYTES];
+  T items_[CAPACITY];
+};
+
+#endif //SIMPLESYNTH_SPSC_QUEUE_H
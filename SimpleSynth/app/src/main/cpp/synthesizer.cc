@@ -15,24 +15,69 @@
  */
 
 #include <assert.h>
+#include <stdlib.h>
 #include "synthesizer.h"
+#include "sample_conversion.h"
+#include "audio_common.h"
+#include "android_log.h"
 #include "trace.h"
 
 #define DEFAULT_SINE_WAVE_FREQUENCY 440.0
-#define TWO_PI (3.14159 * 2)
+#define DEFAULT_VOICE_GAIN 1.0f
+#define MIX_BUFFER_ALIGNMENT_IN_BYTES 64
 
 Synthesizer::Synthesizer(int num_audio_channels, int frame_rate):
     num_audio_channels_(num_audio_channels),
-    frame_rate_(frame_rate){
-  setWaveFrequency(DEFAULT_SINE_WAVE_FREQUENCY);
+    frame_rate_(frame_rate),
+    voice_pool_(frame_rate){
+
+  // The mix buffer is cache line aligned so the vectorized conversion never splits a load
+  void *mix_buffer = nullptr;
+  int result = posix_memalign(&mix_buffer,
+                              MIX_BUFFER_ALIGNMENT_IN_BYTES,
+                              SYNTHESIZER_BLOCK_SIZE_IN_FRAMES * sizeof(float));
+  assert(result == 0);
+  (void) result;
+  mix_buffer_ = static_cast<float *>(mix_buffer);
+
+  wave_frequency_ = DEFAULT_SINE_WAVE_FREQUENCY;
+}
+
+Synthesizer::~Synthesizer() {
+  free(mix_buffer_);
+}
+
+// Write a block of the mono mix to every channel of the output buffer. Volume is expressed in
+// int16 units, the float output is scaled so that both formats have the same level.
+static inline void write_block(const float *mix_buffer, int16_t *audio_buffer,
+                               int num_frames, int num_audio_channels, int volume) {
+  convert_mono_float_to_int16(mix_buffer, audio_buffer, num_frames, num_audio_channels,
+                              (float) volume);
+}
+
+static inline void write_block(const float *mix_buffer, float *audio_buffer,
+                               int num_frames, int num_audio_channels, int volume) {
+  interleave_mono_float(mix_buffer, audio_buffer, num_frames, num_audio_channels,
+                        volume * INT16_TO_FLOAT_SCALE);
 }
 
 int Synthesizer::render(int num_samples, int16_t *audio_buffer) {
+  return renderInterleaved(num_samples, audio_buffer);
+}
+
+int Synthesizer::render(int num_samples, float *audio_buffer) {
+  return renderInterleaved(num_samples, audio_buffer);
+}
+
+template <typename T>
+int Synthesizer::renderInterleaved(int num_samples, T *audio_buffer) {
 
   Trace::beginSection("Synthesizer::render");
 
   assert(audio_buffer != nullptr);
 
+  int64_t render_time = get_time();
+
   // Do some floating point operations to simulate the load required to produce complex
   // synthesizer voices
   float x = 0;
@@ -41,6 +86,8 @@ int Synthesizer::render(int num_samples, int16_t *audio_buffer) {
     float z = 2 / i;
     x = x / (y * z);
   }
+  // Keep the result so an optimizing compiler can't drop the loop
+  work_result_ = x;
 
   // render an interleaved output with the same sample value per channel
   // For example: 6 samples of a 2 channel output stream could look like this
@@ -48,42 +95,151 @@ int Synthesizer::render(int num_samples, int16_t *audio_buffer) {
 
   // Only render full frames
   int frames = num_samples / num_audio_channels_;
-  int sample_count = 0;
+  int frame = 0;
 
-  for (int i = 0; i < frames; i++){
+  // Apply the events which were sent before this render started, rendering up to each event's
+  // frame offset before applying it. Later events are left in the queue for the next render.
+  ControlEvent event;
+  while (event_queue_.peek(&event) && event.timestamp < render_time) {
 
-    int16_t value = (int16_t) ((is_playing_) ? sin(current_phase_) * current_volume_ : 0);
-
-    for (int j = 0; j < num_audio_channels_; j++){
-      audio_buffer[sample_count] = value;
-      sample_count++;
+    int event_frame = eventFrameOffset(event, frames);
+    if (event_frame > frame) {
+      renderFrames(event_frame - frame, audio_buffer + frame * num_audio_channels_);
+      frame = event_frame;
     }
+    handleEvent(event);
+    event_queue_.pop(nullptr);
+  }
 
-    if (current_phase_ > TWO_PI) current_phase_ -= TWO_PI;
-    current_phase_ += phase_increment_;
+  if (frame < frames) {
+    renderFrames(frames - frame, audio_buffer + frame * num_audio_channels_);
   }
 
+  previous_render_time_ = render_time;
+
   Trace::endSection();
 
-  return sample_count;
+  return frames * num_audio_channels_;
+}
+
+template <typename T>
+void Synthesizer::renderFrames(int num_frames, T *audio_buffer) {
+
+  int sample_count = 0;
+
+  // The voices are mixed in blocks into a fixed size mono buffer, then each block is scaled,
+  // converted and copied to every channel
+  for (int block_start = 0; block_start < num_frames;
+       block_start += SYNTHESIZER_BLOCK_SIZE_IN_FRAMES){
+
+    int block_frames = num_frames - block_start;
+    if (block_frames > SYNTHESIZER_BLOCK_SIZE_IN_FRAMES) {
+      block_frames = SYNTHESIZER_BLOCK_SIZE_IN_FRAMES;
+    }
+
+    voice_pool_.render(block_frames, mix_buffer_);
+
+    write_block(mix_buffer_,
+                audio_buffer + sample_count,
+                block_frames,
+                num_audio_channels_,
+                current_volume_);
+    sample_count += block_frames * num_audio_channels_;
+  }
+}
+
+/**
+ * Convert the time an event was sent into a frame offset within the current render. Offsets are
+ * measured from the start of the previous render, so an event sent halfway between two callbacks
+ * is applied halfway through the following callback's buffer.
+ */
+int Synthesizer::eventFrameOffset(const ControlEvent &event, int num_frames) {
+
+  if (previous_render_time_ == 0 || event.timestamp <= previous_render_time_) return 0;
+
+  int64_t offset = ((event.timestamp - previous_render_time_) * frame_rate_) / NANOS_IN_SECOND;
+  return (offset < num_frames) ? (int) offset : num_frames;
+}
+
+void Synthesizer::handleEvent(const ControlEvent &event) {
+
+  switch (event.type) {
+    case CONTROL_EVENT_NOTE_ON:
+      voice_pool_.noteOn(event.note_id, event.float_value, DEFAULT_VOICE_GAIN);
+      break;
+    case CONTROL_EVENT_NOTE_OFF:
+      voice_pool_.noteOff(event.note_id);
+      break;
+    case CONTROL_EVENT_SET_FREQUENCY:
+      voice_pool_.setFrequency(event.note_id, event.float_value);
+      break;
+    case CONTROL_EVENT_SET_VOLUME:
+      current_volume_ = (event.int_value < MAXIMUM_AMPLITUDE_VALUE) ?
+                        event.int_value : MAXIMUM_AMPLITUDE_VALUE;
+      break;
+    case CONTROL_EVENT_SET_WAVEFORM:
+      voice_pool_.setWaveform((Waveform) event.int_value);
+      break;
+    case CONTROL_EVENT_SET_WORK_CYCLES:
+      work_cycles_ = event.int_value;
+      break;
+  }
+}
+
+void Synthesizer::sendEvent(ControlEvent event) {
+
+  std::lock_guard<std::mutex> lock(send_lock_);
+
+  // Timestamps are taken while holding the lock so they never decrease along the queue
+  event.timestamp = get_time();
+  if (!event_queue_.push(event)) {
+    LOGW("Control event queue is full, event of type %d was dropped", event.type);
+  }
 }
 
 void Synthesizer::setVolume(int volume) {
-  current_volume_ = (volume < MAXIMUM_AMPLITUDE_VALUE) ? volume : MAXIMUM_AMPLITUDE_VALUE;
+  ControlEvent event = {CONTROL_EVENT_SET_VOLUME, 0, DEFAULT_NOTE_ID, 0, volume};
+  sendEvent(event);
 }
 
 void Synthesizer::setWaveFrequency(float wave_frequency) {
-  phase_increment_ = TWO_PI * wave_frequency / frame_rate_;
+  {
+    std::lock_guard<std::mutex> lock(send_lock_);
+    wave_frequency_ = wave_frequency;
+  }
+  ControlEvent event = {CONTROL_EVENT_SET_FREQUENCY, 0, DEFAULT_NOTE_ID, wave_frequency, 0};
+  sendEvent(event);
+}
+
+void Synthesizer::setWaveform(Waveform waveform) {
+  ControlEvent event = {CONTROL_EVENT_SET_WAVEFORM, 0, DEFAULT_NOTE_ID, 0, waveform};
+  sendEvent(event);
 }
 
 void Synthesizer::noteOn() {
-  is_playing_ = true;
+  float wave_frequency;
+  {
+    std::lock_guard<std::mutex> lock(send_lock_);
+    wave_frequency = wave_frequency_;
+  }
+  noteOn(DEFAULT_NOTE_ID, wave_frequency);
 }
 
 void Synthesizer::noteOff() {
-  is_playing_ = false;
+  noteOff(DEFAULT_NOTE_ID);
+}
+
+void Synthesizer::noteOn(int note_id, float frequency) {
+  ControlEvent event = {CONTROL_EVENT_NOTE_ON, 0, note_id, frequency, 0};
+  sendEvent(event);
+}
+
+void Synthesizer::noteOff(int note_id) {
+  ControlEvent event = {CONTROL_EVENT_NOTE_OFF, 0, note_id, 0, 0};
+  sendEvent(event);
 }
 
 void Synthesizer::setWorkCycles(int work_cycles){
-  work_cycles_ = work_cycles;
+  ControlEvent event = {CONTROL_EVENT_SET_WORK_CYCLES, 0, DEFAULT_NOTE_ID, 0, work_cycles};
+  sendEvent(event);
 }
@@ -19,36 +19,108 @@
 
 #include <stdint.h>
 #include <math.h>
+#include <mutex>
 #include "audio_renderer.h"
+#include "spsc_queue.h"
+#include "voice_pool.h"
 
 #define MAXIMUM_AMPLITUDE_VALUE 10000
 
+// Audio is rendered in blocks of at most this many frames so the mix buffer can be a fixed size
+#define SYNTHESIZER_BLOCK_SIZE_IN_FRAMES 256
+
+// The note played by noteOn() and noteOff() when no note id is given
+#define DEFAULT_NOTE_ID 0
+
+// Maximum number of control events which can be waiting for the audio thread
+#define CONTROL_EVENT_QUEUE_CAPACITY 256
+
+enum ControlEventType {
+  CONTROL_EVENT_NOTE_ON,
+  CONTROL_EVENT_NOTE_OFF,
+  CONTROL_EVENT_SET_FREQUENCY,
+  CONTROL_EVENT_SET_VOLUME,
+  CONTROL_EVENT_SET_WAVEFORM,
+  CONTROL_EVENT_SET_WORK_CYCLES
+};
+
+/**
+ * A note or parameter change sent from a control thread to the audio thread
+ */
+struct ControlEvent {
+  ControlEventType type;
+  int64_t timestamp;   // CLOCK_MONOTONIC time in nanoseconds at which the event was sent
+  int note_id;
+  float float_value;
+  int int_value;
+};
+
+/**
+ * Renders a mix of voices from the VoicePool.
+ *
+ * The public setters and note methods may be called from any thread other than the audio thread.
+ * Rather than changing state directly they send timestamped events through a wait-free queue.
+ * render() applies each event at the frame offset matching the time at which it was sent,
+ * measured from the start of the previous render call. Every event is therefore delayed by one
+ * callback period, but its position relative to other events is kept to the nearest frame
+ * instead of being rounded to a buffer boundary.
+ */
 
 class Synthesizer : public AudioRenderer {
 
 public:
   Synthesizer(int num_audio_channels, int frame_rate);
 
+  virtual ~Synthesizer();
+
   virtual int render(int num_samples, int16_t *audio_buffer);
 
+  virtual int render(int num_samples, float *audio_buffer);
+
   void setVolume(int volume);
 
   void setWaveFrequency(float wave_frequency);
 
+  void setWaveform(Waveform waveform);
+
   void noteOn();
 
   void noteOff();
 
+  void noteOn(int note_id, float frequency);
+
+  void noteOff(int note_id);
+
   void setWorkCycles(int work_cycles);
 
 private:
+  template <typename T>
+  int renderInterleaved(int num_samples, T *audio_buffer);
+
+  template <typename T>
+  void renderFrames(int num_frames, T *audio_buffer);
+
+  void sendEvent(ControlEvent event);
+  void handleEvent(const ControlEvent &event);
+  int eventFrameOffset(const ControlEvent &event, int num_frames);
+
   int num_audio_channels_;
   int frame_rate_;
-  double phase_increment_;
-  double current_phase_ = 0.0;
+  VoicePool voice_pool_;
+  float *mix_buffer_ = nullptr;
+
+  // Audio thread state, only changed by handleEvent
   int current_volume_ = MAXIMUM_AMPLITUDE_VALUE;
-  bool is_playing_ = false;
   int work_cycles_ = 0;
+  float work_result_ = 0;
+  int64_t previous_render_time_ = 0;
+
+  // Control thread state. Java may call in from more than one thread (e.g. the UI thread and the
+  // variable load generator) so senders are serialized with a lock which the audio thread never
+  // takes.
+  std::mutex send_lock_;
+  float wave_frequency_;
+  SpscQueue<ControlEvent, CONTROL_EVENT_QUEUE_CAPACITY> event_queue_;
 };
 
 #endif //SIMPLESYNTH_SYNTHESIZER_H
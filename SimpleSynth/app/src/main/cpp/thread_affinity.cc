@@ -0,0 +1,70 @@
+/*
+ * Copyright 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#include "thread_affinity.h"
+
+// These are called on audio threads, including the OpenSL callback, so they log through RtLog
+#define MODULE_NAME  "SimpleSynth"
+#include "rt_log.h"
+
+// Priority used for SCHED_FIFO threads, the same as the one Android gives fast audio threads
+#define REAL_TIME_THREAD_PRIORITY 2
+
+bool set_current_thread_affinity(const std::vector<int> &cpu_ids) {
+
+  pid_t current_thread_id = gettid();
+  cpu_set_t cpu_set;
+  CPU_ZERO(&cpu_set);
+
+  // If the cpu ids aren't specified then bind to the current cpu
+  if (cpu_ids.empty()) {
+    int current_cpu_id = sched_getcpu();
+    RTLOG(ANDROID_LOG_VERBOSE, "Current CPU ID is %d", current_cpu_id);
+    CPU_SET(current_cpu_id, &cpu_set);
+  } else {
+
+    for (size_t i = 0; i < cpu_ids.size(); i++) {
+      int cpu_id = cpu_ids.at(i);
+      RTLOG(ANDROID_LOG_VERBOSE, "CPU ID %d added to cores set", cpu_id);
+      CPU_SET(cpu_id, &cpu_set);
+    }
+  }
+
+  int result = sched_setaffinity(current_thread_id, sizeof(cpu_set_t), &cpu_set);
+  if (result == 0) {
+    RTLOG(ANDROID_LOG_VERBOSE, "Thread affinity set");
+  } else {
+    RTLOGW("Error setting thread affinity. Error no: %d", result);
+  }
+  return result == 0;
+}
+
+bool set_current_thread_real_time_priority() {
+
+  sched_param param;
+  param.sched_priority = REAL_TIME_THREAD_PRIORITY;
+  int result = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+  if (result == 0) {
+    RTLOG(ANDROID_LOG_VERBOSE, "Thread scheduled with SCHED_FIFO priority %d",
+          REAL_TIME_THREAD_PRIORITY);
+  } else {
+    RTLOGW("Unable to schedule thread with SCHED_FIFO. Error no: %d", result);
+  }
+  return result == 0;
+}
@@ -0,0 +1,39 @@
+/*
+ * Copyright 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SIMPLESYNTH_THREAD_AFFINITY_H
+#define SIMPLESYNTH_THREAD_AFFINITY_H
+
+#include <vector>
+
+/**
+ * Bind the calling thread to a set of CPU cores. If no cores are given the thread is bound to
+ * the core it is currently running on.
+ *
+ * @param cpu_ids ids of the cores the thread may run on
+ * @return true if the affinity was set
+ */
+bool set_current_thread_affinity(const std::vector<int> &cpu_ids);
+
+/**
+ * Ask for the calling thread to be scheduled with SCHED_FIFO. Apps usually aren't allowed to do
+ * this so failure is expected, in which case the thread keeps its normal priority.
+ *
+ * @return true if the thread's priority was raised
+ */
+bool set_current_thread_real_time_priority();
+
+#endif //SIMPLESYNTH_THREAD_AFFINITY_H
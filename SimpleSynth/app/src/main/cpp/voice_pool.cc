@@ -0,0 +1,201 @@
+/*
+ * Copyright 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <assert.h>
+#include <math.h>
+#include <string.h>
+#include "voice_pool.h"
+
+VoicePool::VoicePool(int frame_rate) :
+    frame_rate_(frame_rate) {
+
+  assert(frame_rate > 0);
+
+  Wavetable::initialize();
+
+  setAttackTime(DEFAULT_ATTACK_TIME_IN_SECONDS);
+  setReleaseTime(DEFAULT_RELEASE_TIME_IN_SECONDS);
+
+  for (int i = 0; i < MAX_VOICES; i++) {
+    phases_[i] = 0;
+    phase_increments_[i] = 0;
+    tables_[i] = Wavetable::getTable(waveform_, 0);
+    gains_[i] = 0;
+    envelope_levels_[i] = 0;
+    envelope_increments_[i] = 0;
+    envelope_stages_[i] = ENVELOPE_IDLE;
+    note_ids_[i] = VOICE_NOT_FOUND;
+    start_orders_[i] = 0;
+  }
+}
+
+int VoicePool::noteOn(int note_id, float frequency, float gain) {
+
+  // A note which is already sounding is retriggered on the same voice, so that the next noteOff
+  // for note_id releases everything that's playing it
+  int voice = findVoice(note_id);
+  if (voice == VOICE_NOT_FOUND) voice = allocateVoice();
+
+  // A retriggered or stolen voice keeps its phase and envelope level so the new note starts from
+  // wherever the old one was, rather than jumping to zero and producing a click
+  if (envelope_stages_[voice] == ENVELOPE_IDLE) {
+    phases_[voice] = 0;
+    envelope_levels_[voice] = 0;
+  }
+
+  phase_increments_[voice] = Wavetable::frequencyToPhaseIncrement(frequency, frame_rate_);
+  tables_[voice] = Wavetable::getTable(waveform_, phase_increments_[voice]);
+  gains_[voice] = gain;
+  envelope_increments_[voice] = attack_increment_;
+  envelope_stages_[voice] = ENVELOPE_ATTACK;
+  note_ids_[voice] = note_id;
+  start_orders_[voice] = next_start_order_++;
+
+  return voice;
+}
+
+void VoicePool::noteOff(int note_id) {
+
+  for (int i = 0; i < MAX_VOICES; i++) {
+    if (note_ids_[i] == note_id && envelope_stages_[i] != ENVELOPE_IDLE) {
+      envelope_increments_[i] = release_increment_;
+      envelope_stages_[i] = ENVELOPE_RELEASE;
+    }
+  }
+}
+
+void VoicePool::allNotesOff() {
+
+  for (int i = 0; i < MAX_VOICES; i++) {
+    if (envelope_stages_[i] != ENVELOPE_IDLE) {
+      envelope_increments_[i] = release_increment_;
+      envelope_stages_[i] = ENVELOPE_RELEASE;
+    }
+  }
+}
+
+void VoicePool::setFrequency(int note_id, float frequency) {
+
+  for (int i = 0; i < MAX_VOICES; i++) {
+    if (note_ids_[i] == note_id && envelope_stages_[i] != ENVELOPE_IDLE) {
+      phase_increments_[i] = Wavetable::frequencyToPhaseIncrement(frequency, frame_rate_);
+      tables_[i] = Wavetable::getTable(waveform_, phase_increments_[i]);
+    }
+  }
+}
+
+void VoicePool::setWaveform(Waveform waveform) {
+  waveform_ = waveform;
+}
+
+void VoicePool::setAttackTime(float seconds) {
+  attack_increment_ = secondsToEnvelopeIncrement(seconds);
+}
+
+void VoicePool::setReleaseTime(float seconds) {
+  release_increment_ = -secondsToEnvelopeIncrement(seconds);
+}
+
+float VoicePool::secondsToEnvelopeIncrement(float seconds) {
+
+  // A zero length stage completes on the first frame
+  float frames = seconds * frame_rate_;
+  return (frames > 1) ? 1.0f / frames : 1.0f;
+}
+
+int VoicePool::findVoice(int note_id) const {
+
+  for (int i = 0; i < MAX_VOICES; i++) {
+    if (note_ids_[i] == note_id && envelope_stages_[i] != ENVELOPE_IDLE) return i;
+  }
+  return VOICE_NOT_FOUND;
+}
+
+/**
+ * Chooses which voice should play a new note. Idle voices are used first, then the quietest voice
+ * which is being released and finally the oldest voice.
+ */
+int VoicePool::allocateVoice() {
+
+  int quietest_released_voice = VOICE_NOT_FOUND;
+  int oldest_voice = 0;
+
+  for (int i = 0; i < MAX_VOICES; i++) {
+
+    if (envelope_stages_[i] == ENVELOPE_IDLE) return i;
+
+    if (envelope_stages_[i] == ENVELOPE_RELEASE &&
+        (quietest_released_voice == VOICE_NOT_FOUND ||
+         envelope_levels_[i] < envelope_levels_[quietest_released_voice])) {
+      quietest_released_voice = i;
+    }
+
+    if (start_orders_[i] < start_orders_[oldest_voice]) oldest_voice = i;
+  }
+
+  return (quietest_released_voice != VOICE_NOT_FOUND) ? quietest_released_voice : oldest_voice;
+}
+
+void VoicePool::render(int num_frames, float *mix_buffer) {
+
+  assert(mix_buffer != nullptr);
+
+  memset(mix_buffer, 0, num_frames * sizeof(float));
+
+  for (int v = 0; v < MAX_VOICES; v++) {
+
+    if (envelope_stages_[v] == ENVELOPE_IDLE) continue;
+
+    // Copy the voice state into locals so the compiler can keep it in registers for the
+    // duration of the inner loop
+    uint32_t phase = phases_[v];
+    const uint32_t phase_increment = phase_increments_[v];
+    const float *table = tables_[v];
+    const float gain = gains_[v];
+    float level = envelope_levels_[v];
+    const float level_increment = envelope_increments_[v];
+
+    for (int i = 0; i < num_frames; i++) {
+      level = fminf(fmaxf(level + level_increment, 0.0f), 1.0f);
+      mix_buffer[i] += Wavetable::lookup(table, phase) * gain * level;
+
+      // The fixed point phase wraps around to the start of the cycle when it overflows
+      phase += phase_increment;
+    }
+
+    phases_[v] = phase;
+    envelope_levels_[v] = level;
+
+    // Stage transitions only happen at block boundaries, the clamp above holds the level steady
+    // for the remainder of the block
+    if (envelope_stages_[v] == ENVELOPE_ATTACK && level >= 1.0f) {
+      envelope_stages_[v] = ENVELOPE_SUSTAIN;
+      envelope_increments_[v] = 0;
+    } else if (envelope_stages_[v] == ENVELOPE_RELEASE && level <= 0.0f) {
+      envelope_stages_[v] = ENVELOPE_IDLE;
+      note_ids_[v] = VOICE_NOT_FOUND;
+    }
+  }
+}
+
+int VoicePool::getActiveVoiceCount() const {
+
+  int count = 0;
+  for (int i = 0; i < MAX_VOICES; i++) {
+    if (envelope_stages_[i] != ENVELOPE_IDLE) count++;
+  }
+  return count;
+}
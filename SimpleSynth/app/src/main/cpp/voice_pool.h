@@ -0,0 +1,113 @@
+/*
+ * Copyright 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SIMPLESYNTH_VOICE_POOL_H
+#define SIMPLESYNTH_VOICE_POOL_H
+
+#include <stdint.h>
+#include "wavetable.h"
+
+#define MAX_VOICES 64
+#define VOICE_NOT_FOUND -1
+
+#define DEFAULT_ATTACK_TIME_IN_SECONDS 0.005f
+#define DEFAULT_RELEASE_TIME_IN_SECONDS 0.05f
+
+enum EnvelopeStage {
+  ENVELOPE_IDLE = 0,
+  ENVELOPE_ATTACK,
+  ENVELOPE_SUSTAIN,
+  ENVELOPE_RELEASE
+};
+
+/**
+ * A fixed capacity pool of band-limited wavetable voices.
+ *
+ * Voice state is stored as a structure of arrays so that the per-voice render loop walks
+ * contiguous memory. All storage is part of the object itself, so once the pool has been
+ * constructed no further memory is allocated, which makes it safe to use from the audio callback.
+ *
+ * When every voice is in use a new note steals the quietest voice which is being released or,
+ * if no voice is being released, the voice which was started least recently.
+ */
+class VoicePool {
+
+public:
+  VoicePool(int frame_rate);
+
+  /**
+   * Start a voice playing. If note_id is already playing its voice is retriggered from its
+   * current level rather than a second voice being started.
+   *
+   * @param note_id an identifier used to stop the voice later
+   * @param frequency frequency of the voice in Hz
+   * @param gain linear gain of the voice, 1.0 is full scale
+   * @return index of the voice which is playing the note
+   */
+  int noteOn(int note_id, float frequency, float gain);
+
+  /**
+   * Move every voice playing note_id into its release stage
+   */
+  void noteOff(int note_id);
+
+  void allNotesOff();
+
+  void setFrequency(int note_id, float frequency);
+
+  /**
+   * Set the waveform used by subsequent notes
+   */
+  void setWaveform(Waveform waveform);
+
+  void setAttackTime(float seconds);
+
+  void setReleaseTime(float seconds);
+
+  /**
+   * Render the sum of all active voices as mono audio
+   *
+   * @param num_frames number of frames to render
+   * @param mix_buffer array of at least num_frames floats, this is overwritten
+   */
+  void render(int num_frames, float *mix_buffer);
+
+  int getActiveVoiceCount() const;
+
+private:
+  int findVoice(int note_id) const;
+  int allocateVoice();
+  float secondsToEnvelopeIncrement(float seconds);
+
+  int frame_rate_;
+  Waveform waveform_ = WAVEFORM_SINE;
+  float attack_increment_;
+  float release_increment_;
+  int64_t next_start_order_ = 0;
+
+  // Per voice state, index i of each array belongs to voice i
+  uint32_t phases_[MAX_VOICES];
+  uint32_t phase_increments_[MAX_VOICES];
+  const float *tables_[MAX_VOICES];
+  float gains_[MAX_VOICES];
+  float envelope_levels_[MAX_VOICES];
+  float envelope_increments_[MAX_VOICES];
+  int envelope_stages_[MAX_VOICES];
+  int note_ids_[MAX_VOICES];
+  int64_t start_orders_[MAX_VOICES];
+};
+
+#endif //SIMPLESYNTH_VOICE_POOL_H
@@ -0,0 +1,277 @@
+/*
+ * Copyright 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * Checks that the stand-in OpenSL ES buffer queue plays buffers in order, paced by the clock,
+ * and counts an underrun when a callback runs late. Then plays Synthesizer through
+ * LoadStabilizer and AudioPlayer and reports the callback jitter with stabilization off and on.
+ *
+ *   callback-jitter-benchmark [seconds per run] [work cycles] [trace.json]
+ *
+ * If a trace file is given the jitter runs are captured with Trace and written to it, open it in
+ * ui.perfetto.dev to see each callback's sections.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <algorithm>
+#include <vector>
+#include <SLES/OpenSLES.h>
+#include <SLES/OpenSLES_Android.h>
+#include "audio_player.h"
+#include "load_stabilizer.h"
+#include "opensles_host.h"
+#include "synthesizer.h"
+#include "trace.h"
+
+#define FRAME_RATE 48000
+#define FRAMES_PER_BUFFER 192
+#define NUM_CHANNELS 2
+#define NUM_BUFFERS 2
+#define API_LEVEL 24
+#define DEFAULT_SECONDS_PER_RUN 2
+#define DEFAULT_WORK_CYCLES 20000
+
+// The counter player writes 1 to COUNTER_PERIOD repeatedly, so that silence (0) stands out
+#define COUNTER_PERIOD 30000
+#define COUNTER_PLAY_TIME_IN_MICROSECONDS 500000
+#define COUNTER_LATE_CALLBACK 20
+
+static const int64_t BUFFER_DURATION_NANOS =
+    (int64_t) FRAMES_PER_BUFFER * NANOS_IN_SECOND / FRAME_RATE;
+
+/**
+ * A player of mono int16 buffers which the callback fills with a running counter
+ */
+struct CounterPlayer {
+  SLObjectItf object;
+  SLPlayItf play_itf;
+  SLAndroidSimpleBufferQueueItf buffer_queue_itf;
+  int16_t buffers[NUM_BUFFERS][FRAMES_PER_BUFFER];
+  int next_buffer;
+  int16_t counter;
+  int callback_count;
+  int late_callback;    // callback which sleeps for several buffer periods, or -1
+};
+
+static void fill_and_enqueue(CounterPlayer *player) {
+  int16_t *buffer = player->buffers[player->next_buffer];
+  for (int i = 0; i < FRAMES_PER_BUFFER; i++) {
+    buffer[i] = player->counter;
+    player->counter = (int16_t) (player->counter % COUNTER_PERIOD + 1);
+  }
+  (*player->buffer_queue_itf)->Enqueue(player->buffer_queue_itf, buffer, sizeof(*buffer) *
+                                                                         FRAMES_PER_BUFFER);
+  player->next_buffer = (player->next_buffer + 1) % NUM_BUFFERS;
+}
+
+static void counter_callback(SLAndroidSimpleBufferQueueItf buffer_queue_itf, void *context) {
+  CounterPlayer *player = static_cast<CounterPlayer *>(context);
+  if (player->callback_count++ == player->late_callback) {
+    usleep((useconds_t) (4 * BUFFER_DURATION_NANOS / 1000));
+  }
+  fill_and_enqueue(player);
+}
+
+static bool play_counter(SLEngineItf engine_itf, SLObjectItf output_mix, int late_callback,
+                         HostRecording *recording) {
+
+  SLDataLocator_AndroidSimpleBufferQueue queue_locator = {
+      SL_DATALOCATOR_ANDROIDSIMPLEBUFFERQUEUE, NUM_BUFFERS };
+  SLDataFormat_PCM format = { SL_DATAFORMAT_PCM, 1, FRAME_RATE * 1000,
+                              SL_PCMSAMPLEFORMAT_FIXED_16, SL_PCMSAMPLEFORMAT_FIXED_16,
+                              1, SL_BYTEORDER_LITTLEENDIAN };
+  SLDataSource source = { &queue_locator, &format };
+  SLDataLocator_OutputMix mix_locator = { SL_DATALOCATOR_OUTPUTMIX, output_mix };
+  SLDataSink sink = { &mix_locator, nullptr };
+  const SLInterfaceID ids[] = { SL_IID_ANDROIDSIMPLEBUFFERQUEUE };
+  const SLboolean required[] = { SL_BOOLEAN_TRUE };
+
+  static CounterPlayer player;
+  player.next_buffer = 0;
+  player.counter = 1;
+  player.callback_count = 0;
+  player.late_callback = late_callback;
+
+  if ((*engine_itf)->CreateAudioPlayer(engine_itf, &player.object, &source, &sink, 1, ids,
+                                       required) != SL_RESULT_SUCCESS ||
+      (*player.object)->Realize(player.object, SL_BOOLEAN_FALSE) != SL_RESULT_SUCCESS ||
+      (*player.object)->GetInterface(player.object, SL_IID_PLAY, &player.play_itf) !=
+          SL_RESULT_SUCCESS ||
+      (*player.object)->GetInterface(player.object, SL_IID_ANDROIDSIMPLEBUFFERQUEUE,
+                                     &player.buffer_queue_itf) != SL_RESULT_SUCCESS) {
+    printf("Unable to create the counter player\n");
+    return false;
+  }
+  (*player.buffer_queue_itf)->RegisterCallback(player.buffer_queue_itf, counter_callback,
+                                               &player);
+  (*player.play_itf)->SetPlayState(player.play_itf, SL_PLAYSTATE_PLAYING);
+  for (int i = 0; i < NUM_BUFFERS; i++) fill_and_enqueue(&player);
+  usleep(COUNTER_PLAY_TIME_IN_MICROSECONDS);
+  (*player.play_itf)->SetPlayState(player.play_itf, SL_PLAYSTATE_STOPPED);
+  (*player.object)->Destroy(player.object);
+
+  opensles_host_get_recording(recording);
+  return true;
+}
+
+/**
+ * Every counter value must follow the previous one, with only whole buffers of silence between
+ * them, and the callbacks must be due exactly one buffer period apart
+ */
+static bool check_counter_recording(const HostRecording &recording, int64_t *silent_buffers) {
+
+  const int16_t *samples = reinterpret_cast<const int16_t *>(recording.pcm.data());
+  size_t num_samples = recording.pcm.size() / sizeof(int16_t);
+  bool is_ok = recording.num_channels == 1 && !recording.is_float && num_samples > 0 &&
+               num_samples % FRAMES_PER_BUFFER == 0;
+
+  int16_t expected = 1;
+  *silent_buffers = 0;
+  for (size_t i = 0; is_ok && i < num_samples; i += FRAMES_PER_BUFFER) {
+    if (samples[i] == 0) {
+      (*silent_buffers)++;
+      for (int j = 0; j < FRAMES_PER_BUFFER; j++) is_ok &= samples[i + j] == 0;
+      continue;
+    }
+    for (int j = 0; j < FRAMES_PER_BUFFER; j++) {
+      is_ok &= samples[i + j] == expected;
+      expected = (int16_t) (expected % COUNTER_PERIOD + 1);
+    }
+  }
+
+  const std::vector<HostCallbackTiming> &timings = recording.callback_timings;
+  for (size_t i = 1; i < timings.size(); i++) {
+    int64_t period = timings[i].due_time - timings[i - 1].due_time;
+    // Underruns add whole periods of silence between callbacks
+    is_ok &= period > 0 && period % BUFFER_DURATION_NANOS == 0;
+  }
+  return is_ok && *silent_buffers == recording.underrun_count;
+}
+
+static bool check_stand_in(SLEngineItf engine_itf, SLObjectItf output_mix) {
+
+  HostRecording recording;
+  int64_t silent_buffers;
+
+  opensles_host_reset_recording();
+  bool is_ok = play_counter(engine_itf, output_mix, -1, &recording);
+  bool is_in_order = is_ok && check_counter_recording(recording, &silent_buffers);
+  printf("stand-in plays %zu buffers in order, %lld underruns: %s\n",
+         recording.pcm.size() / sizeof(int16_t) / FRAMES_PER_BUFFER,
+         (long long) recording.underrun_count, is_in_order ? "ok" : "FAILED");
+
+  opensles_host_reset_recording();
+  is_ok &= play_counter(engine_itf, output_mix, COUNTER_LATE_CALLBACK, &recording);
+  bool is_underrun_counted = is_ok && check_counter_recording(recording, &silent_buffers) &&
+                             recording.underrun_count > 0;
+  printf("late callback plays %lld buffers of silence: %s\n", (long long) silent_buffers,
+         is_underrun_counted ? "ok" : "FAILED");
+
+  return is_in_order && is_underrun_counted;
+}
+
+static int64_t percentile(std::vector<int64_t> values, double fraction) {
+  if (values.empty()) return 0;
+  std::sort(values.begin(), values.end());
+  return values[std::min(values.size() - 1, (size_t) (fraction * values.size()))];
+}
+
+static void measure_jitter(SLEngineItf engine_itf, SLObjectItf output_mix, const char *name,
+                           bool is_stabilized, StabilizationPolicy policy, int seconds,
+                           int work_cycles) {
+
+  AudioStreamFormat format;
+  format.frame_rate = FRAME_RATE;
+  format.frames_per_buffer = FRAMES_PER_BUFFER;
+  format.num_audio_channels = NUM_CHANNELS;
+  format.num_buffers = NUM_BUFFERS;
+  format.num_render_ahead_buffers = 0;
+
+  Synthesizer synth(NUM_CHANNELS, FRAME_RATE);
+  LoadStabilizer stabilizer(&synth, BUFFER_DURATION_NANOS, FRAMES_PER_BUFFER * NUM_CHANNELS);
+  stabilizer.setStabilizationEnabled(is_stabilized);
+  stabilizer.setStabilizationPolicy(policy);
+  synth.setWorkCycles(work_cycles);
+  synth.noteOn();
+
+  opensles_host_set_pcm_recording_enabled(false);
+  opensles_host_reset_recording();
+  AudioPlayer player(engine_itf, output_mix, &stabilizer, format, API_LEVEL);
+  player.play();
+  sleep((unsigned int) seconds);
+  player.stop();
+  opensles_host_set_pcm_recording_enabled(true);
+
+  HostRecording recording;
+  opensles_host_get_recording(&recording);
+  std::vector<int64_t> lateness;
+  std::vector<int64_t> durations;
+  for (const HostCallbackTiming &timing : recording.callback_timings) {
+    lateness.push_back(timing.start_time - timing.due_time);
+    durations.push_back(timing.end_time - timing.start_time);
+  }
+
+  printf("%-20s %5zu callbacks, start late p50 %6.1f us p99 %6.1f us max %7.1f us, "
+         "duration p50 %6.1f us, %lld underruns\n",
+         name, lateness.size(), percentile(lateness, 0.5) / 1000.0,
+         percentile(lateness, 0.99) / 1000.0, percentile(lateness, 1.0) / 1000.0,
+         percentile(durations, 0.5) / 1000.0, (long long) recording.underrun_count);
+}
+
+int main(int argc, char **argv) {
+
+  int seconds = (argc > 1) ? atoi(argv[1]) : DEFAULT_SECONDS_PER_RUN;
+  int work_cycles = (argc > 2) ? atoi(argv[2]) : DEFAULT_WORK_CYCLES;
+  const char *trace_path = (argc > 3) ? argv[3] : nullptr;
+  if (seconds <= 0 || work_cycles < 0) {
+    fprintf(stderr, "Usage: callback-jitter-benchmark [seconds per run] [work cycles] "
+                    "[trace.json]\n");
+    return 1;
+  }
+
+  SLObjectItf engine_object;
+  SLEngineItf engine_itf;
+  SLObjectItf output_mix;
+  if (!opensles_host_create_engine(&engine_object, &engine_itf, &output_mix)) {
+    printf("Unable to create the engine\n");
+    return 1;
+  }
+
+  bool is_ok = check_stand_in(engine_itf, output_mix);
+
+  printf("\n%d frame buffers at %d Hz, %d work cycles\n", FRAMES_PER_BUFFER, FRAME_RATE,
+         work_cycles);
+  if (trace_path != nullptr) Trace::startCapture();
+  measure_jitter(engine_itf, output_mix, "not stabilized", false, STABILIZATION_POLICY_FIXED,
+                 seconds, work_cycles);
+  measure_jitter(engine_itf, output_mix, "fixed padding", true, STABILIZATION_POLICY_FIXED,
+                 seconds, work_cycles);
+  measure_jitter(engine_itf, output_mix, "adaptive padding", true,
+                 STABILIZATION_POLICY_ADAPTIVE, seconds, work_cycles);
+  if (trace_path != nullptr) {
+    int64_t dropped = Trace::getDroppedRecordCount();
+    bool is_written = Trace::stopCapture(trace_path);
+    printf("trace written to %s, %lld records dropped: %s\n", trace_path, (long long) dropped,
+           is_written ? "ok" : "FAILED");
+    is_ok &= is_written;
+  }
+
+  (*output_mix)->Destroy(output_mix);
+  (*engine_object)->Destroy(engine_object);
+  return is_ok ? 0 : 1;
+}
@@ -0,0 +1,164 @@
+/*
+ * Copyright 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * Checks that the float and int16 render paths produce the same audio, first by calling
+ * Synthesizer directly and then through an AudioPlayer on an engine with and without float
+ * support.
+ *
+ *   float-path-check
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <algorithm>
+#include <vector>
+#include "audio_player.h"
+#include "opensles_host.h"
+#include "synthesizer.h"
+
+#define FRAME_RATE 48000
+#define FRAMES_PER_BUFFER 192
+#define NUM_CHANNELS 2
+#define NUM_BUFFERS 4
+#define API_LEVEL 24
+#define PLAY_TIME_IN_MICROSECONDS 500000
+#define MAX_PLAY_ATTEMPTS 3
+
+// The int16 path scales the mix by the volume, the float path by volume / 32768
+#define FLOAT_TO_INT16_SCALE 32768.0f
+
+// Notes are sent before the first render so both synthesizers apply them at frame 0
+static void start_notes(Synthesizer *synth) {
+  synth->setWaveform(WAVEFORM_SAW);
+  synth->noteOn(1, 220);
+  synth->noteOn(2, 330);
+  synth->noteOn(3, 7040);
+}
+
+/**
+ * Count the int16 samples which differ from the float sample converted the same way
+ */
+static int count_differences(const int16_t *int16_samples, const float *float_samples,
+                             size_t num_samples) {
+  int differences = 0;
+  for (size_t i = 0; i < num_samples; i++) {
+    if ((int16_t) (float_samples[i] * FLOAT_TO_INT16_SCALE) != int16_samples[i]) differences++;
+  }
+  return differences;
+}
+
+static bool check_synthesizer() {
+
+  Synthesizer int16_synth(NUM_CHANNELS, FRAME_RATE);
+  Synthesizer float_synth(NUM_CHANNELS, FRAME_RATE);
+  start_notes(&int16_synth);
+  start_notes(&float_synth);
+
+  const int num_samples = FRAMES_PER_BUFFER * NUM_CHANNELS;
+  std::vector<int16_t> int16_buffer(num_samples);
+  std::vector<float> float_buffer(num_samples);
+  int differences = 0;
+  for (int i = 0; i < 500; i++) {
+    int16_synth.render(num_samples, int16_buffer.data());
+    float_synth.render(num_samples, float_buffer.data());
+    differences += count_differences(int16_buffer.data(), float_buffer.data(), num_samples);
+  }
+
+  printf("Synthesizer float against int16: %d differences\n", differences);
+  return differences == 0;
+}
+
+/**
+ * Play a synthesizer through an AudioPlayer and return what the device consumed. Returns false
+ * if the recording has underruns, which would put silence at different places in each run.
+ */
+static bool play(SLEngineItf engine_itf, SLObjectItf output_mix, HostRecording *recording) {
+
+  AudioStreamFormat format;
+  format.frame_rate = FRAME_RATE;
+  format.frames_per_buffer = FRAMES_PER_BUFFER;
+  format.num_audio_channels = NUM_CHANNELS;
+  format.num_buffers = NUM_BUFFERS;
+  format.num_render_ahead_buffers = 0;
+
+  Synthesizer synth(NUM_CHANNELS, FRAME_RATE);
+  start_notes(&synth);
+
+  AudioPlayer player(engine_itf, output_mix, &synth, format, API_LEVEL);
+  player.play();
+  usleep(PLAY_TIME_IN_MICROSECONDS);
+  player.stop();
+
+  opensles_host_get_recording(recording);
+  return recording->underrun_count == 0;
+}
+
+static bool check_player(SLEngineItf engine_itf, SLObjectItf output_mix) {
+
+  HostRecording float_recording;
+  HostRecording int16_recording;
+
+  for (int attempt = 0; attempt < MAX_PLAY_ATTEMPTS; attempt++) {
+    opensles_host_set_float_supported(true);
+    bool is_float_clean = play(engine_itf, output_mix, &float_recording);
+    opensles_host_set_float_supported(false);
+    bool is_int16_clean = play(engine_itf, output_mix, &int16_recording);
+    if (is_float_clean && is_int16_clean) break;
+    printf("Underruns during playback, trying again\n");
+  }
+  opensles_host_set_float_supported(true);
+
+  if (!float_recording.is_float || int16_recording.is_float) {
+    printf("AudioPlayer didn't choose float only when the engine supports it\n");
+    return false;
+  }
+  if (float_recording.underrun_count != 0 || int16_recording.underrun_count != 0) {
+    printf("AudioPlayer underran on every attempt\n");
+    return false;
+  }
+
+  size_t num_samples = std::min(float_recording.pcm.size() / sizeof(float),
+                                int16_recording.pcm.size() / sizeof(int16_t));
+  int differences = count_differences(
+      reinterpret_cast<const int16_t *>(int16_recording.pcm.data()),
+      reinterpret_cast<const float *>(float_recording.pcm.data()),
+      num_samples);
+
+  printf("AudioPlayer float against int16: %d differences in %zu samples\n", differences,
+         num_samples);
+  return num_samples > 0 && differences == 0;
+}
+
+int main() {
+
+  bool is_ok = check_synthesizer();
+
+  SLObjectItf engine_object;
+  SLEngineItf engine_itf;
+  SLObjectItf output_mix;
+  if (!opensles_host_create_engine(&engine_object, &engine_itf, &output_mix)) {
+    printf("Unable to create the engine\n");
+    return 1;
+  }
+  is_ok &= check_player(engine_itf, output_mix);
+  (*output_mix)->Destroy(output_mix);
+  (*engine_object)->Destroy(engine_object);
+
+  printf("%s\n", is_ok ? "ok" : "FAILED");
+  return is_ok ? 0 : 1;
+}
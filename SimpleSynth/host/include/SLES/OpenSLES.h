@@ -0,0 +1,170 @@
+/*
+ * Copyright 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * Host stand-in for <SLES/OpenSLES.h>.
+ *
+ * Only the types, constants and interface methods which SimpleSynth uses are declared. Values
+ * match the Khronos header, but the interface structs are not ABI compatible with it because
+ * unused methods are left out. The implementation is in opensles_host.cc.
+ */
+
+#ifndef SIMPLESYNTH_HOST_OPENSLES_H
+#define SIMPLESYNTH_HOST_OPENSLES_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef int8_t SLint8;
+typedef uint8_t SLuint8;
+typedef int16_t SLint16;
+typedef uint16_t SLuint16;
+typedef int32_t SLint32;
+typedef uint32_t SLuint32;
+typedef SLuint32 SLboolean;
+typedef SLuint8 SLchar;
+typedef SLuint32 SLmillisecond;
+typedef SLuint32 SLresult;
+
+#define SL_BOOLEAN_FALSE ((SLboolean) 0x00000000)
+#define SL_BOOLEAN_TRUE  ((SLboolean) 0x00000001)
+
+#define SL_RESULT_SUCCESS                ((SLuint32) 0x00000000)
+#define SL_RESULT_PRECONDITIONS_VIOLATED ((SLuint32) 0x00000001)
+#define SL_RESULT_PARAMETER_INVALID      ((SLuint32) 0x00000002)
+#define SL_RESULT_MEMORY_FAILURE         ((SLuint32) 0x00000003)
+#define SL_RESULT_RESOURCE_ERROR         ((SLuint32) 0x00000004)
+#define SL_RESULT_BUFFER_INSUFFICIENT    ((SLuint32) 0x00000007)
+#define SL_RESULT_CONTENT_UNSUPPORTED    ((SLuint32) 0x00000009)
+#define SL_RESULT_FEATURE_UNSUPPORTED    ((SLuint32) 0x0000000C)
+#define SL_RESULT_INTERNAL_ERROR         ((SLuint32) 0x0000000D)
+
+#define SL_OBJECT_STATE_UNREALIZED ((SLuint32) 0x00000001)
+#define SL_OBJECT_STATE_REALIZED   ((SLuint32) 0x00000002)
+
+#define SL_DATAFORMAT_PCM ((SLuint32) 0x00000002)
+
+#define SL_PCMSAMPLEFORMAT_FIXED_8  ((SLuint16) 0x0008)
+#define SL_PCMSAMPLEFORMAT_FIXED_16 ((SLuint16) 0x0010)
+#define SL_PCMSAMPLEFORMAT_FIXED_32 ((SLuint16) 0x0020)
+
+#define SL_BYTEORDER_BIGENDIAN    ((SLuint32) 0x00000001)
+#define SL_BYTEORDER_LITTLEENDIAN ((SLuint32) 0x00000002)
+
+#define SL_DATALOCATOR_OUTPUTMIX ((SLuint32) 0x00000004)
+
+#define SL_PLAYSTATE_STOPPED ((SLuint32) 0x00000001)
+#define SL_PLAYSTATE_PAUSED  ((SLuint32) 0x00000002)
+#define SL_PLAYSTATE_PLAYING ((SLuint32) 0x00000003)
+
+typedef const struct SLInterfaceID_ {
+  SLuint32 time_low;
+  SLuint16 time_mid;
+  SLuint16 time_hi_and_version;
+  SLuint16 clock_seq;
+  SLuint8 node[6];
+} *SLInterfaceID;
+
+extern const SLInterfaceID SL_IID_ENGINE;
+extern const SLInterfaceID SL_IID_PLAY;
+
+typedef struct SLDataFormat_PCM_ {
+  SLuint32 formatType;
+  SLuint32 numChannels;
+  SLuint32 samplesPerSec;
+  SLuint32 bitsPerSample;
+  SLuint32 containerSize;
+  SLuint32 channelMask;
+  SLuint32 endianness;
+} SLDataFormat_PCM;
+
+typedef struct SLDataSource_ {
+  void *pLocator;
+  void *pFormat;
+} SLDataSource;
+
+typedef struct SLDataSink_ {
+  void *pLocator;
+  void *pFormat;
+} SLDataSink;
+
+typedef struct SLEngineOption_ {
+  SLuint32 feature;
+  SLuint32 data;
+} SLEngineOption;
+
+// Object
+
+struct SLObjectItf_;
+typedef const struct SLObjectItf_ *const *SLObjectItf;
+
+struct SLObjectItf_ {
+  SLresult (*Realize)(SLObjectItf self, SLboolean async);
+  SLresult (*GetState)(SLObjectItf self, SLuint32 *pState);
+  SLresult (*GetInterface)(SLObjectItf self, const SLInterfaceID iid, void *pInterface);
+  void (*Destroy)(SLObjectItf self);
+};
+
+typedef struct SLDataLocator_OutputMix {
+  SLuint32 locatorType;
+  SLObjectItf outputMix;
+} SLDataLocator_OutputMix;
+
+// Engine
+
+struct SLEngineItf_;
+typedef const struct SLEngineItf_ *const *SLEngineItf;
+
+struct SLEngineItf_ {
+  SLresult (*CreateAudioPlayer)(SLEngineItf self,
+                                SLObjectItf *pPlayer,
+                                SLDataSource *pAudioSrc,
+                                SLDataSink *pAudioSnk,
+                                SLuint32 numInterfaces,
+                                const SLInterfaceID *pInterfaceIds,
+                                const SLboolean *pInterfaceRequired);
+  SLresult (*CreateOutputMix)(SLEngineItf self,
+                              SLObjectItf *pMix,
+                              SLuint32 numInterfaces,
+                              const SLInterfaceID *pInterfaceIds,
+                              const SLboolean *pInterfaceRequired);
+};
+
+SLresult slCreateEngine(SLObjectItf *pEngine,
+                        SLuint32 numOptions,
+                        const SLEngineOption *pEngineOptions,
+                        SLuint32 numInterfaces,
+                        const SLInterfaceID *pInterfaceIds,
+                        const SLboolean *pInterfaceRequired);
+
+// Play
+
+struct SLPlayItf_;
+typedef const struct SLPlayItf_ *const *SLPlayItf;
+
+struct SLPlayItf_ {
+  SLresult (*SetPlayState)(SLPlayItf self, SLuint32 state);
+  SLresult (*GetPlayState)(SLPlayItf self, SLuint32 *pState);
+};
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //SIMPLESYNTH_HOST_OPENSLES_H
@@ -14,18 +14,29 @@
  * limitations under the License.
  */
 
-#ifndef SIMPLESYNTH_TRACE_H
-#define SIMPLESYNTH_TRACE_H
+/**
+ * Host stand-in for <jni.h>. Only the types used by the audio classes are declared, the JNI
+ * bridge itself isn't built on the host.
+ */
+
+#ifndef SIMPLESYNTH_HOST_JNI_H
+#define SIMPLESYNTH_HOST_JNI_H
+
+#include <stdint.h>
 
-class Trace {
+typedef uint8_t jboolean;
+typedef int32_t jint;
+typedef int64_t jlong;
+typedef float jfloat;
+typedef double jdouble;
+typedef jint jsize;
 
-public:
-  static void beginSection(const char * sectionName);
-  static void endSection();
-  static void initialize();
+class _jobject {};
+typedef _jobject *jobject;
+typedef jobject jclass;
+typedef jobject jintArray;
 
-private:
-  static bool is_tracing_supported_;
-};
+#define JNIEXPORT __attribute__ ((visibility ("default")))
+#define JNICALL
 
-#endif //SIMPLESYNTH_TRACE_H
+#endif //SIMPLESYNTH_HOST_JNI_H
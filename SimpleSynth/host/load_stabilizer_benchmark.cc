@@ -0,0 +1,164 @@
+/*
+ * Copyright 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * Calls LoadStabilizer once per callback period around a renderer of known cost and reports the
+ * nanoseconds spun per callback by the fixed and adaptive policies. Checks that the adaptive
+ * policy spins less, that late callbacks make it back off and that missed deadlines are counted.
+ *
+ *   load-stabilizer-benchmark [render microseconds] [callbacks per run]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <vector>
+#include "audio_common.h"
+#include "load_stabilizer.h"
+
+#define FRAME_RATE 48000
+#define FRAMES_PER_BUFFER 192
+#define NUM_CHANNELS 2
+#define DEFAULT_RENDER_MICROSECONDS 300
+#define DEFAULT_CALLBACKS_PER_RUN 500
+
+static const int64_t CALLBACK_PERIOD_NANOS =
+    (int64_t) FRAMES_PER_BUFFER * NANOS_IN_SECOND / FRAME_RATE;
+
+/**
+ * Busy waits for a fixed time then writes silence, standing in for a synthesizer of known cost
+ */
+class BusyRenderer : public AudioRenderer {
+public:
+  int64_t render_nanos = 0;
+
+  int render(int num_samples, int16_t *audio_buffer) {
+    busyWait();
+    memset(audio_buffer, 0, num_samples * sizeof(int16_t));
+    return num_samples;
+  }
+  int render(int num_samples, float *audio_buffer) {
+    busyWait();
+    memset(audio_buffer, 0, num_samples * sizeof(float));
+    return num_samples;
+  }
+
+private:
+  void busyWait() {
+    int64_t end_time = get_time() + render_nanos;
+    while (get_time() < end_time) {
+      // Spin
+    }
+  }
+};
+
+static void sleep_until(int64_t time) {
+  timespec ts;
+  ts.tv_sec = time / NANOS_IN_SECOND;
+  ts.tv_nsec = time % NANOS_IN_SECOND;
+  while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, nullptr) != 0) {
+    // Interrupted by a signal, go back to sleep
+  }
+}
+
+/**
+ * Call the stabilizer num_callbacks times, one period apart. Odd callbacks start late_nanos
+ * after their period begins.
+ */
+static void run(LoadStabilizer *stabilizer, int num_callbacks, int64_t late_nanos,
+                LoadStabilizerStats *stats) {
+
+  std::vector<float> buffer(FRAMES_PER_BUFFER * NUM_CHANNELS);
+  int64_t period_start = get_time();
+  for (int i = 0; i < num_callbacks; i++) {
+    sleep_until(period_start + ((i % 2 == 1) ? late_nanos : 0));
+    stabilizer->render((int) buffer.size(), buffer.data());
+
+    // Periods stay on the device's schedule, so a callback after an overrun starts late
+    period_start += CALLBACK_PERIOD_NANOS;
+  }
+  stabilizer->getStats(stats);
+}
+
+static void print_stats(const char *name, const LoadStabilizerStats &stats) {
+  printf("%-34s %8.1f us spun/callback, render p95 %6.1f us, %lld misses, %lld backoffs\n",
+         name, stats.total_load_duration / 1000.0 / stats.callback_count,
+         stats.percentile_render_duration / 1000.0, (long long) stats.deadline_miss_count,
+         (long long) stats.backoff_count);
+}
+
+static bool check(bool condition, const char *description) {
+  printf("%-56s %s\n", description, condition ? "ok" : "FAILED");
+  return condition;
+}
+
+int main(int argc, char **argv) {
+
+  int render_us = (argc > 1) ? atoi(argv[1]) : DEFAULT_RENDER_MICROSECONDS;
+  int num_callbacks = (argc > 2) ? atoi(argv[2]) : DEFAULT_CALLBACKS_PER_RUN;
+  if (render_us < 0 || render_us * 1000LL >= CALLBACK_PERIOD_NANOS / 2 || num_callbacks < 10) {
+    fprintf(stderr, "Render time must be less than half the %lld us period and there must be "
+                    "at least 10 callbacks\n", (long long) CALLBACK_PERIOD_NANOS / 1000);
+    return 1;
+  }
+
+  BusyRenderer renderer;
+  renderer.render_nanos = render_us * 1000LL;
+  printf("%d frame buffers at %d Hz, %lld us period, %d us render\n\n", FRAMES_PER_BUFFER,
+         FRAME_RATE, (long long) CALLBACK_PERIOD_NANOS / 1000, render_us);
+
+  LoadStabilizerStats fixed_stats;
+  LoadStabilizer fixed(&renderer, CALLBACK_PERIOD_NANOS, FRAMES_PER_BUFFER * NUM_CHANNELS);
+  fixed.setStabilizationEnabled(true);
+  fixed.setStabilizationPolicy(STABILIZATION_POLICY_FIXED);
+  run(&fixed, num_callbacks, 0, &fixed_stats);
+  print_stats("fixed", fixed_stats);
+
+  LoadStabilizerStats adaptive_stats;
+  LoadStabilizer adaptive(&renderer, CALLBACK_PERIOD_NANOS, FRAMES_PER_BUFFER * NUM_CHANNELS);
+  adaptive.setStabilizationEnabled(true);
+  adaptive.setStabilizationPolicy(STABILIZATION_POLICY_ADAPTIVE);
+  run(&adaptive, num_callbacks, 0, &adaptive_stats);
+  print_stats("adaptive", adaptive_stats);
+
+  // Odd callbacks start 40% of the way into their period, past the backoff threshold
+  LoadStabilizerStats late_stats;
+  LoadStabilizer late(&renderer, CALLBACK_PERIOD_NANOS, FRAMES_PER_BUFFER * NUM_CHANNELS);
+  late.setStabilizationEnabled(true);
+  late.setStabilizationPolicy(STABILIZATION_POLICY_ADAPTIVE);
+  run(&late, num_callbacks, CALLBACK_PERIOD_NANOS * 4 / 10, &late_stats);
+  print_stats("adaptive, every other callback late", late_stats);
+
+  // A render which takes longer than the period misses every deadline
+  LoadStabilizerStats overrun_stats;
+  BusyRenderer slow_renderer;
+  slow_renderer.render_nanos = CALLBACK_PERIOD_NANOS * 6 / 5;
+  LoadStabilizer overrun(&slow_renderer, CALLBACK_PERIOD_NANOS, FRAMES_PER_BUFFER * NUM_CHANNELS);
+  overrun.setStabilizationEnabled(true);
+  overrun.setStabilizationPolicy(STABILIZATION_POLICY_ADAPTIVE);
+  run(&overrun, 20, 0, &overrun_stats);
+  print_stats("adaptive, render longer than period", overrun_stats);
+
+  printf("\n");
+  bool is_ok = check(adaptive_stats.total_load_duration < fixed_stats.total_load_duration,
+                     "adaptive spins less than fixed");
+  is_ok &= check(late_stats.backoff_count >= num_callbacks / 2 - 1,
+                 "adaptive backs off on every late callback");
+  is_ok &= check(overrun_stats.deadline_miss_count == overrun_stats.callback_count,
+                 "every overrun counts as a deadline miss");
+  return is_ok ? 0 : 1;
+}
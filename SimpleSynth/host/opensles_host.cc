@@ -0,0 +1,669 @@
+/*
+ * Copyright 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <string.h>
+#include <time.h>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <SLES/OpenSLES.h>
+#include <SLES/OpenSLES_Android.h>
+#include <jni.h>
+#include "opensles_host.h"
+
+#define NANOS_IN_SECOND 1000000000LL
+#define MILLIHERTZ_IN_HERTZ 1000
+
+// Interface ids are only compared by address
+static const struct SLInterfaceID_ engine_iid = {1, 0, 0, 0, {0}};
+static const struct SLInterfaceID_ play_iid = {2, 0, 0, 0, {0}};
+static const struct SLInterfaceID_ buffer_queue_iid = {3, 0, 0, 0, {0}};
+static const struct SLInterfaceID_ configuration_iid = {4, 0, 0, 0, {0}};
+
+extern "C" {
+const SLInterfaceID SL_IID_ENGINE = &engine_iid;
+const SLInterfaceID SL_IID_PLAY = &play_iid;
+const SLInterfaceID SL_IID_ANDROIDSIMPLEBUFFERQUEUE = &buffer_queue_iid;
+const SLInterfaceID SL_IID_ANDROIDCONFIGURATION = &configuration_iid;
+}
+
+static int64_t now_nanos() {
+  timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * NANOS_IN_SECOND + ts.tv_nsec;
+}
+
+static void sleep_until_nanos(int64_t wake_time) {
+  timespec ts;
+  ts.tv_sec = wake_time / NANOS_IN_SECOND;
+  ts.tv_nsec = wake_time % NANOS_IN_SECOND;
+  while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, nullptr) != 0) {
+    // Interrupted by a signal, go back to sleep
+  }
+}
+
+static std::mutex recording_lock;
+static HostRecording recording;
+static std::atomic<bool> is_pcm_recording_enabled(true);
+static std::atomic<bool> is_float_supported(true);
+
+class HostObject;
+
+/**
+ * An OpenSL ES interface handle is a pointer to a pointer to a table of methods. Each interface
+ * of an object is one of these slots, so a method can get back to its object from the handle.
+ */
+template <typename VTABLE>
+struct InterfaceSlot {
+  const VTABLE *vtable;
+  HostObject *owner;
+};
+
+template <typename ITF>
+static HostObject *owner_of(ITF self) {
+  return reinterpret_cast<const InterfaceSlot<void> *>(self)->owner;
+}
+
+class HostObject {
+
+public:
+  HostObject();
+  virtual ~HostObject() {}
+
+  virtual SLresult getInterface(const SLInterfaceID iid, void *interface) {
+    return SL_RESULT_FEATURE_UNSUPPORTED;
+  }
+
+  SLObjectItf getObjectItf() { return &object_slot_.vtable; }
+
+  InterfaceSlot<SLObjectItf_> object_slot_;
+  SLuint32 object_state_ = SL_OBJECT_STATE_UNREALIZED;
+};
+
+static SLresult object_realize(SLObjectItf self, SLboolean async) {
+  owner_of(self)->object_state_ = SL_OBJECT_STATE_REALIZED;
+  return SL_RESULT_SUCCESS;
+}
+
+static SLresult object_get_state(SLObjectItf self, SLuint32 *state) {
+  *state = owner_of(self)->object_state_;
+  return SL_RESULT_SUCCESS;
+}
+
+static SLresult object_get_interface(SLObjectItf self, const SLInterfaceID iid, void *interface) {
+  HostObject *object = owner_of(self);
+  if (object->object_state_ != SL_OBJECT_STATE_REALIZED) return SL_RESULT_PRECONDITIONS_VIOLATED;
+  return object->getInterface(iid, interface);
+}
+
+static void object_destroy(SLObjectItf self) {
+  delete owner_of(self);
+}
+
+static const SLObjectItf_ object_vtable = {
+    object_realize,
+    object_get_state,
+    object_get_interface,
+    object_destroy
+};
+
+HostObject::HostObject() {
+  object_slot_ = {&object_vtable, this};
+}
+
+/**
+ * Audio player with an Android simple buffer queue
+ */
+class HostPlayer : public HostObject {
+
+public:
+  HostPlayer(uint32_t frame_rate, uint32_t num_channels, bool is_float, uint32_t num_buffers);
+  ~HostPlayer();
+
+  SLresult getInterface(const SLInterfaceID iid, void *interface);
+
+  SLresult setPlayState(SLuint32 state);
+  SLresult enqueue(const void *buffer, SLuint32 size);
+  SLresult clear();
+  SLresult getQueueState(SLAndroidSimpleBufferQueueState *state);
+  SLresult registerCallback(slAndroidSimpleBufferQueueCallback callback, void *context);
+
+  InterfaceSlot<SLPlayItf_> play_slot_;
+  InterfaceSlot<SLAndroidSimpleBufferQueueItf_> buffer_queue_slot_;
+  InterfaceSlot<SLAndroidConfigurationItf_> configuration_slot_;
+  SLuint32 play_state_ = SL_PLAYSTATE_STOPPED;
+
+private:
+  struct QueuedBuffer {
+    const uint8_t *data;
+    SLuint32 size;
+  };
+
+  void consume();
+  void dispatchCallbacks();
+  int64_t bufferDuration(SLuint32 size);
+  void record(const uint8_t *data, SLuint32 size, const HostCallbackTiming *timing,
+              bool is_underrun);
+
+  const uint32_t frame_rate_;
+  const uint32_t bytes_per_frame_;
+  const uint32_t num_buffers_;
+
+  std::mutex queue_lock_;
+  std::deque<QueuedBuffer> queue_;
+  uint32_t consumed_count_ = 0;
+  slAndroidSimpleBufferQueueCallback callback_ = nullptr;
+  void *callback_context_ = nullptr;
+
+  // Timings of buffers which have been consumed but not yet called back for
+  std::mutex callback_lock_;
+  std::condition_variable callback_condition_;
+  std::deque<HostCallbackTiming> pending_callbacks_;
+
+  std::thread consumer_thread_;
+  std::thread callback_thread_;
+  std::atomic<bool> is_playing_ { false };
+  std::vector<uint8_t> silence_;
+};
+
+static SLresult play_set_play_state(SLPlayItf self, SLuint32 state) {
+  return static_cast<HostPlayer *>(owner_of(self))->setPlayState(state);
+}
+
+static SLresult play_get_play_state(SLPlayItf self, SLuint32 *state) {
+  *state = static_cast<HostPlayer *>(owner_of(self))->play_state_;
+  return SL_RESULT_SUCCESS;
+}
+
+static const SLPlayItf_ play_vtable = {
+    play_set_play_state,
+    play_get_play_state
+};
+
+static SLresult buffer_queue_enqueue(SLAndroidSimpleBufferQueueItf self,
+                                     const void *buffer,
+                                     SLuint32 size) {
+  return static_cast<HostPlayer *>(owner_of(self))->enqueue(buffer, size);
+}
+
+static SLresult buffer_queue_clear(SLAndroidSimpleBufferQueueItf self) {
+  return static_cast<HostPlayer *>(owner_of(self))->clear();
+}
+
+static SLresult buffer_queue_get_state(SLAndroidSimpleBufferQueueItf self,
+                                       SLAndroidSimpleBufferQueueState *state) {
+  return static_cast<HostPlayer *>(owner_of(self))->getQueueState(state);
+}
+
+static SLresult buffer_queue_register_callback(SLAndroidSimpleBufferQueueItf self,
+                                               slAndroidSimpleBufferQueueCallback callback,
+                                               void *context) {
+  return static_cast<HostPlayer *>(owner_of(self))->registerCallback(callback, context);
+}
+
+static const SLAndroidSimpleBufferQueueItf_ buffer_queue_vtable = {
+    buffer_queue_enqueue,
+    buffer_queue_clear,
+    buffer_queue_get_state,
+    buffer_queue_register_callback
+};
+
+static SLresult configuration_set(SLAndroidConfigurationItf self, const SLchar *key,
+                                  const void *value, SLuint32 value_size) {
+  return SL_RESULT_SUCCESS;
+}
+
+static SLresult configuration_get(SLAndroidConfigurationItf self, const SLchar *key,
+                                  SLuint32 *value_size, void *value) {
+  return SL_RESULT_PARAMETER_INVALID;
+}
+
+static SLresult configuration_acquire_java_proxy(SLAndroidConfigurationItf self,
+                                                 SLuint32 proxy_type,
+                                                 jobject *proxy) {
+  // There is no Java AudioTrack on the host
+  *proxy = nullptr;
+  return SL_RESULT_SUCCESS;
+}
+
+static SLresult configuration_release_java_proxy(SLAndroidConfigurationItf self,
+                                                 SLuint32 proxy_type) {
+  return SL_RESULT_SUCCESS;
+}
+
+/**
+ * The API 24 configuration interface (see OpenSLES_Android_API24.h) has two more methods than the
+ * original one. The same table serves both, laid out like the API 24 struct.
+ */
+struct ConfigurationVtable {
+  SLAndroidConfigurationItf_ base;
+  SLresult (*AcquireJavaProxy)(SLAndroidConfigurationItf self, SLuint32 proxy_type,
+                               jobject *proxy);
+  SLresult (*ReleaseJavaProxy)(SLAndroidConfigurationItf self, SLuint32 proxy_type);
+};
+
+static const ConfigurationVtable configuration_vtable = {
+    {configuration_set, configuration_get},
+    configuration_acquire_java_proxy,
+    configuration_release_java_proxy
+};
+
+HostPlayer::HostPlayer(uint32_t frame_rate, uint32_t num_channels, bool is_float,
+                       uint32_t num_buffers) :
+    frame_rate_(frame_rate),
+    bytes_per_frame_(num_channels * (is_float ? sizeof(float) : sizeof(int16_t))),
+    num_buffers_(num_buffers) {
+
+  play_slot_ = {&play_vtable, this};
+  buffer_queue_slot_ = {&buffer_queue_vtable, this};
+  configuration_slot_ = {&configuration_vtable.base, this};
+
+  std::lock_guard<std::mutex> lock(recording_lock);
+  recording.frame_rate = frame_rate;
+  recording.num_channels = num_channels;
+  recording.is_float = is_float;
+  recording.pcm.clear();
+  recording.callback_timings.clear();
+  recording.underrun_count = 0;
+}
+
+HostPlayer::~HostPlayer() {
+  setPlayState(SL_PLAYSTATE_STOPPED);
+}
+
+SLresult HostPlayer::getInterface(const SLInterfaceID iid, void *interface) {
+
+  if (iid == SL_IID_PLAY) {
+    *static_cast<SLPlayItf *>(interface) = &play_slot_.vtable;
+  } else if (iid == SL_IID_ANDROIDSIMPLEBUFFERQUEUE) {
+    *static_cast<SLAndroidSimpleBufferQueueItf *>(interface) = &buffer_queue_slot_.vtable;
+  } else if (iid == SL_IID_ANDROIDCONFIGURATION) {
+    *static_cast<SLAndroidConfigurationItf *>(interface) = &configuration_slot_.vtable;
+  } else {
+    return SL_RESULT_FEATURE_UNSUPPORTED;
+  }
+  return SL_RESULT_SUCCESS;
+}
+
+SLresult HostPlayer::setPlayState(SLuint32 state) {
+
+  play_state_ = state;
+
+  if (state == SL_PLAYSTATE_PLAYING) {
+    if (!is_playing_.exchange(true)) {
+      consumer_thread_ = std::thread(&HostPlayer::consume, this);
+      callback_thread_ = std::thread(&HostPlayer::dispatchCallbacks, this);
+    }
+  } else if (is_playing_.exchange(false)) {
+
+    {
+      std::lock_guard<std::mutex> lock(callback_lock_);
+      pending_callbacks_.clear();
+    }
+    callback_condition_.notify_all();
+    consumer_thread_.join();
+
+    // The callback may stop its own player, in which case the thread exits once it returns
+    if (std::this_thread::get_id() == callback_thread_.get_id()) {
+      callback_thread_.detach();
+    } else {
+      callback_thread_.join();
+    }
+    if (state == SL_PLAYSTATE_STOPPED) clear();
+  }
+  return SL_RESULT_SUCCESS;
+}
+
+SLresult HostPlayer::enqueue(const void *buffer, SLuint32 size) {
+
+  if (buffer == nullptr || size == 0 || size % bytes_per_frame_ != 0) {
+    return SL_RESULT_PARAMETER_INVALID;
+  }
+
+  std::lock_guard<std::mutex> lock(queue_lock_);
+  if (queue_.size() >= num_buffers_) return SL_RESULT_BUFFER_INSUFFICIENT;
+  queue_.push_back({static_cast<const uint8_t *>(buffer), size});
+  return SL_RESULT_SUCCESS;
+}
+
+SLresult HostPlayer::clear() {
+  std::lock_guard<std::mutex> lock(queue_lock_);
+  queue_.clear();
+  return SL_RESULT_SUCCESS;
+}
+
+SLresult HostPlayer::getQueueState(SLAndroidSimpleBufferQueueState *state) {
+  std::lock_guard<std::mutex> lock(queue_lock_);
+  state->count = static_cast<SLuint32>(queue_.size());
+  state->index = consumed_count_;
+  return SL_RESULT_SUCCESS;
+}
+
+SLresult HostPlayer::registerCallback(slAndroidSimpleBufferQueueCallback callback,
+                                      void *context) {
+  if (is_playing_) return SL_RESULT_PRECONDITIONS_VIOLATED;
+  callback_ = callback;
+  callback_context_ = context;
+  return SL_RESULT_SUCCESS;
+}
+
+int64_t HostPlayer::bufferDuration(SLuint32 size) {
+  return (static_cast<int64_t>(size / bytes_per_frame_) * NANOS_IN_SECOND) / frame_rate_;
+}
+
+/**
+ * Runs on the consumer thread. Playback starts when the first buffer is queued, after which
+ * buffers are taken at the rate they would be played. As on Android the callbacks run on another
+ * thread, so a callback which runs late makes the queue run dry and shows up as an underrun.
+ */
+void HostPlayer::consume() {
+
+  int64_t due_time = 0;
+  int64_t previous_duration = 0;
+
+  while (is_playing_) {
+
+    if (due_time == 0) {
+      bool is_empty;
+      {
+        std::lock_guard<std::mutex> lock(queue_lock_);
+        is_empty = queue_.empty();
+      }
+      if (is_empty) {
+        std::this_thread::sleep_for(std::chrono::microseconds(100));
+        continue;
+      }
+      due_time = now_nanos();
+    }
+
+    sleep_until_nanos(due_time);
+    if (!is_playing_) break;
+
+    QueuedBuffer buffer = {nullptr, 0};
+    uint32_t queued_buffers = 0;
+    {
+      std::lock_guard<std::mutex> lock(queue_lock_);
+      if (!queue_.empty()) {
+        buffer = queue_.front();
+        queue_.pop_front();
+        consumed_count_++;
+        queued_buffers = static_cast<uint32_t>(queue_.size());
+      }
+    }
+
+    if (buffer.data == nullptr && previous_duration == 0) {
+      // The queue was cleared before anything was played, wait for the next buffer
+      due_time = 0;
+      continue;
+    }
+
+    if (buffer.data == nullptr) {
+      // Underrun, the device plays a buffer's worth of silence
+      silence_.resize(static_cast<size_t>((previous_duration * frame_rate_) / NANOS_IN_SECOND) *
+                      bytes_per_frame_);
+      record(silence_.data(), static_cast<SLuint32>(silence_.size()), nullptr, true);
+      due_time += previous_duration;
+      continue;
+    }
+
+    // The buffer is copied before the callback because the callback may reuse it
+    if (is_pcm_recording_enabled) record(buffer.data, buffer.size, nullptr, false);
+
+    HostCallbackTiming timing;
+    timing.due_time = due_time;
+    timing.queued_buffers = queued_buffers;
+    {
+      std::lock_guard<std::mutex> lock(callback_lock_);
+      pending_callbacks_.push_back(timing);
+    }
+    callback_condition_.notify_one();
+
+    previous_duration = bufferDuration(buffer.size);
+    due_time += previous_duration;
+  }
+}
+
+/**
+ * Runs on the callback thread, calling the callback once for each consumed buffer in order
+ */
+void HostPlayer::dispatchCallbacks() {
+
+  while (true) {
+
+    HostCallbackTiming timing;
+    {
+      std::unique_lock<std::mutex> lock(callback_lock_);
+      callback_condition_.wait(lock, [this] {
+        return !pending_callbacks_.empty() || !is_playing_;
+      });
+      if (!is_playing_) break;
+      timing = pending_callbacks_.front();
+      pending_callbacks_.pop_front();
+    }
+
+    timing.start_time = now_nanos();
+    if (callback_ != nullptr) {
+      callback_(&buffer_queue_slot_.vtable, callback_context_);
+    }
+    timing.end_time = now_nanos();
+    record(nullptr, 0, &timing, false);
+  }
+}
+
+void HostPlayer::record(const uint8_t *data, SLuint32 size, const HostCallbackTiming *timing,
+                        bool is_underrun) {
+
+  std::lock_guard<std::mutex> lock(recording_lock);
+  if (data != nullptr && is_pcm_recording_enabled) {
+    recording.pcm.insert(recording.pcm.end(), data, data + size);
+  }
+  if (timing != nullptr) recording.callback_timings.push_back(*timing);
+  if (is_underrun) recording.underrun_count++;
+}
+
+/**
+ * Engine, which creates audio players and output mixes
+ */
+class HostEngine : public HostObject {
+
+public:
+  HostEngine();
+
+  SLresult getInterface(const SLInterfaceID iid, void *interface);
+
+  InterfaceSlot<SLEngineItf_> engine_slot_;
+};
+
+// Check the requested interfaces are ones which the object supports
+static SLresult check_interfaces(SLuint32 num_interfaces,
+                                 const SLInterfaceID *interface_ids,
+                                 const SLboolean *interfaces_required,
+                                 const SLInterfaceID *supported_ids,
+                                 int num_supported_ids) {
+
+  for (SLuint32 i = 0; i < num_interfaces; i++) {
+    bool is_supported = false;
+    for (int j = 0; j < num_supported_ids; j++) {
+      if (interface_ids[i] == supported_ids[j]) is_supported = true;
+    }
+    if (!is_supported && interfaces_required != nullptr && interfaces_required[i]) {
+      return SL_RESULT_FEATURE_UNSUPPORTED;
+    }
+  }
+  return SL_RESULT_SUCCESS;
+}
+
+static SLresult engine_create_audio_player(SLEngineItf self,
+                                           SLObjectItf *player,
+                                           SLDataSource *source,
+                                           SLDataSink *sink,
+                                           SLuint32 num_interfaces,
+                                           const SLInterfaceID *interface_ids,
+                                           const SLboolean *interfaces_required) {
+
+  if (player == nullptr || source == nullptr || sink == nullptr) {
+    return SL_RESULT_PARAMETER_INVALID;
+  }
+
+  const SLInterfaceID supported_ids[] = {SL_IID_PLAY,
+                                         SL_IID_ANDROIDSIMPLEBUFFERQUEUE,
+                                         SL_IID_ANDROIDCONFIGURATION};
+  SLresult result = check_interfaces(num_interfaces, interface_ids, interfaces_required,
+                                     supported_ids, 3);
+  if (result != SL_RESULT_SUCCESS) return result;
+
+  SLDataLocator_AndroidSimpleBufferQueue *locator =
+      static_cast<SLDataLocator_AndroidSimpleBufferQueue *>(source->pLocator);
+  if (locator == nullptr || locator->locatorType != SL_DATALOCATOR_ANDROIDSIMPLEBUFFERQUEUE ||
+      locator->numBuffers == 0) {
+    return SL_RESULT_PARAMETER_INVALID;
+  }
+
+  SLDataLocator_OutputMix *output_locator = static_cast<SLDataLocator_OutputMix *>(sink->pLocator);
+  if (output_locator == nullptr || output_locator->locatorType != SL_DATALOCATOR_OUTPUTMIX) {
+    return SL_RESULT_PARAMETER_INVALID;
+  }
+
+  uint32_t frame_rate;
+  uint32_t num_channels;
+  bool is_float;
+
+  SLuint32 format_type = *static_cast<SLuint32 *>(source->pFormat);
+  if (format_type == SL_DATAFORMAT_PCM) {
+    SLDataFormat_PCM *format = static_cast<SLDataFormat_PCM *>(source->pFormat);
+    if (format->bitsPerSample != SL_PCMSAMPLEFORMAT_FIXED_16) {
+      return SL_RESULT_CONTENT_UNSUPPORTED;
+    }
+    frame_rate = format->samplesPerSec / MILLIHERTZ_IN_HERTZ;
+    num_channels = format->numChannels;
+    is_float = false;
+  } else if (format_type == SL_ANDROID_DATAFORMAT_PCM_EX) {
+    SLAndroidDataFormat_PCM_EX *format = static_cast<SLAndroidDataFormat_PCM_EX *>(
+        source->pFormat);
+    if (format->representation == SL_ANDROID_PCM_REPRESENTATION_FLOAT &&
+        format->bitsPerSample == SL_PCMSAMPLEFORMAT_FIXED_32 && is_float_supported) {
+      is_float = true;
+    } else if (format->representation == SL_ANDROID_PCM_REPRESENTATION_SIGNED_INT &&
+               format->bitsPerSample == SL_PCMSAMPLEFORMAT_FIXED_16) {
+      is_float = false;
+    } else {
+      return SL_RESULT_CONTENT_UNSUPPORTED;
+    }
+    frame_rate = format->sampleRate / MILLIHERTZ_IN_HERTZ;
+    num_channels = format->numChannels;
+  } else {
+    return SL_RESULT_CONTENT_UNSUPPORTED;
+  }
+
+  if (frame_rate == 0 || num_channels == 0) return SL_RESULT_PARAMETER_INVALID;
+
+  HostPlayer *host_player = new HostPlayer(frame_rate, num_channels, is_float,
+                                           locator->numBuffers);
+  *player = host_player->getObjectItf();
+  return SL_RESULT_SUCCESS;
+}
+
+static SLresult engine_create_output_mix(SLEngineItf self,
+                                         SLObjectItf *mix,
+                                         SLuint32 num_interfaces,
+                                         const SLInterfaceID *interface_ids,
+                                         const SLboolean *interfaces_required) {
+
+  SLresult result = check_interfaces(num_interfaces, interface_ids, interfaces_required,
+                                     nullptr, 0);
+  if (result != SL_RESULT_SUCCESS) return result;
+
+  HostObject *output_mix = new HostObject();
+  *mix = output_mix->getObjectItf();
+  return SL_RESULT_SUCCESS;
+}
+
+static const SLEngineItf_ engine_vtable = {
+    engine_create_audio_player,
+    engine_create_output_mix
+};
+
+HostEngine::HostEngine() {
+  engine_slot_ = {&engine_vtable, this};
+}
+
+SLresult HostEngine::getInterface(const SLInterfaceID iid, void *interface) {
+
+  if (iid != SL_IID_ENGINE) return SL_RESULT_FEATURE_UNSUPPORTED;
+  *static_cast<SLEngineItf *>(interface) = &engine_slot_.vtable;
+  return SL_RESULT_SUCCESS;
+}
+
+SLresult slCreateEngine(SLObjectItf *engine,
+                        SLuint32 num_options,
+                        const SLEngineOption *engine_options,
+                        SLuint32 num_interfaces,
+                        const SLInterfaceID *interface_ids,
+                        const SLboolean *interfaces_required) {
+
+  if (engine == nullptr) return SL_RESULT_PARAMETER_INVALID;
+
+  const SLInterfaceID supported_ids[] = {SL_IID_ENGINE};
+  SLresult result = check_interfaces(num_interfaces, interface_ids, interfaces_required,
+                                     supported_ids, 1);
+  if (result != SL_RESULT_SUCCESS) return result;
+
+  HostEngine *host_engine = new HostEngine();
+  *engine = host_engine->getObjectItf();
+  return SL_RESULT_SUCCESS;
+}
+
+// Host controls
+
+bool opensles_host_create_engine(SLObjectItf *engine_object,
+                                 SLEngineItf *engine_itf,
+                                 SLObjectItf *output_mix_object) {
+
+  if (slCreateEngine(engine_object, 0, nullptr, 0, nullptr, nullptr) != SL_RESULT_SUCCESS ||
+      (**engine_object)->Realize(*engine_object, SL_BOOLEAN_FALSE) != SL_RESULT_SUCCESS ||
+      (**engine_object)->GetInterface(*engine_object, SL_IID_ENGINE, engine_itf) !=
+          SL_RESULT_SUCCESS ||
+      (**engine_itf)->CreateOutputMix(*engine_itf, output_mix_object, 0, nullptr, nullptr) !=
+          SL_RESULT_SUCCESS ||
+      (**output_mix_object)->Realize(*output_mix_object, SL_BOOLEAN_FALSE) !=
+          SL_RESULT_SUCCESS) {
+    return false;
+  }
+  return true;
+}
+
+void opensles_host_get_recording(HostRecording *copy) {
+  std::lock_guard<std::mutex> lock(recording_lock);
+  *copy = recording;
+}
+
+void opensles_host_reset_recording() {
+  std::lock_guard<std::mutex> lock(recording_lock);
+  recording.pcm.clear();
+  recording.callback_timings.clear();
+  recording.underrun_count = 0;
+}
+
+void opensles_host_set_pcm_recording_enabled(bool is_enabled) {
+  is_pcm_recording_enabled = is_enabled;
+}
+
+void opensles_host_set_float_supported(bool is_supported) {
+  is_float_supported = is_supported;
+}
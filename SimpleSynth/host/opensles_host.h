@@ -0,0 +1,90 @@
+/*
+ * Copyright 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SIMPLESYNTH_OPENSLES_HOST_H
+#define SIMPLESYNTH_OPENSLES_HOST_H
+
+#include <stdint.h>
+#include <vector>
+#include <SLES/OpenSLES.h>
+
+/**
+ * Controls and measurements for the host stand-in OpenSL ES implementation. These don't exist
+ * on Android.
+ *
+ * Each playing audio player has a consumer thread which takes one buffer from the front of its
+ * buffer queue and copies it to the recording, then wakes a callback thread which calls the
+ * registered callback, just as a device calls back once it has finished with a buffer. The next
+ * buffer is taken when the previous buffer's duration has elapsed on CLOCK_MONOTONIC. If the
+ * queue is empty at that point, for example because a callback ran late, an underrun is counted
+ * and a buffer of silence is recorded in its place.
+ */
+
+/**
+ * Timing of a single buffer queue callback, in CLOCK_MONOTONIC nanoseconds
+ */
+struct HostCallbackTiming {
+  int64_t due_time;         // when the device took the buffer and the callback should start
+  int64_t start_time;
+  int64_t end_time;
+  uint32_t queued_buffers;  // buffers left in the queue when the buffer was consumed
+};
+
+/**
+ * Everything recorded from the most recently created audio player
+ */
+struct HostRecording {
+  uint32_t frame_rate;
+  uint32_t num_channels;
+  bool is_float;            // samples are floats, otherwise int16
+  std::vector<uint8_t> pcm; // interleaved samples in the order the device consumed them
+  std::vector<HostCallbackTiming> callback_timings;
+  int64_t underrun_count;
+};
+
+/**
+ * Create and realize an engine and an output mix for it, as the app does at startup. Destroy
+ * them with their Destroy methods.
+ *
+ * @return false if any step failed
+ */
+bool opensles_host_create_engine(SLObjectItf *engine_object,
+                                 SLEngineItf *engine_itf,
+                                 SLObjectItf *output_mix_object);
+
+/**
+ * Copy the recording of the most recently created audio player.
+ */
+void opensles_host_get_recording(HostRecording *recording);
+
+/**
+ * Discard the PCM, timings and underruns recorded so far.
+ */
+void opensles_host_reset_recording();
+
+/**
+ * Enable or disable recording of the consumed PCM. Callback timings and underruns are always
+ * recorded. Recording is enabled by default, disabling it saves memory in long runs.
+ */
+void opensles_host_set_pcm_recording_enabled(bool is_enabled);
+
+/**
+ * Make the engine accept or reject float PCM, to exercise both of AudioPlayer's sample formats.
+ * Float is supported by default.
+ */
+void opensles_host_set_float_supported(bool is_supported);
+
+#endif //SIMPLESYNTH_OPENSLES_HOST_H
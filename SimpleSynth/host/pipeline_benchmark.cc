@@ -0,0 +1,198 @@
+/*
+ * Copyright 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * Checks that PipelinedRenderer passes its renderer's output through unchanged, then finds the
+ * most work cycles Synthesizer can sustain without underruns when rendering in the callback and
+ * on the producer thread.
+ *
+ *   pipeline-benchmark [fill level in buffers] [milliseconds per run]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <vector>
+#include "audio_player.h"
+#include "opensles_host.h"
+#include "pipelined_renderer.h"
+#include "synthesizer.h"
+
+#define FRAME_RATE 48000
+#define FRAMES_PER_BUFFER 192
+#define NUM_CHANNELS 2
+#define NUM_BUFFERS 2
+#define API_LEVEL 24
+#define DEFAULT_FILL_LEVEL_IN_BUFFERS 2
+#define MAX_FILL_LEVEL_IN_BUFFERS 8
+#define DEFAULT_RUN_TIME_IN_MILLISECONDS 500
+#define MIN_WORK_CYCLES 1000
+#define BISECTION_STEPS 5
+
+// Notes are sent before the first render so every synthesizer applies them at frame 0
+static void start_notes(Synthesizer *synth) {
+  synth->noteOn(1, 220);
+  synth->noteOn(2, 331);
+}
+
+/**
+ * Read from a pipeline as a callback would, giving the producer time to refill in between, and
+ * compare with rendering directly
+ */
+static bool check_pass_through(int fill_level_in_buffers) {
+
+  Synthesizer direct_synth(NUM_CHANNELS, FRAME_RATE);
+  Synthesizer pipelined_synth(NUM_CHANNELS, FRAME_RATE);
+  start_notes(&direct_synth);
+  start_notes(&pipelined_synth);
+
+  PipelinedRenderer pipeline(&pipelined_synth, NUM_CHANNELS, FRAMES_PER_BUFFER,
+                             FRAMES_PER_BUFFER * MAX_FILL_LEVEL_IN_BUFFERS);
+  pipeline.setFillLevel(FRAMES_PER_BUFFER * fill_level_in_buffers);
+  pipeline.start();
+
+  const int num_samples = FRAMES_PER_BUFFER * NUM_CHANNELS;
+  std::vector<float> expected(num_samples);
+  std::vector<float> output(num_samples);
+  std::vector<int16_t> expected16(num_samples);
+  std::vector<int16_t> output16(num_samples);
+  int differences = 0;
+  for (int i = 0; i < 200; i++) {
+    // Alternate formats to check the pipeline's int16 conversion too
+    if (i % 2 == 0) {
+      direct_synth.render(num_samples, expected.data());
+      pipeline.render(num_samples, output.data());
+      for (int j = 0; j < num_samples; j++) differences += output[j] != expected[j];
+    } else {
+      direct_synth.render(num_samples, expected16.data());
+      pipeline.render(num_samples, output16.data());
+      for (int j = 0; j < num_samples; j++) differences += output16[j] != expected16[j];
+    }
+    usleep(2000);
+  }
+  pipeline.stop();
+
+  PipelineStats stats;
+  pipeline.getStats(&stats);
+  printf("pipeline against direct render: %d differences, %lld underflows\n", differences,
+         (long long) stats.underflow_count);
+  return differences == 0 && stats.underflow_count == 0;
+}
+
+/**
+ * Play for run_time_ms and report whether every callback had its samples in time
+ */
+static bool is_sustainable(SLEngineItf engine_itf, SLObjectItf output_mix, bool is_pipelined,
+                           int fill_level_in_buffers, int work_cycles, int run_time_ms) {
+
+  AudioStreamFormat format;
+  format.frame_rate = FRAME_RATE;
+  format.frames_per_buffer = FRAMES_PER_BUFFER;
+  format.num_audio_channels = NUM_CHANNELS;
+  format.num_buffers = NUM_BUFFERS;
+  format.num_render_ahead_buffers = 0;
+
+  Synthesizer synth(NUM_CHANNELS, FRAME_RATE);
+  synth.setWorkCycles(work_cycles);
+  start_notes(&synth);
+
+  PipelinedRenderer pipeline(&synth, NUM_CHANNELS, FRAMES_PER_BUFFER,
+                             FRAMES_PER_BUFFER * MAX_FILL_LEVEL_IN_BUFFERS);
+  pipeline.setFillLevel(FRAMES_PER_BUFFER * fill_level_in_buffers);
+  AudioRenderer *renderer = &synth;
+  if (is_pipelined) {
+    pipeline.start();
+    renderer = &pipeline;
+  }
+
+  opensles_host_set_pcm_recording_enabled(false);
+  opensles_host_reset_recording();
+  {
+    AudioPlayer player(engine_itf, output_mix, renderer, format, API_LEVEL);
+    player.play();
+    usleep((useconds_t) run_time_ms * 1000);
+    player.stop();
+  }
+  pipeline.stop();
+  opensles_host_set_pcm_recording_enabled(true);
+
+  HostRecording recording;
+  opensles_host_get_recording(&recording);
+  PipelineStats stats;
+  pipeline.getStats(&stats);
+  return recording.underrun_count == 0 && stats.underflow_count == 0;
+}
+
+/**
+ * Double the work until it can't be sustained, then bisect between the last two values
+ */
+static int find_max_work_cycles(SLEngineItf engine_itf, SLObjectItf output_mix,
+                                bool is_pipelined, int fill_level_in_buffers, int run_time_ms) {
+
+  int good = 0;
+  int bad = MIN_WORK_CYCLES;
+  while (bad < (1 << 28) &&
+         is_sustainable(engine_itf, output_mix, is_pipelined, fill_level_in_buffers, bad,
+                        run_time_ms)) {
+    good = bad;
+    bad *= 2;
+  }
+  for (int i = 0; i < BISECTION_STEPS; i++) {
+    int middle = good + (bad - good) / 2;
+    if (is_sustainable(engine_itf, output_mix, is_pipelined, fill_level_in_buffers, middle,
+                       run_time_ms)) {
+      good = middle;
+    } else {
+      bad = middle;
+    }
+  }
+  return good;
+}
+
+int main(int argc, char **argv) {
+
+  int fill_level_in_buffers = (argc > 1) ? atoi(argv[1]) : DEFAULT_FILL_LEVEL_IN_BUFFERS;
+  int run_time_ms = (argc > 2) ? atoi(argv[2]) : DEFAULT_RUN_TIME_IN_MILLISECONDS;
+  if (fill_level_in_buffers < 1 || fill_level_in_buffers > MAX_FILL_LEVEL_IN_BUFFERS ||
+      run_time_ms <= 0) {
+    fprintf(stderr, "Usage: pipeline-benchmark [fill level in buffers, 1 to %d] "
+                    "[milliseconds per run]\n", MAX_FILL_LEVEL_IN_BUFFERS);
+    return 1;
+  }
+
+  bool is_ok = check_pass_through(fill_level_in_buffers);
+
+  SLObjectItf engine_object;
+  SLEngineItf engine_itf;
+  SLObjectItf output_mix;
+  if (!opensles_host_create_engine(&engine_object, &engine_itf, &output_mix)) {
+    printf("Unable to create the engine\n");
+    return 1;
+  }
+
+  printf("\n%d frame buffers at %d Hz, %d buffer queue, %d buffer fill level\n",
+         FRAMES_PER_BUFFER, FRAME_RATE, NUM_BUFFERS, fill_level_in_buffers);
+  int callback_work = find_max_work_cycles(engine_itf, output_mix, false,
+                                           fill_level_in_buffers, run_time_ms);
+  printf("render in callback:        %9d work cycles\n", callback_work);
+  int pipelined_work = find_max_work_cycles(engine_itf, output_mix, true,
+                                            fill_level_in_buffers, run_time_ms);
+  printf("render on producer thread: %9d work cycles\n", pipelined_work);
+
+  (*output_mix)->Destroy(output_mix);
+  (*engine_object)->Destroy(engine_object);
+  return is_ok ? 0 : 1;
+}
@@ -0,0 +1,130 @@
+/*
+ * Copyright 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * Calls LoadStabilizer once per callback period around Synthesizer, padding by spinning and by
+ * rendering ahead, and reports how long each callback takes to have its samples ready. Checks
+ * that rendering ahead plays exactly what the synthesizer renders directly.
+ *
+ *   render-ahead-benchmark [work cycles] [callbacks per run]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <vector>
+#include "audio_common.h"
+#include "load_stabilizer.h"
+#include "synthesizer.h"
+
+#define FRAME_RATE 48000
+#define FRAMES_PER_BUFFER 192
+#define NUM_CHANNELS 2
+#define DEFAULT_WORK_CYCLES 100000
+#define DEFAULT_CALLBACKS_PER_RUN 500
+
+static const int64_t CALLBACK_PERIOD_NANOS =
+    (int64_t) FRAMES_PER_BUFFER * NANOS_IN_SECOND / FRAME_RATE;
+
+static void sleep_until(int64_t time) {
+  timespec ts;
+  ts.tv_sec = time / NANOS_IN_SECOND;
+  ts.tv_nsec = time % NANOS_IN_SECOND;
+  while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, nullptr) != 0) {
+    // Interrupted by a signal, go back to sleep
+  }
+}
+
+// Notes and work are sent before the first render so every synthesizer applies them at frame 0
+static void start_synthesizer(Synthesizer *synth, int work_cycles) {
+  synth->setWorkCycles(work_cycles);
+  synth->noteOn(1, 220);
+  synth->noteOn(2, 331);
+}
+
+/**
+ * Call the stabilizer once per period and count the samples which differ from a direct render.
+ * The stabilizer only reports a moving average of how soon samples are ready, so that is sampled
+ * after every callback and averaged over the run.
+ */
+static int run(PaddingMode mode, int work_cycles, int num_callbacks, LoadStabilizerStats *stats,
+               double *mean_ready_nanos) {
+
+  Synthesizer synth(NUM_CHANNELS, FRAME_RATE);
+  Synthesizer reference_synth(NUM_CHANNELS, FRAME_RATE);
+  start_synthesizer(&synth, work_cycles);
+  start_synthesizer(&reference_synth, 0);
+
+  const int num_samples = FRAMES_PER_BUFFER * NUM_CHANNELS;
+  LoadStabilizer stabilizer(&synth, CALLBACK_PERIOD_NANOS, num_samples);
+  stabilizer.setStabilizationEnabled(true);
+  stabilizer.setPaddingMode(mode);
+
+  std::vector<int16_t> output(num_samples);
+  std::vector<int16_t> expected(num_samples);
+  int differences = 0;
+  double total_ready_nanos = 0;
+  int64_t period_start = get_time();
+  for (int i = 0; i < num_callbacks; i++) {
+    sleep_until(period_start);
+    stabilizer.render(num_samples, output.data());
+    reference_synth.render(num_samples, expected.data());
+    for (int j = 0; j < num_samples; j++) differences += output[j] != expected[j];
+    stabilizer.getStats(stats);
+    total_ready_nanos += stats->mean_ready_duration;
+
+    period_start += CALLBACK_PERIOD_NANOS;
+  }
+  *mean_ready_nanos = total_ready_nanos / num_callbacks;
+  return differences;
+}
+
+int main(int argc, char **argv) {
+
+  int work_cycles = (argc > 1) ? atoi(argv[1]) : DEFAULT_WORK_CYCLES;
+  int num_callbacks = (argc > 2) ? atoi(argv[2]) : DEFAULT_CALLBACKS_PER_RUN;
+  if (work_cycles < 0 || num_callbacks < 10) {
+    fprintf(stderr, "Usage: render-ahead-benchmark [work cycles] [callbacks, at least 10]\n");
+    return 1;
+  }
+
+  printf("%d frame buffers at %d Hz, %d work cycles\n\n", FRAMES_PER_BUFFER, FRAME_RATE,
+         work_cycles);
+
+  LoadStabilizerStats spin_stats;
+  double spin_ready_nanos;
+  int spin_differences = run(PADDING_MODE_SPIN, work_cycles, num_callbacks, &spin_stats,
+                             &spin_ready_nanos);
+  LoadStabilizerStats ahead_stats;
+  double ahead_ready_nanos;
+  int ahead_differences = run(PADDING_MODE_RENDER_AHEAD, work_cycles, num_callbacks,
+                              &ahead_stats, &ahead_ready_nanos);
+
+  printf("spin:         samples ready after %7.1f us, render %7.1f us, %lld misses\n",
+         spin_ready_nanos / 1000.0, spin_stats.mean_render_duration / 1000.0,
+         (long long) spin_stats.deadline_miss_count);
+  printf("render ahead: samples ready after %7.1f us, render %7.1f us, %lld misses, "
+         "%lld of %lld callbacks served ahead\n",
+         ahead_ready_nanos / 1000.0, ahead_stats.mean_render_duration / 1000.0,
+         (long long) ahead_stats.deadline_miss_count,
+         (long long) ahead_stats.lookaside_hit_count, (long long) ahead_stats.callback_count);
+
+  bool is_ok = spin_differences == 0 && ahead_differences == 0 &&
+               ahead_stats.lookaside_hit_count > 0;
+  printf("\noutput matches a direct render, %d and %d differences: %s\n", spin_differences,
+         ahead_differences, is_ok ? "ok" : "FAILED");
+  return is_ok ? 0 : 1;
+}
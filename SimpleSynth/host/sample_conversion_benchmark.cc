@@ -0,0 +1,179 @@
+/*
+ * Copyright 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * Checks that convert_mono_float_to_int16 matches the scalar reference bit for bit, including
+ * NaN, infinities and out of range samples, then measures the speed up for mono, stereo and
+ * 4 channel layouts.
+ *
+ *   sample-conversion-benchmark
+ *
+ * Build it with CMAKE_BUILD_TYPE=Release, the default build is unoptimized.
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <vector>
+#include "sample_conversion.h"
+
+#define FRAMES_PER_BUFFER 192
+#define BUFFERS_PER_RUN 20000
+#define RUNS 5
+#define FULL_SCALE 32767.0f
+
+static int64_t now_nanos() {
+  timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static const char *implementation_name() {
+#if SAMPLE_CONVERSION_USE_NEON
+  return "NEON";
+#elif SAMPLE_CONVERSION_USE_SSE2
+  return "SSE2";
+#else
+  return "scalar";
+#endif
+}
+
+/**
+ * Compare against the reference for every channel count from 1 to 8 and every frame count up
+ * to 64, so that each vector kernel and the scalar tail see every value in every lane
+ */
+static bool check_matches_reference(const std::vector<float> &source) {
+
+  const int max_channels = 8;
+  const int max_frames = 64;
+  int16_t expected[max_frames * max_channels];
+  int16_t output[max_frames * max_channels];
+  int mismatches = 0;
+
+  for (size_t offset = 0; offset + max_frames <= source.size(); offset++) {
+    for (int num_channels = 1; num_channels <= max_channels; num_channels++) {
+      for (int num_frames = 1; num_frames <= max_frames; num_frames++) {
+        convert_mono_float_to_int16_scalar(&source[offset], expected, num_frames, num_channels,
+                                           FULL_SCALE);
+        memset(output, 0x55, sizeof(output));
+        convert_mono_float_to_int16(&source[offset], output, num_frames, num_channels,
+                                    FULL_SCALE);
+        if (memcmp(expected, output, num_frames * num_channels * sizeof(int16_t)) != 0) {
+          mismatches++;
+        }
+      }
+    }
+  }
+  printf("%s against scalar reference: %d mismatches\n", implementation_name(), mismatches);
+  return mismatches == 0;
+}
+
+static bool check_special_values() {
+
+  struct Case {
+    float sample;
+    int16_t expected;
+  };
+  const Case cases[] = {
+      { NAN, 0 },
+      { -NAN, 0 },
+      { INFINITY, INT16_MAX },
+      { -INFINITY, INT16_MIN },
+      { 2.0f, INT16_MAX },
+      { -2.0f, INT16_MIN },
+      { 1.0f, 32767 },
+      { -1.0f, -32767 },
+      { 0.5f, 16383 },
+      { -0.5f, -16383 },
+  };
+  const int num_cases = sizeof(cases) / sizeof(cases[0]);
+
+  // Fill a whole vector with each value so both the kernels and the scalar tail convert it
+  bool is_ok = true;
+  for (int i = 0; i < num_cases; i++) {
+    float source[9];
+    int16_t output[9 * 2];
+    for (int j = 0; j < 9; j++) source[j] = cases[i].sample;
+    convert_mono_float_to_int16(source, output, 9, 2, FULL_SCALE);
+    for (int j = 0; j < 9 * 2; j++) {
+      if (output[j] != cases[i].expected) {
+        printf("%f converted to %d, expected %d\n", cases[i].sample, output[j],
+               cases[i].expected);
+        is_ok = false;
+        break;
+      }
+    }
+  }
+  printf("special values: %s\n", is_ok ? "ok" : "FAILED");
+  return is_ok;
+}
+
+/**
+ * Best of RUNS, in nanoseconds per buffer
+ */
+template <typename Convert>
+static double measure(Convert convert) {
+  double best = 1e30;
+  for (int run = 0; run < RUNS; run++) {
+    int64_t start = now_nanos();
+    for (int i = 0; i < BUFFERS_PER_RUN; i++) convert();
+    double nanos = (double) (now_nanos() - start) / BUFFERS_PER_RUN;
+    if (nanos < best) best = nanos;
+  }
+  return best;
+}
+
+int main() {
+
+  // Ordinary samples and the values which need care, in an order which puts them in every lane
+  std::vector<float> source;
+  const float specials[] = { NAN, INFINITY, -INFINITY, 1.5f, -1.5f, 1.0f, -1.0f, 0.0f, -0.0f,
+                             1.0f / 32767, -1.0f / 32767, 0.99999f };
+  srand(1);
+  for (int i = 0; i < 256; i++) {
+    if (i % 5 == 0) {
+      source.push_back(specials[(i / 5) % (sizeof(specials) / sizeof(specials[0]))]);
+    } else {
+      source.push_back(2.5f * rand() / RAND_MAX - 1.25f);
+    }
+  }
+
+  bool is_ok = check_matches_reference(source);
+  is_ok &= check_special_values();
+
+  std::vector<float> input(FRAMES_PER_BUFFER);
+  for (int i = 0; i < FRAMES_PER_BUFFER; i++) input[i] = sinf(i * 0.05f);
+  std::vector<int16_t> output(FRAMES_PER_BUFFER * 4);
+
+  printf("\n%d frame buffers\n", FRAMES_PER_BUFFER);
+  const int channel_counts[] = { 1, 2, 4 };
+  for (int num_channels : channel_counts) {
+    double scalar_nanos = measure([&]() {
+      convert_mono_float_to_int16_scalar(input.data(), output.data(), FRAMES_PER_BUFFER,
+                                         num_channels, FULL_SCALE);
+    });
+    double nanos = measure([&]() {
+      convert_mono_float_to_int16(input.data(), output.data(), FRAMES_PER_BUFFER,
+                                  num_channels, FULL_SCALE);
+    });
+    printf("%d channels: scalar %7.1f ns/buffer, %s %7.1f ns/buffer, %.1fx faster\n",
+           num_channels, scalar_nanos, implementation_name(), nanos, scalar_nanos / nanos);
+  }
+
+  return is_ok ? 0 : 1;
+}
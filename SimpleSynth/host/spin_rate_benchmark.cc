@@ -0,0 +1,131 @@
+/*
+ * Copyright 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * Checks that LoadStabilizer calibrates its spin rates without blocking or rebinding the thread
+ * which creates it, then reports how accurately generateLoad pads on each CPU.
+ *
+ *   spin-rate-benchmark
+ */
+
+#include <sched.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <algorithm>
+#include <vector>
+#include "audio_common.h"
+#include "load_stabilizer.h"
+
+#define FRAME_RATE 48000
+#define FRAMES_PER_BUFFER 192
+#define NUM_CHANNELS 2
+#define LOADS_PER_DURATION 50
+#define CALIBRATION_TIMEOUT_IN_MICROSECONDS 1000000
+
+// Largest median overshoot accepted, load generation can only stop between steps
+#define MAX_MEDIAN_ERROR_IN_NANOS 20000
+
+static const int64_t CALLBACK_PERIOD_NANOS =
+    (int64_t) FRAMES_PER_BUFFER * NANOS_IN_SECOND / FRAME_RATE;
+
+class SilentRenderer : public AudioRenderer {
+public:
+  int render(int num_samples, int16_t *audio_buffer) {
+    std::fill(audio_buffer, audio_buffer + num_samples, 0);
+    return num_samples;
+  }
+  int render(int num_samples, float *audio_buffer) {
+    std::fill(audio_buffer, audio_buffer + num_samples, 0.0f);
+    return num_samples;
+  }
+};
+
+static bool check(bool condition, const char *description) {
+  printf("%-56s %s\n", description, condition ? "ok" : "FAILED");
+  return condition;
+}
+
+/**
+ * Generate each load LOADS_PER_DURATION times on the current CPU and report the median and
+ * largest overshoot
+ */
+static bool measure_accuracy(LoadStabilizer *stabilizer, int cpu_id) {
+
+  const int64_t durations[] = { 20000, 200000, 2000000 };
+  bool is_ok = true;
+  printf("CPU %d, %.3f ops/ns\n", cpu_id, stabilizer->getCalibratedSpinRate(cpu_id));
+  for (int64_t duration : durations) {
+    std::vector<int64_t> errors;
+    for (int i = 0; i < LOADS_PER_DURATION; i++) {
+      int64_t start_time = get_time();
+      stabilizer->generateLoad(duration);
+      errors.push_back(get_time() - start_time - duration);
+    }
+    std::sort(errors.begin(), errors.end());
+    int64_t median = errors[errors.size() / 2];
+    printf("  %4lld us load: error median %5.2f us, max %7.2f us\n", (long long) duration / 1000,
+           median / 1000.0, errors.back() / 1000.0);
+    if (median > MAX_MEDIAN_ERROR_IN_NANOS) is_ok = false;
+  }
+  return is_ok;
+}
+
+int main() {
+
+  cpu_set_t original_cpu_set;
+  CPU_ZERO(&original_cpu_set);
+  if (sched_getaffinity(0, sizeof(cpu_set_t), &original_cpu_set) != 0) {
+    printf("Unable to read this thread's affinity\n");
+    return 1;
+  }
+
+  SilentRenderer renderer;
+  int64_t start_time = get_time();
+  LoadStabilizer stabilizer(&renderer, CALLBACK_PERIOD_NANOS, FRAMES_PER_BUFFER * NUM_CHANNELS);
+  int64_t constructed_time = get_time();
+
+  cpu_set_t cpu_set;
+  CPU_ZERO(&cpu_set);
+  sched_getaffinity(0, sizeof(cpu_set_t), &cpu_set);
+  bool is_ok = check(CPU_EQUAL(&cpu_set, &original_cpu_set),
+                     "constructing doesn't change the thread's affinity");
+
+  for (int i = 0; i < CALIBRATION_TIMEOUT_IN_MICROSECONDS / 1000 && !stabilizer.isCalibrated();
+       i++) {
+    usleep(1000);
+  }
+  int64_t calibrated_time = get_time();
+  is_ok &= check(stabilizer.isCalibrated(), "calibration finishes");
+  printf("constructor took %.2f ms, calibration finished after %.2f ms\n\n",
+         (constructed_time - start_time) / 1e6, (calibrated_time - start_time) / 1e6);
+
+  long num_cpus = sysconf(_SC_NPROCESSORS_CONF);
+  bool is_accurate = true;
+  for (int cpu_id = 0; cpu_id < num_cpus; cpu_id++) {
+    CPU_ZERO(&cpu_set);
+    CPU_SET(cpu_id, &cpu_set);
+    if (sched_setaffinity(0, sizeof(cpu_set_t), &cpu_set) != 0) {
+      printf("CPU %d: unable to run on it\n", cpu_id);
+      continue;
+    }
+    is_accurate &= measure_accuracy(&stabilizer, cpu_id);
+  }
+  sched_setaffinity(0, sizeof(cpu_set_t), &original_cpu_set);
+
+  printf("\n");
+  is_ok &= check(is_accurate, "median load error within 20 us on every CPU");
+  return is_ok ? 0 : 1;
+}
@@ -0,0 +1,162 @@
+/*
+ * Copyright 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * Hammers SpscQueue, then Synthesizer's control event queue while a fake callback thread
+ * renders. Build it with ThreadSanitizer to check for data races:
+ *
+ *   cmake -S host -B tsan-build -DCMAKE_CXX_FLAGS=-fsanitize=thread
+ *   cmake --build tsan-build && tsan-build/spsc-queue-stress
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <atomic>
+#include <thread>
+#include <vector>
+#include "spsc_queue.h"
+#include "synthesizer.h"
+
+#define NUM_ITEMS 1000000
+#define FRAME_RATE 48000
+#define FRAMES_PER_BUFFER 192
+#define NUM_CHANNELS 2
+#define NUM_CONTROL_THREADS 2
+#define EVENTS_PER_CONTROL_THREAD 20000
+
+struct Item {
+  uint32_t sequence;
+  uint32_t check;
+};
+
+static uint32_t check_value(uint32_t sequence) {
+  return sequence * 2654435761u;
+}
+
+/**
+ * Pass NUM_ITEMS through a small queue, so that it's full or empty much of the time and the
+ * indexes wrap many times. Every item must arrive once, in order and intact.
+ */
+static bool check_queue() {
+
+  static SpscQueue<Item, 8> queue;
+  std::atomic<int> errors(0);
+
+  std::thread producer([&]() {
+    for (uint32_t i = 0; i < NUM_ITEMS;) {
+      Item item = { i, check_value(i) };
+      if (queue.push(item)) {
+        i++;
+      } else {
+        std::this_thread::yield();
+      }
+    }
+  });
+
+  uint32_t expected = 0;
+  uint32_t peeks = 0;
+  while (expected < NUM_ITEMS) {
+    Item item;
+    if (expected % 3 == 0 && queue.peek(&item)) {
+      peeks++;
+      if (item.sequence != expected || item.check != check_value(expected)) errors++;
+    }
+    if (queue.pop(&item)) {
+      if (item.sequence != expected || item.check != check_value(expected)) errors++;
+      expected++;
+    } else {
+      std::this_thread::yield();
+    }
+  }
+  producer.join();
+
+  Item item;
+  if (queue.pop(&item) || queue.size() != 0) errors++;
+
+  printf("SpscQueue: %d items, %u peeks, %d errors\n", NUM_ITEMS, peeks, errors.load());
+  return errors == 0;
+}
+
+/**
+ * Send notes and parameter changes from several control threads while a callback thread
+ * renders, then release every note and check the synthesizer goes quiet
+ */
+static bool check_synthesizer() {
+
+  Synthesizer synth(NUM_CHANNELS, FRAME_RATE);
+  std::atomic<bool> is_rendering(true);
+  std::atomic<int> bad_renders(0);
+  std::vector<float> buffer(FRAMES_PER_BUFFER * NUM_CHANNELS);
+
+  std::thread callback([&]() {
+    while (is_rendering) {
+      int num_samples = (int) buffer.size();
+      if (synth.render(num_samples, buffer.data()) != num_samples) bad_renders++;
+      for (float sample : buffer) {
+        if (!std::isfinite(sample)) {
+          bad_renders++;
+          break;
+        }
+      }
+      usleep(200);
+    }
+  });
+
+  std::vector<std::thread> control_threads;
+  for (int t = 0; t < NUM_CONTROL_THREADS; t++) {
+    control_threads.push_back(std::thread([&synth, t]() {
+      for (int i = 0; i < EVENTS_PER_CONTROL_THREAD; i++) {
+        int note_id = t * 16 + i % 16;
+        switch (i % 6) {
+          case 0: synth.noteOn(note_id, 100 + i % 1000); break;
+          case 1: synth.setWaveFrequency(200 + i % 500); break;
+          case 2: synth.setVolume(i % MAXIMUM_AMPLITUDE_VALUE); break;
+          case 3: synth.setWaveform((Waveform) (i % WAVEFORM_COUNT)); break;
+          case 4: synth.setWorkCycles(i % 100); break;
+          case 5: synth.noteOff(note_id); break;
+        }
+        if (i % 16 == 0) usleep(100);
+      }
+    }));
+  }
+  for (std::thread &thread : control_threads) thread.join();
+
+  // The queue may have been full at times, dropping events. Let it drain before releasing every
+  // note, then let the release stages finish.
+  usleep(100000);
+  for (int note_id = 0; note_id < NUM_CONTROL_THREADS * 16; note_id++) synth.noteOff(note_id);
+  usleep(200000);
+  is_rendering = false;
+  callback.join();
+
+  int num_samples = (int) buffer.size();
+  synth.render(num_samples, buffer.data());
+  float peak = 0;
+  for (float sample : buffer) peak = fmaxf(peak, fabsf(sample));
+
+  printf("Synthesizer: %d bad renders, peak %f after every note was released\n",
+         bad_renders.load(), peak);
+  return bad_renders == 0 && peak == 0;
+}
+
+int main() {
+
+  bool is_ok = check_queue();
+  is_ok &= check_synthesizer();
+  printf("%s\n", is_ok ? "ok" : "FAILED");
+  return is_ok ? 0 : 1;
+}
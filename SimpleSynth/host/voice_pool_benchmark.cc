@@ -0,0 +1,125 @@
+/*
+ * Copyright 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * Checks VoicePool's note handling and measures how its render cost grows from 1 to 64 voices.
+ *
+ *   voice-pool-benchmark [frames per buffer]
+ *
+ * Build it with CMAKE_BUILD_TYPE=Release, the default build is unoptimized.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <vector>
+#include "voice_pool.h"
+
+#define FRAME_RATE 48000
+#define DEFAULT_FRAMES_PER_BUFFER 192
+#define BUFFERS_PER_RUN 5000
+#define RUNS 5
+
+static int64_t now_nanos() {
+  timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+// Render until every released voice has finished, or give up after a second
+static void render_until_idle(VoicePool &pool, float *buffer, int frames_per_buffer) {
+  for (int i = 0; i < FRAME_RATE / frames_per_buffer && pool.getActiveVoiceCount() > 0; i++) {
+    pool.render(frames_per_buffer, buffer);
+  }
+}
+
+static bool check(bool condition, const char *description) {
+  printf("%-56s %s\n", description, condition ? "ok" : "FAILED");
+  return condition;
+}
+
+static bool check_notes(int frames_per_buffer) {
+
+  std::vector<float> buffer(frames_per_buffer);
+  bool is_ok = true;
+
+  VoicePool pool(FRAME_RATE);
+  int voice = pool.noteOn(1, 440, 0.5f);
+  pool.render(frames_per_buffer, buffer.data());
+  int retriggered_voice = pool.noteOn(1, 440, 0.5f);
+  is_ok &= check(retriggered_voice == voice && pool.getActiveVoiceCount() == 1,
+                 "retriggered note stays on its voice");
+  pool.noteOff(1);
+  render_until_idle(pool, buffer.data(), frames_per_buffer);
+  is_ok &= check(pool.getActiveVoiceCount() == 0, "noteOff after retrigger releases the note");
+
+  for (int i = 0; i < MAX_VOICES; i++) pool.noteOn(i, 220 + i * 10, 0.01f);
+  is_ok &= check(pool.getActiveVoiceCount() == MAX_VOICES, "every voice can play at once");
+  pool.noteOff(5);
+  pool.render(frames_per_buffer, buffer.data());
+  int stolen_voice = pool.noteOn(MAX_VOICES, 1000, 0.01f);
+  is_ok &= check(stolen_voice == 5, "full pool steals the released voice");
+  int oldest_voice = pool.noteOn(MAX_VOICES + 1, 1000, 0.01f);
+  is_ok &= check(oldest_voice == 0, "full pool without releases steals the oldest voice");
+
+  pool.allNotesOff();
+  render_until_idle(pool, buffer.data(), frames_per_buffer);
+  is_ok &= check(pool.getActiveVoiceCount() == 0, "allNotesOff releases every voice");
+
+  return is_ok;
+}
+
+/**
+ * Best of RUNS, each rendering BUFFERS_PER_RUN buffers with num_voices sustained voices
+ */
+static double measure_nanos_per_buffer(int num_voices, int frames_per_buffer) {
+
+  std::vector<float> buffer(frames_per_buffer);
+  VoicePool pool(FRAME_RATE);
+  for (int i = 0; i < num_voices; i++) pool.noteOn(i, 110 + i * 37, 1.0f / MAX_VOICES);
+
+  double best = 1e30;
+  for (int run = 0; run < RUNS; run++) {
+    int64_t start = now_nanos();
+    for (int i = 0; i < BUFFERS_PER_RUN; i++) pool.render(frames_per_buffer, buffer.data());
+    double nanos = (double) (now_nanos() - start) / BUFFERS_PER_RUN;
+    if (nanos < best) best = nanos;
+  }
+  return best;
+}
+
+int main(int argc, char **argv) {
+
+  int frames_per_buffer = (argc > 1) ? atoi(argv[1]) : DEFAULT_FRAMES_PER_BUFFER;
+  if (frames_per_buffer <= 0 || frames_per_buffer > 4096) {
+    fprintf(stderr, "Frames per buffer must be between 1 and 4096\n");
+    return 1;
+  }
+
+  bool is_ok = check_notes(frames_per_buffer);
+
+  double buffer_nanos = 1e9 * frames_per_buffer / FRAME_RATE;
+  printf("\n%d frame buffers at %d Hz, %.0f us each\n", frames_per_buffer, FRAME_RATE,
+         buffer_nanos / 1000);
+  for (int num_voices = 1; num_voices <= MAX_VOICES; num_voices *= 2) {
+    double nanos = measure_nanos_per_buffer(num_voices, frames_per_buffer);
+    printf("%2d voices: %8.2f us/buffer %6.2f ns/voice/frame %5.2f%% of the buffer\n",
+           num_voices, nanos / 1000, nanos / num_voices / frames_per_buffer,
+           100 * nanos / buffer_nanos);
+  }
+
+  return is_ok ? 0 : 1;
+}
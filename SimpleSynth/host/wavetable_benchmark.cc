@@ -0,0 +1,137 @@
+/*
+ * Copyright 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * Checks the sine Wavetable against sin() and measures a table lookup against the per-frame
+ * sin() call the synthesizer used to make.
+ *
+ *   wavetable-benchmark
+ *
+ * Build it with CMAKE_BUILD_TYPE=Release, the default build is unoptimized.
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <time.h>
+#include "wavetable.h"
+
+#define FRAME_RATE 48000
+#define FRAMES_PER_BUFFER 192
+#define BUFFERS_PER_RUN 20000
+#define RUNS 5
+
+// Largest difference from sin() allowed for the interpolated sine table
+#define MAX_SINE_ERROR 1e-5
+
+static const double PHASE_UNITS_PER_CYCLE = 4294967296.0; // 2^32
+
+static int64_t now_nanos() {
+  timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+/**
+ * Best of RUNS, in nanoseconds per sample
+ */
+template <typename Render>
+static double measure(Render render) {
+  double best = 1e30;
+  for (int run = 0; run < RUNS; run++) {
+    int64_t start = now_nanos();
+    for (int i = 0; i < BUFFERS_PER_RUN; i++) render();
+    double nanos = (double) (now_nanos() - start) / BUFFERS_PER_RUN / FRAMES_PER_BUFFER;
+    if (nanos < best) best = nanos;
+  }
+  return best;
+}
+
+static bool check_sine() {
+
+  const double frequencies[] = { 20.0, 440.0, 1000.0 / 3, 5000.0, 19999.0 };
+  bool is_ok = true;
+
+  for (double frequency : frequencies) {
+    uint32_t phase_increment = Wavetable::frequencyToPhaseIncrement(frequency, FRAME_RATE);
+    const float *table = Wavetable::getTable(WAVEFORM_SINE, phase_increment);
+    uint32_t phase = 0;
+    double max_error = 0;
+    for (int i = 0; i < FRAME_RATE; i++) {
+      double exact = sin(2 * M_PI * (phase / PHASE_UNITS_PER_CYCLE));
+      max_error = fmax(max_error, fabs(Wavetable::lookup(table, phase) - exact));
+      phase += phase_increment;
+    }
+    printf("%8.1f Hz: max error %.2e from sin()\n", frequency, max_error);
+    if (max_error > MAX_SINE_ERROR) is_ok = false;
+  }
+
+  // Every table of every waveform needs its guard point and must stay within full scale
+  for (int waveform = 0; waveform < WAVEFORM_COUNT; waveform++) {
+    for (uint32_t phase_increment = 1; phase_increment != 0 && phase_increment <= (1u << 31);
+         phase_increment <<= 1) {
+      const float *table = Wavetable::getTable((Waveform) waveform, phase_increment);
+      if (table[WAVETABLE_SIZE] != table[0]) is_ok = false;
+      for (int n = 0; n <= WAVETABLE_SIZE; n++) {
+        if (fabsf(table[n]) > 1.0f) is_ok = false;
+      }
+    }
+  }
+
+  printf("%s\n\n", is_ok ? "ok" : "FAILED");
+  return is_ok;
+}
+
+int main() {
+
+  Wavetable::initialize();
+  bool is_ok = check_sine();
+
+  static float buffer[FRAMES_PER_BUFFER];
+  const double frequency = 440;
+
+  // The synthesizer's previous render loop: a double precision phase and one sin() per frame
+  double sin_phase = 0;
+  const double sin_phase_increment = 2 * M_PI * frequency / FRAME_RATE;
+  double sin_nanos = measure([&]() {
+    for (int i = 0; i < FRAMES_PER_BUFFER; i++) {
+      buffer[i] = (float) sin(sin_phase);
+      sin_phase += sin_phase_increment;
+      if (sin_phase > 2 * M_PI) sin_phase -= 2 * M_PI;
+    }
+  });
+  printf("sin()            %6.2f ns/sample\n", sin_nanos);
+
+  for (int waveform = 0; waveform < WAVEFORM_COUNT; waveform++) {
+    uint32_t phase = 0;
+    uint32_t phase_increment = Wavetable::frequencyToPhaseIncrement(frequency, FRAME_RATE);
+    const float *table = Wavetable::getTable((Waveform) waveform, phase_increment);
+    double nanos = measure([&]() {
+      for (int i = 0; i < FRAMES_PER_BUFFER; i++) {
+        buffer[i] = Wavetable::lookup(table, phase);
+        phase += phase_increment;
+      }
+    });
+    static const char *names[] = { "sine", "saw", "square", "triangle" };
+    printf("wavetable %-8s %6.2f ns/sample, %.1fx faster\n", names[waveform], nanos,
+           sin_nanos / nanos);
+  }
+
+  // Keep the compiler from discarding the rendered samples
+  volatile float sink = buffer[FRAMES_PER_BUFFER - 1];
+  (void) sink;
+
+  return is_ok ? 0 : 1;
+}
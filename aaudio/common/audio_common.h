@@ -19,6 +19,7 @@
 #define AAUDIO_AUDIO_COMMON_H
 
 #include <chrono>
+#include <sys/time.h>
 #include <aaudio/AAudio.h>
 
 // Time constants
@@ -14,13 +14,266 @@
  * limitations under the License.
  */
 
+#include <math.h>
+#include <algorithm>
 #include "AudioEffect.h"
+#include "float_vector.h"
 
-void AudioEffect::process(int16_t *inputBuffer, int32_t samplesPerFrame, int32_t numFrames) {
+// Frames processed at a time, on the stack of the audio thread
+constexpr int32_t kSegmentFrames = 256;
 
-  for (int i = 0; i < (numFrames * samplesPerFrame); i++){
+// Frames the interpolator reads before and after the read position
+constexpr int32_t kFramesBeforePosition = 1;
+constexpr int32_t kFramesAfterPosition = 2;
 
-    // DO SOMETHING MORE EXCITING HERE!
-    inputBuffer[i] = inputBuffer[i];
+// Each line is followed by a copy of its first frames, so the interpolator can read the frames
+// around any position without wrapping
+constexpr int32_t kGuardFrames = kFramesBeforePosition + kFramesAfterPosition;
+
+// Added to everything written to the lines so decaying echoes never become denormal, which is
+// very slow on some CPUs. It is far below the quietest 24 bit sample.
+constexpr float kAntiDenormal = 1e-20f;
+
+static const float kLaneIndexes[FLOAT_VECTOR_SIZE] = { 0, 1, 2, 3 };
+
+/**
+ * The first FLOAT_VECTOR_SIZE values of a linear ramp
+ */
+static inline FloatVector vector_ramp(float start, float step) {
+  return vector_add(vector_dup(start), vector_mul(vector_dup(step), vector_load(kLaneIndexes)));
+}
+
+/**
+ * Read consecutive frames at a fixed fractional delay
+ *
+ * @param source the frame before the first read position, followed by at least numFrames + 2
+ * more frames without wrapping
+ * @param fraction how far the read positions are past the frames they start from
+ */
+static void readTap(const float *source, float fraction, float *output, int32_t numFrames) {
+
+  // Catmull-Rom weights of the four frames around each position
+  float t = fraction;
+  float t2 = t * t;
+  float t3 = t2 * t;
+  float w0 = -0.5f * t3 + t2 - 0.5f * t;
+  float w1 = 1.5f * t3 - 2.5f * t2 + 1;
+  float w2 = -1.5f * t3 + 2 * t2 + 0.5f * t;
+  float w3 = 0.5f * t3 - 0.5f * t2;
+
+  FloatVector weight0 = vector_dup(w0);
+  FloatVector weight1 = vector_dup(w1);
+  FloatVector weight2 = vector_dup(w2);
+  FloatVector weight3 = vector_dup(w3);
+  int32_t frame = 0;
+  for (; frame + FLOAT_VECTOR_SIZE <= numFrames; frame += FLOAT_VECTOR_SIZE) {
+    const float *frames = source + frame;
+    FloatVector sum = vector_mul(vector_load(frames), weight0);
+    sum = vector_add(sum, vector_mul(vector_load(frames + 1), weight1));
+    sum = vector_add(sum, vector_mul(vector_load(frames + 2), weight2));
+    sum = vector_add(sum, vector_mul(vector_load(frames + 3), weight3));
+    vector_store(output + frame, sum);
+  }
+  for (; frame < numFrames; frame++) {
+    const float *frames = source + frame;
+    output[frame] = w0 * frames[0] + w1 * frames[1] + w2 * frames[2] + w3 * frames[3];
+  }
+}
+
+/**
+ * Fade from one tap to another, the fade ramping from start by step every frame
+ */
+static void crossfade(float *from, const float *to, float start, float step, int32_t numFrames) {
+
+  FloatVector fade = vector_ramp(start, step);
+  FloatVector fadeStep = vector_dup(step * FLOAT_VECTOR_SIZE);
+  int32_t frame = 0;
+  for (; frame + FLOAT_VECTOR_SIZE <= numFrames; frame += FLOAT_VECTOR_SIZE) {
+    FloatVector a = vector_load(from + frame);
+    FloatVector b = vector_load(to + frame);
+    vector_store(from + frame, vector_add(a, vector_mul(vector_sub(b, a), fade)));
+    fade = vector_add(fade, fadeStep);
+  }
+  for (; frame < numFrames; frame++) {
+    float fadeValue = start + step * frame;
+    from[frame] += (to[frame] - from[frame]) * fadeValue;
+  }
+}
+
+/**
+ * Write the input plus the fed back echoes into the line, and the mix of the input and the
+ * echoes to the output, which may be the input. The feedback and mix ramp by their steps every
+ * frame.
+ */
+static void feedbackAndMix(const float *input, float *output, const float *echoes, float *line,
+                           float feedback, float feedbackStep, float mix, float mixStep,
+                           int32_t numFrames) {
+
+  FloatVector feedbacks = vector_ramp(feedback, feedbackStep);
+  FloatVector feedbacksStep = vector_dup(feedbackStep * FLOAT_VECTOR_SIZE);
+  FloatVector mixes = vector_ramp(mix, mixStep);
+  FloatVector mixesStep = vector_dup(mixStep * FLOAT_VECTOR_SIZE);
+  FloatVector antiDenormal = vector_dup(kAntiDenormal);
+  int32_t frame = 0;
+  for (; frame + FLOAT_VECTOR_SIZE <= numFrames; frame += FLOAT_VECTOR_SIZE) {
+    FloatVector dry = vector_load(input + frame);
+    FloatVector wet = vector_load(echoes + frame);
+    FloatVector fedBack = vector_add(vector_add(dry, vector_mul(wet, feedbacks)), antiDenormal);
+    vector_store(line + frame, fedBack);
+    vector_store(output + frame, vector_add(dry, vector_mul(vector_sub(wet, dry), mixes)));
+    feedbacks = vector_add(feedbacks, feedbacksStep);
+    mixes = vector_add(mixes, mixesStep);
+  }
+  for (; frame < numFrames; frame++) {
+    float dry = input[frame];
+    float wet = echoes[frame];
+    line[frame] = dry + wet * (feedback + feedbackStep * frame) + kAntiDenormal;
+    output[frame] = dry + (wet - dry) * (mix + mixStep * frame);
+  }
+}
+
+void AudioEffect::configure(int32_t channelCount, int32_t sampleRate,
+                            int32_t maxFramesPerProcess) {
+
+  channelCount_ = std::max(1, std::min(channelCount, kAudioEffectMaxChannels));
+  sampleRate_ = sampleRate;
+  rampFrames_ = std::max(1.0, kAudioEffectRampMillis * sampleRate / 1000);
+
+  // Room for the longest delay, the frames around its read position and a segment being written
+  int64_t maxDelayFrames = static_cast<int64_t>(ceil(kAudioEffectMaxDelayMillis * sampleRate /
+                                                     1000));
+  int64_t framesNeeded = maxDelayFrames + kFramesBeforePosition + kFramesAfterPosition +
+                         kSegmentFrames;
+  lineCapacity_ = 1;
+  while (lineCapacity_ < framesNeeded) lineCapacity_ *= 2;
+  lines_.assign(channelCount_ * (lineCapacity_ + kGuardFrames), 0.0f);
+
+  writeIndex_ = 0;
+  delayFrames_ = getTargetDelayFrames();
+  isCrossfading_ = false;
+  crossfade_ = 0;
+  feedback_ = targetFeedback_.load();
+  mix_ = targetMix_.load();
+}
+
+void AudioEffect::setDelayMillis(double delayMillis) {
+  targetDelayMillis_.store(std::max(kAudioEffectMinDelayMillis,
+                                    std::min(delayMillis, kAudioEffectMaxDelayMillis)));
+}
+
+void AudioEffect::setDelayBeats(double beats, double beatsPerMinute) {
+  if (beatsPerMinute > 0) setDelayMillis(beats * 60000 / beatsPerMinute);
+}
+
+void AudioEffect::setFeedback(float feedback) {
+  targetFeedback_.store(std::max(0.0f, std::min(feedback, kAudioEffectMaxFeedback)));
+}
+
+void AudioEffect::setMix(float mix) {
+  targetMix_.store(std::max(0.0f, std::min(mix, 1.0f)));
+}
+
+void AudioEffect::process(const float *const *input, float *const *output, int32_t numFrames) {
+
+  const int64_t mask = lineCapacity_ - 1;
+  int32_t offset = 0;
+  while (offset < numFrames) {
+
+    // A delay set during a crossfade waits for it to finish, only the latest one is faded to
+    if (!isCrossfading_) {
+      double targetDelayFrames = getTargetDelayFrames();
+      if (targetDelayFrames != delayFrames_) {
+        nextDelayFrames_ = targetDelayFrames;
+        isCrossfading_ = true;
+        crossfade_ = 0;
+      }
+    }
+
+    // Split where the writes wrap, and so crossfades end at the end of a segment
+    int32_t segmentFrames = std::min(numFrames - offset, kSegmentFrames);
+    segmentFrames = std::min(segmentFrames, getMaxSegmentFrames(delayFrames_));
+    segmentFrames = static_cast<int32_t>(
+        std::min<int64_t>(segmentFrames, lineCapacity_ - (writeIndex_ & mask)));
+    if (isCrossfading_) {
+      segmentFrames = std::min(segmentFrames, getMaxSegmentFrames(nextDelayFrames_));
+      int32_t crossfadeFrames = static_cast<int32_t>(ceil((1 - crossfade_) * rampFrames_));
+      segmentFrames = std::min(segmentFrames, std::max(1, crossfadeFrames));
+    }
+
+    processSegment(input, output, offset, segmentFrames);
+    offset += segmentFrames;
+  }
+}
+
+double AudioEffect::getTargetDelayFrames() const {
+  double delayFrames = targetDelayMillis_.load(std::memory_order_relaxed) * sampleRate_ / 1000;
+  return std::max(delayFrames, static_cast<double>(kFramesBeforePosition +
+                                                   kFramesAfterPosition + 1));
+}
+
+/**
+ * The most frames which can be read at a delay in one go. Every frame the interpolator reads must
+ * have been written before the segment starts, and the frames read mustn't wrap.
+ */
+int32_t AudioEffect::getMaxSegmentFrames(double delayFrames) const {
+
+  int64_t index = static_cast<int64_t>(floor(writeIndex_ - delayFrames));
+  int64_t writtenFrames = writeIndex_ - index - kFramesAfterPosition;
+  int64_t firstFrame = (index - kFramesBeforePosition) & (lineCapacity_ - 1);
+  int64_t unwrappedFrames = lineCapacity_ + kGuardFrames - firstFrame - kFramesBeforePosition -
+                            kFramesAfterPosition;
+  return static_cast<int32_t>(std::min(writtenFrames, unwrappedFrames));
+}
+
+void AudioEffect::processSegment(const float *const *input, float *const *output,
+                                 int32_t offset, int32_t numFrames) {
+
+  const int64_t mask = lineCapacity_ - 1;
+  double position = writeIndex_ - delayFrames_;
+  int64_t index = static_cast<int64_t>(floor(position));
+  float fraction = static_cast<float>(position - index);
+  double nextPosition = writeIndex_ - nextDelayFrames_;
+  int64_t nextIndex = static_cast<int64_t>(floor(nextPosition));
+  float nextFraction = static_cast<float>(nextPosition - nextIndex);
+
+  // Move each parameter towards its target no faster than the ramp allows
+  float maxChange = static_cast<float>(numFrames / rampFrames_);
+  float targetFeedback = targetFeedback_.load(std::memory_order_relaxed);
+  float targetMix = targetMix_.load(std::memory_order_relaxed);
+  float feedbackEnd = feedback_ + std::max(-maxChange,
+                                           std::min(targetFeedback - feedback_, maxChange));
+  float mixEnd = mix_ + std::max(-maxChange, std::min(targetMix - mix_, maxChange));
+  double crossfadeEnd = std::min(1.0, crossfade_ + numFrames / rampFrames_);
+
+  float echoes[kSegmentFrames];
+  float nextEchoes[kSegmentFrames];
+  for (int32_t channel = 0; channel < channelCount_; channel++) {
+    float *line = &lines_[channel * (lineCapacity_ + kGuardFrames)];
+    readTap(line + ((index - kFramesBeforePosition) & mask), fraction, echoes, numFrames);
+    if (isCrossfading_) {
+      readTap(line + ((nextIndex - kFramesBeforePosition) & mask), nextFraction, nextEchoes,
+              numFrames);
+      crossfade(echoes, nextEchoes, static_cast<float>(crossfade_),
+                static_cast<float>((crossfadeEnd - crossfade_) / numFrames), numFrames);
+    }
+    feedbackAndMix(input[channel] + offset, output[channel] + offset, echoes,
+                   line + (writeIndex_ & mask), feedback_, (feedbackEnd - feedback_) / numFrames,
+                   mix_, (mixEnd - mix_) / numFrames, numFrames);
+    for (int64_t i = writeIndex_ & mask; i < kGuardFrames && i < (writeIndex_ & mask) + numFrames;
+         i++) {
+      line[lineCapacity_ + i] = line[i];
+    }
+  }
+
+  writeIndex_ += numFrames;
+  feedback_ = feedbackEnd;
+  mix_ = mixEnd;
+  if (isCrossfading_) {
+    crossfade_ = crossfadeEnd;
+    if (crossfade_ >= 1) {
+      delayFrames_ = nextDelayFrames_;
+      isCrossfading_ = false;
+      crossfade_ = 0;
+    }
   }
 }
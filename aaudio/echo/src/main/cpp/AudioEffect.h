@@ -17,13 +17,94 @@
 #ifndef AAUDIO_EFFECT_PROCESSOR_H
 #define AAUDIO_EFFECT_PROCESSOR_H
 
+#include <stdint.h>
+#include <atomic>
+#include <vector>
+#include "AudioProcessor.h"
 
-#include <cstdint>
+constexpr int32_t kAudioEffectMaxChannels = 2;
+constexpr double kAudioEffectMinDelayMillis = 1;
+constexpr double kAudioEffectMaxDelayMillis = 2000;
+constexpr float kAudioEffectMaxFeedback = 0.95f;
 
-class AudioEffect {
+// Feedback and mix changes ramp, and delay changes crossfade, over this long
+constexpr double kAudioEffectRampMillis = 20;
+
+constexpr double kAudioEffectDefaultDelayMillis = 250;
+constexpr float kAudioEffectDefaultFeedback = 0.35f;
+constexpr float kAudioEffectDefaultMix = 0.3f;
+
+/**
+ * A feedback delay, the echo the sample is named after, applied to each channel of a planar
+ * float bus.
+ *
+ * Each channel has a power of two circular delay line, allocated by configure and indexed by
+ * masking an absolute frame count. The line is read at a fractional delay using 4 point cubic
+ * interpolation, so tempo synced delays needn't be a whole number of frames. What is read is fed
+ * back into the line and mixed with the dry input.
+ *
+ * Parameters may be set on any thread and change without clicks. The feedback and mix ramp to
+ * their new values over kAudioEffectRampMillis. A new delay crossfades from the old read position
+ * to the new one over the same time, rather than sliding the read position, which would bend the
+ * pitch of everything in the line.
+ *
+ * process is called on the audio thread. configure must not be called at the same time as
+ * process.
+ */
+class AudioEffect : public AudioProcessor {
 public:
-  void process(int16_t *inputBuffer, int32_t samplesPerFrame, int32_t numFrames);
-};
+  /**
+   * Allocate and clear the delay lines and jump to the current parameters
+   */
+  void configure(int32_t channelCount, int32_t sampleRate, int32_t maxFramesPerProcess) override;
+
+  void setDelayMillis(double delayMillis);
 
+  /**
+   * Set the delay to a number of beats, which needn't be whole, at a tempo
+   */
+  void setDelayBeats(double beats, double beatsPerMinute);
+
+  /**
+   * @param feedback how much of each echo is repeated, up to kAudioEffectMaxFeedback
+   */
+  void setFeedback(float feedback);
+
+  /**
+   * @param mix 0 for only the input, 1 for only the echoes
+   */
+  void setMix(float mix);
+
+  /**
+   * @param input one buffer of numFrames frames for each of configure's channels
+   * @param output the same as input or other buffers
+   */
+  void process(const float *const *input, float *const *output, int32_t numFrames) override;
+
+private:
+  // Set on any thread
+  std::atomic<double> targetDelayMillis_ { kAudioEffectDefaultDelayMillis };
+  std::atomic<float> targetFeedback_ { kAudioEffectDefaultFeedback };
+  std::atomic<float> targetMix_ { kAudioEffectDefaultMix };
+
+  // Only used by the audio thread
+  int32_t channelCount_ = 0;
+  int32_t sampleRate_ = 48000;
+  double rampFrames_ = 1;
+  int64_t lineCapacity_ = 0;
+  std::vector<float> lines_;          // channelCount_ lines of lineCapacity_ frames and a guard
+  int64_t writeIndex_ = 0;            // Absolute index of the next frame written to the lines
+  double delayFrames_ = 0;
+  double nextDelayFrames_ = 0;        // The delay being crossfaded to
+  bool isCrossfading_ = false;
+  double crossfade_ = 0;              // From 0 at the old delay to 1 at the next one
+  float feedback_ = 0;
+  float mix_ = 0;
+
+  double getTargetDelayFrames() const;
+  int32_t getMaxSegmentFrames(double delayFrames) const;
+  void processSegment(const float *const *input, float *const *output, int32_t offset,
+                      int32_t numFrames);
+};
 
 #endif //AAUDIO_EFFECT_PROCESSOR_H
@@ -0,0 +1,52 @@
+/*
+ * Copyright 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef AAUDIO_AUDIOPROCESSOR_H
+#define AAUDIO_AUDIOPROCESSOR_H
+
+#include <stdint.h>
+
+/**
+ * A stage of an EffectChain, processing a planar float bus with a buffer per channel.
+ *
+ * configure is called off the audio thread, before the processor is added to a running chain or
+ * when the streams are opened, and is where any memory is allocated. process is called on the
+ * audio thread and must not block or allocate.
+ */
+class AudioProcessor {
+public:
+  virtual ~AudioProcessor() = default;
+
+  /**
+   * @param maxFramesPerProcess the most frames process will be given, a burst
+   */
+  virtual void configure(int32_t channelCount, int32_t sampleRate,
+                         int32_t maxFramesPerProcess) = 0;
+
+  /**
+   * @param input one buffer of numFrames frames for each channel
+   * @param output the same as input if canProcessInPlace, otherwise different buffers
+   */
+  virtual void process(const float *const *input, float *const *output, int32_t numFrames) = 0;
+
+  /**
+   * Whether process can write its output over its input. If not the chain gives it a scratch
+   * bus to write to.
+   */
+  virtual bool canProcessInPlace() const { return true; }
+};
+
+#endif //AAUDIO_AUDIOPROCESSOR_H
@@ -0,0 +1,84 @@
+/*
+ * Copyright 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <algorithm>
+#include "AudioRingBuffer.h"
+
+static int32_t roundUpToPowerOfTwo(int32_t value) {
+  int32_t result = 1;
+  while (result < value) result *= 2;
+  return result;
+}
+
+AudioRingBuffer::AudioRingBuffer(int32_t capacityInFrames) :
+    capacity_(roundUpToPowerOfTwo(capacityInFrames)),
+    mask_(capacity_ - 1),
+    frames_(capacity_) {
+}
+
+void AudioRingBuffer::reset() {
+  writeIndex_.store(0);
+  readIndex_.store(0);
+  droppedFrames_.store(0);
+  writeTimeCount_.store(0);
+}
+
+int32_t AudioRingBuffer::write(const float *frames, int32_t numFrames) {
+
+  int64_t writeIndex = writeIndex_.load(std::memory_order_relaxed);
+  int64_t space = capacity_ - (writeIndex - readIndex_.load(std::memory_order_acquire));
+  int32_t framesToWrite = static_cast<int32_t>(std::min<int64_t>(numFrames, space));
+
+  for (int32_t i = 0; i < framesToWrite; i++) {
+    frames_[(writeIndex + i) & mask_] = frames[i];
+  }
+  writeIndex_.store(writeIndex + framesToWrite, std::memory_order_release);
+
+  // Only the producer writes the count so it doesn't need a read-modify-write
+  if (framesToWrite < numFrames) {
+    int64_t dropped = droppedFrames_.load(std::memory_order_relaxed);
+    droppedFrames_.store(dropped + numFrames - framesToWrite, std::memory_order_relaxed);
+  }
+  return framesToWrite;
+}
+
+void AudioRingBuffer::setWriteTime(int64_t timeNanos) {
+
+  int64_t count = writeTimeCount_.load(std::memory_order_relaxed);
+
+  // A consumer which sees these stores will also see the count from the previous call, so it
+  // can tell its slot is being overwritten
+  std::atomic_thread_fence(std::memory_order_release);
+  WriteTime &slot = writeTimes_[count & 1];
+  slot.writeIndex.store(writeIndex_.load(std::memory_order_relaxed), std::memory_order_relaxed);
+  slot.timeNanos.store(timeNanos, std::memory_order_relaxed);
+  writeTimeCount_.store(count + 1, std::memory_order_release);
+}
+
+bool AudioRingBuffer::getWriteTime(int64_t *writeIndex, int64_t *timeNanos) const {
+
+  // Only retries if the producer made another call in the meantime, so it never waits on it
+  while (true) {
+    int64_t count = writeTimeCount_.load(std::memory_order_acquire);
+    if (count == 0) return false;
+
+    const WriteTime &slot = writeTimes_[(count - 1) & 1];
+    *writeIndex = slot.writeIndex.load(std::memory_order_relaxed);
+    *timeNanos = slot.timeNanos.load(std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (writeTimeCount_.load(std::memory_order_relaxed) == count) return true;
+  }
+}
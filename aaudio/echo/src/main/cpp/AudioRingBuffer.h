@@ -0,0 +1,90 @@
+/*
+ * Copyright 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef AAUDIO_AUDIORINGBUFFER_H
+#define AAUDIO_AUDIORINGBUFFER_H
+
+#include <stdint.h>
+#include <atomic>
+#include <vector>
+
+/**
+ * A lock-free single producer, single consumer ring of mono float frames.
+ *
+ * Frames are addressed by absolute 64-bit indexes. The producer appends at the write index and
+ * the consumer reads any frame between the read index and the write index, then moves the read
+ * index on to release frames it no longer needs. Frames which don't fit when the ring is full
+ * are dropped and counted.
+ *
+ * The producer can also stamp the write index with the time it got there, which lets the
+ * consumer estimate how many frames the producer has received since, see setWriteTime.
+ */
+class AudioRingBuffer {
+
+public:
+  /**
+   * @param capacityInFrames rounded up to a power of two
+   */
+  explicit AudioRingBuffer(int32_t capacityInFrames);
+
+  /**
+   * Empty the ring. Must not be called while either end is in use.
+   */
+  void reset();
+
+  // Producer
+  int32_t write(const float *frames, int32_t numFrames);
+
+  /**
+   * Record that the producer had received all the frames written so far by timeNanos
+   */
+  void setWriteTime(int64_t timeNanos);
+
+  // Consumer
+  int64_t getWriteIndex() const { return writeIndex_.load(std::memory_order_acquire); }
+  int64_t getReadIndex() const { return readIndex_.load(std::memory_order_relaxed); }
+  float getFrame(int64_t index) const { return frames_[index & mask_]; }
+  void setReadIndex(int64_t index) { readIndex_.store(index, std::memory_order_release); }
+
+  /**
+   * Get the write index and time from the last call to setWriteTime
+   *
+   * @return false if setWriteTime hasn't been called since the ring was reset
+   */
+  bool getWriteTime(int64_t *writeIndex, int64_t *timeNanos) const;
+
+  int32_t getCapacityInFrames() const { return capacity_; }
+  int64_t getDroppedFrameCount() const { return droppedFrames_.load(std::memory_order_relaxed); }
+
+private:
+  const int32_t capacity_;
+  const int64_t mask_;
+  std::vector<float> frames_;
+  std::atomic<int64_t> writeIndex_ { 0 };
+  std::atomic<int64_t> readIndex_ { 0 };
+  std::atomic<int64_t> droppedFrames_ { 0 };
+
+  // setWriteTime alternates between two slots and then publishes the count of calls, so the
+  // consumer can read the newest slot while the producer fills the other one
+  struct WriteTime {
+    std::atomic<int64_t> writeIndex { 0 };
+    std::atomic<int64_t> timeNanos { 0 };
+  };
+  WriteTime writeTimes_[2];
+  std::atomic<int64_t> writeTimeCount_ { 0 };
+};
+
+#endif //AAUDIO_AUDIORINGBUFFER_H
@@ -0,0 +1,323 @@
+/*
+ * Copyright 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+#include "ConvolutionReverb.h"
+
+// A transform costs about as much as this many multiply-adds of a partition of the same size
+// for each doubling of its size, as measured with RealFft
+constexpr double kTransformCostPerOctave = 1;
+
+/**
+ * Work per frame of a segment, in complex multiply-adds. Each partition is one per frame,
+ * whatever its size, and so is each transform per octave.
+ */
+static double getSegmentCost(int32_t partitionCount, int32_t blockFrames) {
+  return partitionCount + 2 * kTransformCostPerOctave * log2(2.0 * blockFrames);
+}
+
+ConvolutionReverb::ConvolutionReverb(std::shared_ptr<const ImpulseResponse> response) :
+    response_(std::move(response)) {
+}
+
+/**
+ * Size the segment and transform its partitions of the response, from offset on
+ */
+void ConvolutionReverb::Segment::allocate(int32_t blockFrames, int32_t partitionCount,
+                                          int32_t channelCount,
+                                          const std::vector<std::vector<float>> &response,
+                                          int32_t offset) {
+
+  this->blockFrames = blockFrames;
+  this->partitionCount = partitionCount;
+  ffts.clear();
+  for (int32_t channel = 0; channel < channelCount; channel++) {
+    ffts.emplace_back(new RealFft(2 * blockFrames));
+  }
+  stride = ffts[0]->getSpectrumStride();
+  spectrum.assign(2 * stride, 0.0f);
+  frames.assign(2 * blockFrames, 0.0f);
+
+  // Each partition is in the first half of its window, so the second half of the circular
+  // convolution is the linear convolution. The inverse transform's scale is taken out here.
+  const float scale = 1.0f / (2 * blockFrames);
+  partitions.assign(response.size() * partitionCount * 2 * stride, 0.0f);
+  for (int32_t channel = 0; channel < static_cast<int32_t>(response.size()); channel++) {
+    const std::vector<float> &channelFrames = response[channel];
+    for (int32_t index = 0; index < partitionCount; index++) {
+      std::fill(frames.begin(), frames.end(), 0.0f);
+      int32_t first = offset + index * blockFrames;
+      int32_t end = std::min(first + blockFrames, static_cast<int32_t>(channelFrames.size()));
+      for (int32_t i = first; i < end; i++) frames[i - first] = channelFrames[i] * scale;
+      float *partition = getPartition(channel, index);
+      ffts[0]->forward(frames.data(), partition, partition + stride);
+    }
+  }
+
+  inputSpectra.assign(channelCount * partitionCount * 2 * stride, 0.0f);
+  sums.assign(channelCount * 2 * stride, 0.0f);
+  windows.assign(channelCount * 2 * blockFrames, 0.0f);
+  newest = 0;
+}
+
+float *ConvolutionReverb::Segment::getPartition(int32_t channel, int32_t index) {
+  return &partitions[(channel * partitionCount + index) * 2 * stride];
+}
+
+float *ConvolutionReverb::Segment::getInputSpectrum(int32_t channel, int32_t index) {
+  return &inputSpectra[(channel * partitionCount + index) * 2 * stride];
+}
+
+float *ConvolutionReverb::Segment::getSum(int32_t channel) {
+  return &sums[channel * 2 * stride];
+}
+
+float *ConvolutionReverb::Segment::getWindow(int32_t channel) {
+  return &windows[channel * 2 * blockFrames];
+}
+
+/**
+ * Add partitions [first, end) multiplied by the spectra of the blocks they apply to, where the
+ * newest block is multiplied by partition newestPartition
+ */
+void ConvolutionReverb::Segment::addPartitions(int32_t channel, int32_t responseChannel,
+                                               int32_t first, int32_t end,
+                                               int32_t newestPartition) {
+  float *sum = getSum(channel);
+  for (int32_t index = first; index < end; index++) {
+    int32_t block = (newest - (index - newestPartition) + partitionCount) % partitionCount;
+    const float *input = getInputSpectrum(channel, block);
+    const float *partition = getPartition(responseChannel, index);
+    complex_multiply_add(input, input + stride, partition, partition + stride, sum, sum + stride,
+                         sum, sum + stride, stride);
+  }
+}
+
+void ConvolutionReverb::configure(int32_t channelCount, int32_t sampleRate,
+                                  int32_t maxFramesPerProcess) {
+
+  channelCount_ = std::max(1, std::min(channelCount, kConvolutionReverbMaxChannels));
+  responseChannelCount_ = std::min(response_->getChannelCount(), channelCount_);
+  std::vector<std::vector<float>> response;
+  for (int32_t channel = 0; channel < responseChannelCount_; channel++) {
+    response.push_back(response_->resample(channel, sampleRate));
+  }
+  const int32_t length = static_cast<int32_t>(response[0].size());
+  const int32_t burstFrames = std::max(1, maxFramesPerProcess);
+
+  const int32_t uniformPartitionCount = std::max(1, (length + burstFrames - 1) / burstFrames);
+  double leastCost = getSegmentCost(uniformPartitionCount, burstFrames);
+  tailBursts_ = 0;
+  for (int32_t bursts = 2; bursts <= kConvolutionReverbMaxTailBursts; bursts *= 2) {
+    int32_t headFrames = 2 * bursts * burstFrames;
+    if (headFrames >= length) break;
+    int32_t tailBlockFrames = bursts * burstFrames;
+    int32_t tailPartitionCount = (length - headFrames + tailBlockFrames - 1) / tailBlockFrames;
+    double cost = getSegmentCost(2 * bursts, burstFrames) +
+                  getSegmentCost(tailPartitionCount, tailBlockFrames);
+    if (cost < leastCost) {
+      leastCost = cost;
+      tailBursts_ = bursts;
+    }
+  }
+
+  if (tailBursts_ == 0) {
+    head_.allocate(burstFrames, uniformPartitionCount, channelCount_, response, 0);
+    tail_ = Segment();
+  } else {
+    int32_t headFrames = 2 * tailBursts_ * burstFrames;
+    int32_t tailBlockFrames = tailBursts_ * burstFrames;
+    head_.allocate(burstFrames, 2 * tailBursts_, channelCount_, response, 0);
+    tail_.allocate(tailBlockFrames, (length - headFrames + tailBlockFrames - 1) / tailBlockFrames,
+                   channelCount_, response, headFrames);
+  }
+
+  // Share the tail's tasks out between the steps so each does about as much work
+  tailStepEnds_.clear();
+  if (tailBursts_ > 0) {
+    tailPassCount_ = tail_.ffts[0]->getPassCount();
+    double passCost = kTransformCostPerOctave * log2(2.0 * tail_.blockFrames) / tailPassCount_;
+    int32_t taskCount = 2 * tailPassCount_ + tail_.partitionCount;
+    double work = 2 * tailPassCount_ * passCost + tail_.partitionCount;
+    double taskEndWork = 0;
+    for (int32_t task = 0; task < taskCount; task++) {
+      bool isPass = task < tailPassCount_ || task >= tailPassCount_ + tail_.partitionCount;
+      taskEndWork += isPass ? passCost : 1;
+      while (static_cast<int32_t>(tailStepEnds_.size()) < tailBursts_ &&
+             taskEndWork > work * (tailStepEnds_.size() + 1) / tailBursts_ + 1e-9) {
+        tailStepEnds_.push_back(task);
+      }
+    }
+    tailStepEnds_.resize(tailBursts_, taskCount);
+  }
+  tailWork_.assign(channelCount_ * 2 * tail_.blockFrames, 0.0f);
+  tailOutput_.assign(channelCount_ * 2 * tail_.blockFrames, 0.0f);
+
+  headFill_ = 0;
+  tailFill_ = 0;
+  isTailWorking_ = false;
+  tailPlaying_ = 0;
+  mixStep_ = static_cast<float>(1000 / (kConvolutionReverbRampMillis * sampleRate));
+  mix_ = targetMix_.load();
+}
+
+void ConvolutionReverb::setMix(float mix) {
+  targetMix_.store(std::max(0.0f, std::min(mix, 1.0f)));
+}
+
+void ConvolutionReverb::process(const float *const *input, float *const *output,
+                                int32_t numFrames) {
+
+  if (channelCount_ == 0) return;
+
+  // Segments end where bursts do
+  int32_t offset = 0;
+  while (offset < numFrames) {
+    int32_t segmentFrames = std::min(numFrames - offset, head_.blockFrames - headFill_);
+    processSegment(input, output, offset, segmentFrames);
+    offset += segmentFrames;
+  }
+}
+
+void ConvolutionReverb::processSegment(const float *const *input, float *const *output,
+                                       int32_t offset, int32_t numFrames) {
+
+  const int32_t burstFrames = head_.blockFrames;
+  const int32_t stride = head_.stride;
+  float targetMix = targetMix_.load(std::memory_order_relaxed);
+  float maxChange = mixStep_ * numFrames;
+  float mixEnd = mix_ + std::max(-maxChange, std::min(targetMix - mix_, maxChange));
+  float mixIncrement = (mixEnd - mix_) / numFrames;
+
+  for (int32_t channel = 0; channel < channelCount_; channel++) {
+    const float *in = input[channel] + offset;
+    float *out = output[channel] + offset;
+    int32_t responseChannel = std::min(channel, responseChannelCount_ - 1);
+
+    memcpy(head_.getWindow(channel) + burstFrames + headFill_, in, numFrames * sizeof(float));
+    if (tailBursts_ > 0) {
+      memcpy(tail_.getWindow(channel) + tail_.blockFrames + tailFill_, in,
+             numFrames * sizeof(float));
+    }
+
+    // The burst so far, with zeros for the frames still to come
+    float *spectrum = head_.getInputSpectrum(channel, head_.newest);
+    RealFft *fft = head_.ffts[channel].get();
+    fft->forward(head_.getWindow(channel), spectrum, spectrum + stride);
+    const float *partition = head_.getPartition(responseChannel, 0);
+    const float *sum = head_.getSum(channel);
+    float *result = head_.spectrum.data();
+    complex_multiply_add(spectrum, spectrum + stride, partition, partition + stride, sum,
+                         sum + stride, result, result + stride, stride);
+    fft->inverse(result, result + stride, head_.frames.data());
+
+    const float *wet = head_.frames.data() + burstFrames + headFill_;
+    const float *tailWet = (tailBursts_ > 0) ?
+        &tailOutput_[(channel * 2 + tailPlaying_) * tail_.blockFrames + tailFill_] : nullptr;
+    float mix = mix_;
+    for (int32_t i = 0; i < numFrames; i++) {
+      float dry = in[i];
+      float reverb = wet[i] + (tailWet != nullptr ? tailWet[i] : 0.0f);
+      mix += mixIncrement;
+      out[i] = dry + (reverb - dry) * mix;
+    }
+  }
+
+  mix_ = mixEnd;
+  headFill_ += numFrames;
+  if (tailBursts_ > 0) tailFill_ += numFrames;
+  if (headFill_ == burstFrames) completeBurst();
+}
+
+/**
+ * Sum the earlier bursts' share of the next burst's output, and move the tail on a step
+ */
+void ConvolutionReverb::completeBurst() {
+
+  const int32_t burstFrames = head_.blockFrames;
+  for (int32_t channel = 0; channel < channelCount_; channel++) {
+    int32_t responseChannel = std::min(channel, responseChannelCount_ - 1);
+    float *sum = head_.getSum(channel);
+    std::fill(sum, sum + 2 * head_.stride, 0.0f);
+    head_.addPartitions(channel, responseChannel, 1, head_.partitionCount, 1);
+
+    float *window = head_.getWindow(channel);
+    memcpy(window, window + burstFrames, burstFrames * sizeof(float));
+    std::fill(window + burstFrames, window + 2 * burstFrames, 0.0f);
+  }
+  head_.newest = (head_.newest + 1) % head_.partitionCount;
+  headFill_ = 0;
+
+  if (tailBursts_ == 0) return;
+  if (isTailWorking_) stepTail(tailFill_ / burstFrames);
+
+  // The block just finished is convolved over the next tailBursts_ bursts, and the one before,
+  // finished by the last step, starts playing
+  const int32_t blockFrames = tail_.blockFrames;
+  if (tailFill_ == blockFrames) {
+    for (int32_t channel = 0; channel < channelCount_; channel++) {
+      float *window = tail_.getWindow(channel);
+      memcpy(&tailWork_[channel * 2 * blockFrames], window, 2 * blockFrames * sizeof(float));
+      memcpy(window, window + blockFrames, blockFrames * sizeof(float));
+      std::fill(window + blockFrames, window + 2 * blockFrames, 0.0f);
+    }
+    tailPlaying_ ^= 1;
+    tailFill_ = 0;
+    isTailWorking_ = true;
+  }
+}
+
+/**
+ * One of the tailBursts_ steps convolving a block of the tail, numbered from 1. The tasks are
+ * the passes of the block's transform, the multiply-add of each partition, then the passes of
+ * the inverse transform of the sum into the block which plays next.
+ */
+void ConvolutionReverb::stepTail(int32_t step) {
+
+  const int32_t blockFrames = tail_.blockFrames;
+  const int32_t stride = tail_.stride;
+  const int32_t first = (step == 1) ? 0 : tailStepEnds_[step - 2];
+  const int32_t end = tailStepEnds_[step - 1];
+  const int32_t firstInversePass = tailPassCount_ + tail_.partitionCount;
+
+  for (int32_t channel = 0; channel < channelCount_; channel++) {
+    int32_t responseChannel = std::min(channel, responseChannelCount_ - 1);
+    RealFft *fft = tail_.ffts[channel].get();
+    float *spectrum = tail_.getInputSpectrum(channel, tail_.newest);
+    float *sum = tail_.getSum(channel);
+
+    for (int32_t task = first; task < std::min(end, tailPassCount_); task++) {
+      fft->forwardPass(&tailWork_[channel * 2 * blockFrames], spectrum, spectrum + stride, task);
+    }
+    if (first == 0) std::fill(sum, sum + 2 * stride, 0.0f);
+    int32_t firstPartition = std::max(first, tailPassCount_) - tailPassCount_;
+    int32_t endPartition = std::min(end, firstInversePass) - tailPassCount_;
+    if (firstPartition < endPartition) {
+      tail_.addPartitions(channel, responseChannel, firstPartition, endPartition, 0);
+    }
+    for (int32_t task = std::max(first, firstInversePass); task < end; task++) {
+      fft->inversePass(sum, sum + stride, tail_.frames.data(), task - firstInversePass);
+    }
+    if (step == tailBursts_) {
+      memcpy(&tailOutput_[(channel * 2 + (tailPlaying_ ^ 1)) * blockFrames],
+             tail_.frames.data() + blockFrames, blockFrames * sizeof(float));
+    }
+  }
+  if (step == tailBursts_) tail_.newest = (tail_.newest + 1) % tail_.partitionCount;
+}
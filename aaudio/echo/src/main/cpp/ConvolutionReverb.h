@@ -0,0 +1,143 @@
+/*
+ * Copyright 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef AAUDIO_CONVOLUTIONREVERB_H
+#define AAUDIO_CONVOLUTIONREVERB_H
+
+#include <stdint.h>
+#include <atomic>
+#include <memory>
+#include <vector>
+#include "AudioProcessor.h"
+#include "ImpulseResponse.h"
+#include "real_fft.h"
+
+constexpr int32_t kConvolutionReverbMaxChannels = 2;
+constexpr float kConvolutionReverbDefaultMix = 0.3f;
+
+// Mix changes ramp over this long
+constexpr double kConvolutionReverbRampMillis = 20;
+
+// Most bursts of input the tail works on at once
+constexpr int32_t kConvolutionReverbMaxTailBursts = 64;
+
+/**
+ * Convolves each channel of a planar float bus with an ImpulseResponse, by partitioned
+ * overlap-save FFT convolution, without adding any latency.
+ *
+ * The response is cut into a head and a tail, and each is cut into equal partitions. The head's
+ * partitions are as long as a burst, the most frames process is given. Each call transforms the
+ * burst so far together with the one before, multiplies it by the first partition's spectrum,
+ * adds the spectra of the earlier bursts multiplied by the later partitions, which were summed
+ * when the last burst was complete, and transforms the sum back. So the output is ready in the
+ * same call as the input, however the call's frames line up with the bursts.
+ *
+ * Partitions of the tail are tailBursts bursts long, with tailBursts chosen for the least work
+ * per frame. When a tail block of input is complete its convolution is spread over the next
+ * tailBursts bursts: the passes of its transform, the multiply-adds of the partitions and the
+ * passes of the inverse transform are shared out so no callback does much more work than
+ * another. The result is ready just as it is needed, because the head is two tail blocks long.
+ *
+ * process is called on the audio thread. configure must not be called at the same time as
+ * process. configure resamples the response to the stream's sample rate if they differ.
+ */
+class ConvolutionReverb : public AudioProcessor {
+
+public:
+  /**
+   * @param response used by every channel if mono, otherwise one channel each
+   */
+  explicit ConvolutionReverb(std::shared_ptr<const ImpulseResponse> response);
+
+  /**
+   * Allocate the buffers and transform the partitions of the response
+   */
+  void configure(int32_t channelCount, int32_t sampleRate, int32_t maxFramesPerProcess) override;
+
+  /**
+   * @param mix 0 for only the input, 1 for only the reverb. May be set on any thread.
+   */
+  void setMix(float mix);
+
+  void process(const float *const *input, float *const *output, int32_t numFrames) override;
+
+  /**
+   * How the response was partitioned by configure
+   */
+  int32_t getHeadPartitionCount() const { return head_.partitionCount; }
+  int32_t getTailPartitionCount() const { return tail_.partitionCount; }
+  int32_t getTailBlockFrames() const { return tail_.blockFrames; }
+
+private:
+  /**
+   * Equal partitions of part of the response, and the spectra of recent blocks of input
+   */
+  struct Segment {
+    int32_t blockFrames = 0;
+    int32_t partitionCount = 0;
+    int32_t stride = 0;                   // Of the real or the imaginary parts of a spectrum
+    std::vector<std::unique_ptr<RealFft>> ffts;   // For each channel
+
+    // Spectra are 2 * stride floats, the real parts then the imaginary parts
+    std::vector<float> partitions;        // For each response channel, partitionCount spectra
+    std::vector<float> inputSpectra;      // For each channel, the last partitionCount blocks
+    std::vector<float> sums;              // For each channel, a spectrum being summed
+    std::vector<float> windows;           // For each channel, two blocks of input
+    int32_t newest = 0;                   // inputSpectra index of the newest block
+
+    // Only used while transforming
+    std::vector<float> spectrum;
+    std::vector<float> frames;            // Two blocks
+
+    void allocate(int32_t blockFrames, int32_t partitionCount, int32_t channelCount,
+                  const std::vector<std::vector<float>> &response, int32_t offset);
+    float *getPartition(int32_t channel, int32_t index);
+    float *getInputSpectrum(int32_t channel, int32_t index);
+    float *getSum(int32_t channel);
+    float *getWindow(int32_t channel);
+    void addPartitions(int32_t channel, int32_t responseChannel, int32_t first, int32_t end,
+                       int32_t newestPartition);
+  };
+
+  std::shared_ptr<const ImpulseResponse> response_;
+  std::atomic<float> targetMix_ { kConvolutionReverbDefaultMix };
+
+  // Only used by the audio thread
+  int32_t channelCount_ = 0;
+  int32_t responseChannelCount_ = 0;
+  float mixStep_ = 1;                     // Largest change in the mix from one frame to the next
+  float mix_ = kConvolutionReverbDefaultMix;
+  Segment head_;
+  Segment tail_;
+  int32_t headFill_ = 0;                  // Frames of the current burst
+  int32_t tailFill_ = 0;                  // Frames of the current tail block, which is also
+                                          // how far through its block the tail output is
+  int32_t tailBursts_ = 0;
+  bool isTailWorking_ = false;            // On the previous tail block
+  int32_t tailPassCount_ = 0;
+  std::vector<int32_t> tailStepEnds_;     // Tasks done by the end of each step, see stepTail
+  std::vector<float> tailWork_;           // For each channel, the windows being convolved
+  std::vector<float> tailOutput_;         // For each channel, the block playing then the next
+  int32_t tailPlaying_ = 0;               // Which of the two blocks is playing
+
+  void processSegment(const float *const *input, float *const *output, int32_t offset,
+                      int32_t numFrames);
+  void completeBurst();
+  void stepTail(int32_t step);
+};
+
+#endif //AAUDIO_CONVOLUTIONREVERB_H
@@ -0,0 +1,176 @@
+/*
+ * Copyright 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <algorithm>
+#include "DriftCompensator.h"
+
+constexpr double kNanosPerSecond = 1e9;
+
+// Time constant of the low pass filter on the fill level, which averages out the jitter in the
+// callback times
+constexpr double kFillSmoothingSeconds = 0.5;
+
+// The proportional term alone would correct a fill error over this time. With the integral time
+// twice as long the loop is critically damped and settles in about 20 seconds.
+constexpr double kProportionalSeconds = 2.0;
+constexpr double kIntegralSeconds = 4.0;
+
+// Beyond this many times the target the ring holds too much latency to drain by resampling, and
+// an input this late has stopped
+constexpr int32_t kResyncFillMultiple = 5;
+
+// Frames the interpolator reads before and after the read position
+constexpr int32_t kFramesBeforePosition = 1;
+constexpr int32_t kFramesAfterPosition = 2;
+
+static inline float interpolate(float y0, float y1, float y2, float y3, float t) {
+
+  // Catmull-Rom spline through y1 and y2
+  float c1 = 0.5f * (y2 - y0);
+  float c2 = y0 - 2.5f * y1 + 2 * y2 - 0.5f * y3;
+  float c3 = 0.5f * (y3 - y0) + 1.5f * (y1 - y2);
+  return ((c3 * t + c2) * t + c1) * t + y1;
+}
+
+void DriftCompensator::configure(int32_t targetFillFrames, int32_t sampleRate) {
+  targetFillFrames_ = std::max(targetFillFrames, kFramesAfterPosition + 1);
+  sampleRate_ = sampleRate;
+  isPrimed_ = false;
+  readPosition_ = 0;
+  smoothedFill_ = targetFillFrames_;
+  integral_ = 0;
+  rate_ = 1.0;
+  fillLevelFrames_.store(0);
+  driftPpm_.store(0);
+  correctionPpm_.store(0);
+  underrunCount_.store(0);
+  resyncCount_.store(0);
+}
+
+/**
+ * Start reading target frames behind the newest frame, once the ring holds that many. Anything
+ * older is stale and skipped.
+ */
+void DriftCompensator::prime(AudioRingBuffer *ring, int64_t writeIndex) {
+
+  if (writeIndex - ring->getReadIndex() < targetFillFrames_ + kFramesBeforePosition) return;
+
+  readPosition_ = static_cast<double>(writeIndex - targetFillFrames_);
+  smoothedFill_ = targetFillFrames_;
+  ring->setReadIndex(writeIndex - targetFillFrames_ - kFramesBeforePosition);
+  isPrimed_ = true;
+}
+
+/**
+ * The write index plus the frames the input has received since it was stamped, which the next
+ * input callback will deliver. This stays right while the input callbacks are late, the frames
+ * are still being recorded.
+ *
+ * @return false if the input is so late it has probably stopped
+ */
+bool DriftCompensator::estimateWritePosition(AudioRingBuffer *ring, int64_t writeIndex,
+                                             int64_t nowNanos, double *writePosition) {
+
+  int64_t stampedIndex, stampedTimeNanos;
+  if (!ring->getWriteTime(&stampedIndex, &stampedTimeNanos)) return false;
+
+  double dueFrames = (nowNanos - stampedTimeNanos) * sampleRate_ / kNanosPerSecond;
+  if (dueFrames > targetFillFrames_ * kResyncFillMultiple) return false;
+
+  *writePosition = std::max(static_cast<double>(writeIndex),
+                            stampedIndex + std::max(0.0, dueFrames));
+  return true;
+}
+
+void DriftCompensator::updateRate(double fillFrames, int32_t numFrames) {
+
+  const double seconds = static_cast<double>(numFrames) / sampleRate_;
+  smoothedFill_ += std::min(1.0, seconds / kFillSmoothingSeconds) * (fillFrames - smoothedFill_);
+
+  // The controller works in frames of fill error and a dimensionless rate correction
+  const double maxCorrection = kDriftCompensatorMaxCorrectionPpm * 1e-6;
+  double error = smoothedFill_ - targetFillFrames_;
+  integral_ += error * seconds / (kIntegralSeconds * kIntegralSeconds * sampleRate_);
+  integral_ = std::max(-maxCorrection, std::min(integral_, maxCorrection));
+  double correction = integral_ + error / (kProportionalSeconds * sampleRate_);
+  correction = std::max(-maxCorrection, std::min(correction, maxCorrection));
+  rate_ = 1.0 + correction;
+
+  fillLevelFrames_.store(smoothedFill_, std::memory_order_relaxed);
+  driftPpm_.store(integral_ * 1e6, std::memory_order_relaxed);
+  correctionPpm_.store(correction * 1e6, std::memory_order_relaxed);
+}
+
+bool DriftCompensator::render(AudioRingBuffer *ring, float *output, int32_t numFrames,
+                              int64_t nowNanos) {
+
+  int64_t writeIndex = ring->getWriteIndex();
+  if (!isPrimed_) prime(ring, writeIndex);
+  if (!isPrimed_) {
+    std::fill(output, output + numFrames, 0.0f);
+    return true;
+  }
+
+  if (writeIndex - readPosition_ > targetFillFrames_ * kResyncFillMultiple) {
+    readPosition_ = static_cast<double>(writeIndex - targetFillFrames_);
+    smoothedFill_ = targetFillFrames_;
+    resyncCount_.store(resyncCount_.load(std::memory_order_relaxed) + 1,
+                       std::memory_order_relaxed);
+  }
+
+  // Keep the last rate while the input has stopped, its fill level means nothing
+  double writePosition;
+  if (estimateWritePosition(ring, writeIndex, nowNanos, &writePosition)) {
+    updateRate(writePosition - readPosition_, numFrames);
+  }
+
+  // Frames which haven't arrived yet are played as silence and skipped when they do arrive, so
+  // a late input callback costs a dropout but doesn't move the echo or upset the controller
+  bool isFilled = true;
+  for (int32_t frame = 0; frame < numFrames; frame++) {
+    int64_t index = static_cast<int64_t>(readPosition_);
+    if (index + kFramesAfterPosition < writeIndex) {
+      float fraction = static_cast<float>(readPosition_ - index);
+      output[frame] = interpolate(ring->getFrame(index - 1), ring->getFrame(index),
+                                  ring->getFrame(index + 1), ring->getFrame(index + 2), fraction);
+    } else {
+      output[frame] = 0.0f;
+      isFilled = false;
+    }
+    readPosition_ += rate_;
+  }
+
+  if (!isFilled) {
+    underrunCount_.store(underrunCount_.load(std::memory_order_relaxed) + 1,
+                         std::memory_order_relaxed);
+
+    // The input has stopped, wait for the ring to get back to the target
+    if (readPosition_ - writeIndex > targetFillFrames_ * kResyncFillMultiple) isPrimed_ = false;
+  }
+
+  int64_t readIndex = static_cast<int64_t>(readPosition_) - kFramesBeforePosition;
+  ring->setReadIndex(std::min(readIndex, writeIndex));
+  return isFilled;
+}
+
+void DriftCompensator::getState(DriftCompensatorState *state) const {
+  state->fillLevelFrames = fillLevelFrames_.load();
+  state->targetFillFrames = targetFillFrames_;
+  state->driftPpm = driftPpm_.load();
+  state->correctionPpm = correctionPpm_.load();
+  state->underrunCount = underrunCount_.load();
+  state->resyncCount = resyncCount_.load();
+}
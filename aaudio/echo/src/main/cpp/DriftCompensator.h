@@ -0,0 +1,99 @@
+/*
+ * Copyright 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef AAUDIO_DRIFTCOMPENSATOR_H
+#define AAUDIO_DRIFTCOMPENSATOR_H
+
+#include <stdint.h>
+#include <atomic>
+#include "AudioRingBuffer.h"
+
+// Largest resampling correction, well beyond the drift between two real audio clocks
+constexpr double kDriftCompensatorMaxCorrectionPpm = 2000;
+
+/**
+ * A snapshot of the compensator, see DriftCompensator::getState
+ */
+struct DriftCompensatorState {
+  double fillLevelFrames;         // Smoothed frames in the ring, plus input frames due since the
+                                  // last write
+  int32_t targetFillFrames;
+  double driftPpm;                // How much faster the input clock runs than the output clock
+  double correctionPpm;           // Current resampling correction, drift plus fill error
+  int32_t underrunCount;          // Renders which ran out of input and played some silence
+  int32_t resyncCount;            // The ring held far too much and the reader skipped ahead
+};
+
+/**
+ * Reads the output of a full-duplex stream pair from the ring the input callback fills, holding
+ * the ring at a target fill level however far the input and output clocks drift apart.
+ *
+ * The reader resamples with a fractional read position, using 4 point cubic Hermite
+ * interpolation. A PI controller sets the read rate from the smoothed fill level: the
+ * proportional term pulls the fill back to the target and the integral term converges on the
+ * ratio of the two clocks, which is reported as the drift.
+ *
+ * The frames in the ring only change a whole input burst at a time, and while the input and
+ * output callbacks keep the same order the output sees the same count every time however much
+ * the clocks drift. So the fill level counts the input frames due since the last write as well,
+ * from the write time the input stamps on the ring.
+ *
+ * render is called on the output audio thread. configure must not be called at the same time as
+ * render. getState may be called on any thread.
+ */
+class DriftCompensator {
+
+public:
+  /**
+   * Start again, waiting for the ring to reach the target before playing anything
+   */
+  void configure(int32_t targetFillFrames, int32_t sampleRate);
+
+  /**
+   * Fill output with numFrames frames read from ring at the compensated rate, or silence for
+   * frames the input hasn't delivered yet
+   *
+   * @param nowNanos CLOCK_MONOTONIC time, the same clock as the ring's write times
+   * @return false if the ring ran dry part way through
+   */
+  bool render(AudioRingBuffer *ring, float *output, int32_t numFrames, int64_t nowNanos);
+
+  void getState(DriftCompensatorState *state) const;
+
+private:
+  // Only used by the audio thread
+  int32_t targetFillFrames_ = 0;
+  int32_t sampleRate_ = 48000;
+  bool isPrimed_ = false;
+  double readPosition_ = 0;       // Absolute fractional index into the ring
+  double smoothedFill_ = 0;
+  double integral_ = 0;           // Read rate - 1 which the fill error has integrated to
+  double rate_ = 1.0;             // Input frames read per output frame
+
+  // Written by the audio thread, read by getState
+  std::atomic<double> fillLevelFrames_ { 0 };
+  std::atomic<double> driftPpm_ { 0 };
+  std::atomic<double> correctionPpm_ { 0 };
+  std::atomic<int32_t> underrunCount_ { 0 };
+  std::atomic<int32_t> resyncCount_ { 0 };
+
+  void prime(AudioRingBuffer *ring, int64_t writeIndex);
+  bool estimateWritePosition(AudioRingBuffer *ring, int64_t writeIndex, int64_t nowNanos,
+                             double *writePosition);
+  void updateRate(double fillFrames, int32_t numFrames);
+};
+
+#endif //AAUDIO_DRIFTCOMPENSATOR_H
@@ -15,19 +15,26 @@
  */
 
 #include <logging_macros.h>
+#include <rt_log.h>
+#include <algorithm>
 #include <climits>
+#include <cstring>
 #include <assert.h>
 #include <audio_common.h>
 #include "EchoAudioEngine.h"
 
+// Frames converted at a time on the stack of the data callbacks
+constexpr int32_t kConversionFrames = 256;
+constexpr float kInt16ToFloatScale = 1.0f / 32768;
 
 /**
- * Every time the playback stream requires data this method will be called.
+ * Every time the playback stream requires data, or the recording stream has data, this method
+ * will be called.
  *
- * @param stream the audio stream which is requesting data, this is the playStream_ object
+ * @param stream the audio stream which is calling, either playStream_ or recordingStream_
  * @param userData the context in which the function is being called, in this case it will be the
  * EchoAudioEngine instance
- * @param audioData an empty buffer into which we can write our audio data
+ * @param audioData an empty buffer into which we can write our audio data, or the recorded data
  * @param numFrames the number of audio frames which are required
  * @return Either AAUDIO_CALLBACK_RESULT_CONTINUE if the stream should continue requesting data
  * or AAUDIO_CALLBACK_RESULT_STOP if the stream should stop.
@@ -63,11 +70,20 @@ void errorCallback(AAudioStream *stream,
   audioEngine->errorCallback(stream, error);
 }
 
+EchoAudioEngine::EchoAudioEngine() : echoEffect_(std::make_shared<AudioEffect>()) {
+
+  effectChain_.add(echoEffect_);
+
+  // Warnings from the data callbacks are logged through RtLog's queue, which this thread drains
+  RtLog::start();
+}
+
 EchoAudioEngine::~EchoAudioEngine() {
   stopStream(playStream_);
   stopStream(recordingStream_);
   closeStream(playStream_);
   closeStream(recordingStream_);
+  RtLog::stop();
 }
 
 void EchoAudioEngine::setRecordingDeviceId(int32_t deviceId) {
@@ -89,6 +105,7 @@ void EchoAudioEngine::setEchoOn(bool isEchoOn) {
       openAllStreams();
     } else {
       closeAllStreams();
+      latencyMeasurement_.cancel();
     }
   }
 }
@@ -101,9 +118,15 @@ void EchoAudioEngine::openAllStreams() {
   openPlaybackStream();
   openRecordingStream();
 
-  // Now start the recording stream first so that we can read from it during the playback
-  // stream's dataCallback
+  // Now start the recording stream first so that the ring is filling up by the time the playback
+  // stream's dataCallback reads from it. Neither callback is running so the ring can be reset.
   if (recordingStream_ != nullptr && playStream_ != nullptr) {
+    ringBuffer_.reset();
+    driftCompensator_.configure(AAudioStream_getFramesPerBurst(recordingStream_) *
+                                kEchoTargetFillBursts, sampleRate_);
+    effectChain_.configure(outputChannelCount_, sampleRate_, framesPerBurst_);
+    latencyMeasurement_.configure(sampleRate_);
+    bus_.assign(kEffectChainMaxChannels * framesPerBurst_, 0.0f);
     startStream(recordingStream_);
     startStream(playStream_);
   } else {
@@ -117,10 +140,9 @@ void EchoAudioEngine::openAllStreams() {
 void EchoAudioEngine::closeAllStreams() {
 
  /**
-  * Note: The order of events is important here.
-  * The playback stream must be closed before the recording stream. If the recording stream were to
-  * be closed first the playback stream's callback may attempt to read from the recording stream
-  * which would cause the app to crash since the recording stream would be null.
+  * Note: Closing a stream waits for its callback to return, so once both streams are closed
+  * neither callback is using the ring. The playback stream is closed first so the echo stops
+  * straight away rather than playing out the ring.
   */
 
   if (playStream_ != nullptr) {
@@ -216,6 +238,9 @@ void EchoAudioEngine::setupRecordingStreamParameters(AAudioStreamBuilder *builde
   AAudioStreamBuilder_setDirection(builder, AAUDIO_DIRECTION_INPUT);
   AAudioStreamBuilder_setSampleRate(builder, sampleRate_);
   AAudioStreamBuilder_setChannelCount(builder, inputChannelCount_);
+
+  // The recording stream has its own callback which fills the ring
+  AAudioStreamBuilder_setDataCallback(builder, ::dataCallback, this);
   setupCommonStreamParameters(builder);
 }
 
@@ -291,69 +316,71 @@ void EchoAudioEngine::closeStream(AAudioStream *stream) {
 aaudio_data_callback_result_t EchoAudioEngine::dataCallback(AAudioStream *stream,
                                                             void *audioData,
                                                             int32_t numFrames) {
-  if (isEchoOn_) {
-
-    // frameCount could be
-    //    < 0 : error code
-    //    >= 0 : actual value read from stream
-    aaudio_result_t frameCount = 0;
+  if (!isEchoOn_) return AAUDIO_CALLBACK_RESULT_STOP;
 
-    if (recordingStream_ != nullptr) {
-
-      // If this is the first data callback we want to drain the recording buffer so we're getting
-      // the most up to date data
-      if (isFirstDataCallback_) {
-        drainRecordingStream(audioData, numFrames);
-        isFirstDataCallback_ = false;
-      }
+  if (stream == recordingStream_) {
+    recordingCallback(static_cast<const int16_t *>(audioData), numFrames);
+  } else {
+    playbackCallback(static_cast<int16_t *>(audioData), numFrames);
+  }
+  return AAUDIO_CALLBACK_RESULT_CONTINUE;
+}
 
-      frameCount = AAudioStream_read(recordingStream_, audioData, numFrames,
-                                     static_cast<int64_t>(0));
+/**
+ * Convert the recorded frames to float and add them to the ring. If playback has stalled and the
+ * ring is full the frames are dropped.
+ */
+void EchoAudioEngine::recordingCallback(const int16_t *audioData, int32_t numFrames) {
+
+  float frames[kConversionFrames];
+  while (numFrames > 0) {
+    int32_t chunkFrames = std::min(numFrames, kConversionFrames);
+    for (int i = 0; i < chunkFrames; i++) frames[i] = audioData[i] * kInt16ToFloatScale;
+    ringBuffer_.write(frames, chunkFrames);
+    audioData += chunkFrames;
+    numFrames -= chunkFrames;
+  }
+  ringBuffer_.setWriteTime(get_time_nanoseconds(CLOCK_MONOTONIC));
+}
 
-      ConvertMonoToStereo(static_cast<int16_t *>(audioData), frameCount);
+/**
+ * Read the recorded audio from the ring, resampled to make up for any drift between the
+ * recording and playback clocks, copy it to every output channel and add the echoes. While the
+ * latency is being measured the recorded audio goes to the measurement instead, which plays its
+ * test signal, so the round trip it finds is the echo's own.
+ */
+void EchoAudioEngine::playbackCallback(int16_t *audioData, int32_t numFrames) {
 
-      audioEffect_.process(static_cast<int16_t *>(audioData), outputChannelCount_, frameCount);
+  float *channels[kEffectChainMaxChannels];
+  int32_t channelCount = std::min(outputChannelCount_, kEffectChainMaxChannels);
+  for (int channel = 0; channel < channelCount; channel++) {
+    channels[channel] = &bus_[channel * framesPerBurst_];
+  }
 
-      if (frameCount < 0) {
-        LOGE("****AAudioStream_read() returns %s",
-             AAudio_convertResultToText(frameCount));
-        frameCount = 0;  // continue to play silent audio
-      }
+  int64_t nowNanos = get_time_nanoseconds(CLOCK_MONOTONIC);
+  int16_t *output = audioData;
+  int32_t framesLeft = numFrames;
+  while (framesLeft > 0) {
+    int32_t chunkFrames = std::min(framesLeft, framesPerBurst_);
+    if (!driftCompensator_.render(&ringBuffer_, channels[0], chunkFrames, nowNanos)) {
+      RTLOGW("Echo input arrived late, playing silence in its place");
     }
-
-    /**
-    * If there's not enough audio data from input stream, fill the rest of buffer with
-    * 0 (silence) and continue to loop
-    */
-    numFrames -= frameCount;
-    if (numFrames > 0) {
-      memset(static_cast<int16_t *>(audioData) + frameCount * outputChannelCount_,
-             0, sizeof(int16_t) * numFrames * outputChannelCount_);
+    bool isMeasuring = latencyMeasurement_.process(channels[0], channels[0], chunkFrames);
+    for (int channel = 1; channel < channelCount; channel++) {
+      std::copy(channels[0], channels[0] + chunkFrames, channels[channel]);
     }
-    return AAUDIO_CALLBACK_RESULT_CONTINUE;
+    if (!isMeasuring) effectChain_.process(channels, chunkFrames);
 
-  } else {
-    return AAUDIO_CALLBACK_RESULT_STOP;
+    for (int i = 0; i < chunkFrames; i++) {
+      for (int channel = 0; channel < outputChannelCount_; channel++) {
+        float sample = channels[std::min(channel, channelCount - 1)][i] * 32768;
+        *output++ = static_cast<int16_t>(std::max(std::min(sample, 32767.0f), -32768.0f));
+      }
+    }
+    framesLeft -= chunkFrames;
   }
 }
 
-/**
- * Drain the recording stream of any existing data by reading from it until it's empty. This is
- * usually run to clear out any stale data before performing an actual read operation, thereby
- * obtaining the most recently recorded data and the best possbile recording latency.
- *
- * @param audioData A buffer which the existing data can be read into
- * @param numFrames The number of frames to read in a single read operation, this is typically the
- * size of `audioData`.
- */
-void EchoAudioEngine::drainRecordingStream(void *audioData, int32_t numFrames) {
-
-  aaudio_result_t clearedFrames = 0;
-  do {
-    clearedFrames = AAudioStream_read(recordingStream_, audioData, numFrames, 0);
-  } while (clearedFrames > 0);
-}
-
 /**
  * See the C method errorCallback at the top of this file
  */
@@ -397,3 +424,66 @@ void EchoAudioEngine::warnIfNotLowLatency(AAudioStream *stream) {
     LOGW("Stream is NOT low latency. Check your requested format, sample rate and channel count");
   }
 }
+
+void EchoAudioEngine::getDriftCompensatorState(DriftCompensatorState *state) {
+  driftCompensator_.getState(state);
+}
+
+int64_t EchoAudioEngine::getDroppedInputFrameCount() {
+  return ringBuffer_.getDroppedFrameCount();
+}
+
+EffectChain *EchoAudioEngine::getEffectChain() {
+  return &effectChain_;
+}
+
+void EchoAudioEngine::setEffectDelayMillis(double delayMillis) {
+  echoEffect_->setDelayMillis(delayMillis);
+}
+
+void EchoAudioEngine::setEffectFeedback(float feedback) {
+  echoEffect_->setFeedback(feedback);
+}
+
+void EchoAudioEngine::setEffectMix(float mix) {
+  echoEffect_->setMix(mix);
+}
+
+bool EchoAudioEngine::loadImpulseResponse(const char *path) {
+
+  std::shared_ptr<ImpulseResponse> response = ImpulseResponse::loadWav(path);
+  if (response == nullptr) return false;
+  response->normalize();
+
+  // The chain configures the reverb before the audio thread can see it
+  std::shared_ptr<ConvolutionReverb> reverb = std::make_shared<ConvolutionReverb>(response);
+  reverb->setMix(reverbMix_);
+  if (reverb_ == nullptr || !effectChain_.replace(reverb_, reverb)) effectChain_.add(reverb);
+  reverb_ = reverb;
+  LOGD("Loaded impulse response %s, %d frames at %d Hz", path, response->getNumFrames(),
+       response->getSampleRate());
+  return true;
+}
+
+void EchoAudioEngine::clearImpulseResponse() {
+  if (reverb_ != nullptr) effectChain_.remove(reverb_);
+  reverb_.reset();
+}
+
+void EchoAudioEngine::setReverbMix(float mix) {
+  reverbMix_ = mix;
+  if (reverb_ != nullptr) reverb_->setMix(mix);
+}
+
+bool EchoAudioEngine::startLatencyMeasurement() {
+  if (!isEchoOn_) {
+    LOGE("The echo is off, turn it on before measuring the round trip latency");
+    return false;
+  }
+  latencyMeasurement_.start();
+  return true;
+}
+
+LatencyMeasurementState EchoAudioEngine::getRoundTripLatency(RoundTripLatency *latency) {
+  return latencyMeasurement_.getResult(latency);
+}
@@ -17,13 +17,29 @@
 #ifndef AAUDIO_ECHOAUDIOENGINE_H
 #define AAUDIO_ECHOAUDIOENGINE_H
 
+#include <functional>
+#include <mutex>
 #include <thread>
 #include "audio_common.h"
 #include "AudioEffect.h"
+#include "AudioRingBuffer.h"
+#include "ConvolutionReverb.h"
+#include "DriftCompensator.h"
+#include "EffectChain.h"
+#include "LatencyMeasurement.h"
+
+// The ring holds more than any sensible fill level, the compensator skips ahead long before
+// it fills up
+constexpr int32_t kEchoRingCapacityInFrames = 16384;
+
+// Input bursts kept in the ring: one for the output callback to read, one which the input may
+// not have delivered yet when the output reads, and one for scheduling jitter
+constexpr int32_t kEchoTargetFillBursts = 3;
 
 class EchoAudioEngine {
 
 public:
+  EchoAudioEngine();
   ~EchoAudioEngine();
   void setRecordingDeviceId(int32_t deviceId);
   void setPlaybackDeviceId(int32_t deviceId);
@@ -34,10 +50,53 @@ public:
   void errorCallback(AAudioStream *stream,
                      aaudio_result_t  __unused error);
 
+  /**
+   * Fill level and clock drift of the path from the recording stream to the playback stream
+   */
+  void getDriftCompensatorState(DriftCompensatorState *state);
+  int64_t getDroppedInputFrameCount();
+
+  /**
+   * The effects applied to the echo, which may be changed while it plays. It starts with the
+   * AudioEffect delay the setEffect methods control.
+   */
+  EffectChain *getEffectChain();
+
+  /**
+   * Echo effect parameters, see AudioEffect
+   */
+  void setEffectDelayMillis(double delayMillis);
+  void setEffectFeedback(float feedback);
+  void setEffectMix(float mix);
+
+  /**
+   * Add a ConvolutionReverb after the echo, or swap the response of the one already there.
+   * The response is normalized, see ImpulseResponse::normalize.
+   *
+   * @param path a WAV file
+   * @return false if the file couldn't be loaded, leaving any reverb as it was
+   */
+  bool loadImpulseResponse(const char *path);
+  void clearImpulseResponse();
+  void setReverbMix(float mix);
+
+  /**
+   * Measure the round trip from the playback stream back to the recording stream, see
+   * LatencyMeasurement. The echo and its effects are replaced by the test signal for just over a
+   * second once the streams are running. Turning the echo off abandons the measurement.
+   *
+   * @return false if the echo is off, as there are no streams to measure
+   */
+  bool startLatencyMeasurement();
+
+  /**
+   * @param latency set when the result is LATENCY_MEASUREMENT_DONE or LATENCY_MEASUREMENT_FAILED
+   */
+  LatencyMeasurementState getRoundTripLatency(RoundTripLatency *latency);
+
 private:
 
   bool isEchoOn_ = false;
-  bool isFirstDataCallback_ = true;
   int32_t recordingDeviceId_ = AAUDIO_UNSPECIFIED;
   int32_t playbackDeviceId_ = AAUDIO_UNSPECIFIED;
   aaudio_format_t format_ = AAUDIO_FORMAT_PCM_I16;
@@ -48,11 +107,25 @@ private:
   AAudioStream *playStream_ = nullptr;
   int32_t framesPerBurst_;
   std::mutex restartingLock_;
-  AudioEffect audioEffect_;
+  EffectChain effectChain_;
+  std::shared_ptr<AudioEffect> echoEffect_;
+  std::shared_ptr<ConvolutionReverb> reverb_;
+  float reverbMix_ = kConvolutionReverbDefaultMix;
+  LatencyMeasurement latencyMeasurement_;
+
+  // The playback callback's planar float bus, a burst for each channel, allocated as the streams
+  // are opened
+  std::vector<float> bus_;
+
+  // The recording stream's callback writes into the ring and the playback stream's callback
+  // reads from it through the drift compensator
+  AudioRingBuffer ringBuffer_ { kEchoRingCapacityInFrames };
+  DriftCompensator driftCompensator_;
 
   void openRecordingStream();
-  void drainRecordingStream(void *audioData, int32_t numFrames);
   void openPlaybackStream();
+  void recordingCallback(const int16_t *audioData, int32_t numFrames);
+  void playbackCallback(int16_t *audioData, int32_t numFrames);
 
   void startStream(AAudioStream* stream);
   void stopStream(AAudioStream* stream);
@@ -0,0 +1,172 @@
+/*
+ * Copyright 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <algorithm>
+#include <cstring>
+#include "EffectChain.h"
+
+EffectChain::EffectChain() : snapshot_(new Snapshot()) {
+}
+
+/**
+ * Nothing can be processing by now, so every snapshot can go
+ */
+EffectChain::~EffectChain() {
+  for (RetiredSnapshot &retired : retiredSnapshots_) delete retired.snapshot;
+  delete snapshot_.load();
+}
+
+void EffectChain::configure(int32_t channelCount, int32_t sampleRate,
+                            int32_t maxFramesPerProcess) {
+
+  std::lock_guard<std::mutex> lock(updateLock_);
+  channelCount_ = std::max(1, std::min(channelCount, kEffectChainMaxChannels));
+  sampleRate_ = sampleRate;
+  maxFramesPerProcess_ = std::max(1, maxFramesPerProcess);
+  scratch_.assign(channelCount_ * maxFramesPerProcess_, 0.0f);
+
+  for (const std::shared_ptr<AudioProcessor> &processor : snapshot_.load()->processors) {
+    processor->configure(channelCount_, sampleRate_, maxFramesPerProcess_);
+  }
+}
+
+void EffectChain::insert(int32_t position, std::shared_ptr<AudioProcessor> processor) {
+
+  std::lock_guard<std::mutex> lock(updateLock_);
+
+  // Configured before process can see it
+  if (channelCount_ > 0) processor->configure(channelCount_, sampleRate_, maxFramesPerProcess_);
+
+  Processors processors = snapshot_.load()->processors;
+  position = std::max(0, std::min(position, static_cast<int32_t>(processors.size())));
+  processors.insert(processors.begin() + position, std::move(processor));
+  publish(std::move(processors));
+}
+
+void EffectChain::add(std::shared_ptr<AudioProcessor> processor) {
+  insert(INT32_MAX, std::move(processor));
+}
+
+bool EffectChain::remove(const std::shared_ptr<AudioProcessor> &processor) {
+
+  std::lock_guard<std::mutex> lock(updateLock_);
+  Processors processors = snapshot_.load()->processors;
+  auto found = std::find(processors.begin(), processors.end(), processor);
+  if (found == processors.end()) return false;
+
+  processors.erase(found);
+  publish(std::move(processors));
+  return true;
+}
+
+bool EffectChain::replace(const std::shared_ptr<AudioProcessor> &processor,
+                          std::shared_ptr<AudioProcessor> replacement) {
+
+  std::lock_guard<std::mutex> lock(updateLock_);
+  Processors processors = snapshot_.load()->processors;
+  auto found = std::find(processors.begin(), processors.end(), processor);
+  if (found == processors.end()) return false;
+
+  if (channelCount_ > 0) replacement->configure(channelCount_, sampleRate_, maxFramesPerProcess_);
+  *found = std::move(replacement);
+  publish(std::move(processors));
+  return true;
+}
+
+bool EffectChain::move(int32_t from, int32_t to) {
+
+  std::lock_guard<std::mutex> lock(updateLock_);
+  Processors processors = snapshot_.load()->processors;
+  int32_t size = static_cast<int32_t>(processors.size());
+  if (from < 0 || from >= size || to < 0 || to >= size) return false;
+
+  std::shared_ptr<AudioProcessor> processor = processors[from];
+  processors.erase(processors.begin() + from);
+  processors.insert(processors.begin() + to, std::move(processor));
+  publish(std::move(processors));
+  return true;
+}
+
+int32_t EffectChain::getSize() {
+  std::lock_guard<std::mutex> lock(updateLock_);
+  return static_cast<int32_t>(snapshot_.load()->processors.size());
+}
+
+void EffectChain::process(float *const *channels, int32_t numFrames) {
+
+  if (channelCount_ == 0) return;
+
+  // The count is odd while the snapshot is in use. It and the snapshot are sequentially
+  // consistent with publish, so if publish sees an even count this call will see its snapshot.
+  uint64_t count = processCount_.load(std::memory_order_relaxed);
+  processCount_.store(count + 1);
+  const Snapshot *snapshot = snapshot_.load();
+
+  for (int32_t offset = 0; offset < numFrames; offset += maxFramesPerProcess_) {
+    int32_t chunkFrames = std::min(numFrames - offset, maxFramesPerProcess_);
+
+    // Processors which can't work in place swap the bus for the spare one
+    float *buses[2][kEffectChainMaxChannels];
+    for (int32_t channel = 0; channel < channelCount_; channel++) {
+      buses[0][channel] = channels[channel] + offset;
+      buses[1][channel] = &scratch_[channel * maxFramesPerProcess_];
+    }
+    float **bus = buses[0];
+    float **spare = buses[1];
+    for (const std::shared_ptr<AudioProcessor> &processor : snapshot->processors) {
+      if (processor->canProcessInPlace()) {
+        processor->process(bus, bus, chunkFrames);
+      } else {
+        processor->process(bus, spare, chunkFrames);
+        std::swap(bus, spare);
+      }
+    }
+
+    if (bus != buses[0]) {
+      for (int32_t channel = 0; channel < channelCount_; channel++) {
+        memcpy(buses[0][channel], bus[channel], chunkFrames * sizeof(float));
+      }
+    }
+  }
+
+  processCount_.store(count + 2, std::memory_order_release);
+}
+
+/**
+ * Swap in a new list and retire the old one. Must hold updateLock_.
+ */
+void EffectChain::publish(Processors processors) {
+  Snapshot *retired = snapshot_.exchange(new Snapshot { std::move(processors) });
+  retiredSnapshots_.push_back(RetiredSnapshot { retired, processCount_.load() });
+  reclaim();
+}
+
+/**
+ * Delete the retired snapshots process has finished with. Must hold updateLock_.
+ */
+void EffectChain::reclaim() {
+
+  uint64_t count = processCount_.load();
+  auto isFinished = [count](const RetiredSnapshot &retired) {
+    return retired.processCount % 2 == 0 || count > retired.processCount;
+  };
+  for (RetiredSnapshot &retired : retiredSnapshots_) {
+    if (isFinished(retired)) delete retired.snapshot;
+  }
+  retiredSnapshots_.erase(std::remove_if(retiredSnapshots_.begin(), retiredSnapshots_.end(),
+                                         isFinished),
+                          retiredSnapshots_.end());
+}
@@ -0,0 +1,120 @@
+/*
+ * Copyright 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef AAUDIO_EFFECTCHAIN_H
+#define AAUDIO_EFFECTCHAIN_H
+
+#include <stdint.h>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include "AudioProcessor.h"
+
+constexpr int32_t kEffectChainMaxChannels = 2;
+
+/**
+ * An ordered list of AudioProcessors run one after another over a planar float bus.
+ *
+ * Processors which can work in place are given the bus itself, others write to a scratch bus
+ * which then becomes the bus. The scratch bus is allocated by configure, from the largest number
+ * of frames process will be given, and longer calls are split.
+ *
+ * The list is changed by read-copy-update. Each change builds a new immutable snapshot of the
+ * list and swaps it in with one atomic store, so process always sees a whole list and never
+ * locks. The snapshot it replaces is retired and deleted, along with any processors only it
+ * held, by a later change or the destructor once process can no longer be using it. process
+ * bumps a counter as it starts and finishes, odd while it runs, and a snapshot retired while the
+ * counter was even, or which the counter has passed since, is no longer in use. So the audio
+ * thread never frees memory.
+ *
+ * process is called on the audio thread. configure must not be called at the same time as
+ * process. The other methods may be called on any thread other than the audio thread.
+ */
+class EffectChain {
+public:
+  EffectChain();
+  ~EffectChain();
+
+  /**
+   * Configure every processor in the chain and any added later, and allocate the scratch bus
+   */
+  void configure(int32_t channelCount, int32_t sampleRate, int32_t maxFramesPerProcess);
+
+  /**
+   * Insert a processor before position, or at the end if position is past it
+   */
+  void insert(int32_t position, std::shared_ptr<AudioProcessor> processor);
+  void add(std::shared_ptr<AudioProcessor> processor);
+
+  /**
+   * @return false if the processor isn't in the chain
+   */
+  bool remove(const std::shared_ptr<AudioProcessor> &processor);
+
+  /**
+   * Put another processor in the place of one, in a single change
+   *
+   * @return false if the processor isn't in the chain
+   */
+  bool replace(const std::shared_ptr<AudioProcessor> &processor,
+               std::shared_ptr<AudioProcessor> replacement);
+
+  /**
+   * Move the processor at one position to another
+   *
+   * @return false if either position is outside the chain
+   */
+  bool move(int32_t from, int32_t to);
+
+  int32_t getSize();
+
+  /**
+   * Run each channel through the chain in place
+   *
+   * @param channels one buffer of numFrames frames for each of configure's channels
+   */
+  void process(float *const *channels, int32_t numFrames);
+
+private:
+  typedef std::vector<std::shared_ptr<AudioProcessor>> Processors;
+
+  struct Snapshot {
+    Processors processors;
+  };
+
+  struct RetiredSnapshot {
+    Snapshot *snapshot;
+    uint64_t processCount;          // When it was retired
+  };
+
+  // Read by the audio thread
+  std::atomic<Snapshot *> snapshot_;
+  std::atomic<uint64_t> processCount_ { 0 };
+  int32_t channelCount_ = 0;
+  int32_t maxFramesPerProcess_ = 0;
+  std::vector<float> scratch_;
+
+  // Only used with updateLock_ held
+  std::mutex updateLock_;
+  int32_t sampleRate_ = 0;
+  std::vector<RetiredSnapshot> retiredSnapshots_;
+
+  void publish(Processors processors);
+  void reclaim();
+};
+
+#endif //AAUDIO_EFFECTCHAIN_H
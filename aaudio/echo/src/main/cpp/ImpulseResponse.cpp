@@ -0,0 +1,215 @@
+/*
+ * Copyright 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include <logging_macros.h>
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include "ImpulseResponse.h"
+
+// Zero crossings of the resampling sinc on each side of its centre
+constexpr int32_t kResampleZeroCrossings = 16;
+
+// Samples this small become 0, so the convolution never works on denormals
+constexpr float kSilence = 1e-20f;
+
+ImpulseResponse::ImpulseResponse(int32_t channelCount, int32_t sampleRate, int32_t numFrames) :
+    channelCount_(channelCount), sampleRate_(sampleRate), numFrames_(numFrames),
+    frames_(static_cast<size_t>(channelCount) * numFrames, 0.0f) {
+}
+
+// WAV is little endian whatever the host byte order
+static uint32_t readUint32(const uint8_t *bytes) {
+  return bytes[0] | (bytes[1] << 8) | (bytes[2] << 16) | (static_cast<uint32_t>(bytes[3]) << 24);
+}
+
+static uint16_t readUint16(const uint8_t *bytes) {
+  return static_cast<uint16_t>(bytes[0] | (bytes[1] << 8));
+}
+
+static float readSample(const uint8_t *bytes, int32_t bitsPerSample, bool isFloat) {
+  if (isFloat && bitsPerSample == 32) {
+    uint32_t bits = readUint32(bytes);
+    float value;
+    memcpy(&value, &bits, sizeof(value));
+    return value;
+  }
+  if (isFloat) {
+    uint64_t bits = readUint32(bytes) | (static_cast<uint64_t>(readUint32(bytes + 4)) << 32);
+    double value;
+    memcpy(&value, &bits, sizeof(value));
+    return static_cast<float>(value);
+  }
+  switch (bitsPerSample) {
+    case 8:
+      return (bytes[0] - 128) * (1.0f / 128);
+    case 16:
+      return static_cast<int16_t>(readUint16(bytes)) * (1.0f / 32768);
+    case 24:
+      return static_cast<int32_t>((bytes[0] << 8) | (bytes[1] << 16) |
+                                  (static_cast<uint32_t>(bytes[2]) << 24)) *
+             (1.0f / 2147483648.0f);
+    default:
+      return static_cast<int32_t>(readUint32(bytes)) * (1.0f / 2147483648.0f);
+  }
+}
+
+std::shared_ptr<ImpulseResponse> ImpulseResponse::loadWav(const char *path) {
+
+  FILE *file = fopen(path, "rb");
+  if (file == nullptr) {
+    LOGE("Could not open impulse response %s", path);
+    return nullptr;
+  }
+  std::vector<uint8_t> bytes;
+  uint8_t buffer[4096];
+  size_t bytesRead;
+  while ((bytesRead = fread(buffer, 1, sizeof(buffer), file)) > 0) {
+    bytes.insert(bytes.end(), buffer, buffer + bytesRead);
+  }
+  fclose(file);
+
+  if (bytes.size() < 12 || memcmp(&bytes[0], "RIFF", 4) != 0 ||
+      memcmp(&bytes[8], "WAVE", 4) != 0) {
+    LOGE("Impulse response %s is not a WAV file", path);
+    return nullptr;
+  }
+
+  // Find the format and data chunks, which are padded to an even size
+  const uint8_t *format = nullptr;
+  uint32_t formatSize = 0;
+  const uint8_t *data = nullptr;
+  uint32_t dataSize = 0;
+  size_t offset = 12;
+  while (offset + 8 <= bytes.size()) {
+    uint32_t chunkSize = readUint32(&bytes[offset + 4]);
+    size_t available = bytes.size() - offset - 8;
+    if (memcmp(&bytes[offset], "fmt ", 4) == 0 && chunkSize >= 16 && chunkSize <= available) {
+      format = &bytes[offset + 8];
+      formatSize = chunkSize;
+    } else if (memcmp(&bytes[offset], "data", 4) == 0) {
+      data = &bytes[offset + 8];
+      dataSize = static_cast<uint32_t>(std::min<size_t>(chunkSize, available));
+    }
+    offset += 8 + static_cast<size_t>(chunkSize) + (chunkSize & 1);
+  }
+  if (format == nullptr || data == nullptr) {
+    LOGE("Impulse response %s has no format or no data", path);
+    return nullptr;
+  }
+
+  // WAVE_FORMAT_EXTENSIBLE keeps the real format in the first two bytes of its sub-format
+  uint16_t formatTag = readUint16(format);
+  if (formatTag == 0xfffe && formatSize >= 40) {
+    formatTag = readUint16(format + 24);
+  }
+  int32_t fileChannelCount = readUint16(format + 2);
+  int32_t sampleRate = static_cast<int32_t>(readUint32(format + 4));
+  int32_t bitsPerSample = readUint16(format + 14);
+  bool isFloat = (formatTag == 3);
+  bool isSupported = (formatTag == 1 && (bitsPerSample == 8 || bitsPerSample == 16 ||
+                                         bitsPerSample == 24 || bitsPerSample == 32)) ||
+                     (isFloat && (bitsPerSample == 32 || bitsPerSample == 64));
+  if (!isSupported || fileChannelCount < 1 || sampleRate < 1000) {
+    LOGE("Impulse response %s has an unsupported format %d, %d bits, %d channels, %d Hz", path,
+         formatTag, bitsPerSample, fileChannelCount, sampleRate);
+    return nullptr;
+  }
+
+  int32_t bytesPerFrame = fileChannelCount * bitsPerSample / 8;
+  int64_t numFrames = dataSize / bytesPerFrame;
+  int64_t maxFrames = static_cast<int64_t>(kImpulseResponseMaxSeconds * sampleRate);
+  if (numFrames > maxFrames) {
+    LOGW("Impulse response %s is longer than %g seconds, the rest is ignored", path,
+         kImpulseResponseMaxSeconds);
+    numFrames = maxFrames;
+  }
+  if (numFrames == 0) {
+    LOGE("Impulse response %s is empty", path);
+    return nullptr;
+  }
+
+  int32_t channelCount = std::min(fileChannelCount, 2);
+  std::shared_ptr<ImpulseResponse> response = std::make_shared<ImpulseResponse>(
+      channelCount, sampleRate, static_cast<int32_t>(numFrames));
+  for (int32_t channel = 0; channel < channelCount; channel++) {
+    float *frames = response->getChannel(channel);
+    const uint8_t *sample = data + channel * bitsPerSample / 8;
+    for (int64_t i = 0; i < numFrames; i++, sample += bytesPerFrame) {
+      float value = readSample(sample, bitsPerSample, isFloat);
+      frames[i] = (fabsf(value) < kSilence) ? 0.0f : value;
+    }
+  }
+  return response;
+}
+
+void ImpulseResponse::normalize() {
+
+  double maxEnergy = 0;
+  int32_t length = 0;
+  for (int32_t channel = 0; channel < channelCount_; channel++) {
+    const float *frames = getChannel(channel);
+    double energy = 0;
+    for (int32_t i = 0; i < numFrames_; i++) {
+      energy += frames[i] * frames[i];
+      if (frames[i] != 0) length = std::max(length, i + 1);
+    }
+    maxEnergy = std::max(maxEnergy, energy);
+  }
+  if (maxEnergy == 0) return;
+
+  float scale = static_cast<float>(1 / sqrt(maxEnergy));
+  std::vector<float> frames(static_cast<size_t>(channelCount_) * length);
+  for (int32_t channel = 0; channel < channelCount_; channel++) {
+    for (int32_t i = 0; i < length; i++) {
+      frames[channel * length + i] = getChannel(channel)[i] * scale;
+    }
+  }
+  frames_.swap(frames);
+  numFrames_ = length;
+}
+
+std::vector<float> ImpulseResponse::resample(int32_t channel, int32_t sampleRate) const {
+
+  const float *input = getChannel(channel);
+  if (sampleRate == sampleRate_) return std::vector<float>(input, input + numFrames_);
+
+  // Input frames per output frame, and the cutoff as a fraction of the input's Nyquist frequency
+  const double step = static_cast<double>(sampleRate_) / sampleRate;
+  const double cutoff = std::min(1.0, 1 / step);
+  const double halfWidth = kResampleZeroCrossings / cutoff;
+  const int64_t numOutputFrames = static_cast<int64_t>(ceil(numFrames_ / step));
+
+  std::vector<float> output(numOutputFrames);
+  for (int64_t i = 0; i < numOutputFrames; i++) {
+    const double centre = i * step;
+    const int64_t first = std::max<int64_t>(0, static_cast<int64_t>(ceil(centre - halfWidth)));
+    const int64_t last = std::min<int64_t>(numFrames_ - 1,
+                                           static_cast<int64_t>(floor(centre + halfWidth)));
+    double sum = 0;
+    for (int64_t j = first; j <= last; j++) {
+      double x = j - centre;
+      double sinc = (x == 0) ? 1 : sin(M_PI * cutoff * x) / (M_PI * cutoff * x);
+      double blackman = 0.42 + 0.5 * cos(M_PI * x / halfWidth) +
+                        0.08 * cos(2 * M_PI * x / halfWidth);
+      sum += input[j] * cutoff * sinc * blackman;
+    }
+    output[i] = static_cast<float>(sum);
+  }
+  return output;
+}
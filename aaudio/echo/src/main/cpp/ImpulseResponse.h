@@ -0,0 +1,73 @@
+/*
+ * Copyright 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef AAUDIO_IMPULSERESPONSE_H
+#define AAUDIO_IMPULSERESPONSE_H
+
+#include <stdint.h>
+#include <memory>
+#include <vector>
+
+// Longer files are cut short
+constexpr double kImpulseResponseMaxSeconds = 10;
+
+/**
+ * The impulse response of a room or a speaker cabinet, as planar float frames, for
+ * ConvolutionReverb.
+ */
+class ImpulseResponse {
+
+public:
+  /**
+   * A silent response
+   */
+  ImpulseResponse(int32_t channelCount, int32_t sampleRate, int32_t numFrames);
+
+  /**
+   * Load an 8, 16, 24 or 32-bit integer or a 32 or 64-bit float WAV file. Only the first two
+   * channels of files with more are used.
+   *
+   * @return null if the file can't be read, the reason is logged
+   */
+  static std::shared_ptr<ImpulseResponse> loadWav(const char *path);
+
+  int32_t getChannelCount() const { return channelCount_; }
+  int32_t getSampleRate() const { return sampleRate_; }
+  int32_t getNumFrames() const { return numFrames_; }
+  float *getChannel(int32_t channel) { return &frames_[channel * numFrames_]; }
+  const float *getChannel(int32_t channel) const { return &frames_[channel * numFrames_]; }
+
+  /**
+   * Scale the response so its loudest channel has unit energy, which keeps noise through it at
+   * the same level, and drop any silence at its end
+   */
+  void normalize();
+
+  /**
+   * One channel at another sample rate, through a windowed sinc interpolator which also filters
+   * out anything above the lower of the two Nyquist frequencies
+   */
+  std::vector<float> resample(int32_t channel, int32_t sampleRate) const;
+
+private:
+  int32_t channelCount_;
+  int32_t sampleRate_;
+  int32_t numFrames_;
+  std::vector<float> frames_;
+};
+
+#endif //AAUDIO_IMPULSERESPONSE_H
@@ -0,0 +1,175 @@
+/*
+ * Copyright 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include <logging_macros.h>
+#include <algorithm>
+#include <cmath>
+#include "LatencyMeasurement.h"
+
+// Feedback taps of a Galois LFSR giving the maximum length sequence, x^14 + x^13 + x^12 + x^2 + 1
+constexpr uint32_t kLatencyMeasurementMlsTaps = 0x3802;
+
+// A delay which isn't a whole number of frames spreads the peak over the lags either side, so
+// the confidence counts the correlation this far from it
+constexpr int32_t kLatencyMeasurementPeakSpreadFrames = 4;
+
+void LatencyMeasurement::configure(int32_t sampleRate) {
+
+  std::lock_guard<std::mutex> lock(lock_);
+
+  sampleRate_ = sampleRate;
+  maxLatencyFrames_ = static_cast<int32_t>(
+      static_cast<int64_t>(sampleRate) * kLatencyMeasurementMaxMillis / 1000);
+
+  const int32_t signalFrames = (1 << kLatencyMeasurementMlsOrder) - 1;
+  signal_.resize(signalFrames);
+  uint32_t lfsr = 1;
+  for (int32_t i = 0; i < signalFrames; i++) {
+    signal_[i] = (lfsr & 1) ? kLatencyMeasurementLevel : -kLatencyMeasurementLevel;
+    lfsr = (lfsr & 1) ? (lfsr >> 1) ^ kLatencyMeasurementMlsTaps : lfsr >> 1;
+  }
+  recording_.assign(signalFrames + maxLatencyFrames_, 0.0f);
+
+  // Lags up to maxLatencyFrames_ of the recording against the signal don't wrap around an FFT
+  // the size of the recording
+  int32_t fftSize = 2;
+  while (fftSize < static_cast<int32_t>(recording_.size())) fftSize *= 2;
+  fft_.reset(new RealFft(fftSize));
+  const int32_t stride = fft_->getSpectrumStride();
+  signalRe_.resize(stride);
+  signalIm_.resize(stride);
+  recordingRe_.resize(stride);
+  recordingIm_.resize(stride);
+  correlation_.assign(fftSize, 0.0f);
+
+  std::copy(signal_.begin(), signal_.end(), correlation_.begin());
+  fft_->forward(correlation_.data(), signalRe_.data(), signalIm_.data());
+
+  int32_t state = state_;
+  if (state != LATENCY_MEASUREMENT_IDLE && state != LATENCY_MEASUREMENT_DONE &&
+      state != LATENCY_MEASUREMENT_FAILED) {
+    state_ = LATENCY_MEASUREMENT_REQUESTED;
+  }
+}
+
+void LatencyMeasurement::start() {
+  std::lock_guard<std::mutex> lock(lock_);
+  state_.store(LATENCY_MEASUREMENT_REQUESTED, std::memory_order_release);
+}
+
+void LatencyMeasurement::cancel() {
+  std::lock_guard<std::mutex> lock(lock_);
+  int32_t state = state_;
+  if (state == LATENCY_MEASUREMENT_REQUESTED || state == LATENCY_MEASUREMENT_RECORDING) {
+    state_.compare_exchange_strong(state, LATENCY_MEASUREMENT_IDLE);
+  }
+}
+
+bool LatencyMeasurement::process(const float *input, float *output, int32_t numFrames) {
+
+  int32_t state = state_.load(std::memory_order_acquire);
+  if (state == LATENCY_MEASUREMENT_REQUESTED && !recording_.empty()) {
+    if (!state_.compare_exchange_strong(state, LATENCY_MEASUREMENT_RECORDING)) return false;
+    position_ = 0;
+  } else if (state != LATENCY_MEASUREMENT_RECORDING) {
+    return false;
+  }
+
+  const int32_t signalFrames = static_cast<int32_t>(signal_.size());
+  const int32_t recordingFrames = static_cast<int32_t>(recording_.size());
+  for (int32_t i = 0; i < numFrames; i++) {
+    if (position_ < recordingFrames) recording_[position_] = input[i];
+    output[i] = (position_ < signalFrames) ? signal_[position_] : 0.0f;
+    position_++;
+  }
+
+  // start may have asked for a new measurement meanwhile, in which case it begins next time
+  if (position_ >= recordingFrames) {
+    state_.compare_exchange_strong(state, LATENCY_MEASUREMENT_RECORDED,
+                                   std::memory_order_release);
+  }
+  return true;
+}
+
+LatencyMeasurementState LatencyMeasurement::getResult(RoundTripLatency *result) {
+
+  std::lock_guard<std::mutex> lock(lock_);
+
+  int32_t state = state_.load(std::memory_order_acquire);
+  if (state == LATENCY_MEASUREMENT_RECORDED) {
+    analyze();
+    if (result_.confidence >= kLatencyMeasurementMinConfidence) {
+      state = LATENCY_MEASUREMENT_DONE;
+    } else {
+      LOGW("The test signal wasn't heard, confidence %.3f", result_.confidence);
+      state = LATENCY_MEASUREMENT_FAILED;
+    }
+    state_ = state;
+  }
+  if (state == LATENCY_MEASUREMENT_DONE || state == LATENCY_MEASUREMENT_FAILED) {
+    *result = result_;
+  }
+  return static_cast<LatencyMeasurementState>(state);
+}
+
+/**
+ * Cross-correlate the recording with the test signal and find the lag of the largest peak
+ */
+void LatencyMeasurement::analyze() {
+
+  const int32_t fftSize = fft_->getSize();
+  const int32_t signalFrames = static_cast<int32_t>(signal_.size());
+
+  std::copy(recording_.begin(), recording_.end(), correlation_.begin());
+  std::fill(correlation_.begin() + recording_.size(), correlation_.end(), 0.0f);
+  fft_->forward(correlation_.data(), recordingRe_.data(), recordingIm_.data());
+
+  // The recording's spectrum times the conjugate of the signal's
+  for (int32_t i = 0; i < fft_->getSpectrumStride(); i++) {
+    float re = recordingRe_[i] * signalRe_[i] + recordingIm_[i] * signalIm_[i];
+    float im = recordingIm_[i] * signalRe_[i] - recordingRe_[i] * signalIm_[i];
+    recordingRe_[i] = re;
+    recordingIm_[i] = im;
+  }
+  fft_->inverse(recordingRe_.data(), recordingIm_.data(), correlation_.data());
+
+  // Either polarity, the path may invert the signal
+  int32_t peakLag = 0;
+  for (int32_t lag = 1; lag <= maxLatencyFrames_; lag++) {
+    if (std::fabs(correlation_[lag]) > std::fabs(correlation_[peakLag])) peakLag = lag;
+  }
+
+  double signalEnergy = static_cast<double>(signalFrames) *
+                        kLatencyMeasurementLevel * kLatencyMeasurementLevel;
+  double recordingEnergy = 0;
+  for (int32_t i = 0; i < signalFrames; i++) {
+    recordingEnergy += static_cast<double>(recording_[peakLag + i]) * recording_[peakLag + i];
+  }
+  double peakEnergy = 0;
+  for (int32_t lag = std::max(peakLag - kLatencyMeasurementPeakSpreadFrames, 0);
+       lag <= std::min(peakLag + kLatencyMeasurementPeakSpreadFrames, maxLatencyFrames_); lag++) {
+    peakEnergy += static_cast<double>(correlation_[lag]) * correlation_[lag];
+  }
+  double peak = std::sqrt(peakEnergy) / fftSize;
+
+  result_.frames = peakLag;
+  result_.millis = peakLag * 1000.0 / sampleRate_;
+  result_.confidence = (recordingEnergy > 0) ?
+                       std::min(peak / std::sqrt(signalEnergy * recordingEnergy), 1.0) : 0.0;
+  LOGD("Round trip latency %d frames, %.2f ms, confidence %.3f", result_.frames,
+       result_.millis, result_.confidence);
+}
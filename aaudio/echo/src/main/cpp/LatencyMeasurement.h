@@ -0,0 +1,132 @@
+/*
+ * Copyright 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef AAUDIO_LATENCYMEASUREMENT_H
+#define AAUDIO_LATENCYMEASUREMENT_H
+
+#include <stdint.h>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include <real_fft.h>
+
+// The test signal is a maximum length sequence of 2^order - 1 frames, 341 ms at 48 kHz
+constexpr int32_t kLatencyMeasurementMlsOrder = 14;
+constexpr float kLatencyMeasurementLevel = 0.25f;
+
+// Longest round trip found, the recording runs this long after the test signal ends
+constexpr int32_t kLatencyMeasurementMaxMillis = 1000;
+
+// Below this confidence the test signal wasn't heard and the measurement fails. A recording of
+// noise alone correlates up to about 0.04 somewhere within kLatencyMeasurementMaxMillis.
+constexpr double kLatencyMeasurementMinConfidence = 0.1;
+
+enum LatencyMeasurementState : int32_t {
+  LATENCY_MEASUREMENT_IDLE,
+  LATENCY_MEASUREMENT_REQUESTED,    // Waiting for the audio thread to start playing
+  LATENCY_MEASUREMENT_RECORDING,
+  LATENCY_MEASUREMENT_RECORDED,     // Waiting for getResult to analyze the recording
+  LATENCY_MEASUREMENT_DONE,
+  LATENCY_MEASUREMENT_FAILED        // The test signal wasn't found in the recording
+};
+
+struct RoundTripLatency {
+  int32_t frames;       // From writing a frame to the playback stream to reading it back
+  double millis;
+  double confidence;    // Correlation of the recording with the test signal at that delay,
+                        // 1 for a clean copy, near 0 if it wasn't heard
+};
+
+/**
+ * Measures the round trip latency of a full duplex stream pair by playing a test signal and
+ * finding it in what comes back.
+ *
+ * The test signal is a maximum length sequence, white noise whose autocorrelation is a single
+ * peak, so the recording is cross-correlated with it and the lag of the largest peak is the
+ * latency. The correlation is done with FFTs over the whole recording when the result is asked
+ * for. The confidence is the normalized correlation at the peak, which is 1 if the recording at
+ * that lag is a scaled copy of the test signal, and noise, glitches or a drifting clock all
+ * lower it. It includes the lags just either side of the peak so that a delay between two
+ * frames doesn't count against it, but reflections further away do, so it is lower in a room
+ * than with a loopback cable. A measurement whose confidence is below
+ * kLatencyMeasurementMinConfidence fails, as the peak is then most likely noise.
+ *
+ * process is called on the output audio thread. start and getResult may be called on any thread,
+ * and configure while process isn't running.
+ */
+class LatencyMeasurement {
+
+public:
+  /**
+   * Allocate for streams at sampleRate. A measurement which has been started but not analyzed
+   * starts again.
+   */
+  void configure(int32_t sampleRate);
+
+  /**
+   * Play the test signal from the next process call, abandoning any measurement in progress
+   */
+  void start();
+
+  /**
+   * Abandon a measurement which is waiting to play or recording, for when the streams stop. A
+   * finished recording or result is kept.
+   */
+  void cancel();
+
+  /**
+   * While measuring, record input and replace output with the test signal. input and output may
+   * be the same buffer.
+   *
+   * @return false if there is no measurement playing and output hasn't been touched
+   */
+  bool process(const float *input, float *output, int32_t numFrames);
+
+  /**
+   * Analyze the recording if it has finished. This takes a few milliseconds, so is best not
+   * called on a UI thread.
+   *
+   * @param result set when the result is LATENCY_MEASUREMENT_DONE, or LATENCY_MEASUREMENT_FAILED
+   *     for the confidence and the lag of the peak which was rejected
+   */
+  LatencyMeasurementState getResult(RoundTripLatency *result);
+
+private:
+  // Used by the audio thread while recording and getResult while analyzing, never both
+  std::vector<float> signal_;
+  std::vector<float> recording_;
+  int32_t position_ = 0;
+
+  std::atomic<int32_t> state_ { LATENCY_MEASUREMENT_IDLE };
+  std::mutex lock_;
+
+  // Only used with lock_ held
+  int32_t sampleRate_ = 0;
+  int32_t maxLatencyFrames_ = 0;
+  std::unique_ptr<RealFft> fft_;
+  std::vector<float> signalRe_;
+  std::vector<float> signalIm_;
+  std::vector<float> recordingRe_;
+  std::vector<float> recordingIm_;
+  std::vector<float> correlation_;
+  RoundTripLatency result_;
+
+  void analyze();
+};
+
+#endif //AAUDIO_LATENCYMEASUREMENT_H
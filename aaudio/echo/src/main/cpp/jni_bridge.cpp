@@ -73,5 +73,114 @@ Java_com_google_sample_aaudio_echo_EchoEngine_setPlaybackDeviceId(JNIEnv *env,
   engine->setPlaybackDeviceId(deviceId);
 }
 
+JNIEXPORT void JNICALL
+Java_com_google_sample_aaudio_echo_EchoEngine_setEffectDelayMillis(JNIEnv *env,
+                                                                    jclass, jdouble delayMillis) {
+  if (engine == nullptr) {
+    LOGE("Engine is null, you must call createEngine before calling this method");
+    return;
+  }
+
+  engine->setEffectDelayMillis(delayMillis);
+}
+
+JNIEXPORT void JNICALL
+Java_com_google_sample_aaudio_echo_EchoEngine_setEffectFeedback(JNIEnv *env,
+                                                                 jclass, jfloat feedback) {
+  if (engine == nullptr) {
+    LOGE("Engine is null, you must call createEngine before calling this method");
+    return;
+  }
+
+  engine->setEffectFeedback(feedback);
+}
+
+JNIEXPORT void JNICALL
+Java_com_google_sample_aaudio_echo_EchoEngine_setEffectMix(JNIEnv *env,
+                                                            jclass, jfloat mix) {
+  if (engine == nullptr) {
+    LOGE("Engine is null, you must call createEngine before calling this method");
+    return;
+  }
+
+  engine->setEffectMix(mix);
+}
+
+JNIEXPORT jboolean JNICALL
+Java_com_google_sample_aaudio_echo_EchoEngine_loadImpulseResponse(JNIEnv *env,
+                                                                   jclass, jstring path) {
+  if (engine == nullptr) {
+    LOGE("Engine is null, you must call createEngine before calling this method");
+    return JNI_FALSE;
+  }
+
+  const char *pathChars = env->GetStringUTFChars(path, nullptr);
+  bool isLoaded = engine->loadImpulseResponse(pathChars);
+  env->ReleaseStringUTFChars(path, pathChars);
+  return isLoaded ? JNI_TRUE : JNI_FALSE;
+}
+
+JNIEXPORT void JNICALL
+Java_com_google_sample_aaudio_echo_EchoEngine_clearImpulseResponse(JNIEnv *env,
+                                                                    jclass) {
+  if (engine == nullptr) {
+    LOGE("Engine is null, you must call createEngine before calling this method");
+    return;
+  }
+
+  engine->clearImpulseResponse();
+}
+
+JNIEXPORT void JNICALL
+Java_com_google_sample_aaudio_echo_EchoEngine_setReverbMix(JNIEnv *env,
+                                                            jclass, jfloat mix) {
+  if (engine == nullptr) {
+    LOGE("Engine is null, you must call createEngine before calling this method");
+    return;
+  }
+
+  engine->setReverbMix(mix);
+}
+
+JNIEXPORT jboolean JNICALL
+Java_com_google_sample_aaudio_echo_EchoEngine_startLatencyMeasurement(JNIEnv *env,
+                                                                       jclass) {
+  if (engine == nullptr) {
+    LOGE("Engine is null, you must call createEngine before calling this method");
+    return JNI_FALSE;
+  }
+
+  return engine->startLatencyMeasurement() ? JNI_TRUE : JNI_FALSE;
+}
+
+JNIEXPORT jint JNICALL
+Java_com_google_sample_aaudio_echo_EchoEngine_getLatencyMeasurementState(JNIEnv *env,
+                                                                          jclass) {
+  if (engine == nullptr) {
+    LOGE("Engine is null, you must call createEngine before calling this method");
+    return LATENCY_MEASUREMENT_IDLE;
+  }
+
+  RoundTripLatency latency;
+  return engine->getRoundTripLatency(&latency);
+}
+
+JNIEXPORT jdoubleArray JNICALL
+Java_com_google_sample_aaudio_echo_EchoEngine_getRoundTripLatency(JNIEnv *env,
+                                                                   jclass) {
+  if (engine == nullptr) {
+    LOGE("Engine is null, you must call createEngine before calling this method");
+    return nullptr;
+  }
+
+  RoundTripLatency latency;
+  if (engine->getRoundTripLatency(&latency) != LATENCY_MEASUREMENT_DONE) return nullptr;
+
+  jdouble values[] = { static_cast<jdouble>(latency.frames), latency.millis, latency.confidence };
+  jdoubleArray result = env->NewDoubleArray(3);
+  if (result != nullptr) env->SetDoubleArrayRegion(result, 0, 3, values);
+  return result;
+}
+
 
 }
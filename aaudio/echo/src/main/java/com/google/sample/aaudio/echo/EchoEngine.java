@@ -25,6 +25,14 @@ public enum EchoEngine {
 
     INSTANCE;
 
+    // States of a latency measurement, as in LatencyMeasurement.h
+    static final int LATENCY_MEASUREMENT_IDLE = 0;
+    static final int LATENCY_MEASUREMENT_REQUESTED = 1;
+    static final int LATENCY_MEASUREMENT_RECORDING = 2;
+    static final int LATENCY_MEASUREMENT_RECORDED = 3;
+    static final int LATENCY_MEASUREMENT_DONE = 4;
+    static final int LATENCY_MEASUREMENT_FAILED = 5;
+
     // Load native library
     static {
         System.loadLibrary("echo");
@@ -36,4 +44,20 @@ public enum EchoEngine {
     static native void setEchoOn(boolean isEchoOn);
     static native void setRecordingDeviceId(int deviceId);
     static native void setPlaybackDeviceId(int deviceId);
+    static native void setEffectDelayMillis(double delayMillis);
+    static native void setEffectFeedback(float feedback);
+    static native void setEffectMix(float mix);
+    static native boolean loadImpulseResponse(String path);
+    static native void clearImpulseResponse();
+    static native void setReverbMix(float mix);
+    // false if the echo is off, turning it off also abandons a measurement
+    static native boolean startLatencyMeasurement();
+
+    // Poll until LATENCY_MEASUREMENT_DONE, or LATENCY_MEASUREMENT_FAILED if the test signal
+    // wasn't heard and the measurement should be started again
+    static native int getLatencyMeasurementState();
+
+    // {latency in frames, latency in milliseconds, confidence from 0 to 1}, or null unless the
+    // measurement is LATENCY_MEASUREMENT_DONE
+    static native double[] getRoundTripLatency();
 }
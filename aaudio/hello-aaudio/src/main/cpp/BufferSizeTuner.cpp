@@ -0,0 +1,129 @@
+/*
+ * Copyright 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <algorithm>
+#include "BufferSizeTuner.h"
+
+constexpr int64_t kNanosPerSecond = 1000000000LL;
+constexpr int64_t kNanosPerMillisecond = 1000000LL;
+
+void BufferSizeTuner::configure(int32_t framesPerBurst, int32_t sampleRate,
+                                int32_t bufferCapacityInFrames) {
+  framesPerBurst_ = std::max(1, framesPerBurst);
+  sampleRate_ = sampleRate;
+  capacityInBursts_ = std::max(1, std::min(bufferCapacityInFrames / framesPerBurst_,
+                                           kBufferSizeTunerMaxBursts));
+}
+
+void BufferSizeTuner::reset(int32_t bufferSizeInBursts, int32_t xRunCount, int64_t nowNanos) {
+
+  int32_t maxBursts = getMaxBufferSizeInBursts();
+  bufferSizeInBursts_.store(std::max(1, std::min(bufferSizeInBursts, maxBursts)));
+  maxBufferSizeInBursts_.store(maxBursts);
+  xRunCount_.store(0);
+  growCount_.store(0);
+  shrinkCount_.store(0);
+  shrinkWindowNanos_.store(baseShrinkWindowNanos_.load());
+  shrinkWindowMultiplier_ = 1;
+  for (std::atomic<int64_t> &time : timeAtSizeNanos_) time.store(0);
+
+  lastXRunCount_ = xRunCount;
+  lastUpdateNanos_ = nowNanos;
+  lastChangeNanos_ = nowNanos;
+  hasShrunk_ = false;
+}
+
+int32_t BufferSizeTuner::update(int32_t xRunCount, int64_t nowNanos) {
+
+  int32_t bursts = bufferSizeInBursts_.load(std::memory_order_relaxed);
+  std::atomic<int64_t> &timeAtSize = timeAtSizeNanos_[bursts];
+  timeAtSize.store(timeAtSize.load(std::memory_order_relaxed) + nowNanos - lastUpdateNanos_,
+                   std::memory_order_relaxed);
+  lastUpdateNanos_ = nowNanos;
+
+  int64_t shrinkWindow = baseShrinkWindowNanos_.load(std::memory_order_relaxed) *
+                         shrinkWindowMultiplier_;
+  int32_t maxBursts = getMaxBufferSizeInBursts();
+
+  if (xRunCount > lastXRunCount_) {
+    xRunCount_.store(xRunCount_.load(std::memory_order_relaxed) + xRunCount - lastXRunCount_,
+                     std::memory_order_relaxed);
+    lastXRunCount_ = xRunCount;
+
+    // The last shrink went too far, wait longer before trying that size again
+    if (hasShrunk_ && nowNanos - lastShrinkNanos_ < shrinkWindow) {
+      shrinkWindowMultiplier_ = std::min(shrinkWindowMultiplier_ * 2, kMaxShrinkWindowMultiplier);
+      hasShrunk_ = false;
+    }
+    if (bursts < maxBursts) {
+      bursts++;
+      growCount_.store(growCount_.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    }
+    lastChangeNanos_ = nowNanos;
+
+  } else if (nowNanos - lastChangeNanos_ >= shrinkWindow && bursts > 1) {
+
+    // The previous shrink survived a whole window, so the window can come down again
+    if (hasShrunk_) shrinkWindowMultiplier_ = std::max(shrinkWindowMultiplier_ / 2, 1);
+    bursts--;
+    shrinkCount_.store(shrinkCount_.load(std::memory_order_relaxed) + 1,
+                       std::memory_order_relaxed);
+    lastChangeNanos_ = nowNanos;
+    lastShrinkNanos_ = nowNanos;
+    hasShrunk_ = true;
+  }
+
+  // The target latency may have been lowered
+  if (bursts > maxBursts) {
+    bursts = maxBursts;
+    lastChangeNanos_ = nowNanos;
+  }
+
+  bufferSizeInBursts_.store(bursts, std::memory_order_relaxed);
+  maxBufferSizeInBursts_.store(maxBursts, std::memory_order_relaxed);
+  shrinkWindowNanos_.store(baseShrinkWindowNanos_.load(std::memory_order_relaxed) *
+                          shrinkWindowMultiplier_, std::memory_order_relaxed);
+  return bursts;
+}
+
+void BufferSizeTuner::setShrinkWindowMillis(int32_t shrinkWindowMillis) {
+  baseShrinkWindowNanos_.store(std::max(1, shrinkWindowMillis) * kNanosPerMillisecond);
+}
+
+void BufferSizeTuner::setTargetMaxLatencyMillis(double targetMaxLatencyMillis) {
+  targetMaxLatencyNanos_.store(
+      static_cast<int64_t>(std::max(0.0, targetMaxLatencyMillis) * kNanosPerMillisecond));
+}
+
+void BufferSizeTuner::getState(BufferSizeTunerState *state) const {
+  state->bufferSizeInBursts = bufferSizeInBursts_.load(std::memory_order_relaxed);
+  state->maxBufferSizeInBursts = maxBufferSizeInBursts_.load(std::memory_order_relaxed);
+  state->xRunCount = xRunCount_.load(std::memory_order_relaxed);
+  state->growCount = growCount_.load(std::memory_order_relaxed);
+  state->shrinkCount = shrinkCount_.load(std::memory_order_relaxed);
+  state->shrinkWindowNanos = shrinkWindowNanos_.load(std::memory_order_relaxed);
+  for (int i = 0; i <= kBufferSizeTunerMaxBursts; i++) {
+    state->timeAtSizeNanos[i] = timeAtSizeNanos_[i].load(std::memory_order_relaxed);
+  }
+}
+
+int32_t BufferSizeTuner::getMaxBufferSizeInBursts() const {
+  int64_t targetMaxLatencyNanos = targetMaxLatencyNanos_.load(std::memory_order_relaxed);
+  if (targetMaxLatencyNanos == 0) return capacityInBursts_;
+  int64_t targetFrames = targetMaxLatencyNanos * sampleRate_ / kNanosPerSecond;
+  int32_t targetMaxBursts = static_cast<int32_t>(targetFrames / framesPerBurst_);
+  return std::max(1, std::min(targetMaxBursts, capacityInBursts_));
+}
@@ -0,0 +1,117 @@
+/*
+ * Copyright 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef AAUDIO_BUFFERSIZETUNER_H
+#define AAUDIO_BUFFERSIZETUNER_H
+
+#include <stdint.h>
+#include <atomic>
+
+constexpr int32_t kBufferSizeTunerMaxBursts = 32;
+constexpr int64_t kDefaultShrinkWindowNanos = 5000000000LL;
+
+// A shrink window never grows past this many times the configured window
+constexpr int32_t kMaxShrinkWindowMultiplier = 8;
+
+/**
+ * A snapshot of the tuner, see BufferSizeTuner::getState
+ */
+struct BufferSizeTunerState {
+  int32_t bufferSizeInBursts;
+  int32_t maxBufferSizeInBursts;      // Cap from the stream capacity and the target latency
+  int32_t xRunCount;                  // Since the tuner was reset
+  int32_t growCount;
+  int32_t shrinkCount;
+  int64_t shrinkWindowNanos;          // Current underrun-free time needed to shrink
+  int64_t timeAtSizeNanos[kBufferSizeTunerMaxBursts + 1];   // Indexed by size in bursts
+};
+
+/**
+ * Chooses an output buffer size, in bursts, from the stream's xrun count.
+ *
+ * The buffer grows by one burst on every callback which sees the xrun count go up, and shrinks by
+ * one burst after a whole shrink window without xruns. If a shrink is followed by an xrun within
+ * the window the window doubles, up to kMaxShrinkWindowMultiplier times the configured one, so a
+ * size which keeps glitching is tried less and less often. Each shrink which survives its window
+ * halves it again.
+ *
+ * The size never goes above the stream capacity or, if one is set, the largest size which keeps
+ * the buffer latency under the target. With a target the tuner accepts xruns rather than
+ * exceed it.
+ *
+ * update is called on the audio thread. configure and reset must not be called at the same time
+ * as update, for example before the stream starts or while automatic tuning is off. The setters
+ * and getState may be called on any thread.
+ */
+class BufferSizeTuner {
+
+public:
+  /**
+   * Set the properties of a new stream, before its callbacks start
+   */
+  void configure(int32_t framesPerBurst, int32_t sampleRate, int32_t bufferCapacityInFrames);
+
+  /**
+   * Start tuning again from a size, forgetting the xrun history
+   */
+  void reset(int32_t bufferSizeInBursts, int32_t xRunCount, int64_t nowNanos);
+
+  /**
+   * @param xRunCount the stream's current xrun count
+   * @param nowNanos CLOCK_MONOTONIC time
+   * @return the buffer size in bursts the stream should use
+   */
+  int32_t update(int32_t xRunCount, int64_t nowNanos);
+
+  void setShrinkWindowMillis(int32_t shrinkWindowMillis);
+
+  /**
+   * Limit the buffer size so its latency stays under a target, zero removes the limit
+   */
+  void setTargetMaxLatencyMillis(double targetMaxLatencyMillis);
+
+  void getState(BufferSizeTunerState *state) const;
+
+private:
+  // Set on any thread
+  std::atomic<int64_t> baseShrinkWindowNanos_ { kDefaultShrinkWindowNanos };
+  std::atomic<int64_t> targetMaxLatencyNanos_ { 0 };
+
+  // Only used by the audio thread
+  int32_t framesPerBurst_ = 1;
+  int32_t sampleRate_ = 48000;
+  int32_t capacityInBursts_ = 1;
+  int32_t lastXRunCount_ = 0;
+  int64_t lastUpdateNanos_ = 0;
+  int64_t lastChangeNanos_ = 0;
+  int64_t lastShrinkNanos_ = 0;
+  bool hasShrunk_ = false;
+  int32_t shrinkWindowMultiplier_ = 1;
+
+  // Written by the audio thread, read by getState. Only one thread writes them so they don't
+  // need read-modify-write operations.
+  std::atomic<int32_t> bufferSizeInBursts_ { 1 };
+  std::atomic<int32_t> maxBufferSizeInBursts_ { 1 };
+  std::atomic<int32_t> xRunCount_ { 0 };
+  std::atomic<int32_t> growCount_ { 0 };
+  std::atomic<int32_t> shrinkCount_ { 0 };
+  std::atomic<int64_t> shrinkWindowNanos_ { kDefaultShrinkWindowNanos };
+  std::atomic<int64_t> timeAtSizeNanos_[kBufferSizeTunerMaxBursts + 1] {};
+
+  int32_t getMaxBufferSizeInBursts() const;
+};
+
+#endif //AAUDIO_BUFFERSIZETUNER_H
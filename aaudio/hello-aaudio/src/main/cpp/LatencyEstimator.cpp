@@ -0,0 +1,131 @@
+/*
+ * Copyright 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <cmath>
+#include "LatencyEstimator.h"
+
+constexpr double kNanosPerSecond = 1e9;
+constexpr double kNanosPerMillisecond = 1e6;
+
+LatencyEstimator::LatencyEstimator() {
+  reset(sampleRate_);
+}
+
+void LatencyEstimator::reset(int32_t sampleRate) {
+  sampleRate_ = sampleRate;
+  sampleCount_ = 0;
+  nextSample_ = 0;
+  lastSampleNanos_ = 0;
+  fitNanosPerFrame_ = kNanosPerSecond / sampleRate;
+  publish(0);
+}
+
+bool LatencyEstimator::isSampleDue(int64_t nowNanos) const {
+  return sampleCount_ == 0 || nowNanos - lastSampleNanos_ >= kLatencyEstimatorSamplePeriodNanos;
+}
+
+void LatencyEstimator::addTimestamp(int64_t framePosition, int64_t presentationTimeNanos,
+                                    int64_t nowNanos) {
+
+  lastSampleNanos_ = nowNanos;
+
+  // Start again if the timestamp is off the line, or the position went backwards
+  if (sampleCount_ > 0) {
+    int64_t lastFramePosition =
+        framePositions_[(nextSample_ - 1) & (kLatencyEstimatorMaxSamples - 1)];
+    double predictedNanos = fitTimeNanos_ + (framePosition - fitFrame_) * fitNanosPerFrame_;
+    if (framePosition <= lastFramePosition ||
+        std::fabs(presentationTimeNanos - predictedNanos) > kLatencyEstimatorMaxResidualNanos) {
+      sampleCount_ = 0;
+      nextSample_ = 0;
+      fitNanosPerFrame_ = kNanosPerSecond / sampleRate_;
+    }
+  }
+
+  framePositions_[nextSample_] = framePosition;
+  presentationTimes_[nextSample_] = presentationTimeNanos;
+  nextSample_ = (nextSample_ + 1) & (kLatencyEstimatorMaxSamples - 1);
+  if (sampleCount_ < kLatencyEstimatorMaxSamples) sampleCount_++;
+  fitLine();
+}
+
+void LatencyEstimator::fitLine() {
+
+  // Work relative to the newest sample so the sums stay small enough for doubles
+  int32_t newest = (nextSample_ - 1) & (kLatencyEstimatorMaxSamples - 1);
+  fitFrame_ = framePositions_[newest];
+  int64_t referenceTime = presentationTimes_[newest];
+
+  double meanFrames = 0;
+  double meanNanos = 0;
+  for (int i = 0; i < sampleCount_; i++) {
+    meanFrames += framePositions_[i] - fitFrame_;
+    meanNanos += presentationTimes_[i] - referenceTime;
+  }
+  meanFrames /= sampleCount_;
+  meanNanos /= sampleCount_;
+
+  // With a single sample, or samples too close together, keep the previous slope
+  double covariance = 0;
+  double variance = 0;
+  for (int i = 0; i < sampleCount_; i++) {
+    double frames = framePositions_[i] - fitFrame_ - meanFrames;
+    covariance += frames * (presentationTimes_[i] - referenceTime - meanNanos);
+    variance += frames * frames;
+  }
+  if (sampleCount_ > 1 && variance >= static_cast<double>(sampleRate_) * sampleRate_ / 100) {
+    fitNanosPerFrame_ = covariance / variance;
+  }
+
+  // The line passes through the mean
+  fitTimeNanos_ = referenceTime + static_cast<int64_t>(meanNanos - meanFrames * fitNanosPerFrame_);
+}
+
+void LatencyEstimator::update(int64_t framesWritten, int64_t nowNanos) {
+  if (sampleCount_ == 0) return;
+  double presentationTimeNanos = fitTimeNanos_ + (framesWritten - fitFrame_) * fitNanosPerFrame_;
+  publish((presentationTimeNanos - nowNanos) / kNanosPerMillisecond);
+}
+
+void LatencyEstimator::publish(double latencyMillis) {
+
+  double framesPerSecond = kNanosPerSecond / fitNanosPerFrame_;
+  uint32_t sequence = sequence_.load(std::memory_order_relaxed);
+  sequence_.store(sequence + 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+
+  latencyMillis_.store(latencyMillis, std::memory_order_relaxed);
+  framesPerSecond_.store(framesPerSecond, std::memory_order_relaxed);
+  driftPpm_.store((framesPerSecond / sampleRate_ - 1.0) * 1e6, std::memory_order_relaxed);
+  publishedSampleCount_.store(sampleCount_, std::memory_order_relaxed);
+
+  sequence_.store(sequence + 2, std::memory_order_release);
+}
+
+bool LatencyEstimator::getEstimate(LatencyEstimate *estimate) const {
+
+  uint32_t sequence;
+  do {
+    sequence = sequence_.load(std::memory_order_acquire);
+    estimate->latencyMillis = latencyMillis_.load(std::memory_order_relaxed);
+    estimate->driftPpm = driftPpm_.load(std::memory_order_relaxed);
+    estimate->framesPerSecond = framesPerSecond_.load(std::memory_order_relaxed);
+    estimate->sampleCount = publishedSampleCount_.load(std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_acquire);
+  } while ((sequence & 1) != 0 || sequence != sequence_.load(std::memory_order_relaxed));
+
+  return estimate->sampleCount > 0;
+}
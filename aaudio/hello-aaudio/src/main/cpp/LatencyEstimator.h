@@ -0,0 +1,107 @@
+/*
+ * Copyright 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef AAUDIO_LATENCYESTIMATOR_H
+#define AAUDIO_LATENCYESTIMATOR_H
+
+#include <stdint.h>
+#include <atomic>
+
+// Timestamps kept for the fit, must be a power of two
+constexpr int32_t kLatencyEstimatorMaxSamples = 64;
+constexpr int64_t kLatencyEstimatorSamplePeriodNanos = 250000000LL;
+
+// A timestamp further than this from the fitted line starts a new fit, for example after the
+// device timeline jumps
+constexpr int64_t kLatencyEstimatorMaxResidualNanos = 2000000LL;
+
+struct LatencyEstimate {
+  double latencyMillis;       // Time from writing the next frame until it is presented
+  double driftPpm;            // Device clock error relative to CLOCK_MONOTONIC, positive is fast
+  double framesPerSecond;     // Measured device frame rate
+  int32_t sampleCount;        // Timestamps in the current fit
+};
+
+/**
+ * Estimates output latency and device clock drift from occasional stream timestamps.
+ *
+ * The latency of a frame is the time it will be presented minus the time it is written. Rather
+ * than asking the stream for a timestamp in every callback, the estimator keeps a timestamp every
+ * kLatencyEstimatorSamplePeriodNanos and fits presentation time against frame position with a
+ * least squares line over the last kLatencyEstimatorMaxSamples of them. The line gives the
+ * presentation time of the next frame written, so every callback gets a latency estimate without
+ * a timestamp call, and its slope gives the device's real frame rate and so its drift.
+ *
+ * isSampleDue, addTimestamp and update are called on the audio thread. The estimate is published
+ * with a sequence lock so getEstimate can be called on any thread without blocking the audio
+ * thread.
+ */
+class LatencyEstimator {
+
+public:
+  LatencyEstimator();
+
+  void reset(int32_t sampleRate);
+
+  /**
+   * @return true if it is time to call addTimestamp
+   */
+  bool isSampleDue(int64_t nowNanos) const;
+
+  /**
+   * Add a timestamp from AAudioStream_getTimestamp
+   */
+  void addTimestamp(int64_t framePosition, int64_t presentationTimeNanos, int64_t nowNanos);
+
+  /**
+   * Publish the latency of the next frame to be written
+   *
+   * @param framesWritten AAudioStream_getFramesWritten
+   * @param nowNanos CLOCK_MONOTONIC time
+   */
+  void update(int64_t framesWritten, int64_t nowNanos);
+
+  /**
+   * @return false if there is no estimate yet
+   */
+  bool getEstimate(LatencyEstimate *estimate) const;
+
+private:
+  // Only used by the audio thread
+  int32_t sampleRate_ = 48000;
+  int64_t framePositions_[kLatencyEstimatorMaxSamples];
+  int64_t presentationTimes_[kLatencyEstimatorMaxSamples];
+  int32_t sampleCount_ = 0;
+  int32_t nextSample_ = 0;
+  int64_t lastSampleNanos_ = 0;
+
+  // The fitted line, presentation time = fitTimeNanos_ + (frame - fitFrame_) * fitNanosPerFrame_
+  int64_t fitFrame_ = 0;
+  int64_t fitTimeNanos_ = 0;
+  double fitNanosPerFrame_ = 0;
+
+  // The published estimate. The sequence is odd while the audio thread is writing it.
+  std::atomic<uint32_t> sequence_ { 0 };
+  std::atomic<double> latencyMillis_ { 0 };
+  std::atomic<double> driftPpm_ { 0 };
+  std::atomic<double> framesPerSecond_ { 0 };
+  std::atomic<int32_t> publishedSampleCount_ { 0 };
+
+  void fitLine();
+  void publish(double latencyMillis);
+};
+
+#endif //AAUDIO_LATENCYESTIMATOR_H
@@ -17,7 +17,11 @@
 #include <assert.h>
 #include <trace.h>
 #include <logging_macros.h>
+#include <rt_log.h>
 #include <inttypes.h>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
 #include "PlayAudioEngine.h"
 
 
@@ -69,19 +73,39 @@ PlayAudioEngine::PlayAudioEngine() {
   // blocking. See https://developer.android.com/studio/profile/systrace-commandline.html
   Trace::initialize();
 
+  // Messages from the data callback are logged through RtLog's queue, which this thread drains
+  RtLog::start();
+
   sampleChannels_ = kStereoChannelCount;
   sampleFormat_ = AAUDIO_FORMAT_PCM_FLOAT;
 
   // Create the output stream. By not specifying an audio device id we are telling AAudio that
   // we want the stream to be created using the default playback audio device.
-  createPlaybackStream();
+  PlaybackStream *playbackStream = &playbackStreams_[activeStreamIndex_];
+  if (openPlaybackStream(playbackStream)) {
+    takeOverPlayback(playbackStream);
+    playbackStream->gain = 1;
+    playbackStream->state.store(PLAYBACK_STREAM_ACTIVE);
+    playStream_.store(playbackStream->stream);
+    playStreamDeviceId_.store(playbackStream->deviceId);
+
+    // Start the stream - the dataCallback function will start being called
+    aaudio_result_t result = AAudioStream_requestStart(playStream_);
+    if (result != AAUDIO_OK) {
+      LOGE("Error starting stream. %s", AAudio_convertResultToText(result));
+    }
+  }
 }
 
 PlayAudioEngine::~PlayAudioEngine(){
 
-  closeOutputStream();
-  delete sineOscLeft_;
-  delete sineOscRight_;
+  {
+    std::lock_guard<std::mutex> lock(switchThreadLock_);
+    if (switchThread_.joinable()) switchThread_.join();
+  }
+  closePlaybackStream(&playbackStreams_[0]);
+  closePlaybackStream(&playbackStreams_[1]);
+  RtLog::stop();
 }
 
 /**
@@ -96,9 +120,9 @@ void PlayAudioEngine::setDeviceId(int32_t deviceId){
 
   playbackDeviceId_ = deviceId;
 
-  // If this is a different device from the one currently in use then restart the stream
-  int32_t currentDeviceId = AAudioStream_getDeviceId(playStream_);
-  if (deviceId != currentDeviceId) restartStream();
+  // If this is a different device from the one currently in use then switch streams. A switch
+  // already in progress switches again for the new device when it finishes.
+  if (deviceId != playStreamDeviceId_) restartStream();
 }
 
 /**
@@ -116,60 +140,100 @@ AAudioStreamBuilder* PlayAudioEngine::createStreamBuilder() {
 }
 
 /**
- * Creates an audio stream for playback. The audio device used will depend on playbackDeviceId_.
+ * Opens an audio stream for playback without starting it. The audio device used will depend on
+ * playbackDeviceId_.
+ *
+ * @return false if the stream couldn't be opened
  */
-void PlayAudioEngine::createPlaybackStream(){
+bool PlayAudioEngine::openPlaybackStream(PlaybackStream *playbackStream){
 
   AAudioStreamBuilder* builder = createStreamBuilder();
+  if (builder == nullptr){
+    LOGE("Unable to obtain an AAudioStreamBuilder object");
+    return false;
+  }
 
-  if (builder != nullptr){
-
-    setupPlaybackStreamParameters(builder);
-
-    aaudio_result_t result = AAudioStreamBuilder_openStream(builder, &playStream_);
-
-    if (result == AAUDIO_OK && playStream_ != nullptr){
-
-      // check that we got PCM_FLOAT format
-      if (sampleFormat_ != AAudioStream_getFormat(playStream_)) {
-        LOGW("Sample format is not PCM_FLOAT");
-      }
+  setupPlaybackStreamParameters(builder);
 
-      sampleRate_ = AAudioStream_getSampleRate(playStream_);
-      framesPerBurst_ = AAudioStream_getFramesPerBurst(playStream_);
+  AAudioStream *stream = nullptr;
+  aaudio_result_t result = AAudioStreamBuilder_openStream(builder, &stream);
+  AAudioStreamBuilder_delete(builder);
 
-      // Set the buffer size to the burst size - this will give us the minimum possible latency
-      AAudioStream_setBufferSizeInFrames(playStream_, framesPerBurst_);
-      bufSizeInFrames_ = framesPerBurst_;
+  if (result != AAUDIO_OK || stream == nullptr){
+    LOGE("Failed to create stream. Error: %s", AAudio_convertResultToText(result));
+    return false;
+  }
 
-      PrintAudioStreamInfo(playStream_);
-      prepareOscillators();
+  // check that we got PCM_FLOAT format
+  if (sampleFormat_ != AAudioStream_getFormat(stream)) {
+    LOGW("Sample format is not PCM_FLOAT");
+  }
 
-      // Start the stream - the dataCallback function will start being called
-      result = AAudioStream_requestStart(playStream_);
-      if (result != AAUDIO_OK) {
-        LOGE("Error starting stream. %s", AAudio_convertResultToText(result));
-      }
+  playbackStream->sampleRate = AAudioStream_getSampleRate(stream);
+  playbackStream->framesPerBurst = AAudioStream_getFramesPerBurst(stream);
+  playbackStream->deviceId = AAudioStream_getDeviceId(stream);
+  preparePartials(playbackStream);
 
-      // Store the underrun count so we can tune the latency in the dataCallback
-      playStreamUnderrunCount_ = AAudioStream_getXRunCount(playStream_);
+  // Set the buffer size to the burst size - this will give us the minimum possible latency
+  AAudioStream_setBufferSizeInFrames(stream, playbackStream->framesPerBurst);
+  playbackStream->requestedBufferSize = playbackStream->framesPerBurst;
 
-    } else {
-      LOGE("Failed to create stream. Error: %s", AAudio_convertResultToText(result));
-    }
+  PrintAudioStreamInfo(stream);
+  playbackStream->gain = 0;
+  playbackStream->gainStep = 0;
+  playbackStream->stream.store(stream);
+  return true;
+}
 
-  AAudioStreamBuilder_delete(builder);
+/**
+ * Set the oscillators up for the stream's sample rate. Their phase is kept so a tone carries on
+ * smoothly when the stream changes.
+ */
+void PlayAudioEngine::prepareOscillators(PlaybackStream *playbackStream) {
+  playbackStream->oscLeft.setup(440.0, playbackStream->sampleRate, 0.25);
+  playbackStream->oscRight.setup(660.0, playbackStream->sampleRate, 0.25);
+}
 
-  } else {
-    LOGE("Unable to obtain an AAudioStreamBuilder object");
+/**
+ * Create the stream's partials for its sample rate, spaced evenly in pitch from kLowestPartial to
+ * 20kHz or just below the Nyquist frequency. Their amplitudes are set by applyPartialCount.
+ */
+void PlayAudioEngine::preparePartials(PlaybackStream *playbackStream) {
+  constexpr double kLowestPartial = 20.0;
+  double highestPartial = std::min(20000.0, 0.45 * playbackStream->sampleRate);
+  playbackStream->partials.reset(new SineGeneratorBank(kMaxPartials,
+                                                       playbackStream->sampleRate));
+  for (int32_t i = 0; i < kMaxPartials; i++) {
+    double position = (i + 0.5) / kMaxPartials;
+    playbackStream->partials->setFrequency(
+        i, kLowestPartial * pow(highestPartial / kLowestPartial, position));
   }
 }
 
-void PlayAudioEngine::prepareOscillators() {
-  sineOscLeft_ = new SineGenerator();
-  sineOscLeft_->setup(440.0, sampleRate_, 0.25);
-  sineOscRight_ = new SineGenerator();
-  sineOscRight_->setup(660.0, sampleRate_, 0.25);
+/**
+ * Make a stream the one whose buffer size and latency are tracked. Called on the stream's
+ * callback thread once the handover is ready, or before the first stream is started. The fields
+ * other threads read are atomics.
+ */
+void PlayAudioEngine::takeOverPlayback(PlaybackStream *playbackStream) {
+
+  AAudioStream *stream = playbackStream->stream;
+  int32_t framesPerBurst = playbackStream->framesPerBurst;
+  int32_t bufferSize = AAudioStream_getBufferSizeInFrames(stream);
+  int32_t sampleRate = playbackStream->sampleRate;
+  sampleRate_.store(sampleRate);
+  framesPerBurst_.store(framesPerBurst);
+  bufSizeInFrames_.store(bufferSize);
+  prepareOscillators(playbackStream);
+
+  // Store the underrun count so we can tune the latency in the dataCallback
+  int32_t underrunCount = AAudioStream_getXRunCount(stream);
+  playStreamUnderrunCount_.store(underrunCount);
+  bufferSizeTuner_.configure(framesPerBurst, sampleRate,
+                             AAudioStream_getBufferCapacityInFrames(stream));
+  bufferSizeTuner_.reset(bufferSize / framesPerBurst, underrunCount,
+                         get_time_nanoseconds(CLOCK_MONOTONIC));
+  latencyEstimator_.reset(sampleRate);
 }
 
 /**
@@ -191,23 +255,35 @@ void PlayAudioEngine::setupPlaybackStreamParameters(AAudioStreamBuilder *builder
   AAudioStreamBuilder_setErrorCallback(builder, ::errorCallback, this);
 }
 
-void PlayAudioEngine::closeOutputStream(){
+void PlayAudioEngine::closePlaybackStream(PlaybackStream *playbackStream){
 
-  if (playStream_ != nullptr){
-    aaudio_result_t result = AAudioStream_requestStop(playStream_);
+  AAudioStream *stream = playbackStream->stream;
+  if (stream != nullptr){
+    aaudio_result_t result = AAudioStream_requestStop(stream);
     if (result != AAUDIO_OK){
       LOGE("Error stopping output stream. %s", AAudio_convertResultToText(result));
     }
 
-    result = AAudioStream_close(playStream_);
+    result = AAudioStream_close(stream);
     if (result != AAUDIO_OK){
       LOGE("Error closing output stream. %s", AAudio_convertResultToText(result));
     }
+    playbackStream->stream.store(nullptr);
   }
+  playbackStream->state.store(PLAYBACK_STREAM_CLOSED);
 }
 
 void PlayAudioEngine::setToneOn(bool isToneOn){
-  isToneOn_ = isToneOn;
+  isToneOn_.store(isToneOn, std::memory_order_relaxed);
+}
+
+/**
+ * Mix partialCount sine partials, up to kMaxPartials, into the tone. This is a load for checking
+ * how much rendering the callback can do on a device, see SineGeneratorBank.
+ */
+void PlayAudioEngine::setPartialCount(int32_t partialCount){
+  partialCount_.store(std::max(0, std::min(partialCount, kMaxPartials)),
+                      std::memory_order_relaxed);
 }
 
 /**
@@ -216,42 +292,95 @@ void PlayAudioEngine::setToneOn(bool isToneOn){
 aaudio_data_callback_result_t PlayAudioEngine::dataCallback(AAudioStream *stream,
                                                         void *audioData,
                                                         int32_t numFrames) {
-  assert(stream == playStream_);
 
-  int32_t underrunCount = AAudioStream_getXRunCount(playStream_);
-  aaudio_result_t bufferSize = AAudioStream_getBufferSizeInFrames(playStream_);
-  bool hasUnderrunCountIncreased = false;
+  PlaybackStream *playbackStream = (stream == playbackStreams_[0].stream) ?
+                                   &playbackStreams_[0] : &playbackStreams_[1];
+  assert(stream == playbackStream->stream);
+
+  /**
+   * During a device switch the old stream's callback hands its oscillators over and fades out,
+   * while the new stream's callback picks them up and fades in. See switchPlaybackStream.
+   */
+  int32_t state = playbackStream->state.load(std::memory_order_acquire);
+  if (state == PLAYBACK_STREAM_STANDBY && isHandoverReady_.load(std::memory_order_acquire)) {
+    isHandoverReady_.store(false, std::memory_order_relaxed);
+    playbackStream->oscLeft = handoverOscLeft_;
+    playbackStream->oscRight = handoverOscRight_;
+    takeOverPlayback(playbackStream);
+    playbackStream->gain = 0;
+    playbackStream->gainStep = 1.0f / (kStreamSwitchCrossfadeBursts *
+                                       playbackStream->framesPerBurst);
+    state = PLAYBACK_STREAM_ACTIVE;
+    playbackStream->state.store(state, std::memory_order_release);
+  } else if (state == PLAYBACK_STREAM_FADE_OUT_REQUESTED &&
+             playbackStream->state.compare_exchange_strong(state, PLAYBACK_STREAM_FADING_OUT)) {
+
+    // The switch thread may have given up waiting and taken the request back, hence the swap
+    handoverOscLeft_ = playbackStream->oscLeft;
+    handoverOscRight_ = playbackStream->oscRight;
+    playbackStream->gainStep = -1.0f / (kStreamSwitchCrossfadeBursts *
+                                        playbackStream->framesPerBurst);
+    state = PLAYBACK_STREAM_FADING_OUT;
+    isHandoverReady_.store(true, std::memory_order_release);
+  }
+
+  if (state != PLAYBACK_STREAM_ACTIVE && state != PLAYBACK_STREAM_FADING_OUT) {
+    memset(static_cast<uint8_t *>(audioData), 0, sizeof(float) * sampleChannels_ * numFrames);
+    return AAUDIO_CALLBACK_RESULT_CONTINUE;
+  }
+
+  // Only the active stream tunes its buffer size
+  bool isActive = (state == PLAYBACK_STREAM_ACTIVE);
+  int32_t underrunCount = AAudioStream_getXRunCount(stream);
+  aaudio_result_t bufferSize = AAudioStream_getBufferSizeInFrames(stream);
+  int32_t framesPerBurst = framesPerBurst_.load(std::memory_order_relaxed);
+  int32_t bufferSizeSelection = bufferSizeSelection_.load(std::memory_order_relaxed);
   bool shouldChangeBufferSize = false;
 
-  if (underrunCount > playStreamUnderrunCount_){
-    playStreamUnderrunCount_ = underrunCount;
-    hasUnderrunCountIncreased = true;
+  // Switching back to automatic tuning starts from the current buffer size. The tuner is reset
+  // here rather than in setBufferSizeInBursts so that only this thread changes its state.
+  if (isActive && bufferSizeSelection != appliedBufferSizeSelection_) {
+    if (bufferSizeSelection == BUFFER_SIZE_AUTOMATIC) {
+      bufferSizeTuner_.reset(bufferSize / framesPerBurst, underrunCount,
+                             get_time_nanoseconds(CLOCK_MONOTONIC));
+    }
+    appliedBufferSizeSelection_ = bufferSizeSelection;
   }
 
-  if (hasUnderrunCountIncreased && bufferSizeSelection_ == BUFFER_SIZE_AUTOMATIC){
+  if (!isActive) {
+    // Keep the fading stream's buffer size
+  } else if (bufferSizeSelection == BUFFER_SIZE_AUTOMATIC){
 
     /**
-     * This is a buffer size tuning algorithm. If the number of underruns (i.e. instances where
-     * we were unable to supply sufficient data to the stream) has increased since the last callback
-     * we will try to increase the buffer size by the burst size, which will give us more protection
-     * against underruns in future, at the cost of additional latency.
+     * Let the tuner pick the buffer size. It grows the buffer by a burst whenever the number of
+     * underruns (i.e. instances where we were unable to supply sufficient data to the stream)
+     * increases, which gives us more protection against underruns in future at the cost of
+     * additional latency, and shrinks it again after a period without underruns.
      */
-    bufferSize += framesPerBurst_; // Increase buffer size by one burst
-    shouldChangeBufferSize = true;
-  } else if (bufferSizeSelection_ > 0 && (bufferSizeSelection_ * framesPerBurst_) != bufferSize){
+    int32_t tunedBufferSize = bufferSizeTuner_.update(underrunCount,
+                                                      get_time_nanoseconds(CLOCK_MONOTONIC))
+                              * framesPerBurst;
+    if (tunedBufferSize != playbackStream->requestedBufferSize) {
+      bufferSize = tunedBufferSize;
+      shouldChangeBufferSize = true;
+    }
+  } else if (bufferSizeSelection > 0 &&
+             (bufferSizeSelection * framesPerBurst) != playbackStream->requestedBufferSize){
 
     // If the buffer size selection has changed then update it here
-    bufferSize = bufferSizeSelection_ * framesPerBurst_;
+    bufferSize = bufferSizeSelection * framesPerBurst;
     shouldChangeBufferSize = true;
   }
+  if (isActive) playStreamUnderrunCount_.store(underrunCount, std::memory_order_relaxed);
 
   if (shouldChangeBufferSize){
-    LOGD("Setting buffer size to %d", bufferSize);
+    RTLOGD("Setting buffer size to %d", bufferSize);
+    playbackStream->requestedBufferSize = bufferSize;
     bufferSize = AAudioStream_setBufferSizeInFrames(stream, bufferSize);
     if (bufferSize > 0) {
-      bufSizeInFrames_ = bufferSize;
+      bufSizeInFrames_.store(bufferSize, std::memory_order_relaxed);
     } else {
-      LOGE("Error setting buffer size: %s", AAudio_convertResultToText(bufferSize));
+      RTLOGE("Error setting buffer size: %s", AAudio_convertResultToText(bufferSize));
     }
   }
 
@@ -263,81 +392,126 @@ aaudio_data_callback_result_t PlayAudioEngine::dataCallback(AAudioStream *stream
    */
   Trace::beginSection("numFrames %d, Underruns %d, buffer size %d",
                       numFrames, underrunCount, bufferSize);
+  Trace::setCounter("Underruns", underrunCount);
+  Trace::setCounter("Buffer size", bufferSize);
+
+  renderWithGain(playbackStream, static_cast<float *>(audioData), numFrames);
+
+  if (isActive) {
+    updateLatencyEstimate(stream);
+  } else if (playbackStream->gain <= 0) {
+    playbackStream->state.store(PLAYBACK_STREAM_RETIRED, std::memory_order_release);
+  }
+
+  Trace::endSection();
+  return AAUDIO_CALLBACK_RESULT_CONTINUE;
+}
+
+/**
+ * Render the stream's oscillators and partials, ramping the gain during a crossfade
+ */
+void PlayAudioEngine::renderWithGain(PlaybackStream *playbackStream,
+                                     float *audioData,
+                                     int32_t numFrames) {
 
   int32_t samplesPerFrame = sampleChannels_;
 
   // If the tone is on we need to use our synthesizer to render the audio data for the sine waves
-  if (isToneOn_) {
-    sineOscRight_->render(static_cast<float *>(audioData),
-                                      samplesPerFrame, numFrames);
+  if (isToneOn_.load(std::memory_order_relaxed)) {
+    playbackStream->oscRight.render(audioData, samplesPerFrame, numFrames);
     if (sampleChannels_ == 2) {
-      sineOscLeft_->render(static_cast<float *>(audioData) + 1,
-                                       samplesPerFrame, numFrames);
+      playbackStream->oscLeft.render(audioData + 1, samplesPerFrame, numFrames);
     }
+    renderPartials(playbackStream, audioData, numFrames);
   } else {
-    memset(static_cast<uint8_t *>(audioData), 0,
-           sizeof(float) * samplesPerFrame * numFrames);
+    memset(audioData, 0, sizeof(float) * samplesPerFrame * numFrames);
   }
 
-  calculateCurrentOutputLatencyMillis(stream, &currentOutputLatencyMillis_);
+  if (playbackStream->gainStep == 0) return;
 
-  Trace::endSection();
-  return AAUDIO_CALLBACK_RESULT_CONTINUE;
+  float gain = playbackStream->gain;
+  for (int i = 0; i < numFrames; i++) {
+    for (int j = 0; j < samplesPerFrame; j++) {
+      audioData[i * samplesPerFrame + j] *= gain;
+    }
+    gain = std::min(1.0f, std::max(0.0f, gain + playbackStream->gainStep));
+  }
+  playbackStream->gain = gain;
+  if (gain == 0.0f || gain == 1.0f) playbackStream->gainStep = 0;
 }
 
 /**
- * Calculate the current latency between writing a frame to the output stream and
- * the same frame being presented to the audio hardware.
- *
- * Here's how the calculation works:
- *
- * 1) Get the time a particular frame was presented to the audio hardware
- * @see AAudioStream_getTimestamp
- * 2) From this extrapolate the time which the *next* audio frame written to the stream
- * will be presented
- * 3) Assume that the next audio frame is written at the current time
- * 4) currentLatency = nextFramePresentationTime - nextFrameWriteTime
- *
- * @param stream The stream being written to
- * @param latencyMillis pointer to a variable to receive the latency in milliseconds between
- * writing a frame to the stream and that frame being presented to the audio hardware.
- * @return AAUDIO_OK or a negative error. It is normal to receive an error soon after a stream
- * has started because the timestamps are not yet available.
+ * Play partialCount_ of the stream's partials, ramping them to an equal share of
+ * kPartialsAmplitude over a burst. Only the stream's callback uses its partials once it has
+ * started.
  */
-aaudio_result_t
-PlayAudioEngine::calculateCurrentOutputLatencyMillis(AAudioStream *stream, double *latencyMillis) {
-
-  // Get the time that a known audio frame was presented for playing
-  int64_t existingFrameIndex;
-  int64_t existingFramePresentationTime;
-  aaudio_result_t result = AAudioStream_getTimestamp(stream,
-                                                     CLOCK_MONOTONIC,
-                                                     &existingFrameIndex,
-                                                     &existingFramePresentationTime);
+void PlayAudioEngine::applyPartialCount(PlaybackStream *playbackStream) {
 
-  if (result == AAUDIO_OK){
+  SineGeneratorBank *partials = playbackStream->partials.get();
+  int32_t partialCount = partialCount_.load(std::memory_order_relaxed);
+  if (partials == nullptr || partials->getPartialCount() == partialCount) return;
 
-    // Get the write index for the next audio frame
-    int64_t writeIndex = AAudioStream_getFramesWritten(stream);
+  partials->setPartialCount(partialCount);
+  for (int32_t i = 0; i < partialCount; i++) {
+    partials->rampAmplitude(i, kPartialsAmplitude / partialCount, playbackStream->framesPerBurst);
+  }
+}
 
-    // Calculate the number of frames between our known frame and the write index
-    int64_t frameIndexDelta = writeIndex - existingFrameIndex;
+/**
+ * Add the partials to every channel. They are rendered a block at a time into a mono buffer on
+ * the stack, so the callback doesn't allocate.
+ */
+void PlayAudioEngine::renderPartials(PlaybackStream *playbackStream,
+                                     float *audioData,
+                                     int32_t numFrames) {
 
-    // Calculate the time which the next frame will be presented
-    int64_t frameTimeDelta = (frameIndexDelta * NANOS_PER_SECOND) / sampleRate_;
-    int64_t nextFramePresentationTime = existingFramePresentationTime + frameTimeDelta;
+  applyPartialCount(playbackStream);
+  SineGeneratorBank *partials = playbackStream->partials.get();
+  if (partials == nullptr || partials->getPartialCount() == 0) return;
 
-    // Assume that the next frame will be written at the current time
-    int64_t nextFrameWriteTime = get_time_nanoseconds(CLOCK_MONOTONIC);
+  int32_t samplesPerFrame = sampleChannels_;
+  float mix[kSineGeneratorBankBlockFrames];
+  for (int32_t start = 0; start < numFrames; start += kSineGeneratorBankBlockFrames) {
+    int32_t blockFrames = std::min(kSineGeneratorBankBlockFrames, numFrames - start);
+    std::fill(mix, mix + blockFrames, 0.0f);
+    partials->render(mix, 1, blockFrames);
+    float *blockData = audioData + start * samplesPerFrame;
+    for (int32_t i = 0; i < blockFrames; i++) {
+      for (int32_t j = 0; j < samplesPerFrame; j++) {
+        blockData[i * samplesPerFrame + j] += mix[i];
+      }
+    }
+  }
+}
 
-    // Calculate the latency
-    *latencyMillis = (double) (nextFramePresentationTime - nextFrameWriteTime)
-                           / NANOS_PER_MILLISECOND;
-  } else {
-    LOGE("Error calculating latency: %s", AAudio_convertResultToText(result));
+/**
+ * Update the estimate of the latency between writing a frame to the output stream and the same
+ * frame being presented to the audio hardware.
+ *
+ * AAudioStream_getTimestamp gives the time a particular frame was presented. Only one timestamp
+ * every kLatencyEstimatorSamplePeriodNanos is passed to the estimator, which fits a line through
+ * them to extrapolate the time the *next* frame written will be presented, assuming it is written
+ * now. It is normal for timestamps not to be available soon after a stream has started.
+ *
+ * @param stream The stream being written to
+ */
+void PlayAudioEngine::updateLatencyEstimate(AAudioStream *stream) {
+
+  int64_t now = get_time_nanoseconds(CLOCK_MONOTONIC);
+
+  if (latencyEstimator_.isSampleDue(now)) {
+    int64_t framePosition;
+    int64_t framePresentationTime;
+    aaudio_result_t result = AAudioStream_getTimestamp(stream,
+                                                       CLOCK_MONOTONIC,
+                                                       &framePosition,
+                                                       &framePresentationTime);
+    if (result == AAUDIO_OK) {
+      latencyEstimator_.addTimestamp(framePosition, framePresentationTime, now);
+    }
   }
 
-  return result;
+  latencyEstimator_.update(AAudioStream_getFramesWritten(stream), now);
 }
 
 /**
@@ -346,16 +520,16 @@ PlayAudioEngine::calculateCurrentOutputLatencyMillis(AAudioStream *stream, doubl
 void PlayAudioEngine::errorCallback(AAudioStream *stream,
                    aaudio_result_t error){
 
-  assert(stream == playStream_);
   LOGD("errorCallback result: %s", AAudio_convertResultToText(error));
 
-  aaudio_stream_state_t streamState = AAudioStream_getState(playStream_);
+  // Errors on a stream being switched away from are handled by the switch
+  if (stream != playStream_) return;
+
+  aaudio_stream_state_t streamState = AAudioStream_getState(stream);
   if (streamState == AAUDIO_STREAM_STATE_DISCONNECTED){
 
-    // Handle stream restart on a separate thread
-    std::function<void(void)> restartStream = std::bind(&PlayAudioEngine::restartStream, this);
-    std::thread streamRestartThread(restartStream);
-    streamRestartThread.detach();
+    // The stream restart is handled on a separate thread
+    restartStream();
   }
 }
 
@@ -363,22 +537,131 @@ void PlayAudioEngine::restartStream(){
 
   LOGI("Restarting stream");
 
-  if (restartingLock_.try_lock()){
-    closeOutputStream();
-    createPlaybackStream();
-    restartingLock_.unlock();
+  if (!isRestarting_.exchange(true)){
+
+    // The previous switch thread has finished so joining it doesn't block
+    std::lock_guard<std::mutex> lock(switchThreadLock_);
+    if (switchThread_.joinable()) switchThread_.join();
+    switchThread_ = std::thread(&PlayAudioEngine::switchPlaybackStream, this);
   } else {
     LOGW("Restart stream operation already in progress - ignoring this request");
-    // We were unable to obtain the restarting lock which means the restart operation is currently
-    // active. This is probably because we received successive "stream disconnected" events.
+    // A restart operation is currently active. This is probably because we received successive
+    // "stream disconnected" events.
     // Internal issue b/63087953
   }
 }
 
+/**
+ * Switch to a new stream on playbackDeviceId_ without a gap in the audio. Runs on the switch
+ * thread.
+ *
+ * The new stream is opened and started while the old one keeps playing, its callback plays
+ * silence until the old stream's callback hands over the oscillators. Then for
+ * kStreamSwitchCrossfadeBursts the old stream fades out while the new one fades in, carrying on
+ * from the same phase, and the old stream is closed once it has faded out. If the old stream
+ * isn't running, for example because it was disconnected, it is closed first and the new stream
+ * fades in from where it stopped.
+ */
+void PlayAudioEngine::switchPlaybackStream(){
+
+  while (true) {
+    int32_t deviceId = playbackDeviceId_;
+    bool isSwitched = switchToNewStream();
+    isRestarting_.store(false);
+
+    // restartStream ignores requests while a switch is running, so switch again if the device
+    // was changed in the meantime
+    if (!isSwitched || deviceId == playbackDeviceId_ || isRestarting_.exchange(true)) return;
+  }
+}
+
+/**
+ * Open and start a stream on playbackDeviceId_ and crossfade to it.
+ *
+ * @return false if the new stream couldn't be opened or started
+ */
+bool PlayAudioEngine::switchToNewStream(){
+
+  PlaybackStream *oldStream = &playbackStreams_[activeStreamIndex_];
+  PlaybackStream *newStream = &playbackStreams_[1 - activeStreamIndex_];
+
+  if (!openPlaybackStream(newStream)) return false;
+
+  newStream->state.store(PLAYBACK_STREAM_STANDBY);
+  isHandoverReady_.store(false);
+
+  aaudio_result_t result = AAudioStream_requestStart(newStream->stream);
+  if (result != AAUDIO_OK) {
+    LOGE("Error starting stream. %s", AAudio_convertResultToText(result));
+    closePlaybackStream(newStream);
+    return false;
+  }
+
+  // This thread hands the oscillators over unless the old stream's callback does
+  bool shouldHandOver = true;
+  AAudioStream *stream = oldStream->stream;
+  if (stream != nullptr && AAudioStream_getState(stream) == AAUDIO_STREAM_STATE_STARTED) {
+    oldStream->state.store(PLAYBACK_STREAM_FADE_OUT_REQUESTED, std::memory_order_release);
+    int64_t deadline = get_time_nanoseconds(CLOCK_MONOTONIC) + kStreamSwitchFadeOutTimeoutNanos;
+    while (oldStream->state.load(std::memory_order_acquire) != PLAYBACK_STREAM_RETIRED &&
+           get_time_nanoseconds(CLOCK_MONOTONIC) < deadline) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+
+    // Take the request back if the callback never picked it up
+    int32_t expected = PLAYBACK_STREAM_FADE_OUT_REQUESTED;
+    shouldHandOver = oldStream->state.compare_exchange_strong(expected,
+                                                              PLAYBACK_STREAM_RETIRED);
+  }
+
+  // Closing the stream waits for its callback to return, so the oscillators are safe to copy
+  closePlaybackStream(oldStream);
+  if (shouldHandOver) {
+    handoverOscLeft_ = oldStream->oscLeft;
+    handoverOscRight_ = oldStream->oscRight;
+    isHandoverReady_.store(true, std::memory_order_release);
+  }
+
+  activeStreamIndex_ = 1 - activeStreamIndex_;
+  playStream_.store(newStream->stream);
+  playStreamDeviceId_.store(newStream->deviceId);
+  return true;
+}
+
 double PlayAudioEngine::getCurrentOutputLatencyMillis() {
-  return currentOutputLatencyMillis_;
+  LatencyEstimate estimate;
+  latencyEstimator_.getEstimate(&estimate);
+  return estimate.latencyMillis;
+}
+
+bool PlayAudioEngine::getLatencyEstimate(LatencyEstimate *estimate) {
+  return latencyEstimator_.getEstimate(estimate);
+}
+
+int32_t PlayAudioEngine::getSampleRate() {
+  return sampleRate_.load();
+}
+
+int32_t PlayAudioEngine::getFramesPerBurst() {
+  return framesPerBurst_.load();
 }
 
+/**
+ * Request a buffer size, or BUFFER_SIZE_AUTOMATIC to let BufferSizeTuner choose. The active
+ * stream's callback applies it.
+ */
 void PlayAudioEngine::setBufferSizeInBursts(int32_t numBursts) {
-  PlayAudioEngine::bufferSizeSelection_ = numBursts;
+  bufferSizeSelection_.store(numBursts, std::memory_order_relaxed);
+}
+
+void PlayAudioEngine::setTargetMaxLatencyMillis(double targetMaxLatencyMillis) {
+  bufferSizeTuner_.setTargetMaxLatencyMillis(targetMaxLatencyMillis);
+}
+
+void PlayAudioEngine::setBufferSizeShrinkWindowMillis(int32_t shrinkWindowMillis) {
+  bufferSizeTuner_.setShrinkWindowMillis(shrinkWindowMillis);
+}
+
+void PlayAudioEngine::getBufferSizeTunerState(BufferSizeTunerState *state) {
+  bufferSizeTuner_.getState(state);
 }
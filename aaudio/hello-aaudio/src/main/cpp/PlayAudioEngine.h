@@ -17,12 +17,64 @@
 #ifndef AAUDIO_PLAYAUDIOENGINE_H
 #define AAUDIO_PLAYAUDIOENGINE_H
 
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <mutex>
 #include <thread>
 #include "audio_common.h"
 #include "SineGenerator.h"
+#include "SineGeneratorBank.h"
+#include "BufferSizeTuner.h"
+#include "LatencyEstimator.h"
 
 #define BUFFER_SIZE_AUTOMATIC 0
 
+// Length of the crossfade between the old and new stream when switching devices
+constexpr int32_t kStreamSwitchCrossfadeBursts = 4;
+
+// How long a stream switch waits for the old stream to fade out before closing it anyway
+constexpr int64_t kStreamSwitchFadeOutTimeoutNanos = 500000000LL;
+
+// Most sine partials which can be mixed into the tone, to load the callback on a device
+constexpr int32_t kMaxPartials = 4096;
+
+// Total amplitude of the partials, which is shared between however many are playing
+constexpr float kPartialsAmplitude = 0.25f;
+
+enum PlaybackStreamState : int32_t {
+  PLAYBACK_STREAM_CLOSED,
+  PLAYBACK_STREAM_STANDBY,            // Started, playing silence until the handover
+  PLAYBACK_STREAM_ACTIVE,
+  PLAYBACK_STREAM_FADE_OUT_REQUESTED,
+  PLAYBACK_STREAM_FADING_OUT,
+  PLAYBACK_STREAM_RETIRED             // Faded out, playing silence until it is closed
+};
+
+/**
+ * An output stream and the oscillators which render into it. During a device switch there are
+ * two, each with its own copy of the oscillators. The partials are set up for the stream's
+ * sample rate when it is opened and aren't handed over, they fade in with the new stream.
+ */
+struct PlaybackStream {
+  std::atomic<AAudioStream *> stream { nullptr };
+  int32_t sampleRate = 0;
+  int32_t framesPerBurst = 0;
+  int32_t deviceId = AAUDIO_UNSPECIFIED;
+  SineGenerator oscLeft;
+  SineGenerator oscRight;
+  std::unique_ptr<SineGeneratorBank> partials;
+  std::atomic<int32_t> state { PLAYBACK_STREAM_CLOSED };
+
+  // Only used by the stream's callback
+  float gain = 0;
+  float gainStep = 0;
+
+  // Last size passed to AAudioStream_setBufferSizeInFrames, which the device may have rounded
+  // or clamped, so that a size it won't take isn't asked for again on every callback
+  int32_t requestedBufferSize = 0;
+};
+
 class PlayAudioEngine {
 
 public:
@@ -31,45 +83,91 @@ public:
   void setDeviceId(int32_t deviceId);
   void setToneOn(bool isToneOn);
   void setBufferSizeInBursts(int32_t numBursts);
+  void setPartialCount(int32_t partialCount);
   aaudio_data_callback_result_t dataCallback(AAudioStream *stream,
                                              void *audioData,
                                              int32_t numFrames);
   void errorCallback(AAudioStream *stream,
                      aaudio_result_t  __unused error);
   double getCurrentOutputLatencyMillis();
+  bool getLatencyEstimate(LatencyEstimate *estimate);
+
+  /**
+   * Properties of the stream being played, which change when the device is switched
+   */
+  int32_t getSampleRate();
+  int32_t getFramesPerBurst();
+
+  /**
+   * Settings for the automatic buffer size, see BufferSizeTuner
+   */
+  void setTargetMaxLatencyMillis(double targetMaxLatencyMillis);
+  void setBufferSizeShrinkWindowMillis(int32_t shrinkWindowMillis);
+  void getBufferSizeTunerState(BufferSizeTunerState *state);
 
 private:
 
-  int32_t playbackDeviceId_ = AAUDIO_UNSPECIFIED;
-  int32_t sampleRate_;
+  std::atomic<int32_t> playbackDeviceId_ { AAUDIO_UNSPECIFIED };
+  std::atomic<int32_t> sampleRate_ { 0 };
   int16_t sampleChannels_;
   aaudio_format_t sampleFormat_;
 
-  SineGenerator *sineOscLeft_;
-  SineGenerator *sineOscRight_;
-
-  AAudioStream *playStream_;
-  bool isToneOn_ = false;
-
-  int32_t playStreamUnderrunCount_;
-  int32_t bufSizeInFrames_;
-  int32_t framesPerBurst_;
-  double currentOutputLatencyMillis_ = 0;
-  int32_t bufferSizeSelection_ = BUFFER_SIZE_AUTOMATIC;
+  // The stream being played is playbackStreams_[activeStreamIndex_], the other one is only open
+  // during a device switch
+  PlaybackStream playbackStreams_[2];
+  int32_t activeStreamIndex_ = 0;
+  std::atomic<AAudioStream *> playStream_ { nullptr };
+
+  // Device of playStream_, so it can be checked without querying a stream the switch thread may
+  // be closing
+  std::atomic<int32_t> playStreamDeviceId_ { AAUDIO_UNSPECIFIED };
+  std::atomic<bool> isToneOn_ { false };
+
+  // Set on any thread and applied to the stream's partials by its callback
+  std::atomic<int32_t> partialCount_ { 0 };
+
+  // Oscillator state handed from the old stream's callback to the new stream's callback.
+  // Storing isHandoverReady_ also hands over latencyEstimator_, bufferSizeTuner_ and
+  // appliedBufferSizeSelection_: only the callback of the stream in PLAYBACK_STREAM_ACTIVE uses
+  // them, and the old stream has left that state before the new one takes over.
+  SineGenerator handoverOscLeft_;
+  SineGenerator handoverOscRight_;
+  std::atomic<bool> isHandoverReady_ { false };
+
+  // Written by the active stream's callback, may be read on any thread
+  std::atomic<int32_t> playStreamUnderrunCount_ { 0 };
+  std::atomic<int32_t> bufSizeInFrames_ { 0 };
+  std::atomic<int32_t> framesPerBurst_ { 0 };
+  LatencyEstimator latencyEstimator_;
+
+  // Set on any thread and applied by the callback, which is the only user of bufferSizeTuner_
+  // apart from its thread safe setters and getState
+  std::atomic<int32_t> bufferSizeSelection_ { BUFFER_SIZE_AUTOMATIC };
+  int32_t appliedBufferSizeSelection_ = BUFFER_SIZE_AUTOMATIC;
+  BufferSizeTuner bufferSizeTuner_;
 
 private:
 
-  std::mutex restartingLock_;
+  std::atomic<bool> isRestarting_ { false };
+  std::mutex switchThreadLock_;
+  std::thread switchThread_;
 
-  void createPlaybackStream();
-  void closeOutputStream();
+  bool openPlaybackStream(PlaybackStream *playbackStream);
+  void closePlaybackStream(PlaybackStream *playbackStream);
   void restartStream();
+  void switchPlaybackStream();
+  bool switchToNewStream();
 
   AAudioStreamBuilder* createStreamBuilder();
   void setupPlaybackStreamParameters(AAudioStreamBuilder *builder);
-  void prepareOscillators();
-
-  aaudio_result_t calculateCurrentOutputLatencyMillis(AAudioStream *stream, double *latencyMillis);
+  void prepareOscillators(PlaybackStream *playbackStream);
+  void preparePartials(PlaybackStream *playbackStream);
+  void applyPartialCount(PlaybackStream *playbackStream);
+  void renderPartials(PlaybackStream *playbackStream, float *audioData, int32_t numFrames);
+  void takeOverPlayback(PlaybackStream *playbackStream);
+  void renderWithGain(PlaybackStream *playbackStream, float *audioData, int32_t numFrames);
+
+  void updateLatencyEstimate(AAudioStream *stream);
 
 };
 
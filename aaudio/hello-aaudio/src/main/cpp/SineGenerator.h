@@ -19,16 +19,25 @@
 
 #include <math.h>
 #include <cstdint>
+#include "sine_kernel.h"
 
+/**
+ * Phase is held as a 32-bit fixed point fraction of a cycle and the sine is rendered by rotating
+ * a phasor, see render_sine, so rendering does not call sin(). The phase increment is kept in
+ * double precision so that the exponential sweep can scale it smoothly.
+ *
+ * A sweep holds the frequency for kSweepBlockFrames and then steps it by as much as a sweep
+ * which changed it every frame would have, so the two never differ by more than one block.
+ */
 class SineGenerator
 {
 public:
-    SineGenerator() {}
+    SineGenerator() = default;
     ~SineGenerator() = default;
 
     void setup(double frequency, double frameRate) {
         mFrameRate = frameRate;
-        mPhaseIncrement = frequency * M_PI * 2 / frameRate;
+        mPhaseIncrement = frequency * kPhaseUnitsPerCycle / frameRate;
     }
     void setup(double frequency, double frameRate, float amplitude) {
         setup(frequency, frameRate);
@@ -36,62 +45,73 @@ public:
     }
 
     void setSweep(double frequencyLow, double frequencyHigh, double seconds) {
-        mPhaseIncrementLow = frequencyLow * M_PI * 2 / mFrameRate;
-        mPhaseIncrementHigh = frequencyHigh * M_PI * 2 / mFrameRate;
+        mPhaseIncrementLow = frequencyLow * kPhaseUnitsPerCycle / mFrameRate;
+        mPhaseIncrementHigh = frequencyHigh * kPhaseUnitsPerCycle / mFrameRate;
 
         double numFrames = seconds * mFrameRate;
-        mUpScaler = pow((frequencyHigh / frequencyLow), (1.0 / numFrames));
+        mUpScaler = pow((frequencyHigh / frequencyLow), (kSweepBlockFrames / numFrames));
         mDownScaler = 1.0 / mUpScaler;
+        mFramesUntilSweepStep = kSweepBlockFrames;
         mGoingUp = true;
         mSweeping = true;
     }
 
     void render(int16_t *buffer, int32_t channelStride, int32_t numFrames) {
-        int sampleIndex = 0;
-        for (int i = 0; i < numFrames; i++) {
-            buffer[sampleIndex] = (int16_t) (32767 * sin(mPhase) * mAmplitude);
-            sampleIndex += channelStride;
-            advancePhase();
-        }
+        renderBlocks(buffer, channelStride, numFrames);
     }
     void render(float *buffer, int32_t channelStride, int32_t numFrames) {
-        int sampleIndex = 0;
-        for (int i = 0; i < numFrames; i++) {
-            buffer[sampleIndex] = (float) (sin(mPhase) * mAmplitude);
-            sampleIndex += channelStride;
-            advancePhase();
-        }
+        renderBlocks(buffer, channelStride, numFrames);
     }
 
 private:
-    void advancePhase() {
-        mPhase += mPhaseIncrement;
-        if (mPhase > M_PI * 2) {
-            mPhase -= M_PI * 2;
+    template <typename T>
+    void renderBlocks(T *buffer, int32_t channelStride, int32_t numFrames) {
+        if (!mSweeping) {
+            mPhase = render_sine(buffer, channelStride, numFrames, mPhase,
+                                 (uint32_t) mPhaseIncrement, (float) mAmplitude);
+            return;
+        }
+        while (numFrames > 0) {
+            int32_t blockFrames = (numFrames < mFramesUntilSweepStep) ? numFrames
+                                                                      : mFramesUntilSweepStep;
+            mPhase = render_sine(buffer, channelStride, blockFrames, mPhase,
+                                 (uint32_t) mPhaseIncrement, (float) mAmplitude);
+            buffer += blockFrames * channelStride;
+            numFrames -= blockFrames;
+            mFramesUntilSweepStep -= blockFrames;
+            if (mFramesUntilSweepStep == 0) {
+                advanceSweep();
+                mFramesUntilSweepStep = kSweepBlockFrames;
+            }
         }
-        if (mSweeping) {
-            if (mGoingUp) {
-                mPhaseIncrement *= mUpScaler;
-                if (mPhaseIncrement > mPhaseIncrementHigh) {
-                    mGoingUp = false;
-                }
-            } else {
-                mPhaseIncrement *= mDownScaler;
-                if (mPhaseIncrement < mPhaseIncrementLow) {
-                    mGoingUp = true;
-                }
+    }
+
+    void advanceSweep() {
+        if (mGoingUp) {
+            mPhaseIncrement *= mUpScaler;
+            if (mPhaseIncrement > mPhaseIncrementHigh) {
+                mGoingUp = false;
+            }
+        } else {
+            mPhaseIncrement *= mDownScaler;
+            if (mPhaseIncrement < mPhaseIncrementLow) {
+                mGoingUp = true;
             }
         }
     }
 
+    static constexpr double kPhaseUnitsPerCycle = 4294967296.0; // 2^32
+    static constexpr int32_t kSweepBlockFrames = 32;
+
     double mAmplitude = 0.01;
-    double mPhase = 0.0;
-    double mPhaseIncrement = 440 * M_PI * 2 / 48000;
+    uint32_t mPhase = 0;
+    double mPhaseIncrement = 440 * kPhaseUnitsPerCycle / 48000;
     double mFrameRate = 48000;
     double mPhaseIncrementLow;
     double mPhaseIncrementHigh;
     double mUpScaler = 1.0;
     double mDownScaler = 1.0;
+    int32_t mFramesUntilSweepStep = kSweepBlockFrames;
     bool   mGoingUp = false;
     bool   mSweeping = false;
 };
@@ -0,0 +1,183 @@
+/*
+ * Copyright 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <math.h>
+#include <stdlib.h>
+#include <algorithm>
+#include "float_vector.h"
+#include "SineGeneratorBank.h"
+
+constexpr size_t kCacheLineSizeInBytes = 64;
+constexpr int32_t kFloatsPerCacheLine = kCacheLineSizeInBytes / sizeof(float);
+constexpr int32_t kPartialArrayCount = 8;
+constexpr int kGroupsPerPass = 4;
+
+SineGeneratorBank::SineGeneratorBank(int32_t maxPartials, double frameRate)
+    : frameRate_(frameRate) {
+
+  int32_t arraySize = (std::max(0, maxPartials) + kFloatsPerCacheLine - 1) /
+                      kFloatsPerCacheLine * kFloatsPerCacheLine;
+  size_t numFloats = (size_t) arraySize * kPartialArrayCount +
+                     kSineGeneratorBankBlockFrames * FLOAT_VECTOR_SIZE;
+  void *memory = nullptr;
+  if (posix_memalign(&memory, kCacheLineSizeInBytes, numFloats * sizeof(float)) != 0) return;
+
+  memory_ = static_cast<float *>(memory);
+  maxPartials_ = std::max(0, maxPartials);
+  phasorRe_ = memory_;
+  phasorIm_ = phasorRe_ + arraySize;
+  rotationRe_ = phasorIm_ + arraySize;
+  rotationIm_ = rotationRe_ + arraySize;
+  amplitude_ = rotationIm_ + arraySize;
+  amplitudeStep_ = amplitude_ + arraySize;
+  amplitudeLow_ = amplitudeStep_ + arraySize;
+  amplitudeHigh_ = amplitudeLow_ + arraySize;
+  mix_ = amplitudeHigh_ + arraySize;
+
+  // Every partial starts silent at zero phase and zero frequency. The padding at the end of the
+  // arrays is rendered along with the last partials, so it is set up the same way.
+  for (int32_t i = 0; i < arraySize; i++) {
+    phasorRe_[i] = 1;
+    phasorIm_[i] = 0;
+    rotationRe_[i] = 1;
+    rotationIm_[i] = 0;
+    amplitude_[i] = 0;
+    amplitudeStep_[i] = 0;
+    amplitudeLow_[i] = 0;
+    amplitudeHigh_[i] = 0;
+  }
+}
+
+SineGeneratorBank::~SineGeneratorBank() {
+  free(memory_);
+}
+
+void SineGeneratorBank::setPartialCount(int32_t count) {
+  count = std::max(0, std::min(count, maxPartials_));
+  for (int32_t i = count; i < partialCount_; i++) rampAmplitude(i, 0, 0);
+  partialCount_ = count;
+}
+
+void SineGeneratorBank::setPartial(int32_t index, double frequency, float amplitude) {
+  setFrequency(index, frequency);
+  rampAmplitude(index, amplitude, 0);
+}
+
+void SineGeneratorBank::setFrequency(int32_t index, double frequency) {
+  if (index < 0 || index >= maxPartials_) return;
+  double radians = 2 * M_PI * frequency / frameRate_;
+  rotationRe_[index] = (float) cos(radians);
+  rotationIm_[index] = (float) sin(radians);
+}
+
+void SineGeneratorBank::rampAmplitude(int32_t index, float amplitude, int32_t numFrames) {
+  if (index < 0 || index >= maxPartials_) return;
+  if (numFrames <= 0) {
+    amplitude_[index] = amplitude;
+    amplitudeStep_[index] = 0;
+  } else {
+    amplitudeStep_[index] = (amplitude - amplitude_[index]) / numFrames;
+  }
+  amplitudeLow_[index] = std::min(amplitude_[index], amplitude);
+  amplitudeHigh_[index] = std::max(amplitude_[index], amplitude);
+}
+
+/**
+ * Render groups of FLOAT_VECTOR_SIZE partials starting at offset. Taking more than one group
+ * per pass over the frames gives the processor independent rotations to work on while each one
+ * waits for the previous frame's result.
+ */
+template <int NumGroups>
+static inline void renderGroups(float *phasorRe, float *phasorIm, const float *rotationRe,
+                                const float *rotationIm, float *amplitude,
+                                const float *amplitudeStep, const float *amplitudeLow,
+                                const float *amplitudeHigh, float *mix, int32_t numFrames) {
+
+  FloatVector re[NumGroups];
+  FloatVector im[NumGroups];
+  FloatVector rotRe[NumGroups];
+  FloatVector rotIm[NumGroups];
+  FloatVector amp[NumGroups];
+  for (int g = 0; g < NumGroups; g++) {
+    re[g] = vector_load(phasorRe + g * FLOAT_VECTOR_SIZE);
+    im[g] = vector_load(phasorIm + g * FLOAT_VECTOR_SIZE);
+    rotRe[g] = vector_load(rotationRe + g * FLOAT_VECTOR_SIZE);
+    rotIm[g] = vector_load(rotationIm + g * FLOAT_VECTOR_SIZE);
+    amp[g] = vector_load(amplitude + g * FLOAT_VECTOR_SIZE);
+  }
+
+  for (int32_t frame = 0; frame < numFrames; frame++) {
+    FloatVector sum = vector_load(mix);
+    for (int g = 0; g < NumGroups; g++) {
+      // The ramp limits are read from memory, there aren't enough registers to hold them
+      amp[g] = vector_min(vector_max(vector_add(amp[g],
+                                                vector_load(amplitudeStep + g * FLOAT_VECTOR_SIZE)),
+                                     vector_load(amplitudeLow + g * FLOAT_VECTOR_SIZE)),
+                          vector_load(amplitudeHigh + g * FLOAT_VECTOR_SIZE));
+      sum = vector_add(sum, vector_mul(amp[g], im[g]));
+      FloatVector nextRe = vector_sub(vector_mul(re[g], rotRe[g]), vector_mul(im[g], rotIm[g]));
+      im[g] = vector_add(vector_mul(re[g], rotIm[g]), vector_mul(im[g], rotRe[g]));
+      re[g] = nextRe;
+    }
+    vector_store(mix, sum);
+    mix += FLOAT_VECTOR_SIZE;
+  }
+
+  // One Newton step towards unit magnitude, float rounding only moves it slightly per block
+  const FloatVector half = vector_dup(0.5f);
+  const FloatVector oneAndAHalf = vector_dup(1.5f);
+  for (int g = 0; g < NumGroups; g++) {
+    FloatVector magnitude = vector_add(vector_mul(re[g], re[g]), vector_mul(im[g], im[g]));
+    FloatVector gain = vector_sub(oneAndAHalf, vector_mul(half, magnitude));
+    vector_store(phasorRe + g * FLOAT_VECTOR_SIZE, vector_mul(re[g], gain));
+    vector_store(phasorIm + g * FLOAT_VECTOR_SIZE, vector_mul(im[g], gain));
+    vector_store(amplitude + g * FLOAT_VECTOR_SIZE, amp[g]);
+  }
+}
+
+void SineGeneratorBank::render(float *buffer, int32_t channelStride, int32_t numFrames) {
+
+  const int32_t numGroups = (partialCount_ + FLOAT_VECTOR_SIZE - 1) / FLOAT_VECTOR_SIZE;
+  const FloatVector zero = vector_dup(0);
+
+  while (numFrames > 0) {
+    int32_t blockFrames = std::min(numFrames, kSineGeneratorBankBlockFrames);
+    for (int32_t frame = 0; frame < blockFrames; frame++) {
+      vector_store(mix_ + frame * FLOAT_VECTOR_SIZE, zero);
+    }
+
+    int32_t group = 0;
+    for (; group + kGroupsPerPass <= numGroups; group += kGroupsPerPass) {
+      int32_t offset = group * FLOAT_VECTOR_SIZE;
+      renderGroups<kGroupsPerPass>(phasorRe_ + offset, phasorIm_ + offset, rotationRe_ + offset,
+                                   rotationIm_ + offset, amplitude_ + offset,
+                                   amplitudeStep_ + offset, amplitudeLow_ + offset,
+                                   amplitudeHigh_ + offset, mix_, blockFrames);
+    }
+    for (; group < numGroups; group++) {
+      int32_t offset = group * FLOAT_VECTOR_SIZE;
+      renderGroups<1>(phasorRe_ + offset, phasorIm_ + offset, rotationRe_ + offset,
+                      rotationIm_ + offset, amplitude_ + offset, amplitudeStep_ + offset,
+                      amplitudeLow_ + offset, amplitudeHigh_ + offset, mix_, blockFrames);
+    }
+
+    for (int32_t frame = 0; frame < blockFrames; frame++) {
+      buffer[frame * channelStride] += vector_sum(vector_load(mix_ + frame * FLOAT_VECTOR_SIZE));
+    }
+    buffer += blockFrames * channelStride;
+    numFrames -= blockFrames;
+  }
+}
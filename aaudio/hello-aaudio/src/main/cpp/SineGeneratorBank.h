@@ -0,0 +1,92 @@
+/*
+ * Copyright 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef AAUDIO_SINEGENERATORBANK_H
+#define AAUDIO_SINEGENERATORBANK_H
+
+#include <stdint.h>
+
+// Frames mixed per pass over the partials, this bounds the size of the mix buffer
+constexpr int32_t kSineGeneratorBankBlockFrames = 256;
+
+/**
+ * Additive synthesis: a bank of sine partials which are summed into one channel.
+ *
+ * The partials are stored as structure of arrays. Each partial has a phasor, its rotation per
+ * frame, an amplitude and an amplitude ramp, and each of those is a contiguous array aligned to a
+ * cache line. render takes the partials four at a time in a FloatVector, so one vector operation
+ * advances four partials by a frame. The per-lane mix of each frame is kept in a small buffer and
+ * the lanes are summed once a block, not once per group of partials. Phasors are renormalized
+ * to unit magnitude after every block. The rotations are floats, so a partial's frequency can be
+ * off by about one part in 10^7 and its phase slowly drifts from an exact sine's.
+ *
+ * This is also the stress workload for measuring how many partials a core can render in one
+ * burst. PlayAudioEngine mixes partials into its tone on a device, see setPartialCount, and
+ * sine-generator-bank-benchmark in aaudio/host measures the same offline.
+ *
+ * The setters must not be called at the same time as render.
+ */
+class SineGeneratorBank {
+
+public:
+  SineGeneratorBank(int32_t maxPartials, double frameRate);
+  ~SineGeneratorBank();
+  SineGeneratorBank(const SineGeneratorBank &) = delete;
+  SineGeneratorBank &operator=(const SineGeneratorBank &) = delete;
+
+  int32_t getMaxPartials() const { return maxPartials_; }
+  int32_t getPartialCount() const { return partialCount_; }
+
+  /**
+   * Only the first count partials are rendered. Partials after them are silenced.
+   */
+  void setPartialCount(int32_t count);
+
+  /**
+   * Set a partial's frequency and amplitude straight away, keeping its phase
+   */
+  void setPartial(int32_t index, double frequency, float amplitude);
+  void setFrequency(int32_t index, double frequency);
+
+  /**
+   * Move a partial's amplitude linearly to a new value, reaching it after numFrames frames
+   */
+  void rampAmplitude(int32_t index, float amplitude, int32_t numFrames);
+
+  /**
+   * Add the partials to every channelStride'th element of buffer
+   */
+  void render(float *buffer, int32_t channelStride, int32_t numFrames);
+
+private:
+  int32_t maxPartials_ = 0;
+  int32_t partialCount_ = 0;
+  double frameRate_;
+
+  // Each array holds maxPartials_ rounded up to a whole cache line of floats
+  float *memory_ = nullptr;
+  float *phasorRe_;
+  float *phasorIm_;
+  float *rotationRe_;
+  float *rotationIm_;
+  float *amplitude_;
+  float *amplitudeStep_;
+  float *amplitudeLow_;     // A ramp stops at whichever of low and high it is heading for
+  float *amplitudeHigh_;
+  float *mix_;              // kSineGeneratorBankBlockFrames frames of one sum per vector lane
+};
+
+#endif //AAUDIO_SINEGENERATORBANK_H
@@ -73,6 +73,17 @@ Java_com_google_sample_aaudio_play_PlaybackEngine_setBufferSizeInBursts(
   engine->setBufferSizeInBursts(bufferSizeInBursts);
 }
 
+JNIEXPORT void JNICALL
+Java_com_google_sample_aaudio_play_PlaybackEngine_setPartialCount(
+    JNIEnv *env, jclass, jint partialCount) {
+  if (engine == nullptr) {
+    LOGE("Engine is null, you must call createEngine before calling this method");
+    return;
+  }
+
+  engine->setPartialCount(partialCount);
+}
+
 
 JNIEXPORT jdouble JNICALL
 Java_com_google_sample_aaudio_play_PlaybackEngine_getCurrentOutputLatencyMillis(JNIEnv *env,
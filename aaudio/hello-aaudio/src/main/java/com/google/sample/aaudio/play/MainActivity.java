@@ -23,6 +23,7 @@ import android.support.v4.view.MotionEventCompat;
 import android.view.MotionEvent;
 import android.view.View;
 import android.widget.AdapterView;
+import android.widget.ArrayAdapter;
 import android.widget.SimpleAdapter;
 import android.widget.Spinner;
 import android.widget.TextView;
@@ -42,10 +43,12 @@ public class MainActivity extends Activity {
     private static final String TAG = MainActivity.class.getName();
     private static final long UPDATE_LATENCY_EVERY_MILLIS = 1000;
     private static final int[] BUFFER_SIZE_OPTIONS = {0, 1, 2, 4, 8};
+    private static final Integer[] PARTIAL_COUNT_OPTIONS = {0, 64, 256, 1024, 4096};
 
     private boolean mEngineCreated = false;
     private AudioDeviceSpinner mPlaybackDeviceSpinner;
     private Spinner mBufferSizeSpinner;
+    private Spinner mPartialCountSpinner;
     private TextView mLatencyText;
     private Timer mLatencyUpdater;
 
@@ -109,6 +112,27 @@ public class MainActivity extends Activity {
             }
         });
 
+        // Sine partials mixed into the tone load the audio callback, to see how much rendering
+        // the device can do before it underruns
+        mPartialCountSpinner = findViewById(R.id.partialCountSpinner);
+        mPartialCountSpinner.setAdapter(new ArrayAdapter<>(
+                this,
+                R.layout.buffer_sizes_spinner, // the xml layout
+                R.id.bufferSizeOption, // View to show the count in
+                PARTIAL_COUNT_OPTIONS));
+
+        mPartialCountSpinner.setOnItemSelectedListener(new AdapterView.OnItemSelectedListener() {
+            @Override
+            public void onItemSelected(AdapterView<?> adapterView, View view, int i, long l) {
+                PlaybackEngine.setPartialCount(PARTIAL_COUNT_OPTIONS[i]);
+            }
+
+            @Override
+            public void onNothingSelected(AdapterView<?> adapterView) {
+
+            }
+        });
+
         // initialize native audio system
         mEngineCreated = PlaybackEngine.create();
 
@@ -30,5 +30,6 @@ public enum PlaybackEngine {
     static native void setToneOn(boolean isToneOn);
     static native void setAudioDeviceId(int deviceId);
     static native void setBufferSizeInBursts(int bufferSizeInBursts);
+    static native void setPartialCount(int partialCount);
     static native double getCurrentOutputLatencyMillis();
 }
@@ -0,0 +1,1121 @@
+/*
+ * Copyright 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <mutex>
+#include <random>
+#include <set>
+#include <thread>
+#include <vector>
+#include "AAudioHost.h"
+
+constexpr int64_t kNanosPerSecond = 1000000000LL;
+constexpr int64_t kNever = INT64_MAX;
+
+constexpr int32_t kDefaultSampleRate = 48000;
+constexpr int32_t kDefaultFramesPerBurst = 192;
+constexpr int32_t kDefaultBufferCapacityInBursts = 16;
+constexpr int64_t kDefaultLatencyNanos = 10000000LL;
+constexpr int32_t kDefaultOutputChannelCount = 2;
+constexpr int32_t kDefaultInputChannelCount = 1;
+constexpr int32_t kMaxChannelCount = 8;
+constexpr int32_t kMinSampleRate = 8000;
+constexpr int32_t kMaxSampleRate = 192000;
+
+// Device id reported by streams which didn't ask for a particular device
+constexpr int32_t kHostDeviceId = 1;
+
+// Speaker frames the loopback keeps, enough for its longest delay plus the device latencies
+constexpr int64_t kMaxLoopbackDelayNanos = kNanosPerSecond;
+constexpr int32_t kLoopbackHistoryFrames = 1 << 18;
+
+static int64_t nowNanos() {
+  timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * kNanosPerSecond + ts.tv_nsec;
+}
+
+static void sleepUntilNanos(int64_t wakeTime) {
+  timespec ts;
+  ts.tv_sec = wakeTime / kNanosPerSecond;
+  ts.tv_nsec = wakeTime % kNanosPerSecond;
+  while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, nullptr) != 0) {
+    // Interrupted by a signal, go back to sleep
+  }
+}
+
+static int32_t bytesPerSample(aaudio_format_t format) {
+  return (format == AAUDIO_FORMAT_PCM_I16) ? sizeof(int16_t) : sizeof(float);
+}
+
+/**
+ * Writes a WAV file in the stream's format. The header sizes are patched when the file is
+ * closed.
+ */
+class WavWriter {
+
+public:
+  ~WavWriter() { close(); }
+
+  bool open(const char *path, int32_t sampleRate, int32_t channelCount, aaudio_format_t format) {
+
+    file_ = fopen(path, "wb");
+    if (file_ == nullptr) return false;
+
+    const uint16_t wavFormat = (format == AAUDIO_FORMAT_PCM_FLOAT) ? 3 : 1; // IEEE float or PCM
+    const uint16_t bitsPerSample = static_cast<uint16_t>(bytesPerSample(format) * 8);
+    bytesPerFrame_ = bytesPerSample(format) * channelCount;
+    dataBytes_ = 0;
+
+    fwrite("RIFF", 1, 4, file_);
+    writeUint32(0); // patched on close
+    fwrite("WAVEfmt ", 1, 8, file_);
+    writeUint32(16);
+    writeUint16(wavFormat);
+    writeUint16(static_cast<uint16_t>(channelCount));
+    writeUint32(static_cast<uint32_t>(sampleRate));
+    writeUint32(static_cast<uint32_t>(sampleRate * bytesPerFrame_));
+    writeUint16(static_cast<uint16_t>(bytesPerFrame_));
+    writeUint16(bitsPerSample);
+    fwrite("data", 1, 4, file_);
+    writeUint32(0); // patched on close
+    return true;
+  }
+
+  void write(const void *audioData, int32_t numFrames) {
+    if (file_ == nullptr) return;
+    size_t bytes = static_cast<size_t>(numFrames) * bytesPerFrame_;
+    fwrite(audioData, 1, bytes, file_);
+    dataBytes_ += bytes;
+  }
+
+  void close() {
+    if (file_ == nullptr) return;
+    fseek(file_, 4, SEEK_SET);
+    writeUint32(static_cast<uint32_t>(dataBytes_ + 36));
+    fseek(file_, 40, SEEK_SET);
+    writeUint32(static_cast<uint32_t>(dataBytes_));
+    fclose(file_);
+    file_ = nullptr;
+  }
+
+private:
+  // WAV is little endian whatever the host byte order
+  void writeUint16(uint16_t value) {
+    uint8_t bytes[2] = {static_cast<uint8_t>(value), static_cast<uint8_t>(value >> 8)};
+    fwrite(bytes, 1, sizeof(bytes), file_);
+  }
+
+  void writeUint32(uint32_t value) {
+    writeUint16(static_cast<uint16_t>(value));
+    writeUint16(static_cast<uint16_t>(value >> 16));
+  }
+
+  FILE *file_ = nullptr;
+  int32_t bytesPerFrame_ = 0;
+  size_t dataBytes_ = 0;
+};
+
+/**
+ * The path from the speaker to the microphone set by AAudioHost_setLoopback. The speaker's
+ * history is kept by frame along with the time of the most recent burst's first frame, and the
+ * microphone reads it back by time with linear interpolation.
+ */
+class Loopback {
+
+public:
+  Loopback() : history_(kLoopbackHistoryFrames, 0.0f) {}
+
+  void configure(const AAudioHostLoopback *loopback, uint32_t randomSeed) {
+
+    std::lock_guard<std::mutex> lock(lock_);
+    if (loopback == nullptr) {
+      isEnabled_ = false;
+      return;
+    }
+    if (!isEnabled_) {
+      // Whatever was played before the loopback was connected was never heard
+      std::fill(history_.begin(), history_.end(), 0.0f);
+      hasPlayed_ = false;
+    }
+    isEnabled_ = true;
+    settings_ = *loopback;
+    settings_.delayNanos = std::min(std::max(settings_.delayNanos, static_cast<int64_t>(0)),
+                                    kMaxLoopbackDelayNanos);
+    random_.seed(randomSeed);
+  }
+
+  /**
+   * Called by output streams with every burst the device consumes
+   *
+   * @param firstFrameNanos the time the burst's first frame leaves the speaker
+   */
+  void play(const void *audioData, aaudio_format_t format, int32_t channelCount,
+            int32_t numFrames, int64_t firstFrameNanos, double nanosPerFrame) {
+
+    std::lock_guard<std::mutex> lock(lock_);
+    if (!isEnabled_) return;
+
+    // A gap since the last burst, from the output stream stopping or a new one starting, was
+    // silence
+    if (hasPlayed_) {
+      double gapFrames = (firstFrameNanos - burstNanos_) / nanosPerFrame_ -
+                         (framesPlayed_ - burstFrame_);
+      int64_t silentFrames = std::min(static_cast<int64_t>(std::max(gapFrames + 0.5, 0.0)),
+                                      static_cast<int64_t>(kLoopbackHistoryFrames));
+      for (int64_t i = 0; i < silentFrames; i++) {
+        history_[(framesPlayed_ + i) % kLoopbackHistoryFrames] = 0;
+      }
+      framesPlayed_ += silentFrames;
+    }
+    hasPlayed_ = true;
+    burstFrame_ = framesPlayed_;
+    burstNanos_ = firstFrameNanos;
+    nanosPerFrame_ = nanosPerFrame;
+
+    for (int32_t i = 0; i < numFrames; i++) {
+      float sum = 0;
+      for (int32_t channel = 0; channel < channelCount; channel++) {
+        sum += getSample(audioData, format, i * channelCount + channel);
+      }
+      history_[framesPlayed_ % kLoopbackHistoryFrames] = sum / channelCount;
+      framesPlayed_++;
+    }
+  }
+
+  /**
+   * Called by input streams to add what reached the microphone to every burst they capture
+   *
+   * @param firstFrameNanos the time the burst's first frame reached the microphone
+   */
+  void capture(void *audioData, aaudio_format_t format, int32_t channelCount,
+               int32_t numFrames, int64_t firstFrameNanos, double nanosPerFrame) {
+
+    std::lock_guard<std::mutex> lock(lock_);
+    if (!isEnabled_) return;
+
+    std::normal_distribution<float> noise(0.0f, 1.0f);
+    for (int32_t i = 0; i < numFrames; i++) {
+      int64_t speakerNanos = firstFrameNanos + static_cast<int64_t>(i * nanosPerFrame) -
+                             settings_.delayNanos;
+      float value = settings_.gain * getSpeakerSample(speakerNanos);
+      if (settings_.noiseLevel > 0) value += settings_.noiseLevel * noise(random_);
+      for (int32_t channel = 0; channel < channelCount; channel++) {
+        addSample(audioData, format, i * channelCount + channel, value);
+      }
+    }
+  }
+
+private:
+  std::mutex lock_;
+  bool isEnabled_ = false;
+  AAudioHostLoopback settings_;
+  std::mt19937 random_;
+
+  // Speaker frames by the number played before them, and the time of burstFrame_
+  std::vector<float> history_;
+  int64_t framesPlayed_ = 0;
+  bool hasPlayed_ = false;
+  int64_t burstFrame_ = 0;
+  int64_t burstNanos_ = 0;
+  double nanosPerFrame_ = 0;
+
+  float getSpeakerSample(int64_t timeNanos) const {
+
+    if (!hasPlayed_) return 0;
+    double position = burstFrame_ + (timeNanos - burstNanos_) / nanosPerFrame_;
+    double frame = std::floor(position);
+    int64_t index = static_cast<int64_t>(frame);
+    float fraction = static_cast<float>(position - frame);
+    return getHistory(index) * (1 - fraction) + getHistory(index + 1) * fraction;
+  }
+
+  // Silence before the oldest frame kept and after the newest
+  float getHistory(int64_t frame) const {
+    if (frame < std::max(framesPlayed_ - kLoopbackHistoryFrames, static_cast<int64_t>(0)) ||
+        frame >= framesPlayed_) {
+      return 0;
+    }
+    return history_[frame % kLoopbackHistoryFrames];
+  }
+
+  static float getSample(const void *audioData, aaudio_format_t format, int32_t index) {
+    if (format == AAUDIO_FORMAT_PCM_I16) {
+      return static_cast<const int16_t *>(audioData)[index] * (1.0f / 32768);
+    }
+    return static_cast<const float *>(audioData)[index];
+  }
+
+  static void addSample(void *audioData, aaudio_format_t format, int32_t index, float value) {
+    if (format == AAUDIO_FORMAT_PCM_I16) {
+      int16_t *sample = &static_cast<int16_t *>(audioData)[index];
+      float sum = std::round(*sample + value * 32768);
+      *sample = static_cast<int16_t>(std::min(std::max(sum, -32768.0f), 32767.0f));
+    } else {
+      static_cast<float *>(audioData)[index] += value;
+    }
+  }
+};
+
+struct AAudioStreamBuilderStruct {
+  int32_t deviceId = AAUDIO_UNSPECIFIED;
+  int32_t sampleRate = AAUDIO_UNSPECIFIED;
+  int32_t channelCount = AAUDIO_UNSPECIFIED;
+  aaudio_format_t format = AAUDIO_FORMAT_UNSPECIFIED;
+  aaudio_sharing_mode_t sharingMode = AAUDIO_SHARING_MODE_SHARED;
+  aaudio_direction_t direction = AAUDIO_DIRECTION_OUTPUT;
+  int32_t bufferCapacity = AAUDIO_UNSPECIFIED;
+  aaudio_performance_mode_t performanceMode = AAUDIO_PERFORMANCE_MODE_NONE;
+  int32_t framesPerDataCallback = AAUDIO_UNSPECIFIED;
+  AAudioStream_dataCallback dataCallback = nullptr;
+  void *dataCallbackUserData = nullptr;
+  AAudioStream_errorCallback errorCallback = nullptr;
+  void *errorCallbackUserData = nullptr;
+};
+
+/**
+ * A stream on the simulated device. The FIFO between the application and the device is indexed
+ * by framesWritten_ and framesRead_, which only change while holding fifoLock_.
+ */
+struct AAudioStreamStruct {
+
+public:
+  AAudioStreamStruct(const AAudioStreamBuilder &builder, const AAudioHostConfig &config,
+                     uint32_t randomSeed);
+  ~AAudioStreamStruct();
+
+  aaudio_result_t requestStart();
+  aaudio_result_t requestStop();
+  aaudio_result_t read(void *buffer, int32_t numFrames, int64_t timeoutNanoseconds);
+  aaudio_result_t write(const void *buffer, int32_t numFrames, int64_t timeoutNanoseconds);
+  int32_t setBufferSizeInFrames(int32_t numFrames);
+  aaudio_result_t getTimestamp(int64_t *framePosition, int64_t *timeNanoseconds);
+  void injectXRuns(int32_t count);
+  void disconnect();
+
+  // Fixed when the stream is opened
+  const aaudio_direction_t direction_;
+  const int32_t deviceId_;
+  const int32_t sampleRate_;
+  const int32_t channelCount_;
+  const aaudio_format_t format_;
+  const aaudio_sharing_mode_t sharingMode_;
+  const aaudio_performance_mode_t performanceMode_;
+  const int32_t framesPerBurst_;
+  const int32_t bufferCapacity_;
+  const int32_t framesPerDataCallback_;
+
+  std::atomic<aaudio_stream_state_t> state_;
+  std::atomic<int32_t> bufferSize_;
+  std::atomic<int32_t> xRunCount_ { 0 };
+  std::atomic<int64_t> framesWritten_ { 0 };
+  std::atomic<int64_t> framesRead_ { 0 };
+
+private:
+  void deviceLoop();
+  bool deviceTick(int64_t tickTime);
+  void outputTick(int64_t tickTime, bool isGlitch);
+  void inputTick(int64_t tickTime, bool isGlitch);
+  bool runDataCallbacks();
+  void copyIntoFifo(const void *audioData, int32_t numFrames);
+  void copyFromFifo(void *audioData, int32_t numFrames);
+  void publishTimestamp(int64_t framePosition, int64_t timeNanoseconds);
+  int64_t randomNanos(int64_t maxNanos);
+  bool isOnDeviceThread() const;
+
+  const AAudioStream_dataCallback dataCallback_;
+  void *const dataCallbackUserData_;
+  const AAudioStream_errorCallback errorCallback_;
+  void *const errorCallbackUserData_;
+  const AAudioHostConfig config_;
+  const int32_t bytesPerFrame_;
+
+  std::vector<uint8_t> fifo_;
+  std::mutex fifoLock_;
+  std::condition_variable fifoCondition_;
+
+  // Device thread state
+  std::thread deviceThread_;
+  std::mutex controlLock_;
+  std::atomic<bool> isStopRequested_ { false };
+  std::atomic<bool> isDisconnectRequested_ { false };
+  std::atomic<int32_t> pendingXRuns_ { 0 };
+  std::mt19937 random_;
+  std::vector<uint8_t> deviceBuffer_;
+  std::vector<uint8_t> callbackBuffer_;
+  int64_t nextTickTime_ = 0;
+  double nanosPerFrame_ = 0;
+
+  // Frames written to the FIFO before the most recent callback, and the time that callback
+  // returned. The device can't have seen that callback's data at any earlier time.
+  int64_t framesWrittenBeforeCallback_ = 0;
+  int64_t lastCallbackEndTime_ = 0;
+
+  std::mutex timestampLock_;
+  bool hasTimestamp_ = false;
+  int64_t timestampPosition_ = 0;
+  int64_t timestampNanos_ = 0;
+
+  WavWriter wavWriter_;
+};
+
+static std::mutex streamsLock;
+static std::set<AAudioStream *> openStreams;
+static uint32_t openedStreamCount = 0;
+
+static AAudioHostConfig makeDefaultConfig() {
+  AAudioHostConfig config;
+  AAudioHost_getDefaultConfig(&config);
+  return config;
+}
+
+static AAudioHostConfig hostConfig = makeDefaultConfig();
+static Loopback hostLoopback;
+
+AAudioStreamStruct::AAudioStreamStruct(const AAudioStreamBuilder &builder,
+                                       const AAudioHostConfig &config,
+                                       uint32_t randomSeed) :
+    direction_(builder.direction),
+    deviceId_((builder.deviceId != AAUDIO_UNSPECIFIED) ? builder.deviceId : kHostDeviceId),
+    sampleRate_((builder.sampleRate != AAUDIO_UNSPECIFIED) ? builder.sampleRate
+                                                           : config.sampleRate),
+    channelCount_((builder.channelCount != AAUDIO_UNSPECIFIED) ? builder.channelCount :
+                  (builder.direction == AAUDIO_DIRECTION_OUTPUT) ? kDefaultOutputChannelCount
+                                                                 : kDefaultInputChannelCount),
+    format_((builder.format != AAUDIO_FORMAT_UNSPECIFIED) ? builder.format
+                                                          : AAUDIO_FORMAT_PCM_FLOAT),
+    sharingMode_(builder.sharingMode),
+    performanceMode_(builder.performanceMode),
+    framesPerBurst_(config.framesPerBurst),
+    // The capacity is always a whole number of bursts
+    bufferCapacity_((builder.bufferCapacity != AAUDIO_UNSPECIFIED) ?
+                    ((builder.bufferCapacity + config.framesPerBurst - 1) / config.framesPerBurst)
+                    * config.framesPerBurst :
+                    config.framesPerBurst * config.bufferCapacityInBursts),
+    framesPerDataCallback_((builder.framesPerDataCallback != AAUDIO_UNSPECIFIED) ?
+                           builder.framesPerDataCallback : config.framesPerBurst),
+    state_(AAUDIO_STREAM_STATE_OPEN),
+    bufferSize_(bufferCapacity_),
+    dataCallback_(builder.dataCallback),
+    dataCallbackUserData_(builder.dataCallbackUserData),
+    errorCallback_(builder.errorCallback),
+    errorCallbackUserData_(builder.errorCallbackUserData),
+    config_(config),
+    bytesPerFrame_(bytesPerSample(format_) * channelCount_),
+    random_(randomSeed) {
+
+  fifo_.resize(static_cast<size_t>(bufferCapacity_) * bytesPerFrame_);
+  deviceBuffer_.resize(static_cast<size_t>(framesPerBurst_) * bytesPerFrame_);
+  callbackBuffer_.resize(static_cast<size_t>(framesPerDataCallback_) * bytesPerFrame_);
+
+  if (direction_ == AAUDIO_DIRECTION_OUTPUT && config_.outputWavPath != nullptr) {
+    if (!wavWriter_.open(config_.outputWavPath, sampleRate_, channelCount_, format_)) {
+      fprintf(stderr, "AAudioHost: could not open %s for writing\n", config_.outputWavPath);
+    }
+  }
+}
+
+AAudioStreamStruct::~AAudioStreamStruct() {
+  requestStop();
+}
+
+bool AAudioStreamStruct::isOnDeviceThread() const {
+  return std::this_thread::get_id() == deviceThread_.get_id();
+}
+
+aaudio_result_t AAudioStreamStruct::requestStart() {
+
+  std::lock_guard<std::mutex> lock(controlLock_);
+
+  if (state_ == AAUDIO_STREAM_STATE_DISCONNECTED) return AAUDIO_ERROR_DISCONNECTED;
+  if (state_ == AAUDIO_STREAM_STATE_STARTED) return AAUDIO_OK;
+
+  // The thread may have exited by itself after a callback returned AAUDIO_CALLBACK_RESULT_STOP
+  if (deviceThread_.joinable()) deviceThread_.join();
+
+  isStopRequested_ = false;
+  hasTimestamp_ = false;
+  state_ = AAUDIO_STREAM_STATE_STARTED;
+  deviceThread_ = std::thread(&AAudioStreamStruct::deviceLoop, this);
+  return AAUDIO_OK;
+}
+
+aaudio_result_t AAudioStreamStruct::requestStop() {
+
+  // A callback may stop its own stream, the device thread exits once the callback returns
+  if (isOnDeviceThread()) {
+    isStopRequested_ = true;
+    if (state_ != AAUDIO_STREAM_STATE_DISCONNECTED) state_ = AAUDIO_STREAM_STATE_STOPPED;
+    return AAUDIO_OK;
+  }
+
+  std::lock_guard<std::mutex> lock(controlLock_);
+
+  isStopRequested_ = true;
+  if (deviceThread_.joinable()) deviceThread_.join();
+  if (state_ != AAUDIO_STREAM_STATE_DISCONNECTED) state_ = AAUDIO_STREAM_STATE_STOPPED;
+
+  // Wake any blocked reads or writes so they return what they have
+  fifoCondition_.notify_all();
+  return AAUDIO_OK;
+}
+
+void AAudioStreamStruct::injectXRuns(int32_t count) {
+  pendingXRuns_ += count;
+}
+
+void AAudioStreamStruct::disconnect() {
+
+  std::lock_guard<std::mutex> lock(controlLock_);
+
+  if (state_ == AAUDIO_STREAM_STATE_STARTED) {
+    // The device thread reports the disconnection on its next burst
+    isDisconnectRequested_ = true;
+  } else {
+    state_ = AAUDIO_STREAM_STATE_DISCONNECTED;
+    fifoCondition_.notify_all();
+  }
+}
+
+int32_t AAudioStreamStruct::setBufferSizeInFrames(int32_t numFrames) {
+
+  // Like an MMAP stream the buffer size is a whole number of bursts
+  int32_t numBursts = (numFrames + framesPerBurst_ - 1) / framesPerBurst_;
+  int32_t bufferSize = std::min(std::max(numBursts, 1) * framesPerBurst_, bufferCapacity_);
+  bufferSize_ = bufferSize;
+  return bufferSize;
+}
+
+/**
+ * Runs on the device thread. Device bursts happen at fixed intervals of the (possibly drifting)
+ * device clock. After each burst a single wake up of the callback is scheduled after a random
+ * delay, if a wake up is already pending because the jitter exceeded the burst period it isn't
+ * moved.
+ */
+void AAudioStreamStruct::deviceLoop() {
+
+  pthread_setname_np(pthread_self(), "aaudio_host");
+
+  const double driftPpm = config_.clockDriftPpm +
+                         ((direction_ == AAUDIO_DIRECTION_INPUT) ? config_.inputClockDriftPpm : 0);
+  const double burstPeriodNanos = static_cast<double>(framesPerBurst_) * kNanosPerSecond /
+                                  (sampleRate_ * (1.0 + driftPpm * 1e-6));
+  nanosPerFrame_ = burstPeriodNanos / framesPerBurst_;
+  const int64_t startTime = nowNanos();
+  int64_t burstCount = 1;
+  nextTickTime_ = startTime + static_cast<int64_t>(burstPeriodNanos);
+
+  // Output callbacks prime the buffer before the first burst
+  int64_t callbackTime = (dataCallback_ != nullptr && direction_ == AAUDIO_DIRECTION_OUTPUT) ?
+                         startTime : kNever;
+
+  bool isRunning = true;
+  while (isRunning && !isStopRequested_) {
+
+    sleepUntilNanos(std::min(nextTickTime_, callbackTime));
+    if (isStopRequested_) break;
+
+    if (nextTickTime_ <= callbackTime) {
+      int64_t tickTime = nextTickTime_;
+      isRunning = deviceTick(tickTime);
+      burstCount++;
+      nextTickTime_ = startTime + static_cast<int64_t>(burstCount * burstPeriodNanos);
+
+      if (dataCallback_ != nullptr && callbackTime == kNever) {
+        callbackTime = tickTime + randomNanos(config_.callbackJitterNanos);
+      }
+    } else {
+      isRunning = runDataCallbacks();
+      callbackTime = kNever;
+    }
+  }
+}
+
+/**
+ * Simulate a single burst of the device.
+ *
+ * @return false if the stream was disconnected
+ */
+bool AAudioStreamStruct::deviceTick(int64_t tickTime) {
+
+  if (isDisconnectRequested_) {
+    state_ = AAUDIO_STREAM_STATE_DISCONNECTED;
+    fifoCondition_.notify_all();
+    if (errorCallback_ != nullptr) {
+      errorCallback_(this, errorCallbackUserData_, AAUDIO_ERROR_DISCONNECTED);
+    }
+    return false;
+  }
+
+  bool isGlitch = false;
+  if (pendingXRuns_ > 0) {
+    pendingXRuns_--;
+    isGlitch = true;
+  } else if (config_.xRunProbability > 0) {
+    isGlitch = std::uniform_real_distribution<double>(0.0, 1.0)(random_) < config_.xRunProbability;
+  }
+
+  if (direction_ == AAUDIO_DIRECTION_OUTPUT) {
+    outputTick(tickTime, isGlitch);
+  } else {
+    inputTick(tickTime, isGlitch);
+  }
+  return true;
+}
+
+void AAudioStreamStruct::outputTick(int64_t tickTime, bool isGlitch) {
+
+  uint8_t *deviceData = deviceBuffer_.data();
+  int64_t readPosition;
+  {
+    std::lock_guard<std::mutex> lock(fifoLock_);
+
+    // Data from a callback which finished after this burst was due arrived too late to be played
+    int64_t framesWritten = (lastCallbackEndTime_ > tickTime) ? framesWrittenBeforeCallback_
+                                                              : framesWritten_.load();
+    readPosition = framesRead_;
+    int32_t available = static_cast<int32_t>(
+        std::min(std::max(framesWritten - readPosition, static_cast<int64_t>(0)),
+                 static_cast<int64_t>(framesPerBurst_)));
+
+    copyFromFifo(deviceData, available);
+    memset(deviceData + available * bytesPerFrame_, 0,
+           static_cast<size_t>(framesPerBurst_ - available) * bytesPerFrame_);
+
+    if (isGlitch) {
+      memset(deviceData, 0, deviceBuffer_.size());
+    }
+    if (isGlitch || available < framesPerBurst_) xRunCount_++;
+
+    // Frames which the device missed are dropped
+    framesRead_ = readPosition + framesPerBurst_;
+    if (framesWritten_ < framesRead_) framesWritten_ = framesRead_.load();
+  }
+  fifoCondition_.notify_all();
+
+  publishTimestamp(readPosition, tickTime + config_.outputLatencyNanos);
+
+  hostLoopback.play(deviceData, format_, channelCount_, framesPerBurst_,
+                    tickTime + config_.outputLatencyNanos, nanosPerFrame_);
+  wavWriter_.write(deviceData, framesPerBurst_);
+  if (config_.outputSink != nullptr) {
+    config_.outputSink(this, config_.outputSinkUserData, deviceData, framesPerBurst_);
+  }
+}
+
+void AAudioStreamStruct::inputTick(int64_t tickTime, bool isGlitch) {
+
+  uint8_t *deviceData = deviceBuffer_.data();
+  memset(deviceData, 0, deviceBuffer_.size());
+  if (config_.inputSource != nullptr && !isGlitch) {
+    config_.inputSource(this, config_.inputSourceUserData, deviceData, framesPerBurst_);
+  }
+  if (!isGlitch) {
+    hostLoopback.capture(deviceData, format_, channelCount_, framesPerBurst_,
+                         tickTime - config_.inputLatencyNanos, nanosPerFrame_);
+  }
+
+  int64_t writePosition;
+  {
+    std::lock_guard<std::mutex> lock(fifoLock_);
+
+    writePosition = framesWritten_;
+    if (isGlitch) xRunCount_++;
+
+    // Overrun, the oldest frames are lost
+    if (writePosition + framesPerBurst_ - framesRead_ > bufferCapacity_) {
+      framesRead_ = writePosition + framesPerBurst_ - bufferCapacity_;
+      xRunCount_++;
+    }
+    copyIntoFifo(deviceData, framesPerBurst_);
+    framesWritten_ = writePosition + framesPerBurst_;
+  }
+  fifoCondition_.notify_all();
+
+  publishTimestamp(writePosition, tickTime - config_.inputLatencyNanos);
+}
+
+/**
+ * Call the data callback until the buffer is full (output) or empty (input). Stops early if the
+ * next device burst becomes due so that the device isn't delayed by a long run of callbacks.
+ *
+ * @return false if the callback asked for the stream to stop
+ */
+bool AAudioStreamStruct::runDataCallbacks() {
+
+  for (;;) {
+
+    aaudio_data_callback_result_t result;
+
+    if (direction_ == AAUDIO_DIRECTION_OUTPUT) {
+      int64_t framesWritten = framesWritten_;
+      if (framesWritten - framesRead_ + framesPerDataCallback_ > bufferSize_) return true;
+
+      result = dataCallback_(this, dataCallbackUserData_, callbackBuffer_.data(),
+                             framesPerDataCallback_);
+
+      std::lock_guard<std::mutex> lock(fifoLock_);
+      copyIntoFifo(callbackBuffer_.data(), framesPerDataCallback_);
+      framesWritten_ = framesWritten_ + framesPerDataCallback_;
+      framesWrittenBeforeCallback_ = framesWritten;
+      lastCallbackEndTime_ = nowNanos();
+    } else {
+      {
+        std::lock_guard<std::mutex> lock(fifoLock_);
+        if (framesWritten_ - framesRead_ < framesPerDataCallback_) return true;
+        copyFromFifo(callbackBuffer_.data(), framesPerDataCallback_);
+        framesRead_ = framesRead_ + framesPerDataCallback_;
+      }
+      result = dataCallback_(this, dataCallbackUserData_, callbackBuffer_.data(),
+                             framesPerDataCallback_);
+    }
+
+    if (result != AAUDIO_CALLBACK_RESULT_CONTINUE || isStopRequested_) {
+      if (state_ != AAUDIO_STREAM_STATE_DISCONNECTED) state_ = AAUDIO_STREAM_STATE_STOPPED;
+      return false;
+    }
+    if (nowNanos() >= nextTickTime_) return true;
+  }
+}
+
+// Copy frames into the FIFO at framesWritten_, must hold fifoLock_
+void AAudioStreamStruct::copyIntoFifo(const void *audioData, int32_t numFrames) {
+
+  const uint8_t *source = static_cast<const uint8_t *>(audioData);
+  int32_t offset = static_cast<int32_t>(framesWritten_ % bufferCapacity_);
+  int32_t firstPart = std::min(numFrames, bufferCapacity_ - offset);
+  memcpy(&fifo_[offset * bytesPerFrame_], source,
+         static_cast<size_t>(firstPart) * bytesPerFrame_);
+  memcpy(&fifo_[0], source + firstPart * bytesPerFrame_,
+         static_cast<size_t>(numFrames - firstPart) * bytesPerFrame_);
+}
+
+// Copy frames out of the FIFO from framesRead_, must hold fifoLock_
+void AAudioStreamStruct::copyFromFifo(void *audioData, int32_t numFrames) {
+
+  uint8_t *destination = static_cast<uint8_t *>(audioData);
+  int32_t offset = static_cast<int32_t>(framesRead_ % bufferCapacity_);
+  int32_t firstPart = std::min(numFrames, bufferCapacity_ - offset);
+  memcpy(destination, &fifo_[offset * bytesPerFrame_],
+         static_cast<size_t>(firstPart) * bytesPerFrame_);
+  memcpy(destination + firstPart * bytesPerFrame_, &fifo_[0],
+         static_cast<size_t>(numFrames - firstPart) * bytesPerFrame_);
+}
+
+aaudio_result_t AAudioStreamStruct::read(void *buffer, int32_t numFrames,
+                                         int64_t timeoutNanoseconds) {
+
+  if (direction_ != AAUDIO_DIRECTION_INPUT) return AAUDIO_ERROR_UNIMPLEMENTED;
+  if (dataCallback_ != nullptr) return AAUDIO_ERROR_INVALID_STATE;
+  if (numFrames < 0) return AAUDIO_ERROR_ILLEGAL_ARGUMENT;
+
+  auto deadline = std::chrono::steady_clock::now() +
+                  std::chrono::nanoseconds(timeoutNanoseconds);
+  uint8_t *destination = static_cast<uint8_t *>(buffer);
+  int32_t framesDone = 0;
+
+  std::unique_lock<std::mutex> lock(fifoLock_);
+  for (;;) {
+    if (state_ == AAUDIO_STREAM_STATE_DISCONNECTED) return AAUDIO_ERROR_DISCONNECTED;
+
+    int32_t framesToRead = static_cast<int32_t>(
+        std::min(framesWritten_ - framesRead_, static_cast<int64_t>(numFrames - framesDone)));
+    copyFromFifo(destination + framesDone * bytesPerFrame_, framesToRead);
+    framesRead_ = framesRead_ + framesToRead;
+    framesDone += framesToRead;
+
+    if (framesDone == numFrames || timeoutNanoseconds <= 0 ||
+        state_ != AAUDIO_STREAM_STATE_STARTED) break;
+    if (fifoCondition_.wait_until(lock, deadline) == std::cv_status::timeout) break;
+  }
+  return framesDone;
+}
+
+aaudio_result_t AAudioStreamStruct::write(const void *buffer, int32_t numFrames,
+                                          int64_t timeoutNanoseconds) {
+
+  if (direction_ != AAUDIO_DIRECTION_OUTPUT) return AAUDIO_ERROR_UNIMPLEMENTED;
+  if (dataCallback_ != nullptr) return AAUDIO_ERROR_INVALID_STATE;
+  if (numFrames < 0) return AAUDIO_ERROR_ILLEGAL_ARGUMENT;
+
+  auto deadline = std::chrono::steady_clock::now() +
+                  std::chrono::nanoseconds(timeoutNanoseconds);
+  const uint8_t *source = static_cast<const uint8_t *>(buffer);
+  int32_t framesDone = 0;
+
+  std::unique_lock<std::mutex> lock(fifoLock_);
+  for (;;) {
+    if (state_ == AAUDIO_STREAM_STATE_DISCONNECTED) return AAUDIO_ERROR_DISCONNECTED;
+
+    int64_t space = bufferSize_ - (framesWritten_ - framesRead_);
+    int32_t framesToWrite = static_cast<int32_t>(
+        std::min(std::max(space, static_cast<int64_t>(0)),
+                 static_cast<int64_t>(numFrames - framesDone)));
+    copyIntoFifo(source + framesDone * bytesPerFrame_, framesToWrite);
+    framesWritten_ = framesWritten_ + framesToWrite;
+    framesDone += framesToWrite;
+
+    if (framesDone == numFrames || timeoutNanoseconds <= 0 ||
+        state_ != AAUDIO_STREAM_STATE_STARTED) break;
+    if (fifoCondition_.wait_until(lock, deadline) == std::cv_status::timeout) break;
+  }
+  return framesDone;
+}
+
+void AAudioStreamStruct::publishTimestamp(int64_t framePosition, int64_t timeNanoseconds) {
+
+  if (config_.timestampJitterNanos > 0) {
+    timeNanoseconds += randomNanos(2 * config_.timestampJitterNanos) -
+                       config_.timestampJitterNanos;
+  }
+
+  std::lock_guard<std::mutex> lock(timestampLock_);
+  hasTimestamp_ = true;
+  timestampPosition_ = framePosition;
+  timestampNanos_ = timeNanoseconds;
+}
+
+aaudio_result_t AAudioStreamStruct::getTimestamp(int64_t *framePosition,
+                                                 int64_t *timeNanoseconds) {
+
+  if (state_ == AAUDIO_STREAM_STATE_DISCONNECTED) return AAUDIO_ERROR_DISCONNECTED;
+  if (state_ != AAUDIO_STREAM_STATE_STARTED) return AAUDIO_ERROR_INVALID_STATE;
+
+  std::lock_guard<std::mutex> lock(timestampLock_);
+
+  // As on a device there is no timestamp until the first burst has been processed
+  if (!hasTimestamp_) return AAUDIO_ERROR_INVALID_STATE;
+  *framePosition = timestampPosition_;
+  *timeNanoseconds = timestampNanos_;
+  return AAUDIO_OK;
+}
+
+int64_t AAudioStreamStruct::randomNanos(int64_t maxNanos) {
+  if (maxNanos <= 0) return 0;
+  return std::uniform_int_distribution<int64_t>(0, maxNanos)(random_);
+}
+
+// Host controls
+
+void AAudioHost_getDefaultConfig(AAudioHostConfig *config) {
+  memset(config, 0, sizeof(AAudioHostConfig));
+  config->sampleRate = kDefaultSampleRate;
+  config->framesPerBurst = kDefaultFramesPerBurst;
+  config->bufferCapacityInBursts = kDefaultBufferCapacityInBursts;
+  config->outputLatencyNanos = kDefaultLatencyNanos;
+  config->inputLatencyNanos = kDefaultLatencyNanos;
+}
+
+void AAudioHost_setConfig(const AAudioHostConfig *config) {
+  std::lock_guard<std::mutex> lock(streamsLock);
+  hostConfig = *config;
+}
+
+void AAudioHost_injectXRuns(int32_t count) {
+  std::lock_guard<std::mutex> lock(streamsLock);
+  for (AAudioStream *stream : openStreams) stream->injectXRuns(count);
+}
+
+void AAudioHost_disconnectAllStreams() {
+  std::lock_guard<std::mutex> lock(streamsLock);
+  for (AAudioStream *stream : openStreams) stream->disconnect();
+}
+
+void AAudioHost_setLoopback(const AAudioHostLoopback *loopback) {
+  uint32_t randomSeed;
+  {
+    std::lock_guard<std::mutex> lock(streamsLock);
+    randomSeed = hostConfig.randomSeed;
+  }
+  hostLoopback.configure(loopback, randomSeed);
+}
+
+int32_t AAudioHost_getOpenStreamCount() {
+  std::lock_guard<std::mutex> lock(streamsLock);
+  return static_cast<int32_t>(openStreams.size());
+}
+
+// AAudio API
+
+const char *AAudio_convertResultToText(aaudio_result_t returnCode) {
+  switch (returnCode) {
+    case AAUDIO_OK: return "AAUDIO_OK";
+    case AAUDIO_ERROR_DISCONNECTED: return "AAUDIO_ERROR_DISCONNECTED";
+    case AAUDIO_ERROR_ILLEGAL_ARGUMENT: return "AAUDIO_ERROR_ILLEGAL_ARGUMENT";
+    case AAUDIO_ERROR_INTERNAL: return "AAUDIO_ERROR_INTERNAL";
+    case AAUDIO_ERROR_INVALID_STATE: return "AAUDIO_ERROR_INVALID_STATE";
+    case AAUDIO_ERROR_INVALID_HANDLE: return "AAUDIO_ERROR_INVALID_HANDLE";
+    case AAUDIO_ERROR_UNIMPLEMENTED: return "AAUDIO_ERROR_UNIMPLEMENTED";
+    case AAUDIO_ERROR_UNAVAILABLE: return "AAUDIO_ERROR_UNAVAILABLE";
+    case AAUDIO_ERROR_NO_FREE_HANDLES: return "AAUDIO_ERROR_NO_FREE_HANDLES";
+    case AAUDIO_ERROR_NO_MEMORY: return "AAUDIO_ERROR_NO_MEMORY";
+    case AAUDIO_ERROR_NULL: return "AAUDIO_ERROR_NULL";
+    case AAUDIO_ERROR_TIMEOUT: return "AAUDIO_ERROR_TIMEOUT";
+    case AAUDIO_ERROR_WOULD_BLOCK: return "AAUDIO_ERROR_WOULD_BLOCK";
+    case AAUDIO_ERROR_INVALID_FORMAT: return "AAUDIO_ERROR_INVALID_FORMAT";
+    case AAUDIO_ERROR_OUT_OF_RANGE: return "AAUDIO_ERROR_OUT_OF_RANGE";
+    case AAUDIO_ERROR_NO_SERVICE: return "AAUDIO_ERROR_NO_SERVICE";
+    case AAUDIO_ERROR_INVALID_RATE: return "AAUDIO_ERROR_INVALID_RATE";
+    default: return "Unrecognized AAudio error.";
+  }
+}
+
+const char *AAudio_convertStreamStateToText(aaudio_stream_state_t state) {
+  switch (state) {
+    case AAUDIO_STREAM_STATE_UNINITIALIZED: return "AAUDIO_STREAM_STATE_UNINITIALIZED";
+    case AAUDIO_STREAM_STATE_UNKNOWN: return "AAUDIO_STREAM_STATE_UNKNOWN";
+    case AAUDIO_STREAM_STATE_OPEN: return "AAUDIO_STREAM_STATE_OPEN";
+    case AAUDIO_STREAM_STATE_STARTING: return "AAUDIO_STREAM_STATE_STARTING";
+    case AAUDIO_STREAM_STATE_STARTED: return "AAUDIO_STREAM_STATE_STARTED";
+    case AAUDIO_STREAM_STATE_PAUSING: return "AAUDIO_STREAM_STATE_PAUSING";
+    case AAUDIO_STREAM_STATE_PAUSED: return "AAUDIO_STREAM_STATE_PAUSED";
+    case AAUDIO_STREAM_STATE_FLUSHING: return "AAUDIO_STREAM_STATE_FLUSHING";
+    case AAUDIO_STREAM_STATE_FLUSHED: return "AAUDIO_STREAM_STATE_FLUSHED";
+    case AAUDIO_STREAM_STATE_STOPPING: return "AAUDIO_STREAM_STATE_STOPPING";
+    case AAUDIO_STREAM_STATE_STOPPED: return "AAUDIO_STREAM_STATE_STOPPED";
+    case AAUDIO_STREAM_STATE_CLOSING: return "AAUDIO_STREAM_STATE_CLOSING";
+    case AAUDIO_STREAM_STATE_CLOSED: return "AAUDIO_STREAM_STATE_CLOSED";
+    case AAUDIO_STREAM_STATE_DISCONNECTED: return "AAUDIO_STREAM_STATE_DISCONNECTED";
+    default: return "Unrecognized AAudio state.";
+  }
+}
+
+aaudio_result_t AAudio_createStreamBuilder(AAudioStreamBuilder **builder) {
+  if (builder == nullptr) return AAUDIO_ERROR_NULL;
+  *builder = new AAudioStreamBuilder();
+  return AAUDIO_OK;
+}
+
+void AAudioStreamBuilder_setDeviceId(AAudioStreamBuilder *builder, int32_t deviceId) {
+  builder->deviceId = deviceId;
+}
+
+void AAudioStreamBuilder_setSampleRate(AAudioStreamBuilder *builder, int32_t sampleRate) {
+  builder->sampleRate = sampleRate;
+}
+
+void AAudioStreamBuilder_setChannelCount(AAudioStreamBuilder *builder, int32_t channelCount) {
+  builder->channelCount = channelCount;
+}
+
+void AAudioStreamBuilder_setFormat(AAudioStreamBuilder *builder, aaudio_format_t format) {
+  builder->format = format;
+}
+
+void AAudioStreamBuilder_setSharingMode(AAudioStreamBuilder *builder,
+                                        aaudio_sharing_mode_t sharingMode) {
+  builder->sharingMode = sharingMode;
+}
+
+void AAudioStreamBuilder_setDirection(AAudioStreamBuilder *builder,
+                                      aaudio_direction_t direction) {
+  builder->direction = direction;
+}
+
+void AAudioStreamBuilder_setBufferCapacityInFrames(AAudioStreamBuilder *builder,
+                                                   int32_t numFrames) {
+  builder->bufferCapacity = numFrames;
+}
+
+void AAudioStreamBuilder_setPerformanceMode(AAudioStreamBuilder *builder,
+                                            aaudio_performance_mode_t mode) {
+  builder->performanceMode = mode;
+}
+
+void AAudioStreamBuilder_setDataCallback(AAudioStreamBuilder *builder,
+                                         AAudioStream_dataCallback callback,
+                                         void *userData) {
+  builder->dataCallback = callback;
+  builder->dataCallbackUserData = userData;
+}
+
+void AAudioStreamBuilder_setFramesPerDataCallback(AAudioStreamBuilder *builder,
+                                                  int32_t numFrames) {
+  builder->framesPerDataCallback = numFrames;
+}
+
+void AAudioStreamBuilder_setErrorCallback(AAudioStreamBuilder *builder,
+                                          AAudioStream_errorCallback callback,
+                                          void *userData) {
+  builder->errorCallback = callback;
+  builder->errorCallbackUserData = userData;
+}
+
+aaudio_result_t AAudioStreamBuilder_openStream(AAudioStreamBuilder *builder,
+                                               AAudioStream **stream) {
+
+  if (builder == nullptr || stream == nullptr) return AAUDIO_ERROR_NULL;
+  *stream = nullptr;
+
+  if (builder->format != AAUDIO_FORMAT_UNSPECIFIED &&
+      builder->format != AAUDIO_FORMAT_PCM_I16 &&
+      builder->format != AAUDIO_FORMAT_PCM_FLOAT) {
+    return AAUDIO_ERROR_INVALID_FORMAT;
+  }
+  if (builder->sampleRate != AAUDIO_UNSPECIFIED &&
+      (builder->sampleRate < kMinSampleRate || builder->sampleRate > kMaxSampleRate)) {
+    return AAUDIO_ERROR_INVALID_RATE;
+  }
+  if (builder->channelCount < 0 || builder->channelCount > kMaxChannelCount ||
+      builder->framesPerDataCallback < 0 || builder->bufferCapacity < 0) {
+    return AAUDIO_ERROR_ILLEGAL_ARGUMENT;
+  }
+
+  std::lock_guard<std::mutex> lock(streamsLock);
+  if (hostConfig.framesPerBurst <= 0 || hostConfig.bufferCapacityInBursts <= 0) {
+    return AAUDIO_ERROR_ILLEGAL_ARGUMENT;
+  }
+
+  AAudioStream *newStream = new AAudioStream(*builder, hostConfig,
+                                             hostConfig.randomSeed + openedStreamCount);
+  if (newStream->framesPerDataCallback_ > newStream->bufferCapacity_) {
+    delete newStream;
+    return AAUDIO_ERROR_ILLEGAL_ARGUMENT;
+  }
+
+  openedStreamCount++;
+  openStreams.insert(newStream);
+  *stream = newStream;
+  return AAUDIO_OK;
+}
+
+aaudio_result_t AAudioStreamBuilder_delete(AAudioStreamBuilder *builder) {
+  delete builder;
+  return AAUDIO_OK;
+}
+
+aaudio_result_t AAudioStream_close(AAudioStream *stream) {
+
+  if (stream == nullptr) return AAUDIO_ERROR_NULL;
+  {
+    std::lock_guard<std::mutex> lock(streamsLock);
+    if (openStreams.erase(stream) == 0) return AAUDIO_ERROR_INVALID_HANDLE;
+  }
+
+  // The destructor stops the device thread, waiting for any callback in progress
+  delete stream;
+  return AAUDIO_OK;
+}
+
+aaudio_result_t AAudioStream_requestStart(AAudioStream *stream) {
+  return stream->requestStart();
+}
+
+aaudio_result_t AAudioStream_requestStop(AAudioStream *stream) {
+  return stream->requestStop();
+}
+
+aaudio_stream_state_t AAudioStream_getState(AAudioStream *stream) {
+  return stream->state_;
+}
+
+aaudio_result_t AAudioStream_read(AAudioStream *stream,
+                                  void *buffer,
+                                  int32_t numFrames,
+                                  int64_t timeoutNanoseconds) {
+  return stream->read(buffer, numFrames, timeoutNanoseconds);
+}
+
+aaudio_result_t AAudioStream_write(AAudioStream *stream,
+                                   const void *buffer,
+                                   int32_t numFrames,
+                                   int64_t timeoutNanoseconds) {
+  return stream->write(buffer, numFrames, timeoutNanoseconds);
+}
+
+aaudio_result_t AAudioStream_setBufferSizeInFrames(AAudioStream *stream, int32_t numFrames) {
+  if (numFrames < 0) return AAUDIO_ERROR_ILLEGAL_ARGUMENT;
+  return stream->setBufferSizeInFrames(numFrames);
+}
+
+int32_t AAudioStream_getBufferSizeInFrames(AAudioStream *stream) {
+  return stream->bufferSize_;
+}
+
+int32_t AAudioStream_getFramesPerBurst(AAudioStream *stream) {
+  return stream->framesPerBurst_;
+}
+
+int32_t AAudioStream_getBufferCapacityInFrames(AAudioStream *stream) {
+  return stream->bufferCapacity_;
+}
+
+int32_t AAudioStream_getFramesPerDataCallback(AAudioStream *stream) {
+  return stream->framesPerDataCallback_;
+}
+
+int32_t AAudioStream_getXRunCount(AAudioStream *stream) {
+  return stream->xRunCount_;
+}
+
+int32_t AAudioStream_getSampleRate(AAudioStream *stream) {
+  return stream->sampleRate_;
+}
+
+int32_t AAudioStream_getChannelCount(AAudioStream *stream) {
+  return stream->channelCount_;
+}
+
+int32_t AAudioStream_getSamplesPerFrame(AAudioStream *stream) {
+  return stream->channelCount_;
+}
+
+int32_t AAudioStream_getDeviceId(AAudioStream *stream) {
+  return stream->deviceId_;
+}
+
+aaudio_format_t AAudioStream_getFormat(AAudioStream *stream) {
+  return stream->format_;
+}
+
+aaudio_sharing_mode_t AAudioStream_getSharingMode(AAudioStream *stream) {
+  return stream->sharingMode_;
+}
+
+aaudio_performance_mode_t AAudioStream_getPerformanceMode(AAudioStream *stream) {
+  return stream->performanceMode_;
+}
+
+aaudio_direction_t AAudioStream_getDirection(AAudioStream *stream) {
+  return stream->direction_;
+}
+
+int64_t AAudioStream_getFramesWritten(AAudioStream *stream) {
+  return stream->framesWritten_;
+}
+
+int64_t AAudioStream_getFramesRead(AAudioStream *stream) {
+  return stream->framesRead_;
+}
+
+aaudio_result_t AAudioStream_getTimestamp(AAudioStream *stream,
+                                          clockid_t clockid,
+                                          int64_t *framePosition,
+                                          int64_t *timeNanoseconds) {
+
+  // Without suspend CLOCK_BOOTTIME and CLOCK_MONOTONIC are equivalent
+  if (clockid != CLOCK_MONOTONIC && clockid != CLOCK_BOOTTIME) {
+    return AAUDIO_ERROR_ILLEGAL_ARGUMENT;
+  }
+  return stream->getTimestamp(framePosition, timeNanoseconds);
+}
@@ -0,0 +1,71 @@
+/*
+ * Copyright 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <atomic>
+#include <android/log.h>
+
+static const int LOG_MAX_MESSAGE_LENGTH = 1024;
+
+static std::atomic<int32_t> minimumPriority(ANDROID_LOG_INFO);
+
+static char priorityToChar(int prio) {
+  static const char priorityChars[] = "??VDIWEFS";
+  return (prio >= 0 && prio <= ANDROID_LOG_SILENT) ? priorityChars[prio] : '?';
+}
+
+int __android_log_write(int prio, const char *tag, const char *text) {
+
+  if (prio < minimumPriority.load(std::memory_order_relaxed)) return 0;
+
+  // A single call to fprintf keeps lines from different threads from being interleaved
+  return fprintf(stderr, "%c/%s: %s\n", priorityToChar(prio), tag, text);
+}
+
+int __android_log_vprint(int prio, const char *tag, const char *fmt, va_list ap) {
+
+  if (prio < minimumPriority.load(std::memory_order_relaxed)) return 0;
+
+  char message[LOG_MAX_MESSAGE_LENGTH];
+  vsnprintf(message, sizeof(message), fmt, ap);
+  return __android_log_write(prio, tag, message);
+}
+
+int __android_log_print(int prio, const char *tag, const char *fmt, ...) {
+
+  va_list args;
+  va_start(args, fmt);
+  int result = __android_log_vprint(prio, tag, fmt, args);
+  va_end(args);
+  return result;
+}
+
+void __android_log_assert(const char *cond, const char *tag, const char *fmt, ...) {
+
+  char message[LOG_MAX_MESSAGE_LENGTH];
+  va_list args;
+  va_start(args, fmt);
+  vsnprintf(message, sizeof(message), fmt, args);
+  va_end(args);
+
+  fprintf(stderr, "F/%s: assertion failed: %s %s\n", tag, cond, message);
+  abort();
+}
+
+int32_t __android_log_set_minimum_priority(int32_t priority) {
+  return minimumPriority.exchange(priority);
+}
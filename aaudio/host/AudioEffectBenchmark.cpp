@@ -0,0 +1,295 @@
+/*
+ * Copyright 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * Measures the echo sample's AudioEffect at delays from 1 ms to 2 s, against a per-frame delay
+ * line with the same interpolation, and checks their output agrees and parameter changes don't
+ * click.
+ *
+ *   audio-effect-benchmark [frames per burst]
+ *
+ * Build it with CMAKE_BUILD_TYPE=Release, the default build is unoptimized.
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <algorithm>
+#include <vector>
+#include "AudioEffect.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define BENCHMARK_HAS_CYCLE_COUNTER 1
+#endif
+
+constexpr int32_t kDefaultFramesPerBurst = 192;
+constexpr int32_t kFrameRate = 48000;
+constexpr int32_t kChannelCount = 2;
+constexpr int kBurstsPerRun = 5000;
+constexpr int kRuns = 5;
+
+// Largest difference allowed between AudioEffect and the reference
+constexpr float kMaxError = 1e-5f;
+
+// Largest step between frames with parameters changing, as a multiple of the largest step with
+// them fixed
+constexpr double kMaxStepRatio = 1.5;
+
+static int64_t nowNanos() {
+  timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static uint64_t readCycles() {
+#if BENCHMARK_HAS_CYCLE_COUNTER
+  return __rdtsc();
+#else
+  return 0;
+#endif
+}
+
+struct Timing {
+  double cyclesPerFrame;
+  double nanosPerFrame;
+};
+
+/**
+ * Best of kRuns, each processing kBurstsPerRun bursts
+ */
+template <typename Process>
+static Timing measure(int32_t framesPerBurst, Process process) {
+  Timing best = { 1e30, 1e30 };
+  for (int run = 0; run < kRuns; run++) {
+    uint64_t startCycles = readCycles();
+    int64_t startNanos = nowNanos();
+    for (int i = 0; i < kBurstsPerRun; i++) process();
+    double frames = (double) kBurstsPerRun * framesPerBurst;
+    double cycles = (readCycles() - startCycles) / frames;
+    double nanos = (nowNanos() - startNanos) / frames;
+    if (nanos < best.nanosPerFrame) best = Timing { cycles, nanos };
+  }
+  return best;
+}
+
+static void printTiming(const char *name, Timing timing) {
+#if BENCHMARK_HAS_CYCLE_COUNTER
+  printf("%-30s %7.2f cycles/frame %7.2f ns/frame\n", name, timing.cyclesPerFrame,
+         timing.nanosPerFrame);
+#else
+  printf("%-30s %7.2f ns/frame\n", name, timing.nanosPerFrame);
+#endif
+}
+
+/**
+ * A mono feedback delay with fixed parameters, reading and writing the line a frame at a time
+ */
+class ReferenceDelay {
+public:
+  ReferenceDelay(double delayMillis, float feedback, float mix) :
+      line_(1 << 18), delayFrames_(delayMillis * kFrameRate / 1000), feedback_(feedback),
+      mix_(mix) {}
+
+  void process(float *buffer, int32_t numFrames) {
+    const int64_t mask = line_.size() - 1;
+    for (int i = 0; i < numFrames; i++) {
+      double position = writeIndex_ - delayFrames_;
+      int64_t index = (int64_t) floor(position);
+      float t = (float) (position - index);
+      float y0 = line_[(index - 1) & mask];
+      float y1 = line_[index & mask];
+      float y2 = line_[(index + 1) & mask];
+      float y3 = line_[(index + 2) & mask];
+      float c1 = 0.5f * (y2 - y0);
+      float c2 = y0 - 2.5f * y1 + 2 * y2 - 0.5f * y3;
+      float c3 = 0.5f * (y3 - y0) + 1.5f * (y1 - y2);
+      float echo = ((c3 * t + c2) * t + c1) * t + y1;
+
+      float dry = buffer[i];
+      line_[writeIndex_ & mask] = dry + echo * feedback_;
+      buffer[i] = dry + (echo - dry) * mix_;
+      writeIndex_++;
+    }
+  }
+
+private:
+  std::vector<float> line_;
+  int64_t writeIndex_ = 0;
+  double delayFrames_;
+  float feedback_;
+  float mix_;
+};
+
+/**
+ * Noise, different on each channel
+ */
+static void fillInput(float *const *channels, int32_t numFrames, uint32_t *seed) {
+  for (int channel = 0; channel < kChannelCount; channel++) {
+    for (int i = 0; i < numFrames; i++) {
+      *seed = *seed * 1664525 + 1013904223;
+      channels[channel][i] = (int32_t) *seed * (0.5f / 2147483648.0f);
+    }
+  }
+}
+
+/**
+ * Largest difference from the reference over a few seconds of odd sized bursts, at whole and
+ * fractional delays including tempo synced ones
+ */
+static bool checkAccuracy() {
+
+  const double delaysMillis[] = { 1.0, 10.0, 60000.0 / 120 / 3, 60000.0 / 100 * 0.75, 1234.567,
+                                  2000.0 };
+  const int32_t burstSizes[] = { 1, 3, 64, 97, 192, 240, 1000 };
+  bool isWithinBound = true;
+
+  for (double delayMillis : delaysMillis) {
+    AudioEffect effect;
+    effect.setDelayMillis(delayMillis);
+    effect.setFeedback(0.7f);
+    effect.setMix(0.4f);
+    effect.configure(kChannelCount, kFrameRate, 1000);
+    ReferenceDelay left(delayMillis, 0.7f, 0.4f);
+    ReferenceDelay right(delayMillis, 0.7f, 0.4f);
+
+    std::vector<float> buffers[4];
+    for (std::vector<float> &buffer : buffers) buffer.resize(1000);
+    float *channels[] = { buffers[0].data(), buffers[1].data() };
+    uint32_t seed = 1;
+    float maxError = 0;
+    for (int i = 0; i < 700; i++) {
+      int32_t numFrames = burstSizes[i % 7];
+      fillInput(channels, numFrames, &seed);
+      std::copy(buffers[0].begin(), buffers[0].begin() + numFrames, buffers[2].begin());
+      std::copy(buffers[1].begin(), buffers[1].begin() + numFrames, buffers[3].begin());
+      effect.process(channels, channels, numFrames);
+      left.process(buffers[2].data(), numFrames);
+      right.process(buffers[3].data(), numFrames);
+      for (int j = 0; j < numFrames; j++) {
+        maxError = std::max(maxError, fabsf(buffers[0][j] - buffers[2][j]));
+        maxError = std::max(maxError, fabsf(buffers[1][j] - buffers[3][j]));
+      }
+    }
+    printf("%9.3f ms delay: max error %.2e from the reference\n", delayMillis, maxError);
+    if (maxError > kMaxError) isWithinBound = false;
+  }
+  return isWithinBound;
+}
+
+/**
+ * Largest step between frames of the echoes of a sine, with the parameters fixed and with them
+ * jumping every 50 ms
+ */
+static double measureLargestStep(bool isChangingParameters) {
+
+  AudioEffect effect;
+  effect.setDelayMillis(100);
+  effect.setFeedback(0.5f);
+  effect.setMix(0.5f);
+  const int32_t burstFrames = 192;
+  effect.configure(1, kFrameRate, burstFrames);
+
+  const int32_t burstsPerChange = kFrameRate / 20 / burstFrames;
+  float buffer[burstFrames];
+  float *channels[] = { buffer };
+  double phase = 0;
+  float last = 0;
+  double largestStep = 0;
+  for (int burst = 0; burst < 2000; burst++) {
+    if (isChangingParameters && burst % burstsPerChange == 0) {
+      int change = burst / burstsPerChange;
+      effect.setDelayMillis((change % 3 == 0) ? 100 : (change % 3 == 1) ? 37.5 : 1500);
+      effect.setFeedback((change % 2 == 0) ? 0.5f : 0.1f);
+      effect.setMix((change % 4 < 2) ? 0.5f : 0.9f);
+    }
+    for (int i = 0; i < burstFrames; i++) {
+      buffer[i] = 0.25f * (float) sin(phase);
+      phase += 2 * M_PI * 440 / kFrameRate;
+    }
+    effect.process(channels, channels, burstFrames);
+    for (int i = 0; i < burstFrames; i++) {
+      if (burst > 0) largestStep = std::max(largestStep, (double) fabsf(buffer[i] - last));
+      last = buffer[i];
+    }
+  }
+  return largestStep;
+}
+
+int main(int argc, char **argv) {
+
+  int32_t framesPerBurst = (argc > 1) ? atoi(argv[1]) : kDefaultFramesPerBurst;
+  if (framesPerBurst <= 0 || framesPerBurst > 4096) {
+    fprintf(stderr, "Frames per burst must be between 1 and 4096\n");
+    return 1;
+  }
+
+  bool isWithinBound = checkAccuracy();
+  double fixedStep = measureLargestStep(false);
+  double changingStep = measureLargestStep(true);
+  printf("Largest step between frames %.4f with fixed parameters, %.4f with them changing\n",
+         fixedStep, changingStep);
+  bool isGlitchFree = changingStep <= fixedStep * kMaxStepRatio;
+
+  printf("\n%d frame bursts, %d channels, ns per frame of all channels\n", framesPerBurst,
+         kChannelCount);
+  std::vector<float> buffers[kChannelCount];
+  for (std::vector<float> &buffer : buffers) buffer.resize(framesPerBurst);
+  float *channels[] = { buffers[0].data(), buffers[1].data() };
+  uint32_t seed = 1;
+  fillInput(channels, framesPerBurst, &seed);
+
+  const double delaysMillis[] = { 1, 10, 100, 500, 1000, 2000 };
+  char name[64];
+  for (double delayMillis : delaysMillis) {
+    AudioEffect effect;
+    effect.setDelayMillis(delayMillis);
+    effect.configure(kChannelCount, kFrameRate, framesPerBurst);
+    snprintf(name, sizeof(name), "effect %g ms", delayMillis);
+    printTiming(name, measure(framesPerBurst, [&]() {
+      effect.process(channels, channels, framesPerBurst);
+    }));
+  }
+
+  AudioEffect crossfading;
+  crossfading.configure(kChannelCount, kFrameRate, framesPerBurst);
+  int burst = 0;
+  printTiming("effect always crossfading", measure(framesPerBurst, [&]() {
+    crossfading.setDelayMillis((burst++ % 2 == 0) ? 100 : 200);
+    crossfading.process(channels, channels, framesPerBurst);
+  }));
+
+  for (double delayMillis : delaysMillis) {
+    ReferenceDelay left(delayMillis, kAudioEffectDefaultFeedback, kAudioEffectDefaultMix);
+    ReferenceDelay right(delayMillis, kAudioEffectDefaultFeedback, kAudioEffectDefaultMix);
+    snprintf(name, sizeof(name), "per-frame reference %g ms", delayMillis);
+    printTiming(name, measure(framesPerBurst, [&]() {
+      left.process(channels[0], framesPerBurst);
+      right.process(channels[1], framesPerBurst);
+    }));
+  }
+
+  if (!isWithinBound) {
+    printf("Error exceeds %.1e\n", kMaxError);
+    return 1;
+  }
+  if (!isGlitchFree) {
+    printf("Parameter changes make steps over %.1f times larger\n", kMaxStepRatio);
+    return 1;
+  }
+  return 0;
+}
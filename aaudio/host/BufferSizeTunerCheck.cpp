@@ -0,0 +1,214 @@
+/*
+ * Copyright 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * Checks BufferSizeTuner's growing, shrinking, shrink window backoff and latency cap against a
+ * simulated clock, then checks that PlayAudioEngine applies buffer size requests made while it
+ * plays, including a switch back to automatic tuning, and that it asks for a size the stream
+ * clamps only once.
+ *
+ *   buffer-size-tuner-check
+ *
+ * Build it with -fsanitize=thread to check the engine's handling of requests for races.
+ */
+
+#include <stdio.h>
+#include <chrono>
+#include <thread>
+#include "AAudioHost.h"
+#include "BufferSizeTuner.h"
+#include "PlayAudioEngine.h"
+#include "rt_log.h"
+
+constexpr int32_t kFrameRate = 48000;
+constexpr int32_t kFramesPerBurst = 192;
+constexpr int32_t kCapacityInBursts = 16;
+constexpr int64_t kBurstNanos = 4000000LL;
+constexpr int32_t kShrinkWindowMillis = 100;
+constexpr int64_t kShrinkWindowNanos = kShrinkWindowMillis * 1000000LL;
+constexpr int32_t kFixedBufferSizeInBursts = 4;
+constexpr int kSettleMillis = 100;
+constexpr int kPollMillis = 10;
+constexpr int kEngineTimeoutMillis = 3000;
+constexpr int kRequestToggles = 200;
+constexpr int kClampedRequestMillis = 500;
+
+static bool check(bool isCorrect, const char *description) {
+  printf("%-64s %s\n", description, isCorrect ? "ok" : "FAILED");
+  return isCorrect;
+}
+
+/**
+ * Feed the tuner one callback per burst for a duration, with the given xrun count
+ */
+static int32_t runTuner(BufferSizeTuner *tuner, int64_t *nowNanos, int64_t durationNanos,
+                        int32_t xRunCount) {
+  int32_t bursts = 0;
+  for (int64_t end = *nowNanos + durationNanos; *nowNanos < end; ) {
+    *nowNanos += kBurstNanos;
+    bursts = tuner->update(xRunCount, *nowNanos);
+  }
+  return bursts;
+}
+
+static bool checkTuner() {
+
+  BufferSizeTuner tuner;
+  BufferSizeTunerState state;
+  tuner.setShrinkWindowMillis(kShrinkWindowMillis);
+  tuner.configure(kFramesPerBurst, kFrameRate, kCapacityInBursts * kFramesPerBurst);
+  int64_t now = 0;
+  tuner.reset(1, 0, now);
+  bool isCorrect = true;
+
+  // Each callback which sees the xrun count go up grows the buffer by one burst
+  int32_t bursts = 1;
+  int32_t xRunCount = 0;
+  bool isGrowthCorrect = true;
+  for (int i = 0; i < 3; i++) {
+    now += kBurstNanos;
+    xRunCount += 2;
+    int32_t grown = tuner.update(xRunCount, now);
+    isGrowthCorrect &= grown == bursts + 1;
+    bursts = grown;
+  }
+  tuner.getState(&state);
+  isCorrect &= check(isGrowthCorrect && state.growCount == 3 && state.xRunCount == 6,
+                     "grows one burst per callback with new xruns");
+
+  // A window without xruns shrinks it by one burst
+  bursts = runTuner(&tuner, &now, kShrinkWindowNanos - kBurstNanos, xRunCount);
+  bool isKeptForWindow = bursts == 4;
+  bursts = runTuner(&tuner, &now, kBurstNanos, xRunCount);
+  isCorrect &= check(isKeptForWindow && bursts == 3, "shrinks one burst after a quiet window");
+
+  // An xrun soon after the shrink doubles the window
+  now += kBurstNanos;
+  xRunCount++;
+  bursts = tuner.update(xRunCount, now);
+  tuner.getState(&state);
+  isCorrect &= check(bursts == 4 && state.shrinkWindowNanos == 2 * kShrinkWindowNanos,
+                     "an xrun right after a shrink doubles the window");
+
+  // Repeated failed shrinks stop doubling at the limit
+  for (int i = 0; i < 6; i++) {
+    tuner.getState(&state);
+    runTuner(&tuner, &now, state.shrinkWindowNanos + kBurstNanos, xRunCount);
+    now += kBurstNanos;
+    xRunCount++;
+    tuner.update(xRunCount, now);
+  }
+  tuner.getState(&state);
+  isCorrect &= check(state.shrinkWindowNanos == kMaxShrinkWindowMultiplier * kShrinkWindowNanos,
+                     "the window stops growing at its limit");
+
+  // Constant xruns never take the buffer past the capacity
+  for (int i = 0; i < 2 * kCapacityInBursts; i++) {
+    now += kBurstNanos;
+    xRunCount++;
+    bursts = tuner.update(xRunCount, now);
+  }
+  isCorrect &= check(bursts == kCapacityInBursts, "never grows past the capacity");
+
+  // A target latency of 5 bursts caps the size straight away
+  tuner.setTargetMaxLatencyMillis(5 * kBurstNanos / 1e6);
+  now += kBurstNanos;
+  bursts = tuner.update(xRunCount, now);
+  tuner.getState(&state);
+  isCorrect &= check(bursts == 5 && state.maxBufferSizeInBursts == 5,
+                     "a target latency caps the size");
+
+  tuner.setTargetMaxLatencyMillis(0);
+  tuner.reset(2, xRunCount, now);
+  tuner.getState(&state);
+  isCorrect &= check(state.bufferSizeInBursts == 2 && state.growCount == 0 &&
+                         state.xRunCount == 0 && state.shrinkWindowNanos == kShrinkWindowNanos,
+                     "reset forgets the history");
+  return isCorrect;
+}
+
+// Wait for the tuner to report a size, or time out
+static bool waitForTunerSize(PlayAudioEngine *engine, int32_t bursts) {
+  BufferSizeTunerState state;
+  for (int waited = 0; waited < kEngineTimeoutMillis; waited += kPollMillis) {
+    engine->getBufferSizeTunerState(&state);
+    if (state.bufferSizeInBursts == bursts) return true;
+    std::this_thread::sleep_for(std::chrono::milliseconds(kPollMillis));
+  }
+  return false;
+}
+
+static bool checkEngine() {
+
+  AAudioHostConfig config;
+  AAudioHost_getDefaultConfig(&config);
+  config.sampleRate = kFrameRate;
+  config.framesPerBurst = kFramesPerBurst;
+  config.bufferCapacityInBursts = kCapacityInBursts;
+  AAudioHost_setConfig(&config);
+
+  PlayAudioEngine engine;
+  engine.setToneOn(true);
+  engine.setBufferSizeShrinkWindowMillis(kShrinkWindowMillis);
+  bool isCorrect = true;
+
+  // A fixed size leaves the tuner alone
+  engine.setBufferSizeInBursts(kFixedBufferSizeInBursts);
+  std::this_thread::sleep_for(std::chrono::milliseconds(kSettleMillis));
+  BufferSizeTunerState state;
+  engine.getBufferSizeTunerState(&state);
+  isCorrect &= check(state.bufferSizeInBursts == 1, "a fixed size doesn't move the tuner");
+
+  // Back to automatic, the callback restarts the tuner from the fixed size, which it then
+  // shrinks without underruns
+  engine.setBufferSizeInBursts(BUFFER_SIZE_AUTOMATIC);
+  isCorrect &= check(waitForTunerSize(&engine, kFixedBufferSizeInBursts),
+                     "automatic tuning restarts from the fixed size");
+  isCorrect &= check(waitForTunerSize(&engine, 1), "then shrinks back to one burst");
+
+  // Requests from another thread while the callback runs
+  for (int i = 0; i < kRequestToggles; i++) {
+    engine.setBufferSizeInBursts((i % 2 == 0) ? 1 + i % kCapacityInBursts
+                                              : BUFFER_SIZE_AUTOMATIC);
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  engine.setBufferSizeInBursts(BUFFER_SIZE_AUTOMATIC);
+  isCorrect &= check(waitForTunerSize(&engine, 1), "settles after many requests");
+
+  // The stream clamps a size beyond its capacity. Asking again on every callback would log
+  // "Setting buffer size" every time, which the log's rate limiter would count.
+  engine.setBufferSizeInBursts(2 * kCapacityInBursts);
+  std::this_thread::sleep_for(std::chrono::milliseconds(kSettleMillis));
+  int64_t logCountBefore = RtLog::getRateLimitedCount() + RtLog::getDroppedCount();
+  std::this_thread::sleep_for(std::chrono::milliseconds(kClampedRequestMillis));
+  int64_t logCount = RtLog::getRateLimitedCount() + RtLog::getDroppedCount() - logCountBefore;
+  printf("%lld log records rate limited or dropped in %d ms with a clamped size\n",
+         static_cast<long long>(logCount), kClampedRequestMillis);
+  isCorrect &= check(logCount == 0, "a size the stream clamps is asked for once");
+  return isCorrect;
+}
+
+int main() {
+
+  bool isTunerCorrect = checkTuner();
+  bool isEngineCorrect = checkEngine();
+
+  if (!isTunerCorrect || !isEngineCorrect) {
+    printf("BufferSizeTuner didn't behave as expected\n");
+    return 1;
+  }
+  return 0;
+}
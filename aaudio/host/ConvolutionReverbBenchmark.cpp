@@ -0,0 +1,322 @@
+/*
+ * Copyright 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+/**
+ * Checks the echo sample's ConvolutionReverb, and the RealFft and WAV loading it is built on,
+ * against direct computation, then measures its CPU per callback with responses from 0.5 s to
+ * 5 s.
+ *
+ *   convolution-reverb-benchmark [frames per burst]
+ *
+ * Build it with CMAKE_BUILD_TYPE=Release, the default build is unoptimized.
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <algorithm>
+#include <vector>
+#include "ConvolutionReverb.h"
+#include "ImpulseResponse.h"
+#include "real_fft.h"
+
+constexpr int32_t kDefaultFramesPerBurst = 192;
+constexpr int32_t kFrameRate = 48000;
+constexpr int32_t kChannelCount = 2;
+constexpr double kSecondsPerRun = 20;
+constexpr const char *kWavPath = "convolution-reverb-benchmark.wav";
+
+// Largest differences allowed from direct computation, relative to the largest output
+constexpr double kMaxFftError = 1e-5;
+constexpr double kMaxConvolutionError = 1e-4;
+constexpr double kMaxResamplingError = 1e-3;
+
+static int64_t nowNanos() {
+  timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static float nextNoise(uint32_t *seed) {
+  *seed = *seed * 1664525 + 1013904223;
+  return static_cast<int32_t>(*seed) * (1.0f / 2147483648.0f);
+}
+
+/**
+ * Noise decaying by 60 dB over its length, like a room
+ */
+static std::vector<float> makeResponse(int32_t numFrames, uint32_t seed) {
+  std::vector<float> frames(numFrames);
+  for (int32_t i = 0; i < numFrames; i++) {
+    double envelope = pow(0.001, static_cast<double>(i) / numFrames);
+    frames[i] = nextNoise(&seed) * static_cast<float>(envelope);
+  }
+  return frames;
+}
+
+static void writeUint32(FILE *file, uint32_t value) {
+  uint8_t bytes[] = { static_cast<uint8_t>(value), static_cast<uint8_t>(value >> 8),
+                      static_cast<uint8_t>(value >> 16), static_cast<uint8_t>(value >> 24) };
+  fwrite(bytes, 1, 4, file);
+}
+
+static void writeUint16(FILE *file, uint16_t value) {
+  uint8_t bytes[] = { static_cast<uint8_t>(value), static_cast<uint8_t>(value >> 8) };
+  fwrite(bytes, 1, 2, file);
+}
+
+/**
+ * Write planar channels as a 32-bit float or 16-bit integer WAV file
+ */
+static bool writeWav(const char *path, const std::vector<std::vector<float>> &channels,
+                     int32_t sampleRate, bool isFloat) {
+  FILE *file = fopen(path, "wb");
+  if (file == nullptr) return false;
+  const uint16_t channelCount = static_cast<uint16_t>(channels.size());
+  const uint16_t bytesPerSample = isFloat ? 4 : 2;
+  const uint32_t dataSize = channels[0].size() * channelCount * bytesPerSample;
+  fwrite("RIFF", 1, 4, file);
+  writeUint32(file, 36 + dataSize);
+  fwrite("WAVEfmt ", 1, 8, file);
+  writeUint32(file, 16);
+  writeUint16(file, isFloat ? 3 : 1);
+  writeUint16(file, channelCount);
+  writeUint32(file, sampleRate);
+  writeUint32(file, sampleRate * channelCount * bytesPerSample);
+  writeUint16(file, channelCount * bytesPerSample);
+  writeUint16(file, bytesPerSample * 8);
+  fwrite("data", 1, 4, file);
+  writeUint32(file, dataSize);
+  for (size_t i = 0; i < channels[0].size(); i++) {
+    for (const std::vector<float> &channel : channels) {
+      if (isFloat) {
+        uint32_t bits;
+        memcpy(&bits, &channel[i], sizeof(bits));
+        writeUint32(file, bits);
+      } else {
+        float sample = std::max(-1.0f, std::min(channel[i], 32767.0f / 32768));
+        writeUint16(file, static_cast<uint16_t>(static_cast<int16_t>(lrintf(sample * 32768))));
+      }
+    }
+  }
+  return fclose(file) == 0;
+}
+
+/**
+ * RealFft against a double precision DFT, at sizes whose halves have every kind of factor
+ */
+static bool checkFft() {
+  const int32_t sizes[] = { 2 * 96, 2 * 128, 2 * 192, 2 * 240, 2 * 256, 2 * 441, 2 * 13 };
+  bool isWithinBound = true;
+  for (int32_t size : sizes) {
+    RealFft fft(size);
+    std::vector<float> input(size);
+    std::vector<float> re(fft.getSpectrumStride());
+    std::vector<float> im(fft.getSpectrumStride());
+    std::vector<float> output(size);
+    uint32_t seed = size;
+    for (float &sample : input) sample = nextNoise(&seed);
+    fft.forward(input.data(), re.data(), im.data());
+    fft.inverse(re.data(), im.data(), output.data());
+
+    double maxError = 0;
+    double maxMagnitude = 0;
+    for (int32_t k = 0; k <= size / 2; k++) {
+      double expectedRe = 0;
+      double expectedIm = 0;
+      for (int32_t i = 0; i < size; i++) {
+        double angle = -2 * M_PI * static_cast<double>(k) * i / size;
+        expectedRe += input[i] * cos(angle);
+        expectedIm += input[i] * sin(angle);
+      }
+      maxError = std::max(maxError, hypot(re[k] - expectedRe, im[k] - expectedIm));
+      maxMagnitude = std::max(maxMagnitude, hypot(expectedRe, expectedIm));
+    }
+    double maxRoundTripError = 0;
+    for (int32_t i = 0; i < size; i++) {
+      maxRoundTripError = std::max(maxRoundTripError,
+                                   static_cast<double>(fabsf(output[i] / size - input[i])));
+    }
+    printf("FFT of %4d frames: error %.1e, round trip error %.1e\n", size,
+           maxError / maxMagnitude, maxRoundTripError);
+    if (maxError / maxMagnitude > kMaxFftError || maxRoundTripError > kMaxFftError) {
+      isWithinBound = false;
+    }
+  }
+  return isWithinBound;
+}
+
+/**
+ * A stereo response written as a float WAV file and loaded again, against direct convolution of
+ * noise, with calls of every size up to a burst
+ */
+static bool checkConvolution(int32_t framesPerBurst) {
+
+  const int32_t responseFrames = kFrameRate * 3 / 4;
+  std::vector<std::vector<float>> channels = { makeResponse(responseFrames, 1),
+                                               makeResponse(responseFrames, 2) };
+  if (!writeWav(kWavPath, channels, kFrameRate, true)) {
+    printf("Could not write %s\n", kWavPath);
+    return false;
+  }
+  std::shared_ptr<ImpulseResponse> response = ImpulseResponse::loadWav(kWavPath);
+  remove(kWavPath);
+  if (response == nullptr) return false;
+
+  ConvolutionReverb reverb(response);
+  reverb.setMix(1);
+  reverb.configure(kChannelCount, kFrameRate, framesPerBurst);
+
+  const int32_t numFrames = kFrameRate * 2;
+  std::vector<float> input[kChannelCount];
+  std::vector<float> output[kChannelCount];
+  uint32_t seed = 3;
+  for (int32_t channel = 0; channel < kChannelCount; channel++) {
+    input[channel].resize(numFrames);
+    for (float &sample : input[channel]) sample = nextNoise(&seed);
+    output[channel].resize(numFrames);
+  }
+  const int32_t callSizes[] = { 1, 3, 64, 97, framesPerBurst, framesPerBurst - 1, 7 };
+  int32_t call = 0;
+  for (int32_t offset = 0; offset < numFrames; call++) {
+    int32_t callFrames = std::min(std::max(1, std::min(callSizes[call % 7], framesPerBurst)),
+                                  numFrames - offset);
+    const float *in[] = { &input[0][offset], &input[1][offset] };
+    float *out[] = { &output[0][offset], &output[1][offset] };
+    reverb.process(in, out, callFrames);
+    offset += callFrames;
+  }
+
+  // Every 7th frame, which is enough to cover every position in a burst
+  double maxError = 0;
+  double maxOutput = 0;
+  for (int32_t channel = 0; channel < kChannelCount; channel++) {
+    for (int32_t i = 0; i < numFrames; i += 7) {
+      double expected = 0;
+      for (int32_t j = 0; j <= std::min(i, responseFrames - 1); j++) {
+        expected += static_cast<double>(channels[channel][j]) * input[channel][i - j];
+      }
+      maxError = std::max(maxError, fabs(output[channel][i] - expected));
+      maxOutput = std::max(maxOutput, fabs(expected));
+    }
+  }
+  printf("Convolution with a %d frame response in %d head and %d tail partitions of %d frames: "
+         "error %.1e\n", responseFrames, reverb.getHeadPartitionCount(),
+         reverb.getTailPartitionCount(), reverb.getTailBlockFrames(), maxError / maxOutput);
+  return maxError / maxOutput <= kMaxConvolutionError;
+}
+
+/**
+ * A sine written as a 16-bit WAV file at 44.1 kHz, loaded and resampled to 48 kHz, against the
+ * same sine at 48 kHz away from the ends
+ */
+static bool checkResampling() {
+
+  const int32_t fileRate = 44100;
+  const double frequency = 1000;
+  std::vector<std::vector<float>> channels(1, std::vector<float>(fileRate / 2));
+  for (size_t i = 0; i < channels[0].size(); i++) {
+    channels[0][i] = 0.5f * static_cast<float>(sin(2 * M_PI * frequency * i / fileRate));
+  }
+  if (!writeWav(kWavPath, channels, fileRate, false)) {
+    printf("Could not write %s\n", kWavPath);
+    return false;
+  }
+  std::shared_ptr<ImpulseResponse> response = ImpulseResponse::loadWav(kWavPath);
+  remove(kWavPath);
+  if (response == nullptr) return false;
+
+  std::vector<float> resampled = response->resample(0, kFrameRate);
+  double maxError = 0;
+  for (size_t i = 100; i + 100 < resampled.size(); i++) {
+    double expected = 0.5 * sin(2 * M_PI * frequency * i / kFrameRate);
+    maxError = std::max(maxError, fabs(resampled[i] - expected) / 0.5);
+  }
+  printf("Resampling from %d Hz to %d Hz: %zu frames, error %.1e\n", fileRate, kFrameRate,
+         resampled.size(), maxError);
+  return maxError <= kMaxResamplingError;
+}
+
+int main(int argc, char **argv) {
+
+  int32_t framesPerBurst = (argc > 1) ? atoi(argv[1]) : kDefaultFramesPerBurst;
+  if (framesPerBurst <= 0 || framesPerBurst > 4096) {
+    fprintf(stderr, "Frames per burst must be between 1 and 4096\n");
+    return 1;
+  }
+
+  bool isFftWithinBound = checkFft();
+  bool isConvolutionWithinBound = checkConvolution(framesPerBurst);
+  bool isResamplingWithinBound = checkResampling();
+
+  const double burstMicros = 1e6 * framesPerBurst / kFrameRate;
+  printf("\n%d frame bursts (%.0f us), %d channels, %.0f s of noise for each response\n",
+         framesPerBurst, burstMicros, kChannelCount, kSecondsPerRun);
+  printf("%8s %5s %5s %6s %10s %10s %10s %8s\n", "response", "head", "tail", "block",
+         "mean us", "99% us", "max us", "mean CPU");
+  const double responseSeconds[] = { 0.5, 1, 2, 3, 5 };
+  std::vector<float> buffers[kChannelCount];
+  for (std::vector<float> &buffer : buffers) buffer.resize(framesPerBurst);
+  float *channels[] = { buffers[0].data(), buffers[1].data() };
+  for (double seconds : responseSeconds) {
+    int32_t responseFrames = static_cast<int32_t>(seconds * kFrameRate);
+    std::shared_ptr<ImpulseResponse> response =
+        std::make_shared<ImpulseResponse>(kChannelCount, kFrameRate, responseFrames);
+    for (int32_t channel = 0; channel < kChannelCount; channel++) {
+      std::vector<float> frames = makeResponse(responseFrames, channel + 1);
+      std::copy(frames.begin(), frames.end(), response->getChannel(channel));
+    }
+    response->normalize();
+    ConvolutionReverb reverb(response);
+    reverb.configure(kChannelCount, kFrameRate, framesPerBurst);
+
+    int32_t bursts = static_cast<int32_t>(kSecondsPerRun * kFrameRate / framesPerBurst);
+    std::vector<int64_t> nanos(bursts);
+    uint32_t seed = 1;
+    for (int32_t burst = 0; burst < bursts; burst++) {
+      for (std::vector<float> &buffer : buffers) {
+        for (float &sample : buffer) sample = 0.25f * nextNoise(&seed);
+      }
+      int64_t startNanos = nowNanos();
+      reverb.process(channels, channels, framesPerBurst);
+      nanos[burst] = nowNanos() - startNanos;
+    }
+    double meanMicros = 0;
+    for (int64_t burstNanos : nanos) meanMicros += burstNanos / 1000.0 / bursts;
+    std::sort(nanos.begin(), nanos.end());
+    printf("%7.1fs %5d %5d %6d %10.1f %10.1f %10.1f %7.1f%%\n", seconds,
+           reverb.getHeadPartitionCount(), reverb.getTailPartitionCount(),
+           reverb.getTailBlockFrames(), meanMicros, nanos[bursts * 99 / 100] / 1000.0,
+           nanos.back() / 1000.0, 100 * meanMicros / burstMicros);
+  }
+
+  if (!isFftWithinBound) {
+    printf("FFT error exceeds %.1e\n", kMaxFftError);
+    return 1;
+  }
+  if (!isConvolutionWithinBound) {
+    printf("Convolution error exceeds %.1e\n", kMaxConvolutionError);
+    return 1;
+  }
+  if (!isResamplingWithinBound) {
+    printf("Resampling error exceeds %.1e\n", kMaxResamplingError);
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,193 @@
+/*
+ * Copyright 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * Checks echo's DriftCompensator with input clocks up to 300 ppm fast and slow against the
+ * output clock. Input and output callbacks are simulated on one thread in time order, with
+ * callback jitter, so the result doesn't depend on the machine's scheduling.
+ *
+ *   drift-compensator-check [seconds per run]
+ *
+ * Each run must play without underruns or resyncs after priming, report the drift, hold the
+ * ring at its target fill level and play the input sine without jumps.
+ */
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <vector>
+#include "AudioRingBuffer.h"
+#include "DriftCompensator.h"
+
+constexpr int32_t kFrameRate = 48000;
+constexpr int32_t kFramesPerBurst = 192;
+constexpr int32_t kTargetFillFrames = 3 * kFramesPerBurst;
+constexpr int32_t kRingCapacityInFrames = 16384;
+constexpr int64_t kNanosPerSecond = 1000000000LL;
+constexpr int64_t kCallbackJitterNanos = 1000000LL;
+
+// The drift estimate and the fill level are only checked after the controller has settled.
+// The estimate is the controller's integral term, which callback jitter moves around for tens
+// of seconds at a time, so its average over at least 40 s is checked.
+constexpr int kSettleSeconds = 20;
+constexpr int kMinSecondsPerRun = 60;
+constexpr double kMaxDriftErrorPpm = 10;
+constexpr double kMaxFillErrorFrames = kFramesPerBurst / 2;
+
+constexpr double kToneFrequency = 440;
+constexpr float kToneAmplitude = 0.5f;
+
+// Resampling may overshoot the largest step of the sine a little
+constexpr float kMaxStepTolerance = 1.05f;
+
+static bool check(bool isCorrect, const char *description) {
+  printf("%-64s %s\n", description, isCorrect ? "ok" : "FAILED");
+  return isCorrect;
+}
+
+static uint32_t gSeed = 1;
+
+static int64_t nextJitter() {
+  gSeed = gSeed * 1664525u + 1013904223u;
+  return static_cast<int64_t>((gSeed >> 8) % kCallbackJitterNanos);
+}
+
+struct RunResult {
+  DriftCompensatorState state;
+  double meanSettledDriftPpm;
+  double maxSettledFillError;
+  float maxStep;
+  int32_t settledUnderrunCount;
+};
+
+static RunResult run(double inputDriftPpm, int seconds) {
+
+  AudioRingBuffer ring(kRingCapacityInFrames);
+  DriftCompensator compensator;
+  compensator.configure(kTargetFillFrames, kFrameRate);
+
+  const double inputBurstNanos = kFramesPerBurst * kNanosPerSecond /
+                                 (kFrameRate * (1 + inputDriftPpm / 1e6));
+  const double outputBurstNanos = static_cast<double>(kFramesPerBurst) * kNanosPerSecond /
+                                  kFrameRate;
+  const double phaseStep = 2 * M_PI * kToneFrequency / kFrameRate;
+  std::vector<float> input(kFramesPerBurst);
+  std::vector<float> output(kFramesPerBurst);
+
+  RunResult result;
+  result.meanSettledDriftPpm = 0;
+  result.maxSettledFillError = 0;
+  result.maxStep = 0;
+  result.settledUnderrunCount = 0;
+
+  int64_t inputBurst = 0;
+  int64_t outputBurst = 0;
+  int64_t inputFrame = 0;
+  int64_t inputTime = nextJitter();
+  int64_t outputTime = nextJitter();
+  float lastSample = 0;
+  bool isPlaying = false;
+  const int64_t endNanos = seconds * kNanosPerSecond;
+  const int64_t settledNanos = kSettleSeconds * kNanosPerSecond;
+  int32_t underrunsAtSettle = 0;
+  int64_t settledBursts = 0;
+
+  while (outputTime < endNanos) {
+    if (inputTime <= outputTime) {
+      for (int32_t i = 0; i < kFramesPerBurst; i++) {
+        input[i] = kToneAmplitude * static_cast<float>(sin(phaseStep * inputFrame++));
+      }
+      ring.write(input.data(), kFramesPerBurst);
+      ring.setWriteTime(inputTime);
+      inputBurst++;
+      inputTime = static_cast<int64_t>(inputBurst * inputBurstNanos) + nextJitter();
+      continue;
+    }
+
+    compensator.render(&ring, output.data(), kFramesPerBurst, outputTime);
+    DriftCompensatorState state;
+    compensator.getState(&state);
+    for (int32_t i = 0; i < kFramesPerBurst; i++) {
+      // Playing starts with the first frame of input
+      if (!isPlaying && output[i] == 0) continue;
+      if (isPlaying) result.maxStep = std::max(result.maxStep, fabsf(output[i] - lastSample));
+      isPlaying = true;
+      lastSample = output[i];
+    }
+
+    if (outputTime < settledNanos) {
+      underrunsAtSettle = state.underrunCount;
+    } else {
+      result.meanSettledDriftPpm += state.driftPpm;
+      settledBursts++;
+      result.maxSettledFillError = std::max(result.maxSettledFillError,
+                                            fabs(state.fillLevelFrames - kTargetFillFrames));
+    }
+    outputBurst++;
+    outputTime = static_cast<int64_t>(outputBurst * outputBurstNanos) + nextJitter();
+  }
+
+  compensator.getState(&result.state);
+  if (settledBursts > 0) result.meanSettledDriftPpm /= settledBursts;
+  result.settledUnderrunCount = result.state.underrunCount - underrunsAtSettle;
+  return result;
+}
+
+static bool checkDrift(double inputDriftPpm, int seconds) {
+
+  RunResult result = run(inputDriftPpm, seconds);
+  const float sineMaxStep = static_cast<float>(kToneAmplitude * 2 * M_PI * kToneFrequency /
+                                               kFrameRate);
+
+  printf("\nInput clock %+.0f ppm, %d s\n", inputDriftPpm, seconds);
+  printf("drift %.1f ppm on average after %d s, fill error up to %.1f frames, "
+         "largest step %.4f (sine %.4f), %d underruns, %d resyncs\n",
+         result.meanSettledDriftPpm, kSettleSeconds,
+         result.maxSettledFillError, result.maxStep, sineMaxStep, result.state.underrunCount,
+         result.state.resyncCount);
+
+  bool isCorrect = check(result.settledUnderrunCount == 0 && result.state.resyncCount == 0,
+                         "no underruns or resyncs once settled");
+  isCorrect &= check(fabs(result.meanSettledDriftPpm - inputDriftPpm) <= kMaxDriftErrorPpm,
+                     "reports the drift");
+  isCorrect &= check(result.maxSettledFillError <= kMaxFillErrorFrames,
+                     "holds the ring at the target fill level");
+  isCorrect &= check(result.maxStep <= sineMaxStep * kMaxStepTolerance,
+                     "plays the input without jumps");
+  return isCorrect;
+}
+
+int main(int argc, char **argv) {
+
+  int seconds = (argc > 1) ? atoi(argv[1]) : kMinSecondsPerRun;
+  if (seconds < kMinSecondsPerRun) {
+    fprintf(stderr, "Usage: drift-compensator-check [seconds per run, at least %d]\n",
+            kMinSecondsPerRun);
+    return 1;
+  }
+
+  bool isCorrect = true;
+  const double driftsPpm[] = { 0, 100, -100, 300, -300 };
+  for (double driftPpm : driftsPpm) isCorrect &= checkDrift(driftPpm, seconds);
+
+  if (!isCorrect) {
+    printf("DriftCompensator didn't hold the fill level against a drifting input\n");
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,227 @@
+/*
+ * Copyright 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+/**
+ * Measures the echo sample's EffectChain at depths from 1 to 32, with processors which work in
+ * place, processors which need the scratch bus and AudioEffect delays, then changes the chain
+ * from another thread while it processes and checks every burst saw a whole chain.
+ *
+ *   effect-chain-benchmark [frames per burst]
+ *
+ * Build it with CMAKE_BUILD_TYPE=Release, the default build is unoptimized.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <vector>
+#include "AudioEffect.h"
+#include "EffectChain.h"
+
+constexpr int32_t kDefaultFramesPerBurst = 192;
+constexpr int32_t kFrameRate = 48000;
+constexpr int32_t kChannelCount = 2;
+constexpr int kBurstsPerRun = 2000;
+constexpr int kRuns = 5;
+constexpr int kChangingBursts = 200000;
+
+static int64_t nowNanos() {
+  timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+/**
+ * Scales the bus in place
+ */
+class Gain : public AudioProcessor {
+public:
+  explicit Gain(float gain) : gain_(gain) {}
+
+  void configure(int32_t channelCount, int32_t sampleRate,
+                 int32_t maxFramesPerProcess) override {
+    channelCount_ = channelCount;
+  }
+
+  void process(const float *const *input, float *const *output, int32_t numFrames) override {
+    for (int32_t channel = 0; channel < channelCount_; channel++) {
+      for (int32_t i = 0; i < numFrames; i++) output[channel][i] = input[channel][i] * gain_;
+    }
+  }
+
+private:
+  float gain_;
+  int32_t channelCount_ = 0;
+};
+
+/**
+ * Adds a constant, writing to a different bus so the chain has to give it the scratch one
+ */
+class OutOfPlaceOffset : public AudioProcessor {
+public:
+  explicit OutOfPlaceOffset(float offset) : offset_(offset) {}
+
+  void configure(int32_t channelCount, int32_t sampleRate,
+                 int32_t maxFramesPerProcess) override {
+    channelCount_ = channelCount;
+  }
+
+  void process(const float *const *input, float *const *output, int32_t numFrames) override {
+    for (int32_t channel = 0; channel < channelCount_; channel++) {
+      for (int32_t i = 0; i < numFrames; i++) output[channel][i] = input[channel][i] + offset_;
+    }
+  }
+
+  bool canProcessInPlace() const override { return false; }
+
+private:
+  float offset_;
+  int32_t channelCount_ = 0;
+};
+
+/**
+ * Best of kRuns, each processing kBurstsPerRun bursts, in ns per frame of all channels
+ */
+static double measure(EffectChain *chain, float *const *channels, int32_t framesPerBurst) {
+  double best = 1e30;
+  for (int run = 0; run < kRuns; run++) {
+    int64_t startNanos = nowNanos();
+    for (int i = 0; i < kBurstsPerRun; i++) chain->process(channels, framesPerBurst);
+    best = std::min(best, (nowNanos() - startNanos) / ((double) kBurstsPerRun * framesPerBurst));
+  }
+  return best;
+}
+
+/**
+ * Processes silence through a chain of offsets of 1 while another thread inserts, removes and
+ * moves them, so the output of each burst is the number of offsets in the chain it saw. Any
+ * burst whose frames differ, or which isn't a number the chain had, saw a partly changed chain.
+ *
+ * @return false if a burst saw a partly changed chain
+ */
+static bool checkChanges(int32_t framesPerBurst) {
+
+  const int32_t minDepth = 1;
+  const int32_t maxDepth = 8;
+  EffectChain chain;
+  chain.configure(kChannelCount, kFrameRate, framesPerBurst);
+  for (int32_t i = 0; i < minDepth; i++) chain.add(std::make_shared<OutOfPlaceOffset>(1.0f));
+
+  std::atomic<bool> isDone { false };
+  std::atomic<int64_t> changeCount { 0 };
+  std::thread changer([&]() {
+    std::vector<std::shared_ptr<AudioProcessor>> added;
+    uint32_t seed = 1;
+    while (!isDone.load()) {
+      seed = seed * 1664525 + 1013904223;
+      int32_t size = chain.getSize();
+      int32_t position = (seed >> 8) % (size + 1);
+      if ((seed >> 24) % 3 == 0 && size < maxDepth) {
+        // Gains of 1 don't change the output but do change which bus the offsets are given
+        std::shared_ptr<AudioProcessor> processor;
+        if ((seed >> 4) % 2 == 0) {
+          processor = std::make_shared<OutOfPlaceOffset>(1.0f);
+        } else {
+          processor = std::make_shared<Gain>(1.0f);
+        }
+        chain.insert(position, processor);
+        added.push_back(processor);
+      } else if ((seed >> 24) % 3 == 1 && !added.empty()) {
+        chain.remove(added.back());
+        added.pop_back();
+      } else {
+        chain.move(position % size, (seed >> 16) % size);
+      }
+      changeCount++;
+    }
+  });
+
+  std::vector<float> buffers[kChannelCount];
+  for (std::vector<float> &buffer : buffers) buffer.resize(framesPerBurst);
+  float *channels[] = { buffers[0].data(), buffers[1].data() };
+  int64_t brokenBurstCount = 0;
+  int64_t worstNanos = 0;
+  for (int burst = 0; burst < kChangingBursts; burst++) {
+    for (std::vector<float> &buffer : buffers) std::fill(buffer.begin(), buffer.end(), 0.0f);
+    int64_t startNanos = nowNanos();
+    chain.process(channels, framesPerBurst);
+    worstNanos = std::max(worstNanos, nowNanos() - startNanos);
+
+    float depth = buffers[0][0];
+    bool isWhole = depth >= minDepth && depth <= maxDepth && depth == (int32_t) depth;
+    for (const std::vector<float> &buffer : buffers) {
+      for (float sample : buffer) isWhole = isWhole && sample == depth;
+    }
+    if (!isWhole) brokenBurstCount++;
+  }
+  isDone.store(true);
+  changer.join();
+
+  printf("%d bursts with %lld changes made meanwhile: %lld saw a partly changed chain, "
+         "slowest burst %.1f us\n", kChangingBursts, (long long) changeCount.load(),
+         (long long) brokenBurstCount, worstNanos / 1000.0);
+  return brokenBurstCount == 0;
+}
+
+int main(int argc, char **argv) {
+
+  int32_t framesPerBurst = (argc > 1) ? atoi(argv[1]) : kDefaultFramesPerBurst;
+  if (framesPerBurst <= 0 || framesPerBurst > 4096) {
+    fprintf(stderr, "Frames per burst must be between 1 and 4096\n");
+    return 1;
+  }
+
+  std::vector<float> buffers[kChannelCount];
+  for (std::vector<float> &buffer : buffers) buffer.assign(framesPerBurst, 0.25f);
+  float *channels[] = { buffers[0].data(), buffers[1].data() };
+
+  printf("%d frame bursts, %d channels, ns per frame of all channels (per processor)\n",
+         framesPerBurst, kChannelCount);
+  printf("%5s %20s %20s %20s\n", "depth", "in place", "out of place", "delays");
+  const int32_t depths[] = { 1, 2, 4, 8, 16, 32 };
+  for (int32_t depth : depths) {
+    EffectChain inPlace;
+    EffectChain outOfPlace;
+    EffectChain delays;
+    inPlace.configure(kChannelCount, kFrameRate, framesPerBurst);
+    outOfPlace.configure(kChannelCount, kFrameRate, framesPerBurst);
+    delays.configure(kChannelCount, kFrameRate, framesPerBurst);
+    for (int32_t i = 0; i < depth; i++) {
+      inPlace.add(std::make_shared<Gain>(1.0f));
+      outOfPlace.add(std::make_shared<OutOfPlaceOffset>(0.0f));
+      std::shared_ptr<AudioEffect> effect = std::make_shared<AudioEffect>();
+      effect->setDelayMillis(10.0 + 30.0 * i);
+      effect->setFeedback(0.0f);
+      delays.add(effect);
+    }
+    double timings[] = { measure(&inPlace, channels, framesPerBurst),
+                         measure(&outOfPlace, channels, framesPerBurst),
+                         measure(&delays, channels, framesPerBurst) };
+    printf("%5d", depth);
+    for (double nanos : timings) printf(" %8.2f (%8.3f)  ", nanos, nanos / depth);
+    printf("\n");
+  }
+
+  EffectChain empty;
+  empty.configure(kChannelCount, kFrameRate, framesPerBurst);
+  printf("empty chain %.3f ns/frame\n\n", measure(&empty, channels, framesPerBurst));
+
+  return checkChanges(framesPerBurst) ? 0 : 1;
+}
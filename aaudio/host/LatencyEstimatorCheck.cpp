@@ -0,0 +1,216 @@
+/*
+ * Copyright 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * Checks hello-aaudio's LatencyEstimator against a simulated device with a known latency and
+ * clock drift, with and without timestamp jitter, and across a jump in the device timeline.
+ * Then checks the estimate PlayAudioEngine reports against the stand-in's configured latency.
+ *
+ *   latency-estimator-check
+ */
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+#include <thread>
+#include "AAudioHost.h"
+#include "LatencyEstimator.h"
+#include "PlayAudioEngine.h"
+
+constexpr int32_t kFrameRate = 48000;
+constexpr int32_t kFramesPerBurst = 192;
+constexpr int64_t kNanosPerMilli = 1000000LL;
+constexpr int64_t kNanosPerSecond = 1000000000LL;
+constexpr int64_t kSimulatedSeconds = 20;
+constexpr int32_t kBufferFrames = 2 * kFramesPerBurst;
+constexpr int64_t kOutputLatencyNanos = 10 * kNanosPerMilli;
+constexpr double kMaxLatencyErrorMillis = 0.1;
+constexpr int64_t kTimelineJumpNanos = 50 * kNanosPerMilli;
+constexpr int kEngineSettleMillis = 1500;
+constexpr double kMaxEngineLatencyErrorMillis = 1.0;
+
+static bool check(bool isCorrect, const char *description) {
+  printf("%-64s %s\n", description, isCorrect ? "ok" : "FAILED");
+  return isCorrect;
+}
+
+/**
+ * An output device whose clock runs driftPpm fast. The app keeps kBufferFrames written ahead of
+ * the frame being read, and a frame is presented kOutputLatencyNanos after it is read.
+ */
+struct SimulatedDevice {
+  double nanosPerFrame;
+  int64_t startNanos;
+  int64_t timestampJitterNanos;
+  uint32_t seed = 1;
+
+  SimulatedDevice(double driftPpm, int64_t timestampJitterNanos) :
+      nanosPerFrame(kNanosPerSecond / (kFrameRate * (1 + driftPpm / 1e6))),
+      startNanos(0),
+      timestampJitterNanos(timestampJitterNanos) {}
+
+  int64_t framesRead(int64_t nowNanos) const {
+    return static_cast<int64_t>((nowNanos - startNanos) / nanosPerFrame);
+  }
+
+  int64_t framesWritten(int64_t nowNanos) const {
+    return framesRead(nowNanos) + kBufferFrames;
+  }
+
+  int64_t presentationTime(int64_t frame) const {
+    return startNanos + static_cast<int64_t>(frame * nanosPerFrame) + kOutputLatencyNanos;
+  }
+
+  // Latency of the next frame the app writes
+  double latencyMillis(int64_t nowNanos) const {
+    return (presentationTime(framesWritten(nowNanos)) - nowNanos) / 1e6;
+  }
+
+  int64_t jitter() {
+    if (timestampJitterNanos == 0) return 0;
+    seed = seed * 1664525u + 1013904223u;
+    return static_cast<int64_t>(seed % (2 * timestampJitterNanos + 1)) - timestampJitterNanos;
+  }
+};
+
+/**
+ * Run the estimator with one callback per burst, the way PlayAudioEngine does
+ *
+ * @return the number of timestamps the estimator asked for
+ */
+static int runCallbacks(LatencyEstimator *estimator, SimulatedDevice *device, int64_t *nowNanos,
+                        int64_t durationNanos) {
+  const int64_t burstNanos = kFramesPerBurst * kNanosPerSecond / kFrameRate;
+  int timestampCount = 0;
+  for (int64_t end = *nowNanos + durationNanos; *nowNanos < end; *nowNanos += burstNanos) {
+    if (estimator->isSampleDue(*nowNanos)) {
+      int64_t frame = device->framesRead(*nowNanos);
+      estimator->addTimestamp(frame, device->presentationTime(frame) + device->jitter(),
+                              *nowNanos);
+      timestampCount++;
+    }
+    estimator->update(device->framesWritten(*nowNanos), *nowNanos);
+  }
+  return timestampCount;
+}
+
+static bool checkDevice(const char *description, double driftPpm, int64_t jitterNanos,
+                        double maxDriftErrorPpm) {
+
+  LatencyEstimator estimator;
+  estimator.reset(kFrameRate);
+  SimulatedDevice device(driftPpm, jitterNanos);
+  LatencyEstimate estimate;
+  bool hasEarlyEstimate = estimator.getEstimate(&estimate);
+
+  int64_t now = kNanosPerMilli;
+  int timestampCount = runCallbacks(&estimator, &device, &now,
+                                    kSimulatedSeconds * kNanosPerSecond);
+  bool hasEstimate = estimator.getEstimate(&estimate);
+  double trueLatencyMillis = device.latencyMillis(now);
+  double latencyError = estimate.latencyMillis - trueLatencyMillis;
+  double driftError = estimate.driftPpm - driftPpm;
+  int expectedTimestamps = static_cast<int>(kSimulatedSeconds * kNanosPerSecond /
+                                            kLatencyEstimatorSamplePeriodNanos);
+
+  printf("\n%s\n", description);
+  printf("latency %.3f ms (true %.3f ms), drift %.1f ppm (true %.1f ppm), %d timestamps\n",
+         estimate.latencyMillis, trueLatencyMillis, estimate.driftPpm, driftPpm, timestampCount);
+  bool isCorrect = check(!hasEarlyEstimate, "no estimate before the first timestamp");
+  isCorrect &= check(abs(timestampCount - expectedTimestamps) <= 1,
+                     "asks for one timestamp per sample period");
+  isCorrect &= check(hasEstimate && estimate.sampleCount == kLatencyEstimatorMaxSamples,
+                     "the fit keeps the newest samples");
+  isCorrect &= check(fabs(latencyError) <= kMaxLatencyErrorMillis, "latency is accurate");
+  isCorrect &= check(fabs(driftError) <= maxDriftErrorPpm, "drift is accurate");
+  return isCorrect;
+}
+
+static bool checkTimelineJump() {
+
+  LatencyEstimator estimator;
+  estimator.reset(kFrameRate);
+  SimulatedDevice device(100, 0);
+  int64_t now = kNanosPerMilli;
+  runCallbacks(&estimator, &device, &now, 5 * kNanosPerSecond);
+
+  // The device's frames now come out later, as if its latency had grown
+  device.startNanos += kTimelineJumpNanos;
+  runCallbacks(&estimator, &device, &now, 2 * kLatencyEstimatorSamplePeriodNanos);
+  LatencyEstimate estimate;
+  estimator.getEstimate(&estimate);
+  double latencyError = estimate.latencyMillis - device.latencyMillis(now);
+
+  printf("\nDevice timeline jumps by %lld ms\n",
+         static_cast<long long>(kTimelineJumpNanos / kNanosPerMilli));
+  printf("latency %.3f ms (true %.3f ms), %d samples\n", estimate.latencyMillis,
+         device.latencyMillis(now), estimate.sampleCount);
+  bool isCorrect = check(estimate.sampleCount <= 3, "a timestamp off the line starts a new fit");
+  isCorrect &= check(fabs(latencyError) <= kMaxLatencyErrorMillis, "latency follows the jump");
+
+  estimator.reset(kFrameRate);
+  isCorrect &= check(!estimator.getEstimate(&estimate), "reset clears the estimate");
+  return isCorrect;
+}
+
+/**
+ * The engine's estimate should be the stand-in's output latency plus the time the written frames
+ * spend in the buffer
+ */
+static bool checkEngine() {
+
+  AAudioHostConfig config;
+  AAudioHost_getDefaultConfig(&config);
+  config.sampleRate = kFrameRate;
+  config.framesPerBurst = kFramesPerBurst;
+  config.outputLatencyNanos = kOutputLatencyNanos;
+  AAudioHost_setConfig(&config);
+
+  PlayAudioEngine engine;
+  engine.setToneOn(true);
+  std::this_thread::sleep_for(std::chrono::milliseconds(kEngineSettleMillis));
+  LatencyEstimate estimate;
+  bool hasEstimate = engine.getLatencyEstimate(&estimate);
+
+  // One burst written ahead, and up to one more being consumed
+  double minMillis = kOutputLatencyNanos / 1e6;
+  double maxMillis = minMillis + 2 * kFramesPerBurst * 1000.0 / kFrameRate;
+  printf("\nPlayAudioEngine on the stand-in with %.0f ms output latency\n", minMillis);
+  printf("latency %.3f ms, expected %.3f to %.3f ms, %d samples\n", estimate.latencyMillis,
+         minMillis, maxMillis, estimate.sampleCount);
+  return check(hasEstimate && estimate.latencyMillis >= minMillis - kMaxEngineLatencyErrorMillis &&
+                   estimate.latencyMillis <= maxMillis + kMaxEngineLatencyErrorMillis,
+               "the engine reports the stand-in's latency");
+}
+
+int main() {
+
+  bool isCorrect = checkDevice("Device clock 200 ppm fast", 200, 0, 1);
+
+  // 200 us of jitter over a 16 s fit leaves the slope a few ppm out
+  isCorrect &= checkDevice("Device clock 300 ppm slow, timestamps with 200 us jitter", -300,
+                           200000, 20);
+  isCorrect &= checkTimelineJump();
+  isCorrect &= checkEngine();
+
+  if (!isCorrect) {
+    printf("LatencyEstimator didn't behave as expected\n");
+    return 1;
+  }
+  return 0;
+}
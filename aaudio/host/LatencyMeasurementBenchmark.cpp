@@ -0,0 +1,265 @@
+/*
+ * Copyright 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+/**
+ * Checks the echo sample's LatencyMeasurement. First against recordings delayed by a known
+ * number of frames, with noise and inverted polarity, and recordings in which the test signal
+ * is too quiet to hear, where the measurement should fail. Then end to end through
+ * EchoAudioEngine on the stand-in runtime with its loopback at delays from 0 to 500 ms, where the
+ * round trip less the loopback delay should stay within a millisecond. Also checks that the
+ * engine refuses to measure while the echo is off, and abandons a measurement when it is turned
+ * off.
+ *
+ *   latency-measurement-benchmark
+ */
+
+#include <stdio.h>
+#include <time.h>
+#include <algorithm>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include "AAudioHost.h"
+#include "EchoAudioEngine.h"
+#include "LatencyMeasurement.h"
+
+constexpr int32_t kFrameRate = 48000;
+constexpr int32_t kFramesPerBurst = 192;
+constexpr int64_t kNanosPerMilli = 1000000LL;
+
+// A clean recording should correlate almost perfectly
+constexpr double kMinCleanConfidence = 0.99;
+
+// End to end, through the stand-in's loopback. Late callbacks make the drift compensator move
+// the ring's fill level between measurements, so the path itself varies by a fraction of a
+// millisecond on a busy host. A callback starved by other threads glitches the recording, which
+// lowers the confidence but still finds the path within a few frames, so the bar is well above
+// noise but below what a glitch leaves, and the path variation is what's checked.
+constexpr double kMinLoopbackConfidence = 0.6;
+constexpr int32_t kMaxPathVariationFrames = kFrameRate / 1000;
+constexpr int64_t kSettleMillis = 1000;
+constexpr int32_t kMaxMeasurementAttempts = 5;
+constexpr int64_t kMeasurementTimeoutMillis = 5000;
+constexpr int64_t kPollMillis = 20;
+
+static int64_t nowNanos() {
+  timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static float nextNoise(uint32_t *seed) {
+  *seed = *seed * 1664525 + 1013904223;
+  return static_cast<int32_t>(*seed) * (1.0f / 2147483648.0f);
+}
+
+struct RecordingCase {
+  int32_t delayFrames;
+  float gain;           // 0 for a recording of noise alone
+  float noiseLevel;     // Peak level of uniform noise
+  bool isHeard;         // false if the measurement should fail
+};
+
+/**
+ * Play a measurement into a recording of delayed, scaled and noisy copies of its output, a burst
+ * at a time
+ */
+static bool checkRecordings() {
+
+  const RecordingCase cases[] = {
+      { 1, 1.0f, 0, true },
+      { 97, -0.5f, 0, true },
+      { 1000, 0.1f, 0.01f, true },
+      { 4800, 0.5f, 0.2f, true },
+      { 2000, 0.2f, 0.5f, true },
+      { kFrameRate * kLatencyMeasurementMaxMillis / 1000, 0.5f, 0, true },
+      { 2000, 0.02f, 0.5f, false },
+      { 2000, 0, 0.1f, false },
+  };
+
+  printf("%8s %6s %6s %8s %8s %10s %12s\n", "delay", "gain", "noise", "result", "found",
+         "confidence", "analysis ms");
+  bool isCorrect = true;
+  for (const RecordingCase &recordingCase : cases) {
+    LatencyMeasurement measurement;
+    measurement.configure(kFrameRate);
+    measurement.start();
+
+    std::vector<float> played;
+    std::vector<float> input(kFramesPerBurst);
+    std::vector<float> output(kFramesPerBurst);
+    uint32_t seed = 1;
+    RoundTripLatency latency;
+    LatencyMeasurementState state;
+    int64_t analysisNanos = 0;
+    // Calls no longer than the delay, so that each only hears what earlier ones played
+    const int32_t callFrames = std::min(kFramesPerBurst, recordingCase.delayFrames);
+    for (;;) {
+      for (int32_t i = 0; i < callFrames; i++) {
+        int64_t frame = static_cast<int64_t>(played.size()) + i - recordingCase.delayFrames;
+        float heard = (frame >= 0) ? played[frame] : 0.0f;
+        input[i] = recordingCase.gain * heard + recordingCase.noiseLevel * nextNoise(&seed);
+      }
+      measurement.process(input.data(), output.data(), callFrames);
+      played.insert(played.end(), output.begin(), output.begin() + callFrames);
+
+      int64_t startNanos = nowNanos();
+      state = measurement.getResult(&latency);
+      if (state == LATENCY_MEASUREMENT_DONE || state == LATENCY_MEASUREMENT_FAILED) {
+        analysisNanos = nowNanos() - startNanos;
+        break;
+      }
+    }
+
+    bool isCaseCorrect;
+    if (recordingCase.isHeard) {
+      isCaseCorrect = state == LATENCY_MEASUREMENT_DONE &&
+                      latency.frames == recordingCase.delayFrames &&
+                      (recordingCase.noiseLevel > 0 || latency.confidence >= kMinCleanConfidence);
+    } else {
+      isCaseCorrect = state == LATENCY_MEASUREMENT_FAILED;
+    }
+    printf("%8d %6.2f %6.2f %8s %8d %10.3f %12.1f%s\n", recordingCase.delayFrames,
+           recordingCase.gain, recordingCase.noiseLevel,
+           (state == LATENCY_MEASUREMENT_DONE) ? "done" : "failed", latency.frames,
+           latency.confidence, analysisNanos / 1e6, isCaseCorrect ? "" : "  wrong");
+    isCorrect = isCorrect && isCaseCorrect;
+  }
+  return isCorrect;
+}
+
+/**
+ * Measure the echo's round trip at loopback delays from 0 to 500 ms. What the loopback adds
+ * should be exactly its delay, leaving the path through the devices, the buffers and the ring
+ * the same every time.
+ */
+static bool checkLoopback(const char *description, const AAudioHostConfig &config) {
+
+  AAudioHost_setConfig(&config);
+  EchoAudioEngine engine;
+  engine.setEchoOn(true);
+  std::this_thread::sleep_for(std::chrono::milliseconds(kSettleMillis));
+
+  printf("\n%s\n", description);
+  printf("%8s %8s %8s %10s %10s %8s\n", "delay ms", "frames", "found", "confidence", "path ms",
+         "attempts");
+  const int64_t delaysMillis[] = { 0, 5, 20, 50, 200, 500 };
+  bool isCorrect = true;
+  int32_t minPathFrames = INT32_MAX;
+  int32_t maxPathFrames = INT32_MIN;
+  for (int64_t delayMillis : delaysMillis) {
+    AAudioHostLoopback loopback = { delayMillis * kNanosPerMilli, 0.5f, 0.001f };
+    AAudioHost_setLoopback(&loopback);
+
+    // A glitch in the round trip spoils a measurement, which the confidence shows or which
+    // fails, so like an app this tries again
+    RoundTripLatency latency;
+    bool isConfident = false;
+    int32_t attempts = 0;
+    while (!isConfident && attempts < kMaxMeasurementAttempts) {
+      attempts++;
+      if (!engine.startLatencyMeasurement()) break;
+      LatencyMeasurementState state = LATENCY_MEASUREMENT_REQUESTED;
+      for (int64_t waitedMillis = 0; waitedMillis < kMeasurementTimeoutMillis &&
+           state != LATENCY_MEASUREMENT_DONE && state != LATENCY_MEASUREMENT_FAILED;
+           waitedMillis += kPollMillis) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(kPollMillis));
+        state = engine.getRoundTripLatency(&latency);
+      }
+      if (state != LATENCY_MEASUREMENT_DONE && state != LATENCY_MEASUREMENT_FAILED) break;
+      isConfident = state == LATENCY_MEASUREMENT_DONE &&
+                    latency.confidence >= kMinLoopbackConfidence;
+    }
+    if (!isConfident) {
+      printf("%8lld not measured confidently\n", static_cast<long long>(delayMillis));
+      isCorrect = false;
+      continue;
+    }
+
+    const int32_t delayFrames = static_cast<int32_t>(delayMillis * kFrameRate / 1000);
+    const int32_t pathFrames = latency.frames - delayFrames;
+    minPathFrames = std::min(minPathFrames, pathFrames);
+    maxPathFrames = std::max(maxPathFrames, pathFrames);
+    printf("%8lld %8d %8d %10.3f %10.2f %8d\n", static_cast<long long>(delayMillis), delayFrames,
+           latency.frames, latency.confidence, pathFrames * 1000.0 / kFrameRate, attempts);
+  }
+  engine.setEchoOn(false);
+  AAudioHost_setLoopback(nullptr);
+
+  // The path includes at least the device latencies
+  const int32_t deviceFrames = static_cast<int32_t>(
+      (config.outputLatencyNanos + config.inputLatencyNanos) * kFrameRate / 1000000000LL);
+  printf("Path %d to %d frames, device latencies %d frames\n", minPathFrames, maxPathFrames,
+         deviceFrames);
+  if (maxPathFrames - minPathFrames > kMaxPathVariationFrames) {
+    printf("The path varied by more than %d frames\n", kMaxPathVariationFrames);
+    return false;
+  }
+  return isCorrect && minPathFrames >= deviceFrames;
+}
+
+/**
+ * Without streams a measurement would wait to play forever
+ */
+static bool checkEchoOff(const AAudioHostConfig &config) {
+
+  AAudioHost_setConfig(&config);
+  EchoAudioEngine engine;
+  RoundTripLatency latency;
+  bool isRefused = !engine.startLatencyMeasurement() &&
+                   engine.getRoundTripLatency(&latency) == LATENCY_MEASUREMENT_IDLE;
+
+  engine.setEchoOn(true);
+  bool isStarted = engine.startLatencyMeasurement();
+  engine.setEchoOn(false);
+  bool isAbandoned = engine.getRoundTripLatency(&latency) == LATENCY_MEASUREMENT_IDLE;
+
+  printf("\nWith the echo off a measurement is %s, turning it off %s a measurement\n",
+         isRefused ? "refused" : "accepted", isAbandoned ? "abandons" : "keeps");
+  return isRefused && isStarted && isAbandoned;
+}
+
+int main() {
+
+  bool areRecordingsCorrect = checkRecordings();
+
+  AAudioHostConfig config;
+  AAudioHost_getDefaultConfig(&config);
+  config.sampleRate = kFrameRate;
+  config.framesPerBurst = kFramesPerBurst;
+  bool isEchoOffCorrect = checkEchoOff(config);
+  bool isSteadyLoopbackCorrect = checkLoopback("Loopback without jitter or drift", config);
+
+  config.callbackJitterNanos = 2 * kNanosPerMilli;
+  config.inputClockDriftPpm = 100;
+  bool isDriftingLoopbackCorrect = checkLoopback(
+      "Loopback with 2 ms callback jitter and the input clock 100 ppm fast", config);
+
+  if (!areRecordingsCorrect) {
+    printf("A delayed recording was measured wrongly\n");
+    return 1;
+  }
+  if (!isEchoOffCorrect) {
+    printf("A measurement was left waiting without the echo on\n");
+    return 1;
+  }
+  if (!isSteadyLoopbackCorrect || !isDriftingLoopbackCorrect) {
+    printf("A loopback wasn't measured correctly\n");
+    return 1;
+  }
+  return 0;
+}
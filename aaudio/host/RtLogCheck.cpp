@@ -0,0 +1,223 @@
+/*
+ * Copyright 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * Checks that the RTLOGx macros never allocate or take a lock on the calling thread. malloc,
+ * calloc, realloc, free and pthread_mutex_lock are interposed and count the calls made inside
+ * RTLOG calls, which several threads make at once, with and without the drain thread running.
+ * Also checks the counts of records dropped with a full queue and by the rate limiter.
+ *
+ *   rt-log-check
+ *
+ * The interposition needs glibc, and doesn't work under a sanitizer which replaces malloc.
+ */
+
+#define MODULE_NAME "RtLogCheck"
+
+#include <dlfcn.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "rt_log.h"
+
+constexpr int kThreads = 4;
+// The queue holds 256 records, so more than that without draining must drop the rest
+constexpr int kQueueCapacity = 256;
+constexpr int kMessagesPerThread = 100;
+constexpr int kRateLimitedMessagesPerThread = 50;
+constexpr int kDrainedMessagesPerThread = 500;
+// Slower than the drain thread empties the queue, so nothing should be dropped
+constexpr int kDrainedMessagesPerPause = 5;
+constexpr int kPauseMillis = 10;
+
+extern "C" void *__libc_malloc(size_t size);
+extern "C" void *__libc_calloc(size_t count, size_t size);
+extern "C" void *__libc_realloc(void *pointer, size_t size);
+extern "C" void __libc_free(void *pointer);
+
+// Calls made by threads inside an RTLOG call
+static std::atomic<int64_t> gAllocationCount { 0 };
+static std::atomic<int64_t> gLockCount { 0 };
+static thread_local bool tIsCounting = false;
+
+extern "C" void *malloc(size_t size) noexcept {
+  if (tIsCounting) gAllocationCount++;
+  return __libc_malloc(size);
+}
+
+extern "C" void *calloc(size_t count, size_t size) noexcept {
+  if (tIsCounting) gAllocationCount++;
+  return __libc_calloc(count, size);
+}
+
+extern "C" void *realloc(void *pointer, size_t size) noexcept {
+  if (tIsCounting) gAllocationCount++;
+  return __libc_realloc(pointer, size);
+}
+
+extern "C" void free(void *pointer) noexcept {
+  if (tIsCounting) gAllocationCount++;
+  __libc_free(pointer);
+}
+
+extern "C" int pthread_mutex_lock(pthread_mutex_t *mutex) noexcept {
+  typedef int (*MutexLock)(pthread_mutex_t *);
+  static MutexLock realMutexLock = nullptr;
+  if (realMutexLock == nullptr) {
+    realMutexLock = reinterpret_cast<MutexLock>(dlsym(RTLD_NEXT, "pthread_mutex_lock"));
+  }
+  if (tIsCounting) gLockCount++;
+  return realMutexLock(mutex);
+}
+
+static bool check(bool isCorrect, const char *description) {
+  printf("%-64s %s\n", description, isCorrect ? "ok" : "FAILED");
+  return isCorrect;
+}
+
+/**
+ * Without a rate limiter every call reaches the queue
+ */
+static void logUnlimited(int threadIndex, int messageIndex) {
+  RtLogRateLimiter *noLimit = nullptr;
+  tIsCounting = true;
+  RtLog::log(noLimit, ANDROID_LOG_INFO, MODULE_NAME, "thread %d message %d at %.1f", threadIndex,
+             messageIndex, 0.5 * messageIndex);
+  tIsCounting = false;
+}
+
+/**
+ * Every thread shares this call site and so its rate limiter
+ */
+static void logRateLimited(int threadIndex, int messageIndex) {
+  tIsCounting = true;
+  RTLOGW("thread %d rate limited message %d", threadIndex, messageIndex);
+  tIsCounting = false;
+}
+
+static void runThreads(void (*body)(int)) {
+  std::vector<std::thread> threads;
+  for (int i = 0; i < kThreads; i++) threads.emplace_back(body, i);
+  for (std::thread &thread : threads) thread.join();
+}
+
+// The interposed functions must see the calls at all for a count of 0 to mean anything
+static bool checkCounting() {
+  std::mutex mutex;
+  tIsCounting = true;
+  {
+    // Through operator new, as C++ code allocates
+    std::vector<int> values(kThreads);
+    asm volatile("" : : "r"(values.data()) : "memory");
+  }
+  mutex.lock();
+  tIsCounting = false;
+  mutex.unlock();
+  bool isCounting = gAllocationCount.exchange(0) == 2 && gLockCount.exchange(0) == 1;
+  return check(isCounting, "allocations and locks are counted");
+}
+
+static bool checkWithoutDrain() {
+
+  int64_t droppedBefore = RtLog::getDroppedCount();
+  runThreads([](int threadIndex) {
+    for (int i = 0; i < kMessagesPerThread; i++) logUnlimited(threadIndex, i);
+  });
+  int64_t dropped = RtLog::getDroppedCount() - droppedBefore;
+  int64_t allocations = gAllocationCount.exchange(0);
+  int64_t locks = gLockCount.exchange(0);
+  RtLog::flush();
+
+  // Only the first calls in the rate limiter's window get into the queue
+  int64_t rateLimitedBefore = RtLog::getRateLimitedCount();
+  droppedBefore = RtLog::getDroppedCount();
+  runThreads([](int threadIndex) {
+    for (int i = 0; i < kRateLimitedMessagesPerThread; i++) logRateLimited(threadIndex, i);
+  });
+  int64_t rateLimited = RtLog::getRateLimitedCount() - rateLimitedBefore;
+  int64_t droppedWhileLimited = RtLog::getDroppedCount() - droppedBefore;
+  allocations += gAllocationCount.exchange(0);
+  locks += gLockCount.exchange(0);
+  RtLog::flush();
+
+  const int64_t limitedCalls = kThreads * kRateLimitedMessagesPerThread;
+  printf("\n%d threads without the drain thread\n", kThreads);
+  printf("%d messages: %lld dropped, %lld calls to one call site: %lld rate limited, "
+         "%lld allocations, %lld locks\n", kThreads * kMessagesPerThread,
+         static_cast<long long>(dropped), static_cast<long long>(limitedCalls),
+         static_cast<long long>(rateLimited), static_cast<long long>(allocations),
+         static_cast<long long>(locks));
+
+  bool isCorrect = check(allocations == 0 && locks == 0, "RTLOG never allocates or locks");
+  isCorrect &= check(dropped == kThreads * kMessagesPerThread - kQueueCapacity,
+                     "a full queue drops and counts the rest");
+  // Threads racing at the start of the window may each let one more through
+  isCorrect &= check(rateLimited <= limitedCalls - kRtLogMaxRecordsPerSecond &&
+                         rateLimited >= limitedCalls - kRtLogMaxRecordsPerSecond - kThreads &&
+                         droppedWhileLimited == 0,
+                     "a call site is rate limited and counted");
+  return isCorrect;
+}
+
+static bool checkWithDrain() {
+
+  RtLog::start();
+  int64_t droppedBefore = RtLog::getDroppedCount();
+  int64_t rateLimitedBefore = RtLog::getRateLimitedCount();
+  runThreads([](int threadIndex) {
+    for (int i = 0; i < kDrainedMessagesPerThread; i++) {
+      logUnlimited(threadIndex, i);
+      if (i % kDrainedMessagesPerPause == kDrainedMessagesPerPause - 1) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(kPauseMillis));
+      }
+    }
+  });
+  RtLog::stop();
+  int64_t dropped = RtLog::getDroppedCount() - droppedBefore;
+  int64_t rateLimited = RtLog::getRateLimitedCount() - rateLimitedBefore;
+  int64_t allocations = gAllocationCount.exchange(0);
+  int64_t locks = gLockCount.exchange(0);
+
+  printf("\n%d threads with the drain thread\n", kThreads);
+  printf("%d messages: %lld dropped, %lld rate limited, %lld allocations, %lld locks\n",
+         kThreads * kDrainedMessagesPerThread, static_cast<long long>(dropped),
+         static_cast<long long>(rateLimited), static_cast<long long>(allocations),
+         static_cast<long long>(locks));
+
+  bool isCorrect = check(allocations == 0 && locks == 0,
+                         "RTLOG never allocates or locks while draining");
+  isCorrect &= check(dropped == 0 && rateLimited == 0, "a drained queue drops nothing");
+  return isCorrect;
+}
+
+int main() {
+
+  // Log lines from the drain go to stderr, the results to stdout
+  bool isCorrect = checkCounting();
+  isCorrect &= checkWithoutDrain();
+  isCorrect &= checkWithDrain();
+
+  if (!isCorrect) {
+    printf("RtLog didn't behave as expected\n");
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,209 @@
+/*
+ * Copyright 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * Offline benchmark for SineGeneratorBank: finds how many partials per channel of interleaved
+ * stereo can be rendered in one burst on one core, while an eighth of the partials ramp their
+ * amplitude in every burst.
+ *
+ *   sine-generator-bank-benchmark [frames per burst] [sample rate] [cpu id] [budget percent]
+ *
+ * The budget is the share of the burst period the rendering may take, by default 100%. Each
+ * partial count is rendered for kBurstsPerMeasurement bursts and judged by its 99th percentile
+ * burst time. Build with CMAKE_BUILD_TYPE=Release, the default build is unoptimized.
+ */
+
+#include <math.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <algorithm>
+#include <random>
+#include <vector>
+#include "SineGeneratorBank.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define BENCHMARK_HAS_CYCLE_COUNTER 1
+#endif
+
+constexpr int32_t kDefaultFramesPerBurst = 192;
+constexpr int32_t kDefaultSampleRate = 48000;
+constexpr int32_t kMaxPartialsPerChannel = 1 << 16;
+constexpr int kBurstsPerMeasurement = 2000;
+constexpr int kWarmUpBursts = 100;
+constexpr int32_t kRampingPartialFraction = 8;
+
+static int64_t nowNanos() {
+  timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static uint64_t readCycles() {
+#if BENCHMARK_HAS_CYCLE_COUNTER
+  return __rdtsc();
+#else
+  return 0;
+#endif
+}
+
+struct Measurement {
+  int64_t medianNanos;
+  int64_t p99Nanos;
+  double cyclesPerPartialFrame;
+};
+
+/**
+ * A stereo additive voice. Frequencies are spread over the audible range and the amplitudes
+ * share a total of 0.5 so the mix doesn't clip.
+ */
+class StereoBank {
+public:
+  StereoBank(int32_t partialsPerChannel, int32_t sampleRate)
+      : left_(partialsPerChannel, sampleRate),
+        right_(partialsPerChannel, sampleRate),
+        partials_(partialsPerChannel),
+        amplitude_(0.5f / partialsPerChannel),
+        random_(partialsPerChannel) {
+    left_.setPartialCount(partialsPerChannel);
+    right_.setPartialCount(partialsPerChannel);
+    std::uniform_real_distribution<double> frequency(20.0, sampleRate * 0.45);
+    for (int32_t i = 0; i < partialsPerChannel; i++) {
+      left_.setPartial(i, frequency(random_), amplitude_);
+      right_.setPartial(i, frequency(random_), amplitude_);
+    }
+  }
+
+  void renderBurst(float *buffer, int32_t framesPerBurst) {
+    std::fill(buffer, buffer + framesPerBurst * 2, 0.0f);
+    int32_t numRamps = std::max(1, partials_ / kRampingPartialFraction);
+    for (int32_t i = 0; i < numRamps; i++) {
+      int32_t index = (nextRamp_ + i) % partials_;
+      float target = (burst_ % 2 == 0) ? 0.0f : amplitude_;
+      left_.rampAmplitude(index, target, framesPerBurst);
+      right_.rampAmplitude(index, target, framesPerBurst);
+    }
+    nextRamp_ = (nextRamp_ + numRamps) % partials_;
+    burst_++;
+    left_.render(buffer, 2, framesPerBurst);
+    right_.render(buffer + 1, 2, framesPerBurst);
+  }
+
+private:
+  SineGeneratorBank left_;
+  SineGeneratorBank right_;
+  int32_t partials_;
+  float amplitude_;
+  std::minstd_rand random_;
+  int32_t nextRamp_ = 0;
+  int64_t burst_ = 0;
+};
+
+static Measurement measure(int32_t partialsPerChannel, int32_t framesPerBurst,
+                           int32_t sampleRate) {
+
+  StereoBank bank(partialsPerChannel, sampleRate);
+  std::vector<float> buffer(framesPerBurst * 2);
+  for (int i = 0; i < kWarmUpBursts; i++) bank.renderBurst(buffer.data(), framesPerBurst);
+
+  std::vector<int64_t> burstNanos(kBurstsPerMeasurement);
+  uint64_t startCycles = readCycles();
+  for (int i = 0; i < kBurstsPerMeasurement; i++) {
+    int64_t start = nowNanos();
+    bank.renderBurst(buffer.data(), framesPerBurst);
+    burstNanos[i] = nowNanos() - start;
+  }
+  double partialFrames = 2.0 * partialsPerChannel * framesPerBurst * kBurstsPerMeasurement;
+  double cycles = (double) (readCycles() - startCycles);
+
+  std::sort(burstNanos.begin(), burstNanos.end());
+  return Measurement { burstNanos[kBurstsPerMeasurement / 2],
+                       burstNanos[kBurstsPerMeasurement * 99 / 100],
+                       cycles / partialFrames };
+}
+
+static void printMeasurement(int32_t partialsPerChannel, const Measurement &measurement,
+                             int64_t burstNanos) {
+  printf("%6d partials  median %8.1f us  p99 %8.1f us  %6.1f%% of burst", partialsPerChannel,
+         measurement.medianNanos / 1000.0, measurement.p99Nanos / 1000.0,
+         100.0 * measurement.p99Nanos / burstNanos);
+#if BENCHMARK_HAS_CYCLE_COUNTER
+  printf("  %.2f cycles/partial/frame", measurement.cyclesPerPartialFrame);
+#endif
+  printf("\n");
+  fflush(stdout);
+}
+
+int main(int argc, char **argv) {
+
+  int32_t framesPerBurst = (argc > 1) ? atoi(argv[1]) : kDefaultFramesPerBurst;
+  int32_t sampleRate = (argc > 2) ? atoi(argv[2]) : kDefaultSampleRate;
+  int cpuId = (argc > 3) ? atoi(argv[3]) : -1;
+  double budgetPercent = (argc > 4) ? atof(argv[4]) : 100.0;
+  if (framesPerBurst <= 0 || sampleRate <= 0 || budgetPercent <= 0) {
+    fprintf(stderr, "usage: %s [frames per burst] [sample rate] [cpu id] [budget percent]\n",
+            argv[0]);
+    return 1;
+  }
+
+  if (cpuId >= 0) {
+    cpu_set_t cpuSet;
+    CPU_ZERO(&cpuSet);
+    CPU_SET(cpuId, &cpuSet);
+    if (sched_setaffinity(0, sizeof(cpu_set_t), &cpuSet) != 0) {
+      fprintf(stderr, "Could not run on CPU %d\n", cpuId);
+      return 1;
+    }
+  }
+
+  int64_t burstNanos = 1000000000LL * framesPerBurst / sampleRate;
+  int64_t budgetNanos = (int64_t) (burstNanos * budgetPercent / 100);
+  printf("%d frame bursts at %d Hz, %.1f us per burst, budget %.1f us, CPU %s\n",
+         framesPerBurst, sampleRate, burstNanos / 1000.0, budgetNanos / 1000.0,
+         (cpuId >= 0) ? argv[3] : "any");
+
+  // Double the partial count until a burst goes over budget, then bisect
+  int32_t fits = 0;
+  int32_t exceeds = 0;
+  for (int32_t partials = 16; partials <= kMaxPartialsPerChannel; partials *= 2) {
+    Measurement measurement = measure(partials, framesPerBurst, sampleRate);
+    printMeasurement(partials, measurement, burstNanos);
+    if (measurement.p99Nanos > budgetNanos) {
+      exceeds = partials;
+      break;
+    }
+    fits = partials;
+  }
+  if (exceeds == 0) {
+    printf("More than %d partials per channel fit in the budget\n", fits);
+    return 0;
+  }
+
+  while (exceeds - fits > std::max(4, fits / 50)) {
+    int32_t partials = (fits + exceeds) / 2;
+    Measurement measurement = measure(partials, framesPerBurst, sampleRate);
+    printMeasurement(partials, measurement, burstNanos);
+    if (measurement.p99Nanos > budgetNanos) {
+      exceeds = partials;
+    } else {
+      fits = partials;
+    }
+  }
+  printf("%d partials per channel fit in %.0f%% of a burst\n", fits, budgetPercent);
+  return 0;
+}
@@ -0,0 +1,230 @@
+/*
+ * Copyright 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * Measures SineGenerator against a per-frame Wavetable lookup, which is how it used to render,
+ * and checks its output against both.
+ *
+ *   sine-generator-benchmark [frames per burst]
+ *
+ * Build it with CMAKE_BUILD_TYPE=Release, the default build is unoptimized.
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <algorithm>
+#include <vector>
+#include "SineGenerator.h"
+#include "wavetable.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define BENCHMARK_HAS_CYCLE_COUNTER 1
+#endif
+
+constexpr int32_t kDefaultFramesPerBurst = 192;
+constexpr int32_t kFrameRate = 48000;
+constexpr int kBurstsPerRun = 20000;
+constexpr int kRuns = 5;
+constexpr double kPhaseUnitsPerCycle = 4294967296.0; // 2^32
+
+static int64_t nowNanos() {
+  timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static uint64_t readCycles() {
+#if BENCHMARK_HAS_CYCLE_COUNTER
+  return __rdtsc();
+#else
+  return 0;
+#endif
+}
+
+struct Timing {
+  double cyclesPerFrame;
+  double nanosPerFrame;
+};
+
+/**
+ * Best of kRuns, each rendering kBurstsPerRun bursts
+ */
+template <typename Render>
+static Timing measure(int32_t framesPerBurst, Render render) {
+  Timing best = { 1e30, 1e30 };
+  for (int run = 0; run < kRuns; run++) {
+    uint64_t startCycles = readCycles();
+    int64_t startNanos = nowNanos();
+    for (int i = 0; i < kBurstsPerRun; i++) render();
+    double frames = (double) kBurstsPerRun * framesPerBurst;
+    double cycles = (readCycles() - startCycles) / frames;
+    double nanos = (nowNanos() - startNanos) / frames;
+    if (nanos < best.nanosPerFrame) best = Timing { cycles, nanos };
+  }
+  return best;
+}
+
+static void printTiming(const char *name, Timing timing) {
+#if BENCHMARK_HAS_CYCLE_COUNTER
+  printf("%-34s %7.2f cycles/frame %7.2f ns/frame\n", name, timing.cyclesPerFrame,
+         timing.nanosPerFrame);
+#else
+  printf("%-34s %7.2f ns/frame\n", name, timing.nanosPerFrame);
+#endif
+}
+
+/**
+ * The previous SineGenerator: one linearly interpolated table lookup per frame
+ */
+class WavetableSine {
+public:
+  WavetableSine(double frequency, float amplitude) : amplitude_(amplitude) {
+    Wavetable::initialize();
+    table_ = Wavetable::getTable(WAVEFORM_SINE, 0);
+    phaseIncrement_ = (uint32_t) (frequency * kPhaseUnitsPerCycle / kFrameRate);
+  }
+  void render(float *buffer, int32_t channelStride, int32_t numFrames) {
+    for (int i = 0; i < numFrames; i++) {
+      buffer[i * channelStride] = (float) (Wavetable::lookup(table_, phase_) * amplitude_);
+      phase_ += phaseIncrement_;
+    }
+  }
+  void render(int16_t *buffer, int32_t channelStride, int32_t numFrames) {
+    for (int i = 0; i < numFrames; i++) {
+      buffer[i * channelStride] =
+          (int16_t) (32767 * Wavetable::lookup(table_, phase_) * amplitude_);
+      phase_ += phaseIncrement_;
+    }
+  }
+private:
+  const float *table_;
+  uint32_t phase_ = 0;
+  uint32_t phaseIncrement_;
+  double amplitude_;
+};
+
+/**
+ * Largest differences, as a fraction of the amplitude, from an exact sine and from the
+ * wavetable over a few seconds of odd sized bursts
+ */
+static bool checkAccuracy() {
+
+  const double frequencies[] = { 20.0, 440.0, 660.0, 1000.0 / 3, 5000.0, 19999.0 };
+  const float amplitude = 0.25f;
+  const int32_t burstSizes[] = { 1, 3, 64, 97, 192, 240 };
+  bool isWithinBound = true;
+
+  for (double frequency : frequencies) {
+    SineGenerator generator;
+    generator.setup(frequency, kFrameRate, amplitude);
+    WavetableSine reference(frequency, amplitude);
+    uint32_t phaseIncrement = (uint32_t) (frequency * kPhaseUnitsPerCycle / kFrameRate);
+
+    float output[256];
+    float expected[256];
+    int16_t output16[256];
+    int16_t expected16[256];
+    double maxExactError = 0;
+    double maxTableError = 0;
+    int maxInt16Error = 0;
+    uint32_t phase = 0;
+    for (int i = 0; i < 2000; i++) {
+      int32_t numFrames = burstSizes[i % 6];
+      if (i % 2 == 0) {
+        generator.render(output, 1, numFrames);
+        reference.render(expected, 1, numFrames);
+        for (int j = 0; j < numFrames; j++) {
+          double exact = amplitude * sin(2 * M_PI * (phase / kPhaseUnitsPerCycle));
+          maxExactError = fmax(maxExactError, fabs(output[j] - exact) / amplitude);
+          maxTableError = fmax(maxTableError, fabs(output[j] - expected[j]) / amplitude);
+          phase += phaseIncrement;
+        }
+      } else {
+        generator.render(output16, 1, numFrames);
+        reference.render(expected16, 1, numFrames);
+        for (int j = 0; j < numFrames; j++) {
+          maxInt16Error = std::max(maxInt16Error, abs(output16[j] - expected16[j]));
+          phase += phaseIncrement;
+        }
+      }
+    }
+    printf("%8.1f Hz: max error %.2e from sin(), %.2e from wavetable, %d from int16 wavetable\n",
+           frequency, maxExactError, maxTableError, maxInt16Error);
+    if (maxExactError > SINE_KERNEL_MAX_ERROR) isWithinBound = false;
+  }
+  return isWithinBound;
+}
+
+int main(int argc, char **argv) {
+
+  int32_t framesPerBurst = (argc > 1) ? atoi(argv[1]) : kDefaultFramesPerBurst;
+  if (framesPerBurst <= 0 || framesPerBurst > 4096) {
+    fprintf(stderr, "Frames per burst must be between 1 and 4096\n");
+    return 1;
+  }
+
+  bool isWithinBound = checkAccuracy();
+  printf("\n%d frame bursts\n", framesPerBurst);
+
+  std::vector<float> floatBuffer(framesPerBurst * 2);
+  std::vector<int16_t> int16Buffer(framesPerBurst * 2);
+  float *floats = floatBuffer.data();
+  int16_t *int16s = int16Buffer.data();
+
+  WavetableSine tableLeft(440, 0.25f);
+  WavetableSine tableRight(660, 0.25f);
+  SineGenerator left;
+  SineGenerator right;
+  left.setup(440, kFrameRate, 0.25f);
+  right.setup(660, kFrameRate, 0.25f);
+  SineGenerator sweep;
+  sweep.setup(440, kFrameRate, 0.25f);
+  sweep.setSweep(100, 10000, 1.0);
+
+  printTiming("wavetable float mono", measure(framesPerBurst, [&]() {
+    tableLeft.render(floats, 1, framesPerBurst);
+  }));
+  printTiming("wavetable float stereo", measure(framesPerBurst, [&]() {
+    tableLeft.render(floats, 2, framesPerBurst);
+    tableRight.render(floats + 1, 2, framesPerBurst);
+  }));
+  printTiming("phasor float mono", measure(framesPerBurst, [&]() {
+    left.render(floats, 1, framesPerBurst);
+  }));
+  printTiming("phasor float stereo", measure(framesPerBurst, [&]() {
+    left.render(floats, 2, framesPerBurst);
+    right.render(floats + 1, 2, framesPerBurst);
+  }));
+  printTiming("phasor int16 mono", measure(framesPerBurst, [&]() {
+    left.render(int16s, 1, framesPerBurst);
+  }));
+  printTiming("phasor int16 stereo", measure(framesPerBurst, [&]() {
+    left.render(int16s, 2, framesPerBurst);
+    right.render(int16s + 1, 2, framesPerBurst);
+  }));
+  printTiming("phasor float mono sweep", measure(framesPerBurst, [&]() {
+    sweep.render(floats, 1, framesPerBurst);
+  }));
+
+  if (!isWithinBound) {
+    printf("Error exceeds SINE_KERNEL_MAX_ERROR (%.1e)\n", SINE_KERNEL_MAX_ERROR);
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,295 @@
+/*
+ * Copyright 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * Switches PlayAudioEngine between simulated devices with different sample rates and burst
+ * sizes. First with the tone on, measuring the longest silence around each switch from when the
+ * devices present what they play, which the crossfade between the old and new stream should
+ * keep under a burst. Then while another thread changes the tone, buffer size and partial count
+ * and reads the engine's state, the way the UI does, checking that each switch completes, that
+ * the engine reports the new stream's properties and that the tone keeps playing.
+ *
+ *   stream-switch-check
+ *
+ * Build it with -fsanitize=thread to check the handover between the streams' callbacks for races.
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "AAudioHost.h"
+#include "PlayAudioEngine.h"
+
+constexpr int kSwitches = 10;
+constexpr int kSwitchTimeoutMillis = 3000;
+constexpr int kPollMillis = 5;
+constexpr int kSettleMillis = 100;
+constexpr float kMinTonePeak = 0.2f;
+// Partial counts the controls step through, few enough to play under -fsanitize=thread
+constexpr int32_t kControlPartials = 16;
+constexpr int kGapMeasureMillis = 200;
+constexpr int32_t kGapMeasureBufferBursts = 4;
+// Frames quieter than -60 dB count as silence
+constexpr float kSilenceLevel = 0.001f;
+
+struct DeviceProperties {
+  int32_t sampleRate;
+  int32_t framesPerBurst;
+};
+
+constexpr DeviceProperties kDevices[] = {
+    { 48000, 192 },
+    { 44100, 96 },
+    { 96000, 480 },
+};
+
+// Peak of the last burst any output stream played
+static std::atomic<float> gLastPeak { 0 };
+
+// Where the devices played something audible, in presentation time. The device threads of both
+// streams call the sink during a switch.
+struct AudibleSpan {
+  int64_t startNanos;
+  int64_t endNanos;
+};
+static std::mutex gSpansLock;
+static std::vector<AudibleSpan> gAudibleSpans;
+// Where the spans before the last reset ended, so silence right after it counts too
+static int64_t gAudibleBeforeResetNanos = 0;
+
+// Underruns leave silence too, but they come from the device thread being starved rather than
+// from the switch, so switches with underruns are reported separately
+struct StreamUnderruns {
+  AAudioStream *stream;
+  int32_t firstCount;
+  int32_t lastCount;
+};
+static std::vector<StreamUnderruns> gStreamUnderruns;
+
+static void recordUnderruns(AAudioStream *stream) {
+  int32_t underrunCount = AAudioStream_getXRunCount(stream);
+  std::lock_guard<std::mutex> lock(gSpansLock);
+  for (StreamUnderruns &underruns : gStreamUnderruns) {
+    if (underruns.stream == stream) {
+      underruns.lastCount = underrunCount;
+      return;
+    }
+  }
+  gStreamUnderruns.push_back({ stream, underrunCount, underrunCount });
+}
+
+static int32_t getUnderrunCount() {
+  std::lock_guard<std::mutex> lock(gSpansLock);
+  int32_t underrunCount = 0;
+  for (const StreamUnderruns &underruns : gStreamUnderruns) {
+    underrunCount += underruns.lastCount - underruns.firstCount;
+  }
+  return underrunCount;
+}
+
+static void recordPeak(AAudioStream *stream, void *userData, const void *audioData,
+                       int32_t numFrames) {
+  const float *samples = static_cast<const float *>(audioData);
+  const int32_t channelCount = AAudioStream_getChannelCount(stream);
+  float peak = 0;
+  int32_t firstAudibleFrame = -1;
+  int32_t lastAudibleFrame = -1;
+  for (int32_t i = 0; i < numFrames * channelCount; i++) {
+    float level = fabsf(samples[i]);
+    peak = std::max(peak, level);
+    if (level >= kSilenceLevel) {
+      if (firstAudibleFrame < 0) firstAudibleFrame = i / channelCount;
+      lastAudibleFrame = i / channelCount;
+    }
+  }
+  gLastPeak.store(peak);
+  recordUnderruns(stream);
+  if (firstAudibleFrame < 0) return;
+
+  // The device publishes when a burst will be presented before passing it to the sink, so spans
+  // don't move when the device thread wakes up late
+  int64_t framePosition;
+  int64_t presentationNanos;
+  if (AAudioStream_getTimestamp(stream, CLOCK_MONOTONIC, &framePosition,
+                                &presentationNanos) != AAUDIO_OK) {
+    return;
+  }
+  const double nanosPerFrame = 1e9 / AAudioStream_getSampleRate(stream);
+  AudibleSpan span;
+  span.startNanos = presentationNanos + static_cast<int64_t>(firstAudibleFrame * nanosPerFrame);
+  span.endNanos = presentationNanos + static_cast<int64_t>((lastAudibleFrame + 1) * nanosPerFrame);
+  std::lock_guard<std::mutex> lock(gSpansLock);
+  gAudibleSpans.push_back(span);
+}
+
+static void resetSwitchMeasurement() {
+  std::lock_guard<std::mutex> lock(gSpansLock);
+  for (const AudibleSpan &span : gAudibleSpans) {
+    gAudibleBeforeResetNanos = std::max(gAudibleBeforeResetNanos, span.endNanos);
+  }
+  gAudibleSpans.clear();
+  gStreamUnderruns.clear();
+}
+
+// The longest silence since the end of what was audible before the reset
+static int64_t getLongestGapNanos() {
+  std::vector<AudibleSpan> spans;
+  int64_t audibleUntilNanos;
+  {
+    std::lock_guard<std::mutex> lock(gSpansLock);
+    spans = gAudibleSpans;
+    audibleUntilNanos = gAudibleBeforeResetNanos;
+  }
+  if (spans.empty()) return 0;
+  std::sort(spans.begin(), spans.end(), [](const AudibleSpan &a, const AudibleSpan &b) {
+    return a.startNanos < b.startNanos;
+  });
+  int64_t longestGapNanos = 0;
+  if (audibleUntilNanos == 0) audibleUntilNanos = spans[0].startNanos;
+  for (const AudibleSpan &span : spans) {
+    longestGapNanos = std::max(longestGapNanos, span.startNanos - audibleUntilNanos);
+    audibleUntilNanos = std::max(audibleUntilNanos, span.endNanos);
+  }
+  return longestGapNanos;
+}
+
+static int64_t getBurstNanos(const DeviceProperties &device) {
+  return device.framesPerBurst * 1000000000LL / device.sampleRate;
+}
+
+static bool check(bool isCorrect, const char *description) {
+  printf("%-64s %s\n", description, isCorrect ? "ok" : "FAILED");
+  return isCorrect;
+}
+
+static void setDevice(const DeviceProperties &device) {
+  AAudioHostConfig config;
+  AAudioHost_getDefaultConfig(&config);
+  config.sampleRate = device.sampleRate;
+  config.framesPerBurst = device.framesPerBurst;
+  config.outputSink = recordPeak;
+  AAudioHost_setConfig(&config);
+}
+
+// Wait for the engine to play on a device with one stream open
+static bool waitForSwitch(PlayAudioEngine *engine, const DeviceProperties &device) {
+  for (int waited = 0; waited < kSwitchTimeoutMillis; waited += kPollMillis) {
+    if (engine->getSampleRate() == device.sampleRate &&
+        engine->getFramesPerBurst() == device.framesPerBurst &&
+        AAudioHost_getOpenStreamCount() == 1) {
+      return true;
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(kPollMillis));
+  }
+  return false;
+}
+
+// What the UI thread does while the streams switch
+static void useControls(PlayAudioEngine *engine, std::atomic<bool> *isRunning) {
+  LatencyEstimate estimate;
+  BufferSizeTunerState state;
+  for (int i = 0; isRunning->load(); i++) {
+    engine->setToneOn(i % 8 != 0);
+    engine->setBufferSizeInBursts((i % 16 == 0) ? 2 : BUFFER_SIZE_AUTOMATIC);
+    engine->setPartialCount((i % 4) * kControlPartials);
+    engine->getLatencyEstimate(&estimate);
+    engine->getBufferSizeTunerState(&state);
+    engine->getSampleRate();
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+}
+
+int main() {
+
+  setDevice(kDevices[0]);
+  PlayAudioEngine engine;
+  engine.setToneOn(true);
+  bool isCorrect = check(waitForSwitch(&engine, kDevices[0]), "plays on the first device");
+  // The tone has to be audible before the first switch for the silence after it to count
+  std::this_thread::sleep_for(std::chrono::milliseconds(kSettleMillis));
+
+  // The silence each switch leaves, with nothing else changing the output. A fixed buffer of a
+  // few bursts keeps the tuner from starting each new stream at one burst.
+  engine.setBufferSizeInBursts(kGapMeasureBufferBursts);
+  printf("\n%8s %8s %12s %12s %10s\n", "from Hz", "to Hz", "silence ms", "burst ms",
+         "underruns");
+  bool areGapsShort = true;
+  int switchCount = 0;
+  int measuredCount = 0;
+  for (int i = 1; i <= kSwitches; i++) {
+    const DeviceProperties &from = kDevices[(i - 1) % 3];
+    const DeviceProperties &device = kDevices[i % 3];
+    setDevice(device);
+    resetSwitchMeasurement();
+    engine.setDeviceId(1 + i);
+    if (waitForSwitch(&engine, device)) switchCount++;
+    std::this_thread::sleep_for(std::chrono::milliseconds(kGapMeasureMillis));
+
+    // The handover happens in callback time and each stream's half of the crossfade is delayed
+    // by its own burst, so a device with longer bursts may start fading in a little after the
+    // old one has faded out. That is less than a burst.
+    int64_t gapNanos = getLongestGapNanos();
+    int64_t burstNanos = std::max(getBurstNanos(from), getBurstNanos(device));
+    int32_t underrunCount = getUnderrunCount();
+    printf("%8d %8d %12.2f %12.2f %10d\n", from.sampleRate, device.sampleRate, gapNanos / 1e6,
+           burstNanos / 1e6, underrunCount);
+    if (underrunCount == 0) {
+      areGapsShort &= gapNanos <= burstNanos;
+      measuredCount++;
+    }
+  }
+  char description[64];
+  snprintf(description, sizeof(description), "%d of %d switches took over the new stream",
+           switchCount, kSwitches);
+  isCorrect &= check(switchCount == kSwitches, description);
+  snprintf(description, sizeof(description), "%d switches without underruns leave under a burst",
+           measuredCount);
+  isCorrect &= check(areGapsShort && measuredCount >= kSwitches / 2, description);
+
+  std::atomic<bool> isRunning { true };
+  std::thread controlThread(useControls, &engine, &isRunning);
+
+  switchCount = 0;
+  for (int i = 1; i <= kSwitches; i++) {
+    const DeviceProperties &device = kDevices[i % 3];
+    setDevice(device);
+    engine.setDeviceId(1 + kSwitches + i);
+    if (waitForSwitch(&engine, device)) switchCount++;
+  }
+  isRunning.store(false);
+  controlThread.join();
+
+  snprintf(description, sizeof(description), "%d of %d switches took over while controls are used",
+           switchCount, kSwitches);
+  isCorrect &= check(switchCount == kSwitches, description);
+
+  engine.setToneOn(true);
+  engine.setBufferSizeInBursts(BUFFER_SIZE_AUTOMATIC);
+  engine.setPartialCount(0);
+  std::this_thread::sleep_for(std::chrono::milliseconds(kSettleMillis));
+  isCorrect &= check(gLastPeak.load() >= kMinTonePeak, "the tone plays after the switches");
+
+  if (!isCorrect) {
+    printf("The stream switches didn't behave as expected\n");
+    return 1;
+  }
+  return 0;
+}
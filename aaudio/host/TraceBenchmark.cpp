@@ -0,0 +1,135 @@
+/*
+ * Copyright 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * Measures what a traced section costs the traced thread: Trace::beginSection and endSection
+ * while nothing is recording and while a sink is recording, against the vsprintf beginSection
+ * they replaced, copied in below. Also measures formatting a section name, which is what
+ * Trace::setFormatsSystraceNames(true) adds on a device.
+ *
+ *   trace-benchmark
+ *
+ * There is no ATrace on Linux, so none of the numbers include the ATrace call itself. Build it
+ * with CMAKE_BUILD_TYPE=Release, the default build is unoptimized.
+ */
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <time.h>
+#include <algorithm>
+#include "trace.h"
+
+constexpr int kSectionsPerRun = 200000;
+constexpr int kRuns = 5;
+// Fewer begin and end records than a thread's ring holds, so recording never drops
+constexpr int kSectionsPerBatch = 200;
+
+static int64_t nowNanos() {
+  timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+/**
+ * Trace::beginSection as it was, formatting every section into a shared buffer. On a device the
+ * buffer was then passed to ATrace_beginSection.
+ */
+namespace vsprintf_trace {
+
+static const int TRACE_MAX_SECTION_NAME_LENGTH = 100;
+
+__attribute__((noinline)) static void beginSection(const char *fmt, ...) {
+  static char buff[TRACE_MAX_SECTION_NAME_LENGTH];
+  va_list args;
+  va_start(args, fmt);
+  vsprintf(buff, fmt, args);
+  va_end(args);
+}
+
+__attribute__((noinline)) static void endSection() {
+}
+
+}  // namespace vsprintf_trace
+
+static void ignoreRecord(const TraceRecord &record, const char *sectionName, void *userData) {
+}
+
+/**
+ * Best of kRuns of kSectionsPerRun sections, in ns per begin and end pair. When recording, the
+ * rings are drained between batches outside the timing.
+ */
+template <typename Section>
+static double measure(Section section, bool isRecording) {
+  double best = 1e30;
+  for (int run = 0; run < kRuns; run++) {
+    int64_t elapsedNanos = 0;
+    for (int done = 0; done < kSectionsPerRun; done += kSectionsPerBatch) {
+      int64_t startNanos = nowNanos();
+      for (int i = 0; i < kSectionsPerBatch; i++) section(done + i);
+      elapsedNanos += nowNanos() - startNanos;
+      if (isRecording) Trace::flush();
+    }
+    best = std::min(best, static_cast<double>(elapsedNanos) / kSectionsPerRun);
+  }
+  return best;
+}
+
+int main() {
+
+  Trace::registerCurrentThread();
+  const double notRecordingNanos = measure([](int i) {
+    Trace::beginSection("renderAudio %d frames at %d Hz", i, 48000);
+    Trace::endSection();
+  }, false);
+
+  Trace::setSink(ignoreRecord, nullptr);
+  int64_t droppedBefore = Trace::getDroppedRecordCount();
+  const double recordingNanos = measure([](int i) {
+    Trace::beginSection("renderAudio %d frames at %d Hz", i, 48000);
+    Trace::endSection();
+  }, true);
+  int64_t dropped = Trace::getDroppedRecordCount() - droppedBefore;
+  Trace::setSink(nullptr, nullptr);
+
+  const double vsprintfNanos = measure([](int i) {
+    vsprintf_trace::beginSection("renderAudio %d frames at %d Hz", i, 48000);
+    vsprintf_trace::endSection();
+  }, false);
+
+  const double formattingNanos = measure([](int i) {
+    static char sectionName[100];
+    TraceArg args[] = { makeTraceArg(i), makeTraceArg(48000) };
+    formatTraceArgs("renderAudio %d frames at %d Hz", args, 2, sectionName, sizeof(sectionName));
+    asm volatile("" : : "r"(sectionName) : "memory");
+  }, false);
+
+  printf("ns per beginSection and endSection pair, best of %d runs of %d sections\n", kRuns,
+         kSectionsPerRun);
+  printf("%-48s %8.1f\n", "Trace, not recording", notRecordingNanos);
+  printf("%-48s %8.1f\n", "Trace, recording for a sink", recordingNanos);
+  printf("%-48s %8.1f\n", "vsprintf beginSection it replaced", vsprintfNanos);
+  printf("%-48s %8.1f\n", "formatting for systrace, when turned on", formattingNanos);
+
+  if (dropped != 0) {
+    printf("%lld records were dropped while recording\n", static_cast<long long>(dropped));
+    return 1;
+  }
+  if (notRecordingNanos >= vsprintfNanos) {
+    printf("A section costs as much as it did with vsprintf\n");
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,127 @@
+/*
+ * Copyright 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * Checks that Trace's ring pool is reused as threads come and go: many short-lived threads, and
+ * PlayAudioEngine across stream restarts, are captured without dropping anything. The cost of a
+ * traced section is measured by trace-benchmark.
+ *
+ *   trace-capture-check [trace.json]
+ *
+ * The engine's capture is left in the file, open it in ui.perfetto.dev.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <chrono>
+#include <thread>
+#include "AAudioHost.h"
+#include "PlayAudioEngine.h"
+#include "trace.h"
+
+// More than the pool holds, so only reuse can record them all
+constexpr int kShortLivedThreads = 100;
+constexpr int kSectionsPerThread = 10;
+constexpr int kStreamRestarts = 10;
+constexpr int kRestartIntervalMillis = 100;
+
+// Count the begin events in a Chrome trace file, and which of them contain text
+static int countSections(const char *jsonPath, const char *text, int *matchingCount) {
+  FILE *file = fopen(jsonPath, "r");
+  if (file == nullptr) return -1;
+  int count = 0;
+  *matchingCount = 0;
+  char line[512];
+  while (fgets(line, sizeof(line), file) != nullptr) {
+    if (strstr(line, "\"ph\":\"B\"") == nullptr) continue;
+    count++;
+    if (strstr(line, text) != nullptr) (*matchingCount)++;
+  }
+  fclose(file);
+  return count;
+}
+
+static void recordSections(int threadIndex) {
+  for (int i = 0; i < kSectionsPerThread; i++) {
+    Trace::beginSection("thread %d section %d", threadIndex, i);
+    Trace::endSection();
+  }
+}
+
+static bool checkShortLivedThreads(const char *jsonPath) {
+
+  Trace::startCapture();
+  int64_t droppedBefore = Trace::getDroppedRecordCount();
+  for (int i = 0; i < kShortLivedThreads; i++) {
+    std::thread thread(recordSections, i);
+    thread.join();
+    // The threads reuse one ring, so drain it before it fills
+    Trace::flush();
+  }
+  int64_t dropped = Trace::getDroppedRecordCount() - droppedBefore;
+  if (!Trace::stopCapture(jsonPath)) return false;
+
+  int formattedCount = 0;
+  int count = countSections(jsonPath, "thread 99 section 9", &formattedCount);
+  printf("%d threads: %d sections captured, %lld dropped\n", kShortLivedThreads, count,
+         static_cast<long long>(dropped));
+  return count == kShortLivedThreads * kSectionsPerThread && formattedCount == 1 && dropped == 0;
+}
+
+static bool checkStreamRestarts(const char *jsonPath) {
+
+  AAudioHostConfig config;
+  AAudioHost_getDefaultConfig(&config);
+  AAudioHost_setConfig(&config);
+
+  Trace::startCapture();
+  int64_t droppedBefore = Trace::getDroppedRecordCount();
+  {
+    PlayAudioEngine engine;
+    engine.setToneOn(true);
+    for (int i = 0; i < kStreamRestarts; i++) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(kRestartIntervalMillis));
+      AAudioHost_disconnectAllStreams();
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(kRestartIntervalMillis));
+  }
+  int64_t dropped = Trace::getDroppedRecordCount() - droppedBefore;
+  if (!Trace::stopCapture(jsonPath)) return false;
+
+  int callbackCount = 0;
+  int count = countSections(jsonPath, "numFrames", &callbackCount);
+  printf("%d stream restarts: %d callbacks captured, %lld records dropped\n", kStreamRestarts,
+         callbackCount, static_cast<long long>(dropped));
+  return count > 0 && callbackCount > 0 && dropped == 0;
+}
+
+int main(int argc, char **argv) {
+
+  const char *jsonPath = (argc > 1) ? argv[1] : "trace.json";
+
+  bool areThreadsCaptured = checkShortLivedThreads(jsonPath);
+  bool areRestartsCaptured = checkStreamRestarts(jsonPath);
+
+  if (!areThreadsCaptured) {
+    printf("Short-lived threads weren't all captured\n");
+    return 1;
+  }
+  if (!areRestartsCaptured) {
+    printf("The engine wasn't captured across stream restarts\n");
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,162 @@
+/*
+ * Copyright 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef AAUDIO_HOST_H
+#define AAUDIO_HOST_H
+
+#include <aaudio/AAudio.h>
+
+/**
+ * Controls for the host stand-in AAudio runtime. These functions don't exist on Android, they let
+ * a Linux harness shape the behaviour of the simulated audio device.
+ *
+ * Each started stream owns a device thread which wakes once per burst period on
+ * CLOCK_MONOTONIC. On every wake the simulated device consumes (output) or produces (input) one
+ * burst, then the data callback is called after a random delay of up to callbackJitterNanos,
+ * as many times as it takes to fill the buffer up to AAudioStream_getBufferSizeInFrames. If the
+ * callback is late enough that the device finds less than a burst in the buffer the stream
+ * counts an underrun and the device plays silence for the missing frames. Input streams count
+ * an overrun when the buffer is full and the oldest frames are dropped.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Called on the device thread with every burst the simulated output device consumes.
+ * audioData is in the stream's format and channel count.
+ */
+typedef void (*AAudioHost_outputSink)(AAudioStream *stream,
+                                      void *userData,
+                                      const void *audioData,
+                                      int32_t numFrames);
+
+/**
+ * Called on the device thread to fill every burst the simulated input device captures.
+ * audioData is in the stream's format and channel count and is zeroed before the call.
+ */
+typedef void (*AAudioHost_inputSource)(AAudioStream *stream,
+                                       void *userData,
+                                       void *audioData,
+                                       int32_t numFrames);
+
+typedef struct AAudioHostConfig {
+  // Device properties, used when the stream builder leaves them unspecified
+  int32_t sampleRate;
+  int32_t framesPerBurst;
+  int32_t bufferCapacityInBursts;
+
+  // Each data callback is delayed after the burst boundary by a uniformly distributed random time
+  // between zero and this value
+  int64_t callbackJitterNanos;
+
+  // Probability that the device glitches on any burst, counting an xrun and losing the burst
+  double xRunProbability;
+
+  // Error of the device clock relative to CLOCK_MONOTONIC in parts per million. A positive value
+  // makes the device run fast.
+  double clockDriftPpm;
+
+  // Added to clockDriftPpm for input streams, simulating an input device with its own clock
+  double inputClockDriftPpm;
+
+  // Time between the device reading an output frame and it leaving the speaker, and between an
+  // input frame reaching the microphone and the device writing it. Reflected in
+  // AAudioStream_getTimestamp.
+  int64_t outputLatencyNanos;
+  int64_t inputLatencyNanos;
+
+  // Uniformly distributed random error of up to this value added to each timestamp
+  int64_t timestampJitterNanos;
+
+  // Seed for the jitter and xrun random number generators, making runs repeatable
+  uint32_t randomSeed;
+
+  // If not null every output stream writes what the device consumed to this WAV file. The file
+  // is rewritten each time an output stream is opened.
+  const char *outputWavPath;
+
+  // Optional memory sink for output streams and signal source for input streams. Input streams
+  // capture silence when no source is set.
+  AAudioHost_outputSink outputSink;
+  void *outputSinkUserData;
+  AAudioHost_inputSource inputSource;
+  void *inputSourceUserData;
+} AAudioHostConfig;
+
+/**
+ * An acoustic path from the simulated speaker to the simulated microphone, see
+ * AAudioHost_setLoopback
+ */
+typedef struct AAudioHostLoopback {
+  // Time from a frame leaving the speaker to it reaching the microphone, up to one second
+  int64_t delayNanos;
+  float gain;
+
+  // RMS level of white noise added to the microphone signal
+  float noiseLevel;
+} AAudioHostLoopback;
+
+/**
+ * Fill config with the defaults: 48kHz, 192 frame bursts, 16 burst capacity, no jitter, no
+ * xruns, no drift, 10ms output and input latency, no output file and silent input.
+ */
+void AAudioHost_getDefaultConfig(AAudioHostConfig *config);
+
+/**
+ * Set the configuration used by streams opened after this call. Streams which are already open
+ * keep the configuration they were opened with.
+ */
+void AAudioHost_setConfig(const AAudioHostConfig *config);
+
+/**
+ * Make every open stream glitch on its next count bursts, as if the device had missed them.
+ */
+void AAudioHost_injectXRuns(int32_t count);
+
+/**
+ * Disconnect every open stream, as happens on a device when headphones are unplugged. On its
+ * next burst each started stream moves to AAUDIO_STREAM_STATE_DISCONNECTED and calls its error
+ * callback with AAUDIO_ERROR_DISCONNECTED. Streams which aren't started are disconnected
+ * immediately.
+ */
+void AAudioHost_disconnectAllStreams();
+
+/**
+ * Let input streams hear output streams, or stop them hearing them if loopback is null. Takes
+ * effect on the next burst of every stream.
+ *
+ * Output streams play into the loopback, mixed down to one channel. Input streams add what
+ * reached the microphone to every channel of each burst they capture, after any inputSource,
+ * resampled by time so that the two streams may have different rates and clocks. A frame's
+ * time at the speaker and at the microphone is the one AAudioStream_getTimestamp gives it, so
+ * the delay from an output frame being consumed to it being captured is outputLatencyNanos +
+ * delayNanos + inputLatencyNanos. Sound the output device hasn't consumed yet is silence, so
+ * that should be longer than a burst. Meant for one output stream at a time.
+ */
+void AAudioHost_setLoopback(const AAudioHostLoopback *loopback);
+
+/**
+ * @return the number of streams which have been opened and not yet closed
+ */
+int32_t AAudioHost_getOpenStreamCount();
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //AAUDIO_HOST_H
@@ -0,0 +1,238 @@
+/*
+ * Copyright 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * Host stand-in for the NDK's <aaudio/AAudio.h>.
+ *
+ * Declares the subset of the AAudio API used by the samples, with the same names, types and
+ * values as the NDK header so the engine sources compile unchanged on Linux. The implementation
+ * in AAudioHost.cpp simulates an audio device with a timer thread, see AAudioHost.h for the
+ * controls which shape its behaviour.
+ */
+
+#ifndef AAUDIO_AAUDIO_H
+#define AAUDIO_AAUDIO_H
+
+#include <stdint.h>
+#include <time.h>
+
+// Bionic defines __unused in <sys/cdefs.h>, glibc does not
+#ifndef __unused
+#define __unused __attribute__((__unused__))
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+enum {
+  AAUDIO_DIRECTION_OUTPUT,
+  AAUDIO_DIRECTION_INPUT
+};
+typedef int32_t aaudio_direction_t;
+
+enum {
+  AAUDIO_FORMAT_INVALID = -1,
+  AAUDIO_FORMAT_UNSPECIFIED = 0,
+  AAUDIO_FORMAT_PCM_I16,
+  AAUDIO_FORMAT_PCM_FLOAT
+};
+typedef int32_t aaudio_format_t;
+
+enum {
+  AAUDIO_OK,
+  AAUDIO_ERROR_BASE = -900,
+  AAUDIO_ERROR_DISCONNECTED,
+  AAUDIO_ERROR_ILLEGAL_ARGUMENT,
+  AAUDIO_ERROR_INTERNAL = AAUDIO_ERROR_ILLEGAL_ARGUMENT + 2,
+  AAUDIO_ERROR_INVALID_STATE,
+  AAUDIO_ERROR_INVALID_HANDLE = AAUDIO_ERROR_INVALID_STATE + 3,
+  AAUDIO_ERROR_UNIMPLEMENTED = AAUDIO_ERROR_INVALID_HANDLE + 2,
+  AAUDIO_ERROR_UNAVAILABLE,
+  AAUDIO_ERROR_NO_FREE_HANDLES,
+  AAUDIO_ERROR_NO_MEMORY,
+  AAUDIO_ERROR_NULL,
+  AAUDIO_ERROR_TIMEOUT,
+  AAUDIO_ERROR_WOULD_BLOCK,
+  AAUDIO_ERROR_INVALID_FORMAT,
+  AAUDIO_ERROR_OUT_OF_RANGE,
+  AAUDIO_ERROR_NO_SERVICE,
+  AAUDIO_ERROR_INVALID_RATE
+};
+typedef int32_t aaudio_result_t;
+
+enum {
+  AAUDIO_STREAM_STATE_UNINITIALIZED = 0,
+  AAUDIO_STREAM_STATE_UNKNOWN,
+  AAUDIO_STREAM_STATE_OPEN,
+  AAUDIO_STREAM_STATE_STARTING,
+  AAUDIO_STREAM_STATE_STARTED,
+  AAUDIO_STREAM_STATE_PAUSING,
+  AAUDIO_STREAM_STATE_PAUSED,
+  AAUDIO_STREAM_STATE_FLUSHING,
+  AAUDIO_STREAM_STATE_FLUSHED,
+  AAUDIO_STREAM_STATE_STOPPING,
+  AAUDIO_STREAM_STATE_STOPPED,
+  AAUDIO_STREAM_STATE_CLOSING,
+  AAUDIO_STREAM_STATE_CLOSED,
+  AAUDIO_STREAM_STATE_DISCONNECTED
+};
+typedef int32_t aaudio_stream_state_t;
+
+enum {
+  AAUDIO_SHARING_MODE_EXCLUSIVE,
+  AAUDIO_SHARING_MODE_SHARED
+};
+typedef int32_t aaudio_sharing_mode_t;
+
+enum {
+  AAUDIO_PERFORMANCE_MODE_NONE = 10,
+  AAUDIO_PERFORMANCE_MODE_POWER_SAVING,
+  AAUDIO_PERFORMANCE_MODE_LOW_LATENCY
+};
+typedef int32_t aaudio_performance_mode_t;
+
+enum {
+  AAUDIO_CALLBACK_RESULT_CONTINUE = 0,
+  AAUDIO_CALLBACK_RESULT_STOP
+};
+typedef int32_t aaudio_data_callback_result_t;
+
+#define AAUDIO_UNSPECIFIED 0
+
+typedef struct AAudioStreamStruct AAudioStream;
+typedef struct AAudioStreamBuilderStruct AAudioStreamBuilder;
+
+typedef aaudio_data_callback_result_t (*AAudioStream_dataCallback)(AAudioStream *stream,
+                                                                   void *userData,
+                                                                   void *audioData,
+                                                                   int32_t numFrames);
+
+typedef void (*AAudioStream_errorCallback)(AAudioStream *stream,
+                                           void *userData,
+                                           aaudio_result_t error);
+
+// Utilities
+
+const char *AAudio_convertResultToText(aaudio_result_t returnCode);
+
+const char *AAudio_convertStreamStateToText(aaudio_stream_state_t state);
+
+// Stream builder
+
+aaudio_result_t AAudio_createStreamBuilder(AAudioStreamBuilder **builder);
+
+void AAudioStreamBuilder_setDeviceId(AAudioStreamBuilder *builder, int32_t deviceId);
+
+void AAudioStreamBuilder_setSampleRate(AAudioStreamBuilder *builder, int32_t sampleRate);
+
+void AAudioStreamBuilder_setChannelCount(AAudioStreamBuilder *builder, int32_t channelCount);
+
+void AAudioStreamBuilder_setFormat(AAudioStreamBuilder *builder, aaudio_format_t format);
+
+void AAudioStreamBuilder_setSharingMode(AAudioStreamBuilder *builder,
+                                        aaudio_sharing_mode_t sharingMode);
+
+void AAudioStreamBuilder_setDirection(AAudioStreamBuilder *builder, aaudio_direction_t direction);
+
+void AAudioStreamBuilder_setBufferCapacityInFrames(AAudioStreamBuilder *builder,
+                                                   int32_t numFrames);
+
+void AAudioStreamBuilder_setPerformanceMode(AAudioStreamBuilder *builder,
+                                            aaudio_performance_mode_t mode);
+
+void AAudioStreamBuilder_setDataCallback(AAudioStreamBuilder *builder,
+                                         AAudioStream_dataCallback callback,
+                                         void *userData);
+
+void AAudioStreamBuilder_setFramesPerDataCallback(AAudioStreamBuilder *builder,
+                                                  int32_t numFrames);
+
+void AAudioStreamBuilder_setErrorCallback(AAudioStreamBuilder *builder,
+                                          AAudioStream_errorCallback callback,
+                                          void *userData);
+
+aaudio_result_t AAudioStreamBuilder_openStream(AAudioStreamBuilder *builder,
+                                               AAudioStream **stream);
+
+aaudio_result_t AAudioStreamBuilder_delete(AAudioStreamBuilder *builder);
+
+// Stream control
+
+aaudio_result_t AAudioStream_close(AAudioStream *stream);
+
+aaudio_result_t AAudioStream_requestStart(AAudioStream *stream);
+
+aaudio_result_t AAudioStream_requestStop(AAudioStream *stream);
+
+aaudio_stream_state_t AAudioStream_getState(AAudioStream *stream);
+
+// Stream I/O, only for streams without a data callback
+
+aaudio_result_t AAudioStream_read(AAudioStream *stream,
+                                  void *buffer,
+                                  int32_t numFrames,
+                                  int64_t timeoutNanoseconds);
+
+aaudio_result_t AAudioStream_write(AAudioStream *stream,
+                                   const void *buffer,
+                                   int32_t numFrames,
+                                   int64_t timeoutNanoseconds);
+
+// Stream queries
+
+aaudio_result_t AAudioStream_setBufferSizeInFrames(AAudioStream *stream, int32_t numFrames);
+
+int32_t AAudioStream_getBufferSizeInFrames(AAudioStream *stream);
+
+int32_t AAudioStream_getFramesPerBurst(AAudioStream *stream);
+
+int32_t AAudioStream_getBufferCapacityInFrames(AAudioStream *stream);
+
+int32_t AAudioStream_getFramesPerDataCallback(AAudioStream *stream);
+
+int32_t AAudioStream_getXRunCount(AAudioStream *stream);
+
+int32_t AAudioStream_getSampleRate(AAudioStream *stream);
+
+int32_t AAudioStream_getChannelCount(AAudioStream *stream);
+
+int32_t AAudioStream_getSamplesPerFrame(AAudioStream *stream);
+
+int32_t AAudioStream_getDeviceId(AAudioStream *stream);
+
+aaudio_format_t AAudioStream_getFormat(AAudioStream *stream);
+
+aaudio_sharing_mode_t AAudioStream_getSharingMode(AAudioStream *stream);
+
+aaudio_performance_mode_t AAudioStream_getPerformanceMode(AAudioStream *stream);
+
+aaudio_direction_t AAudioStream_getDirection(AAudioStream *stream);
+
+int64_t AAudioStream_getFramesWritten(AAudioStream *stream);
+
+int64_t AAudioStream_getFramesRead(AAudioStream *stream);
+
+aaudio_result_t AAudioStream_getTimestamp(AAudioStream *stream,
+                                          clockid_t clockid,
+                                          int64_t *framePosition,
+                                          int64_t *timeNanoseconds);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //AAUDIO_AAUDIO_H
@@ -0,0 +1,66 @@
+/*
+ * Copyright 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * Host stand-in for the NDK's <android/log.h>. Messages are written to stderr.
+ */
+
+#ifndef AAUDIO_HOST_ANDROID_LOG_H
+#define AAUDIO_HOST_ANDROID_LOG_H
+
+#include <stdarg.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum android_LogPriority {
+  ANDROID_LOG_UNKNOWN = 0,
+  ANDROID_LOG_DEFAULT,
+  ANDROID_LOG_VERBOSE,
+  ANDROID_LOG_DEBUG,
+  ANDROID_LOG_INFO,
+  ANDROID_LOG_WARN,
+  ANDROID_LOG_ERROR,
+  ANDROID_LOG_FATAL,
+  ANDROID_LOG_SILENT
+} android_LogPriority;
+
+int __android_log_write(int prio, const char *tag, const char *text);
+
+int __android_log_print(int prio, const char *tag, const char *fmt, ...)
+    __attribute__((__format__(printf, 3, 4)));
+
+int __android_log_vprint(int prio, const char *tag, const char *fmt, va_list ap)
+    __attribute__((__format__(printf, 3, 0)));
+
+void __android_log_assert(const char *cond, const char *tag, const char *fmt, ...)
+    __attribute__((__noreturn__)) __attribute__((__format__(printf, 3, 4)));
+
+/**
+ * Messages below this priority are discarded. The default is ANDROID_LOG_INFO, which matches
+ * the logcat default for release builds.
+ *
+ * @return the previous minimum priority
+ */
+int32_t __android_log_set_minimum_priority(int32_t priority);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //AAUDIO_HOST_ANDROID_LOG_H
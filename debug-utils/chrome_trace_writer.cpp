@@ -0,0 +1,88 @@
+/*
+ * Copyright 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <unistd.h>
+#include <cinttypes>
+#include <cstdio>
+#include "chrome_trace_writer.h"
+
+void ChromeTraceWriter::beginSection(int32_t threadId, int64_t timestampNanos, const char *name) {
+  sectionDepths_[threadId]++;
+  events_.push_back({'B', threadId, timestampNanos, name, 0});
+}
+
+void ChromeTraceWriter::endSection(int32_t threadId, int64_t timestampNanos) {
+  int &depth = sectionDepths_[threadId];
+  if (depth == 0) return;
+  depth--;
+  events_.push_back({'E', threadId, timestampNanos, std::string(), 0});
+}
+
+void ChromeTraceWriter::setCounter(int32_t threadId, int64_t timestampNanos, const char *name,
+                                   int64_t value) {
+  events_.push_back({'C', threadId, timestampNanos, name, value});
+}
+
+void ChromeTraceWriter::clear() {
+  events_.clear();
+  sectionDepths_.clear();
+}
+
+// Write a string as a JSON string literal
+static void writeJsonString(FILE *file, const std::string &text) {
+  fputc('"', file);
+  for (char c : text) {
+    if (c == '"' || c == '\\') {
+      fputc('\\', file);
+      fputc(c, file);
+    } else if (static_cast<unsigned char>(c) < 0x20) {
+      fprintf(file, "\\u%04x", c);
+    } else {
+      fputc(c, file);
+    }
+  }
+  fputc('"', file);
+}
+
+bool ChromeTraceWriter::write(const char *path) const {
+
+  FILE *file = fopen(path, "w");
+  if (file == nullptr) return false;
+
+  int processId = static_cast<int>(getpid());
+  fprintf(file, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[");
+
+  for (size_t i = 0; i < events_.size(); i++) {
+    const Event &event = events_[i];
+
+    // Timestamps are in microseconds, keep nanosecond precision
+    fprintf(file, "%s\n{\"ph\":\"%c\",\"pid\":%d,\"tid\":%d,\"ts\":%" PRId64 ".%03d",
+            (i == 0) ? "" : ",", event.phase, processId, event.threadId,
+            event.timestampNanos / 1000, static_cast<int>(event.timestampNanos % 1000));
+    if (event.phase != 'E') {
+      fprintf(file, ",\"name\":");
+      writeJsonString(file, event.name);
+    }
+    if (event.phase == 'C') {
+      fprintf(file, ",\"args\":{\"value\":%" PRId64 "}", event.value);
+    }
+    fputc('}', file);
+  }
+
+  fprintf(file, "\n]}\n");
+  bool isWritten = !ferror(file);
+  return fclose(file) == 0 && isWritten;
+}
@@ -0,0 +1,66 @@
+/*
+ * Copyright 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef DEBUG_UTILS_CHROME_TRACE_WRITER_H
+#define DEBUG_UTILS_CHROME_TRACE_WRITER_H
+
+#include <stdint.h>
+#include <map>
+#include <string>
+#include <vector>
+
+/**
+ * Collects trace events in memory and writes them as Chrome trace event JSON, which can be
+ * opened in Perfetto (ui.perfetto.dev) or chrome://tracing.
+ *
+ * Section begin and end events must be added in order for each thread so that nesting is
+ * preserved. End events without a matching begin, from sections which were already open when a
+ * capture started, are dropped. The writer isn't thread safe.
+ */
+class ChromeTraceWriter {
+
+public:
+  void beginSection(int32_t threadId, int64_t timestampNanos, const char *name);
+
+  void endSection(int32_t threadId, int64_t timestampNanos);
+
+  void setCounter(int32_t threadId, int64_t timestampNanos, const char *name, int64_t value);
+
+  void clear();
+
+  size_t getEventCount() const { return events_.size(); }
+
+  /**
+   * Write every event added so far to a file
+   *
+   * @return false if the file couldn't be written
+   */
+  bool write(const char *path) const;
+
+private:
+  struct Event {
+    char phase;             // 'B' begin, 'E' end or 'C' counter
+    int32_t threadId;
+    int64_t timestampNanos;
+    std::string name;
+    int64_t value;
+  };
+
+  std::vector<Event> events_;
+  std::map<int32_t, int> sectionDepths_;
+};
+
+#endif //DEBUG_UTILS_CHROME_TRACE_WRITER_H
@@ -0,0 +1,209 @@
+/*
+ * Copyright 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <time.h>
+#include <chrono>
+#include <mutex>
+#include <thread>
+#include "rt_log.h"
+
+// Must be a power of two
+constexpr uint32_t kRtLogQueueCapacity = 256;
+constexpr int kRtLogMaxMessageLength = 256;
+constexpr int kRtLogDrainPeriodMillis = 10;
+constexpr int64_t kNanosPerSecond = 1000000000LL;
+constexpr int kCacheLineSizeInBytes = 64;
+
+static int64_t nowNanos() {
+  timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * kNanosPerSecond + ts.tv_nsec;
+}
+
+struct RtLogRecord {
+  const char *tag;
+  const char *format;
+  int priority;
+  uint8_t numArgs;
+  TraceArg args[kTraceMaxArgs];
+};
+
+/**
+ * Bounded multiple producer, single consumer queue. Each slot has a sequence number which tells
+ * producers when it is free and the consumer when its record has been written, so a producer
+ * only has to claim a position with a compare and swap.
+ */
+class RtLogQueue {
+
+public:
+  RtLogQueue() {
+    for (uint32_t i = 0; i < kRtLogQueueCapacity; i++) {
+      slots_[i].sequence.store(i, std::memory_order_relaxed);
+    }
+  }
+
+  bool push(int priority, const char *tag, const char *format, const TraceArg *args,
+            uint8_t numArgs) {
+
+    Slot *slot;
+    uint32_t position = enqueuePosition_.load(std::memory_order_relaxed);
+    for (;;) {
+      slot = &slots_[position & (kRtLogQueueCapacity - 1)];
+      uint32_t sequence = slot->sequence.load(std::memory_order_acquire);
+      int32_t difference = static_cast<int32_t>(sequence - position);
+      if (difference == 0) {
+        if (enqueuePosition_.compare_exchange_weak(position, position + 1,
+                                                   std::memory_order_relaxed)) {
+          break;
+        }
+      } else if (difference < 0) {
+        return false; // Full
+      } else {
+        position = enqueuePosition_.load(std::memory_order_relaxed);
+      }
+    }
+
+    RtLogRecord &record = slot->record;
+    record.tag = tag;
+    record.format = format;
+    record.priority = priority;
+    record.numArgs = numArgs;
+    for (int i = 0; i < numArgs; i++) record.args[i] = args[i];
+    slot->sequence.store(position + 1, std::memory_order_release);
+    return true;
+  }
+
+  // Consumer only
+  bool pop(RtLogRecord *record) {
+
+    Slot &slot = slots_[dequeuePosition_ & (kRtLogQueueCapacity - 1)];
+    uint32_t sequence = slot.sequence.load(std::memory_order_acquire);
+    if (sequence != dequeuePosition_ + 1) return false;
+    *record = slot.record;
+    slot.sequence.store(dequeuePosition_ + kRtLogQueueCapacity, std::memory_order_release);
+    dequeuePosition_++;
+    return true;
+  }
+
+private:
+  struct Slot {
+    std::atomic<uint32_t> sequence;
+    RtLogRecord record;
+  };
+
+  // Padding keeps the producers' position off the consumer's cache line
+  std::atomic<uint32_t> enqueuePosition_ { 0 };
+  char enqueuePositionPadding_[kCacheLineSizeInBytes];
+  uint32_t dequeuePosition_ = 0;
+  Slot slots_[kRtLogQueueCapacity];
+};
+
+static RtLogQueue gQueue;
+static std::atomic<int64_t> gDroppedCount { 0 };
+static std::atomic<int64_t> gRateLimitedCount { 0 };
+
+// The drain lock makes the queue's consumer exclusive
+static std::mutex gDrainLock;
+static int64_t gReportedDroppedCount = 0;
+static int64_t gReportedRateLimitedCount = 0;
+
+static std::mutex gThreadLock;
+static int gStartCount = 0;
+static std::atomic<bool> gIsDraining { false };
+static std::thread gDrainThread;
+
+bool RtLogRateLimiter::tryAcquire(int64_t nowNanos) {
+
+  // Races between threads sharing a call site can let a few extra records through, which is fine
+  int64_t windowStartNanos = windowStartNanos_.load(std::memory_order_relaxed);
+  if (nowNanos - windowStartNanos >= kNanosPerSecond) {
+    windowStartNanos_.store(nowNanos, std::memory_order_relaxed);
+    count_.store(0, std::memory_order_relaxed);
+  }
+  return count_.fetch_add(1, std::memory_order_relaxed) < kRtLogMaxRecordsPerSecond;
+}
+
+void RtLog::logWithArgs(RtLogRateLimiter *rateLimiter, int priority, const char *tag,
+                        const char *format, const TraceArg *args, uint8_t numArgs) {
+
+  if (rateLimiter != nullptr && !rateLimiter->tryAcquire(nowNanos())) {
+    gRateLimitedCount.fetch_add(1, std::memory_order_relaxed);
+    return;
+  }
+  if (!gQueue.push(priority, tag, format, args, numArgs)) {
+    gDroppedCount.fetch_add(1, std::memory_order_relaxed);
+  }
+}
+
+// The drain lock must be held
+static void drainQueue() {
+
+  char message[kRtLogMaxMessageLength];
+  RtLogRecord record;
+  while (gQueue.pop(&record)) {
+    formatTraceArgs(record.format, record.args, record.numArgs, message, sizeof(message));
+    __android_log_print(record.priority, record.tag, "%s", message);
+  }
+
+  int64_t droppedCount = gDroppedCount.load(std::memory_order_relaxed);
+  int64_t rateLimitedCount = gRateLimitedCount.load(std::memory_order_relaxed);
+  if (droppedCount != gReportedDroppedCount || rateLimitedCount != gReportedRateLimitedCount) {
+    LOGW("Real-time log dropped %lld records with a full queue and %lld rate limited records",
+         static_cast<long long>(droppedCount - gReportedDroppedCount),
+         static_cast<long long>(rateLimitedCount - gReportedRateLimitedCount));
+    gReportedDroppedCount = droppedCount;
+    gReportedRateLimitedCount = rateLimitedCount;
+  }
+}
+
+static void runDrain() {
+  while (gIsDraining.load()) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(kRtLogDrainPeriodMillis));
+    std::lock_guard<std::mutex> lock(gDrainLock);
+    drainQueue();
+  }
+}
+
+void RtLog::start() {
+  std::lock_guard<std::mutex> lock(gThreadLock);
+  if (gStartCount++ == 0) {
+    gIsDraining.store(true);
+    gDrainThread = std::thread(runDrain);
+  }
+}
+
+void RtLog::stop() {
+  std::lock_guard<std::mutex> lock(gThreadLock);
+  if (gStartCount == 0) return;
+  if (--gStartCount == 0) {
+    gIsDraining.store(false);
+    gDrainThread.join();
+    flush();
+  }
+}
+
+void RtLog::flush() {
+  std::lock_guard<std::mutex> lock(gDrainLock);
+  drainQueue();
+}
+
+int64_t RtLog::getDroppedCount() {
+  return gDroppedCount.load(std::memory_order_relaxed);
+}
+
+int64_t RtLog::getRateLimitedCount() {
+  return gRateLimitedCount.load(std::memory_order_relaxed);
+}
@@ -0,0 +1,109 @@
+/*
+ * Copyright 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef DEBUG_UTILS_RT_LOG_H
+#define DEBUG_UTILS_RT_LOG_H
+
+#include <stdint.h>
+#include <atomic>
+#include "logging_macros.h"
+#include "trace_args.h"
+
+// Records each call site may log per second, the rest are counted and dropped
+constexpr int32_t kRtLogMaxRecordsPerSecond = 10;
+
+/**
+ * Limits how often one call site logs. Each RTLOGx call site has its own, so a message logged on
+ * every callback doesn't hide the others.
+ */
+class RtLogRateLimiter {
+
+public:
+  constexpr RtLogRateLimiter() {}
+
+  bool tryAcquire(int64_t nowNanos);
+
+private:
+  std::atomic<int64_t> windowStartNanos_ { 0 };
+  std::atomic<int32_t> count_ { 0 };
+};
+
+/**
+ * Logging which is safe to call from an audio callback.
+ *
+ * __android_log_print can block on a lock or on the log device, so it shouldn't be called from
+ * the audio thread. RtLog::log only copies the priority, the format string pointer and up to
+ * kTraceMaxArgs raw arguments into a fixed size lock-free queue, it never allocates, formats or
+ * takes a lock. A background thread started with RtLog::start() drains the queue, formats the
+ * messages and logs them.
+ *
+ * The format string and any string arguments must outlive the formatting, in practice they
+ * should be string literals. Records are dropped when the queue is full or when a call site
+ * exceeds kRtLogMaxRecordsPerSecond, the drain thread logs how many.
+ *
+ * Use the RTLOGx macros rather than calling RtLog::log directly.
+ */
+class RtLog {
+
+public:
+  template <typename... Args>
+  static void log(RtLogRateLimiter *rateLimiter, int priority, const char *tag,
+                  const char *format, Args... args) {
+    static_assert(sizeof...(Args) <= kTraceMaxArgs, "Too many log arguments");
+    TraceArg logArgs[sizeof...(Args) + 1] = {makeTraceArg(args)...};
+    logWithArgs(rateLimiter, priority, tag, format, logArgs,
+                static_cast<uint8_t>(sizeof...(Args)));
+  }
+
+  /**
+   * Start the drain thread. Calls are counted, the thread runs until stop() has been called as
+   * many times as start().
+   */
+  static void start();
+  static void stop();
+
+  /**
+   * Log every queued record on the calling thread
+   */
+  static void flush();
+
+  /**
+   * Records dropped because the queue was full
+   */
+  static int64_t getDroppedCount();
+
+  /**
+   * Records dropped because their call site logged too often
+   */
+  static int64_t getRateLimitedCount();
+
+private:
+  static void logWithArgs(RtLogRateLimiter *rateLimiter, int priority, const char *tag,
+                          const char *format, const TraceArg *args, uint8_t numArgs);
+};
+
+#define RTLOG(priority, ...) \
+  do { \
+    static RtLogRateLimiter rtLogRateLimiter; \
+    RtLog::log(&rtLogRateLimiter, priority, MODULE_NAME, __VA_ARGS__); \
+  } while (0)
+
+#define RTLOGD(...) RTLOG(ANDROID_LOG_DEBUG, __VA_ARGS__)
+#define RTLOGI(...) RTLOG(ANDROID_LOG_INFO, __VA_ARGS__)
+#define RTLOGW(...) RTLOG(ANDROID_LOG_WARN, __VA_ARGS__)
+#define RTLOGE(...) RTLOG(ANDROID_LOG_ERROR, __VA_ARGS__)
+
+#endif //DEBUG_UTILS_RT_LOG_H
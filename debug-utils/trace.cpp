@@ -15,46 +15,332 @@
  */
 
 #include <dlfcn.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/syscall.h>
 #include "logging_macros.h"
+#include <atomic>
+#include <chrono>
 #include <cstdio>
+#include <mutex>
+#include <thread>
+#include "chrome_trace_writer.h"
 #include "trace.h"
 
 static const int TRACE_MAX_SECTION_NAME_LENGTH = 100;
 
+// Records each thread can buffer before the formatting thread drains them, must be a power of two
+constexpr uint32_t kTraceRingCapacity = 512;
+// Threads which can record at the same time, a thread's ring is returned to the pool when it exits
+constexpr int kTraceMaxThreads = 16;
+constexpr int kTraceFormatterPeriodMillis = 10;
+constexpr int kCacheLineSizeInBytes = 64;
+
 // Tracing functions
 static void *(*ATrace_beginSection)(const char *sectionName);
 
 static void *(*ATrace_endSection)(void);
 
+// Only available from API 29
+static void *(*ATrace_setCounter)(const char *counterName, int64_t counterValue);
+
 typedef void *(*fp_ATrace_beginSection)(const char *sectionName);
 
 typedef void *(*fp_ATrace_endSection)(void);
 
+typedef void *(*fp_ATrace_setCounter)(const char *counterName, int64_t counterValue);
+
 bool Trace::is_tracing_supported_ = false;
+static std::atomic<bool> gFormatsSystraceNames { false };
+
+static int64_t nowNanos() {
+  timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
 
-void Trace::beginSection(const char *fmt, ...){
+/**
+ * Records made by one thread. The owning thread is the only producer and the formatting thread,
+ * or a thread calling Trace::flush, the only consumer. Rings live in a pool and are reused once
+ * their thread exits, records left by the previous owner keep its thread id and are still drained.
+ */
+class ThreadTraceRing {
 
-  static char buff[TRACE_MAX_SECTION_NAME_LENGTH];
-  va_list args;
-  va_start(args, fmt);
-  vsprintf(buff, fmt, args);
-  va_end(args);
+public:
+  // Lock-free so that a thread can claim its ring inside an audio callback
+  bool claim(int32_t threadId) {
+    bool isInUse = false;
+    if (!isInUse_.compare_exchange_strong(isInUse, true, std::memory_order_acquire)) return false;
+    threadId_ = threadId;
+    return true;
+  }
 
-  if (is_tracing_supported_) {
-    ATrace_beginSection(buff);
+  void release() {
+    isInUse_.store(false, std::memory_order_release);
+  }
+
+  // Owning thread only. The record is written straight into the ring to avoid copying it twice.
+  void push(TraceRecordType type, const char *format, const TraceArg *args, uint8_t numArgs) {
+    uint32_t writeIndex = writeIndex_.load(std::memory_order_relaxed);
+    uint32_t readIndex = readIndex_.load(std::memory_order_acquire);
+    if (writeIndex - readIndex >= kTraceRingCapacity) {
+      dropped_.fetch_add(1, std::memory_order_relaxed);
+      return;
+    }
+    TraceRecord &record = records_[writeIndex & (kTraceRingCapacity - 1)];
+    record.timestampNanos = nowNanos();
+    record.threadId = threadId_;
+    record.type = type;
+    record.format = format;
+    record.numArgs = numArgs;
+    for (int i = 0; i < numArgs; i++) record.args[i] = args[i];
+    writeIndex_.store(writeIndex + 1, std::memory_order_release);
+  }
+
+  bool pop(TraceRecord *record) {
+    uint32_t readIndex = readIndex_.load(std::memory_order_relaxed);
+    uint32_t writeIndex = writeIndex_.load(std::memory_order_acquire);
+    if (readIndex == writeIndex) return false;
+    *record = records_[readIndex & (kTraceRingCapacity - 1)];
+    readIndex_.store(readIndex + 1, std::memory_order_release);
+    return true;
+  }
+
+  int64_t getDroppedCount() const { return dropped_.load(std::memory_order_relaxed); }
+
+private:
+  // Padding keeps the indexes on separate cache lines
+  std::atomic<uint32_t> writeIndex_ { 0 };
+  char writeIndexPadding_[kCacheLineSizeInBytes];
+  std::atomic<uint32_t> readIndex_ { 0 };
+  char readIndexPadding_[kCacheLineSizeInBytes];
+  std::atomic<int64_t> dropped_ { 0 };
+  std::atomic<bool> isInUse_ { false };
+  int32_t threadId_ = 0;
+  TraceRecord records_[kTraceRingCapacity];
+};
+
+// The pool is allocated off the audio thread, by the first Trace::setSink or
+// Trace::registerCurrentThread, and never freed
+static std::mutex gRingsLock;
+static std::atomic<ThreadTraceRing *> gRingPool { nullptr };
+static thread_local ThreadTraceRing *tRing = nullptr;
+// Returns the calling thread's ring to the pool when the thread exits
+static pthread_key_t gRingKey;
+static pthread_once_t gRingKeyOnce = PTHREAD_ONCE_INIT;
+// Records dropped because every ring in the pool was in use
+static std::atomic<int64_t> gUnpooledDropped { 0 };
+
+// The sink lock is held while records are passed to the sink. Lock order is sink then rings.
+static std::mutex gSinkLock;
+static TraceSink gSink = nullptr;
+static void *gSinkUserData = nullptr;
+static std::atomic<bool> gIsRecording { false };
+static std::thread gFormatterThread;
+
+// Sections and counters captured by Trace::startCapture, only used from the sink
+static ChromeTraceWriter gCaptureWriter;
+
+static void releaseRing(void *ring) {
+  static_cast<ThreadTraceRing *>(ring)->release();
+}
+
+static void createRingKey() {
+  pthread_key_create(&gRingKey, releaseRing);
+}
+
+static void allocateRingPool() {
+  pthread_once(&gRingKeyOnce, createRingKey);
+  std::lock_guard<std::mutex> lock(gRingsLock);
+  if (gRingPool.load(std::memory_order_relaxed) == nullptr) {
+    gRingPool.store(new ThreadTraceRing[kTraceMaxThreads], std::memory_order_release);
+  }
+}
+
+// Never allocates or locks, returns null if the pool is missing or every ring is in use
+static ThreadTraceRing *getCurrentThreadRing() {
+  if (tRing == nullptr) {
+    ThreadTraceRing *pool = gRingPool.load(std::memory_order_acquire);
+    if (pool == nullptr) return nullptr;
+    int32_t threadId = static_cast<int32_t>(syscall(SYS_gettid));
+    for (int i = 0; i < kTraceMaxThreads; i++) {
+      if (pool[i].claim(threadId)) {
+        tRing = &pool[i];
+        pthread_setspecific(gRingKey, tRing);
+        break;
+      }
+    }
+  }
+  return tRing;
+}
+
+static void pushRecord(TraceRecordType type, const char *format, const TraceArg *args,
+                       uint8_t numArgs) {
+  ThreadTraceRing *ring = getCurrentThreadRing();
+  if (ring != nullptr) {
+    ring->push(type, format, args, numArgs);
   } else {
-    LOGE("Tracing is either not initialized (call Trace::initialize()) "
-             "or not supported on this device");
+    gUnpooledDropped.fetch_add(1, std::memory_order_relaxed);
+  }
+}
+
+// Pass every buffered record to the sink, the sink lock must be held
+static void drainRings() {
+
+  ThreadTraceRing *pool = gRingPool.load(std::memory_order_acquire);
+  if (pool == nullptr) return;
+
+  char sectionName[TRACE_MAX_SECTION_NAME_LENGTH];
+  TraceRecord record;
+  for (int i = 0; i < kTraceMaxThreads; i++) {
+    while (pool[i].pop(&record)) {
+      if (gSink == nullptr) continue;
+      if (record.type == TRACE_RECORD_BEGIN) {
+        formatTraceArgs(record.format, record.args, record.numArgs, sectionName,
+                        sizeof(sectionName));
+      } else if (record.type == TRACE_RECORD_COUNTER) {
+        snprintf(sectionName, sizeof(sectionName), "%s", record.format);
+      } else {
+        sectionName[0] = '\0';
+      }
+      gSink(record, sectionName, gSinkUserData);
+    }
+  }
+}
+
+static void runFormatter() {
+  while (gIsRecording.load()) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(kTraceFormatterPeriodMillis));
+    std::lock_guard<std::mutex> lock(gSinkLock);
+    drainRings();
+  }
+}
+
+void Trace::beginSectionWithArgs(const char *format, const TraceArg *args, uint8_t numArgs) {
+
+  bool isRecording = gIsRecording.load(std::memory_order_relaxed);
+  if (isRecording) pushRecord(TRACE_RECORD_BEGIN, format, args, numArgs);
+
+  if (is_tracing_supported_) {
+    if (gFormatsSystraceNames.load(std::memory_order_relaxed)) {
+      // ATrace copies the name, so one buffer per thread is enough
+      static thread_local char sectionName[TRACE_MAX_SECTION_NAME_LENGTH];
+      formatTraceArgs(format, args, numArgs, sectionName, sizeof(sectionName));
+      ATrace_beginSection(sectionName);
+    } else {
+      ATrace_beginSection(format);
+    }
+  } else if (!isRecording) {
+    // Only warn once, this is called from audio callbacks on any number of threads
+    static std::atomic<bool> hasWarned { false };
+    if (!hasWarned.load(std::memory_order_relaxed) && !hasWarned.exchange(true)) {
+      LOGE("Tracing is either not initialized (call Trace::initialize()) "
+               "or not supported on this device");
+    }
   }
 }
 
 void Trace::endSection() {
 
+  if (gIsRecording.load(std::memory_order_relaxed)) {
+    pushRecord(TRACE_RECORD_END, nullptr, nullptr, 0);
+  }
   if (is_tracing_supported_) {
     ATrace_endSection();
   }
 }
 
+void Trace::setFormatsSystraceNames(bool isFormatted) {
+  gFormatsSystraceNames.store(isFormatted);
+}
+
+void Trace::setCounter(const char *name, int64_t value) {
+
+  if (gIsRecording.load(std::memory_order_relaxed)) {
+    TraceArg arg;
+    arg.type = TRACE_ARG_INT;
+    arg.i = value;
+    pushRecord(TRACE_RECORD_COUNTER, name, &arg, 1);
+  }
+  if (ATrace_setCounter != nullptr) {
+    ATrace_setCounter(name, value);
+  }
+}
+
+void Trace::setSink(TraceSink sink, void *userData) {
+
+  // Stop the formatting thread, if any, and hand what has been recorded to the old sink
+  if (gIsRecording.exchange(false)) {
+    gFormatterThread.join();
+  }
+  std::lock_guard<std::mutex> lock(gSinkLock);
+  drainRings();
+
+  gSink = sink;
+  gSinkUserData = userData;
+  if (sink != nullptr) {
+    allocateRingPool();
+    gIsRecording.store(true);
+    gFormatterThread = std::thread(runFormatter);
+  }
+}
+
+void Trace::flush() {
+  std::lock_guard<std::mutex> lock(gSinkLock);
+  drainRings();
+}
+
+void Trace::registerCurrentThread() {
+  allocateRingPool();
+  getCurrentThreadRing();
+}
+
+int64_t Trace::getDroppedRecordCount() {
+  int64_t dropped = gUnpooledDropped.load(std::memory_order_relaxed);
+  ThreadTraceRing *pool = gRingPool.load(std::memory_order_acquire);
+  if (pool == nullptr) return dropped;
+  for (int i = 0; i < kTraceMaxThreads; i++) dropped += pool[i].getDroppedCount();
+  return dropped;
+}
+
+static void captureRecord(const TraceRecord &record, const char *sectionName, void *userData) {
+
+  ChromeTraceWriter *writer = static_cast<ChromeTraceWriter *>(userData);
+  switch (record.type) {
+    case TRACE_RECORD_BEGIN:
+      writer->beginSection(record.threadId, record.timestampNanos, sectionName);
+      break;
+    case TRACE_RECORD_END:
+      writer->endSection(record.threadId, record.timestampNanos);
+      break;
+    case TRACE_RECORD_COUNTER:
+      writer->setCounter(record.threadId, record.timestampNanos, sectionName, record.args[0].i);
+      break;
+  }
+}
+
+void Trace::startCapture() {
+
+  // Drain anything recorded for the previous sink before clearing the capture
+  setSink(nullptr, nullptr);
+  gCaptureWriter.clear();
+  setSink(captureRecord, &gCaptureWriter);
+}
+
+bool Trace::stopCapture(const char *jsonPath) {
+
+  setSink(nullptr, nullptr);
+  bool isWritten = gCaptureWriter.write(jsonPath);
+  if (isWritten) {
+    LOGI("Wrote %zu trace events to %s", gCaptureWriter.getEventCount(), jsonPath);
+  } else {
+    LOGE("Could not write trace to %s", jsonPath);
+  }
+  gCaptureWriter.clear();
+  return isWritten;
+}
+
 void Trace::initialize() {
 
   // Using dlsym allows us to use tracing on API 21+ without needing android/trace.h which wasn't
@@ -69,6 +355,9 @@ void Trace::initialize() {
     ATrace_endSection =
         reinterpret_cast<fp_ATrace_endSection >(
             dlsym(lib, "ATrace_endSection"));
+    ATrace_setCounter =
+        reinterpret_cast<fp_ATrace_setCounter >(
+            dlsym(lib, "ATrace_setCounter"));
 
     if (ATrace_beginSection != nullptr && ATrace_endSection != nullptr){
       is_tracing_supported_ = true;
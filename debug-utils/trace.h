@@ -17,14 +17,118 @@
 #ifndef SIMPLESYNTH_TRACE_H
 #define SIMPLESYNTH_TRACE_H
 
+#include <stdint.h>
+#include "trace_args.h"
+
+enum TraceRecordType : uint8_t {
+  TRACE_RECORD_BEGIN,
+  TRACE_RECORD_END,
+  TRACE_RECORD_COUNTER
+};
+
+/**
+ * A section boundary or counter value as recorded on the traced thread. Begin records keep the
+ * format string pointer and the raw arguments, end records only have a timestamp and thread id.
+ * Counter records keep the counter name in format and the value in args[0].
+ */
+struct TraceRecord {
+  int64_t timestampNanos;     // CLOCK_MONOTONIC
+  int32_t threadId;
+  TraceRecordType type;
+  uint8_t numArgs;
+  const char *format;
+  TraceArg args[kTraceMaxArgs];
+};
+
+/**
+ * Called on the trace formatting thread for every record, in order for each thread
+ *
+ * @param record the raw record
+ * @param sectionName the formatted section name or the counter name, empty for end records
+ * @param userData the pointer passed to Trace::setSink
+ */
+typedef void (*TraceSink)(const TraceRecord &record, const char *sectionName, void *userData);
+
+/**
+ * Systrace sections, optionally also recorded for a TraceSink.
+ *
+ * ATrace must be called on the traced thread for the timeline to be right, so by default it is
+ * given the format string as the section name and nothing is formatted on the traced thread.
+ * Systrace then shows "renderAudio %d frames" rather than the numbers. setFormatsSystraceNames(true)
+ * formats the name into a per-thread buffer first, which costs the traced thread more than the
+ * vsprintf beginSection did (see trace-benchmark), so only turn it on while investigating.
+ * When a sink is set each call also stores a record, with the raw arguments, in a lock-free ring
+ * owned by the calling thread. A background thread drains the rings, formats the section names and
+ * passes them to the sink.
+ *
+ * The format string and any string arguments must outlive the formatting, in practice they
+ * should be string literals. The rings come from a fixed pool allocated by the first setSink or
+ * registerCurrentThread call. A thread claims a ring without locking on its first traced call and
+ * returns it when it exits, so audio callback threads need no registration. Records made while
+ * every ring is in use are dropped.
+ */
 class Trace {
 
 public:
-  static void beginSection(const char *format, ...);
+  template <typename... Args>
+  static void beginSection(const char *format, Args... args) {
+    static_assert(sizeof...(Args) <= kTraceMaxArgs, "Too many trace section arguments");
+    TraceArg traceArgs[sizeof...(Args) + 1] = {makeTraceArg(args)...};
+    beginSectionWithArgs(format, traceArgs, static_cast<uint8_t>(sizeof...(Args)));
+  }
+
   static void endSection();
   static void initialize();
 
+  /**
+   * Pass systrace formatted section names rather than format strings, off by default. Records
+   * for the sink are formatted on the formatting thread either way.
+   */
+  static void setFormatsSystraceNames(bool isFormatted);
+
+  /**
+   * Set a named counter, shown as a track of its own. The name must be a string literal.
+   */
+  static void setCounter(const char *name, int64_t value);
+
+  /**
+   * Start recording for a sink, or stop recording if sink is null. Records still in the rings
+   * are passed to the previous sink before it is replaced.
+   */
+  static void setSink(TraceSink sink, void *userData);
+
+  /**
+   * Pass every record made so far to the sink, on the calling thread
+   */
+  static void flush();
+
+  /**
+   * Claim a ring for the calling thread now rather than on its first traced call
+   */
+  static void registerCurrentThread();
+
+  /**
+   * Number of records dropped because a thread's ring was full or no ring was free
+   */
+  static int64_t getDroppedRecordCount();
+
+  /**
+   * Start capturing sections and counters in memory, replacing any sink. This doesn't need
+   * ATrace so it also works on Linux host builds.
+   */
+  static void startCapture();
+
+  /**
+   * Stop the capture and write it as Chrome trace event JSON, which can be opened in Perfetto
+   * (ui.perfetto.dev) or chrome://tracing
+   *
+   * @return false if the file couldn't be written
+   */
+  static bool stopCapture(const char *jsonPath);
+
 private:
+  static void beginSectionWithArgs(const char *format, const TraceArg *args, uint8_t numArgs);
+
   static bool is_tracing_supported_;
 };
 
@@ -0,0 +1,101 @@
+/*
+ * Copyright 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <cstdio>
+#include <cstring>
+#include "trace_args.h"
+
+/**
+ * Format a printf style conversion for a single raw argument. Length modifiers in the format are
+ * replaced with the ones matching how the argument was stored.
+ */
+static int formatArg(char *buffer, size_t size, const char *spec, size_t specLength,
+                     char conversion, const TraceArg *arg) {
+
+  char argFormat[32];
+  size_t length = 0;
+  for (size_t i = 0; i < specLength - 1 && length < sizeof(argFormat) - 4; i++) {
+    if (strchr("hlLqjzt", spec[i]) == nullptr) argFormat[length++] = spec[i];
+  }
+
+  if (arg == nullptr) return snprintf(buffer, size, "?");
+
+  if (strchr("diouxXc", conversion) != nullptr) {
+    if (conversion != 'c') {
+      argFormat[length++] = 'l';
+      argFormat[length++] = 'l';
+    }
+    argFormat[length++] = conversion;
+    argFormat[length] = '\0';
+    long long value = (arg->type == TRACE_ARG_DOUBLE) ? static_cast<long long>(arg->d) : arg->i;
+    if (conversion == 'c') return snprintf(buffer, size, argFormat, static_cast<int>(value));
+    return snprintf(buffer, size, argFormat, value);
+  }
+
+  argFormat[length++] = conversion;
+  argFormat[length] = '\0';
+  switch (conversion) {
+    case 's':
+      return snprintf(buffer, size, argFormat,
+                      arg->type == TRACE_ARG_STRING && arg->s != nullptr ? arg->s : "?");
+    case 'p':
+      return snprintf(buffer, size, argFormat, arg->p);
+    default:
+      // Floating point conversions
+      double value = (arg->type == TRACE_ARG_DOUBLE) ? arg->d :
+                     (arg->type == TRACE_ARG_INT) ? static_cast<double>(arg->i) :
+                     static_cast<double>(arg->u);
+      return snprintf(buffer, size, argFormat, value);
+  }
+}
+
+void formatTraceArgs(const char *format, const TraceArg *args, int numArgs,
+                     char *buffer, size_t size) {
+
+  size_t position = 0;
+  int argIndex = 0;
+
+  while (*format != '\0' && position < size - 1) {
+
+    if (*format != '%') {
+      buffer[position++] = *format++;
+      continue;
+    }
+    if (format[1] == '%') {
+      buffer[position++] = '%';
+      format += 2;
+      continue;
+    }
+
+    // Find the end of the conversion specification
+    const char *conversion = format + 1;
+    while (*conversion != '\0' && strchr("diouxXeEfFgGaAcsp", *conversion) == nullptr) {
+      conversion++;
+    }
+    if (*conversion == '\0') break;
+
+    const TraceArg *arg = (argIndex < numArgs) ? &args[argIndex] : nullptr;
+    argIndex++;
+    int written = formatArg(buffer + position, size - position, format,
+                            static_cast<size_t>(conversion - format + 1), *conversion, arg);
+    if (written > 0) {
+      position += static_cast<size_t>(written);
+      if (position > size - 1) position = size - 1;
+    }
+    format = conversion + 1;
+  }
+  buffer[position] = '\0';
+}
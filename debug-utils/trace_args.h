@@ -0,0 +1,86 @@
+/*
+ * Copyright 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef DEBUG_UTILS_TRACE_ARGS_H
+#define DEBUG_UTILS_TRACE_ARGS_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <type_traits>
+
+constexpr int kTraceMaxArgs = 6;
+
+enum TraceArgType : uint8_t {
+  TRACE_ARG_INT,
+  TRACE_ARG_UINT,
+  TRACE_ARG_DOUBLE,
+  TRACE_ARG_POINTER,
+  TRACE_ARG_STRING
+};
+
+/**
+ * A printf style argument, stored raw so it can be formatted later on another thread
+ */
+struct TraceArg {
+  TraceArgType type;
+  union {
+    int64_t i;
+    uint64_t u;
+    double d;
+    const void *p;
+    const char *s;
+  };
+};
+
+template <typename T>
+inline typename std::enable_if<std::is_arithmetic<T>::value, TraceArg>::type
+makeTraceArg(T value) {
+  TraceArg arg;
+  if (std::is_floating_point<T>::value) {
+    arg.type = TRACE_ARG_DOUBLE;
+    arg.d = static_cast<double>(value);
+  } else if (std::is_signed<T>::value) {
+    arg.type = TRACE_ARG_INT;
+    arg.i = static_cast<int64_t>(value);
+  } else {
+    arg.type = TRACE_ARG_UINT;
+    arg.u = static_cast<uint64_t>(value);
+  }
+  return arg;
+}
+
+inline TraceArg makeTraceArg(const char *value) {
+  TraceArg arg;
+  arg.type = TRACE_ARG_STRING;
+  arg.s = value;
+  return arg;
+}
+
+inline TraceArg makeTraceArg(const void *value) {
+  TraceArg arg;
+  arg.type = TRACE_ARG_POINTER;
+  arg.p = value;
+  return arg;
+}
+
+/**
+ * Format a printf style format string with raw arguments. Length modifiers in the format are
+ * ignored, each argument is formatted the way it was stored. Missing arguments are shown as "?".
+ */
+void formatTraceArgs(const char *format, const TraceArg *args, int numArgs,
+                     char *buffer, size_t size);
+
+#endif //DEBUG_UTILS_TRACE_ARGS_H
@@ -0,0 +1,127 @@
+/*
+ * Copyright 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef DSP_UTILS_FLOAT_VECTOR_H
+#define DSP_UTILS_FLOAT_VECTOR_H
+
+/**
+ * A vector of four floats with the few operations the DSP kernels need. The SIMD implementation
+ * is chosen at compile time. NEON is used on ARM, SSE2 on x86 and a scalar loop everywhere else.
+ */
+#if defined(__ARM_NEON__) || defined(__ARM_NEON)
+#define FLOAT_VECTOR_USE_NEON 1
+#include <arm_neon.h>
+#elif defined(__SSE2__)
+#define FLOAT_VECTOR_USE_SSE2 1
+#include <emmintrin.h>
+#endif
+
+#define FLOAT_VECTOR_SIZE 4
+
+#if FLOAT_VECTOR_USE_NEON
+
+typedef float32x4_t FloatVector;
+
+static inline FloatVector vector_load(const float *values) { return vld1q_f32(values); }
+static inline FloatVector vector_dup(float value) { return vdupq_n_f32(value); }
+static inline FloatVector vector_add(FloatVector a, FloatVector b) { return vaddq_f32(a, b); }
+static inline FloatVector vector_sub(FloatVector a, FloatVector b) { return vsubq_f32(a, b); }
+static inline FloatVector vector_mul(FloatVector a, FloatVector b) { return vmulq_f32(a, b); }
+static inline FloatVector vector_min(FloatVector a, FloatVector b) { return vminq_f32(a, b); }
+static inline FloatVector vector_max(FloatVector a, FloatVector b) { return vmaxq_f32(a, b); }
+static inline void vector_store(float *values, FloatVector a) { vst1q_f32(values, a); }
+
+static inline float vector_sum(FloatVector a) {
+  float32x2_t pair = vadd_f32(vget_low_f32(a), vget_high_f32(a));
+  return vget_lane_f32(vpadd_f32(pair, pair), 0);
+}
+
+#elif FLOAT_VECTOR_USE_SSE2
+
+typedef __m128 FloatVector;
+
+static inline FloatVector vector_load(const float *values) { return _mm_loadu_ps(values); }
+static inline FloatVector vector_dup(float value) { return _mm_set1_ps(value); }
+static inline FloatVector vector_add(FloatVector a, FloatVector b) { return _mm_add_ps(a, b); }
+static inline FloatVector vector_sub(FloatVector a, FloatVector b) { return _mm_sub_ps(a, b); }
+static inline FloatVector vector_mul(FloatVector a, FloatVector b) { return _mm_mul_ps(a, b); }
+static inline FloatVector vector_min(FloatVector a, FloatVector b) { return _mm_min_ps(a, b); }
+static inline FloatVector vector_max(FloatVector a, FloatVector b) { return _mm_max_ps(a, b); }
+static inline void vector_store(float *values, FloatVector a) { _mm_storeu_ps(values, a); }
+
+static inline float vector_sum(FloatVector a) {
+  __m128 pairs = _mm_add_ps(a, _mm_movehl_ps(a, a));
+  return _mm_cvtss_f32(_mm_add_ss(pairs, _mm_shuffle_ps(pairs, pairs, 1)));
+}
+
+#else
+
+struct FloatVector {
+  float lanes[FLOAT_VECTOR_SIZE];
+};
+
+static inline FloatVector vector_load(const float *values) {
+  FloatVector result;
+  for (int i = 0; i < FLOAT_VECTOR_SIZE; i++) result.lanes[i] = values[i];
+  return result;
+}
+
+static inline FloatVector vector_dup(float value) {
+  FloatVector result;
+  for (int i = 0; i < FLOAT_VECTOR_SIZE; i++) result.lanes[i] = value;
+  return result;
+}
+
+static inline FloatVector vector_add(FloatVector a, FloatVector b) {
+  for (int i = 0; i < FLOAT_VECTOR_SIZE; i++) a.lanes[i] += b.lanes[i];
+  return a;
+}
+
+static inline FloatVector vector_sub(FloatVector a, FloatVector b) {
+  for (int i = 0; i < FLOAT_VECTOR_SIZE; i++) a.lanes[i] -= b.lanes[i];
+  return a;
+}
+
+static inline FloatVector vector_mul(FloatVector a, FloatVector b) {
+  for (int i = 0; i < FLOAT_VECTOR_SIZE; i++) a.lanes[i] *= b.lanes[i];
+  return a;
+}
+
+static inline FloatVector vector_min(FloatVector a, FloatVector b) {
+  for (int i = 0; i < FLOAT_VECTOR_SIZE; i++) {
+    if (b.lanes[i] < a.lanes[i]) a.lanes[i] = b.lanes[i];
+  }
+  return a;
+}
+
+static inline FloatVector vector_max(FloatVector a, FloatVector b) {
+  for (int i = 0; i < FLOAT_VECTOR_SIZE; i++) {
+    if (b.lanes[i] > a.lanes[i]) a.lanes[i] = b.lanes[i];
+  }
+  return a;
+}
+
+static inline void vector_store(float *values, FloatVector a) {
+  for (int i = 0; i < FLOAT_VECTOR_SIZE; i++) values[i] = a.lanes[i];
+}
+
+static inline float vector_sum(FloatVector a) {
+  return (a.lanes[0] + a.lanes[1]) + (a.lanes[2] + a.lanes[3]);
+}
+
+#endif
+
+#endif //DSP_UTILS_FLOAT_VECTOR_H
@@ -0,0 +1,513 @@
+/*
+ * Copyright 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include <math.h>
+#include <algorithm>
+#include "float_vector.h"
+#include "real_fft.h"
+
+/**
+ * The arithmetic the butterflies are written with, on one float or on FLOAT_VECTOR_SIZE of them
+ */
+struct ScalarOps {
+  typedef float Value;
+  static const int32_t kWidth = 1;
+  static inline float load(const float *values) { return *values; }
+  static inline void store(float *values, float a) { *values = a; }
+  static inline float dup(float value) { return value; }
+  static inline float add(float a, float b) { return a + b; }
+  static inline float sub(float a, float b) { return a - b; }
+  static inline float mul(float a, float b) { return a * b; }
+};
+
+struct VectorOps {
+  typedef FloatVector Value;
+  static const int32_t kWidth = FLOAT_VECTOR_SIZE;
+  static inline FloatVector load(const float *values) { return vector_load(values); }
+  static inline void store(float *values, FloatVector a) { vector_store(values, a); }
+  static inline FloatVector dup(float value) { return vector_dup(value); }
+  static inline FloatVector add(FloatVector a, FloatVector b) { return vector_add(a, b); }
+  static inline FloatVector sub(FloatVector a, FloatVector b) { return vector_sub(a, b); }
+  static inline FloatVector mul(FloatVector a, FloatVector b) { return vector_mul(a, b); }
+};
+
+/**
+ * One stage of the Stockham FFT. Sub-transform q's element k, for k in [0, radix * m), is at
+ * x[q + s * k]. Each butterfly p takes elements p, p + m, p + 2 * m... of a sub-transform, and
+ * writes their DFT, multiplied by the stage's twiddles, to y[q + s * (radix * p + j)].
+ */
+struct StageArgs {
+  const float *x_re;
+  const float *x_im;
+  float *y_re;
+  float *y_im;
+  int32_t s;
+  int32_t m;
+  const float *w_re;              // (radix - 1) twiddles for each p
+  const float *w_im;
+  const float *root_re;           // Only for radices without their own butterfly
+  const float *root_im;
+  int32_t radix;
+};
+
+/**
+ * The butterflies transform radix values in place, without the twiddles
+ */
+template <typename Ops>
+struct Radix2 {
+  static const int32_t kRadix = 2;
+  static inline void compute(typename Ops::Value *re, typename Ops::Value *im) {
+    typename Ops::Value a0_re = re[0];
+    typename Ops::Value a0_im = im[0];
+    re[0] = Ops::add(a0_re, re[1]);
+    im[0] = Ops::add(a0_im, im[1]);
+    re[1] = Ops::sub(a0_re, re[1]);
+    im[1] = Ops::sub(a0_im, im[1]);
+  }
+};
+
+template <typename Ops>
+struct Radix3 {
+  static const int32_t kRadix = 3;
+  static inline void compute(typename Ops::Value *re, typename Ops::Value *im) {
+    typedef typename Ops::Value V;
+    const V half = Ops::dup(0.5f);
+    const V sin60 = Ops::dup(0.86602540378443865f);
+    V t1_re = Ops::add(re[1], re[2]);
+    V t1_im = Ops::add(im[1], im[2]);
+    V t2_re = Ops::sub(re[0], Ops::mul(t1_re, half));
+    V t2_im = Ops::sub(im[0], Ops::mul(t1_im, half));
+    // -i * sin(60) * (a1 - a2)
+    V t3_re = Ops::mul(Ops::sub(im[1], im[2]), sin60);
+    V t3_im = Ops::mul(Ops::sub(re[2], re[1]), sin60);
+    re[0] = Ops::add(re[0], t1_re);
+    im[0] = Ops::add(im[0], t1_im);
+    re[1] = Ops::add(t2_re, t3_re);
+    im[1] = Ops::add(t2_im, t3_im);
+    re[2] = Ops::sub(t2_re, t3_re);
+    im[2] = Ops::sub(t2_im, t3_im);
+  }
+};
+
+template <typename Ops>
+struct Radix4 {
+  static const int32_t kRadix = 4;
+  static inline void compute(typename Ops::Value *re, typename Ops::Value *im) {
+    typedef typename Ops::Value V;
+    V sum02_re = Ops::add(re[0], re[2]);
+    V sum02_im = Ops::add(im[0], im[2]);
+    V diff02_re = Ops::sub(re[0], re[2]);
+    V diff02_im = Ops::sub(im[0], im[2]);
+    V sum13_re = Ops::add(re[1], re[3]);
+    V sum13_im = Ops::add(im[1], im[3]);
+    // -i * (a1 - a3)
+    V rot13_re = Ops::sub(im[1], im[3]);
+    V rot13_im = Ops::sub(re[3], re[1]);
+    re[0] = Ops::add(sum02_re, sum13_re);
+    im[0] = Ops::add(sum02_im, sum13_im);
+    re[1] = Ops::add(diff02_re, rot13_re);
+    im[1] = Ops::add(diff02_im, rot13_im);
+    re[2] = Ops::sub(sum02_re, sum13_re);
+    im[2] = Ops::sub(sum02_im, sum13_im);
+    re[3] = Ops::sub(diff02_re, rot13_re);
+    im[3] = Ops::sub(diff02_im, rot13_im);
+  }
+};
+
+template <typename Ops>
+struct Radix5 {
+  static const int32_t kRadix = 5;
+  static inline void compute(typename Ops::Value *re, typename Ops::Value *im) {
+    typedef typename Ops::Value V;
+    const V cos1 = Ops::dup(0.30901699437494742f);      // cos(2 * pi / 5)
+    const V cos2 = Ops::dup(-0.80901699437494742f);     // cos(4 * pi / 5)
+    const V sin1 = Ops::dup(0.95105651629515357f);
+    const V sin2 = Ops::dup(0.58778525229247313f);
+    V t1_re = Ops::add(re[1], re[4]);
+    V t1_im = Ops::add(im[1], im[4]);
+    V t2_re = Ops::add(re[2], re[3]);
+    V t2_im = Ops::add(im[2], im[3]);
+    V t3_re = Ops::sub(re[1], re[4]);
+    V t3_im = Ops::sub(im[1], im[4]);
+    V t4_re = Ops::sub(re[2], re[3]);
+    V t4_im = Ops::sub(im[2], im[3]);
+
+    V m1_re = Ops::add(re[0], Ops::add(Ops::mul(t1_re, cos1), Ops::mul(t2_re, cos2)));
+    V m1_im = Ops::add(im[0], Ops::add(Ops::mul(t1_im, cos1), Ops::mul(t2_im, cos2)));
+    V m2_re = Ops::add(re[0], Ops::add(Ops::mul(t1_re, cos2), Ops::mul(t2_re, cos1)));
+    V m2_im = Ops::add(im[0], Ops::add(Ops::mul(t1_im, cos2), Ops::mul(t2_im, cos1)));
+    V n1_re = Ops::add(Ops::mul(t3_re, sin1), Ops::mul(t4_re, sin2));
+    V n1_im = Ops::add(Ops::mul(t3_im, sin1), Ops::mul(t4_im, sin2));
+    V n2_re = Ops::sub(Ops::mul(t3_re, sin2), Ops::mul(t4_re, sin1));
+    V n2_im = Ops::sub(Ops::mul(t3_im, sin2), Ops::mul(t4_im, sin1));
+
+    // b1 = m1 - i * n1, b4 = m1 + i * n1, b2 = m2 - i * n2, b3 = m2 + i * n2
+    re[0] = Ops::add(re[0], Ops::add(t1_re, t2_re));
+    im[0] = Ops::add(im[0], Ops::add(t1_im, t2_im));
+    re[1] = Ops::add(m1_re, n1_im);
+    im[1] = Ops::sub(m1_im, n1_re);
+    re[2] = Ops::add(m2_re, n2_im);
+    im[2] = Ops::sub(m2_im, n2_re);
+    re[3] = Ops::sub(m2_re, n2_im);
+    im[3] = Ops::add(m2_im, n2_re);
+    re[4] = Ops::sub(m1_re, n1_im);
+    im[4] = Ops::add(m1_im, n1_re);
+  }
+};
+
+/**
+ * Butterflies for sub-transforms [q_begin, q_end) of butterfly p, Ops::kWidth at a time
+ */
+template <template <typename> class Butterfly, typename Ops>
+static void run_butterflies(const StageArgs &args, int32_t p, int32_t q_begin, int32_t q_end) {
+  typedef typename Ops::Value V;
+  const int32_t radix = Butterfly<Ops>::kRadix;
+  const int32_t s = args.s;
+  V w_re[radix];
+  V w_im[radix];
+  for (int32_t j = 1; j < radix; j++) {
+    w_re[j] = Ops::dup(args.w_re[(radix - 1) * p + j - 1]);
+    w_im[j] = Ops::dup(args.w_im[(radix - 1) * p + j - 1]);
+  }
+  for (int32_t q = q_begin; q < q_end; q += Ops::kWidth) {
+    V re[radix];
+    V im[radix];
+    for (int32_t k = 0; k < radix; k++) {
+      re[k] = Ops::load(args.x_re + q + s * (p + k * args.m));
+      im[k] = Ops::load(args.x_im + q + s * (p + k * args.m));
+    }
+    Butterfly<Ops>::compute(re, im);
+    const int32_t out = q + s * radix * p;
+    Ops::store(args.y_re + out, re[0]);
+    Ops::store(args.y_im + out, im[0]);
+    for (int32_t j = 1; j < radix; j++) {
+      Ops::store(args.y_re + out + j * s,
+                 Ops::sub(Ops::mul(re[j], w_re[j]), Ops::mul(im[j], w_im[j])));
+      Ops::store(args.y_im + out + j * s,
+                 Ops::add(Ops::mul(re[j], w_im[j]), Ops::mul(im[j], w_re[j])));
+    }
+  }
+}
+
+/**
+ * The first stage has one sub-transform, so FLOAT_VECTOR_SIZE butterflies [p, p + 4) run at
+ * once instead. Their inputs are neighbours but their outputs and twiddles are radix apart, so
+ * those go through the stack.
+ */
+template <template <typename> class Butterfly>
+static void run_first_butterflies(const StageArgs &args, int32_t p) {
+  const int32_t radix = Butterfly<VectorOps>::kRadix;
+  FloatVector re[radix];
+  FloatVector im[radix];
+  for (int32_t k = 0; k < radix; k++) {
+    re[k] = vector_load(args.x_re + p + k * args.m);
+    im[k] = vector_load(args.x_im + p + k * args.m);
+  }
+  Butterfly<VectorOps>::compute(re, im);
+
+  float out_re[radix][FLOAT_VECTOR_SIZE];
+  float out_im[radix][FLOAT_VECTOR_SIZE];
+  vector_store(out_re[0], re[0]);
+  vector_store(out_im[0], im[0]);
+  for (int32_t j = 1; j < radix; j++) {
+    float lane_re[FLOAT_VECTOR_SIZE];
+    float lane_im[FLOAT_VECTOR_SIZE];
+    for (int32_t lane = 0; lane < FLOAT_VECTOR_SIZE; lane++) {
+      lane_re[lane] = args.w_re[(radix - 1) * (p + lane) + j - 1];
+      lane_im[lane] = args.w_im[(radix - 1) * (p + lane) + j - 1];
+    }
+    FloatVector w_re = vector_load(lane_re);
+    FloatVector w_im = vector_load(lane_im);
+    vector_store(out_re[j], vector_sub(vector_mul(re[j], w_re), vector_mul(im[j], w_im)));
+    vector_store(out_im[j], vector_add(vector_mul(re[j], w_im), vector_mul(im[j], w_re)));
+  }
+  for (int32_t lane = 0; lane < FLOAT_VECTOR_SIZE; lane++) {
+    for (int32_t j = 0; j < radix; j++) {
+      args.y_re[radix * (p + lane) + j] = out_re[j][lane];
+      args.y_im[radix * (p + lane) + j] = out_im[j][lane];
+    }
+  }
+}
+
+/**
+ * Run a butterfly for every p, FLOAT_VECTOR_SIZE sub-transforms at a time while there are that
+ * many left, or FLOAT_VECTOR_SIZE butterflies at a time in the first stage
+ */
+template <template <typename> class Butterfly>
+static void run_stage(const StageArgs &args) {
+  int32_t p = 0;
+  if (args.s == 1) {
+    for (; p + FLOAT_VECTOR_SIZE <= args.m; p += FLOAT_VECTOR_SIZE) {
+      run_first_butterflies<Butterfly>(args, p);
+    }
+  }
+  const int32_t vector_end = args.s - args.s % FLOAT_VECTOR_SIZE;
+  for (; p < args.m; p++) {
+    run_butterflies<Butterfly, VectorOps>(args, p, 0, vector_end);
+    run_butterflies<Butterfly, ScalarOps>(args, p, vector_end, args.s);
+  }
+}
+
+/**
+ * Any other prime radix, as a plain DFT
+ */
+template <typename Ops>
+struct RadixAny {
+  static void run(const StageArgs &args, int32_t p, int32_t q_begin, int32_t q_end) {
+    typedef typename Ops::Value V;
+    const int32_t s = args.s;
+    const int32_t sm = s * args.m;
+    const int32_t radix = args.radix;
+    for (int32_t q = q_begin; q < q_end; q += Ops::kWidth) {
+      const int32_t in = q + s * p;
+      const int32_t out = q + s * radix * p;
+      for (int32_t j = 0; j < radix; j++) {
+        V sum_re = Ops::dup(0.0f);
+        V sum_im = Ops::dup(0.0f);
+        for (int32_t k = 0; k < radix; k++) {
+          V a_re = Ops::load(args.x_re + in + k * sm);
+          V a_im = Ops::load(args.x_im + in + k * sm);
+          V root_re = Ops::dup(args.root_re[(j * k) % radix]);
+          V root_im = Ops::dup(args.root_im[(j * k) % radix]);
+          sum_re = Ops::add(sum_re, Ops::sub(Ops::mul(a_re, root_re), Ops::mul(a_im, root_im)));
+          sum_im = Ops::add(sum_im, Ops::add(Ops::mul(a_re, root_im), Ops::mul(a_im, root_re)));
+        }
+        if (j == 0) {
+          Ops::store(args.y_re + out, sum_re);
+          Ops::store(args.y_im + out, sum_im);
+        } else {
+          V w_re = Ops::dup(args.w_re[(radix - 1) * p + j - 1]);
+          V w_im = Ops::dup(args.w_im[(radix - 1) * p + j - 1]);
+          Ops::store(args.y_re + out + j * s,
+                     Ops::sub(Ops::mul(sum_re, w_re), Ops::mul(sum_im, w_im)));
+          Ops::store(args.y_im + out + j * s,
+                     Ops::add(Ops::mul(sum_re, w_im), Ops::mul(sum_im, w_re)));
+        }
+      }
+    }
+  }
+};
+
+static void run_any_stage(const StageArgs &args) {
+  const int32_t vector_end = args.s - args.s % FLOAT_VECTOR_SIZE;
+  for (int32_t p = 0; p < args.m; p++) {
+    RadixAny<VectorOps>::run(args, p, 0, vector_end);
+    RadixAny<ScalarOps>::run(args, p, vector_end, args.s);
+  }
+}
+
+RealFft::RealFft(int32_t size) :
+    size_(size),
+    half_size_(size / 2),
+    spectrum_stride_((size / 2 + FLOAT_VECTOR_SIZE) / FLOAT_VECTOR_SIZE * FLOAT_VECTOR_SIZE) {
+
+  // Radix 4 first, so the stages after the first have enough sub-transforms to vectorize
+  std::vector<int32_t> radices;
+  int32_t remaining = half_size_;
+  while (remaining % 4 == 0) {
+    radices.push_back(4);
+    remaining /= 4;
+  }
+  if (remaining % 2 == 0) {
+    radices.push_back(2);
+    remaining /= 2;
+  }
+  for (int32_t factor = 3; factor * factor <= remaining; factor += 2) {
+    while (remaining % factor == 0) {
+      radices.push_back(factor);
+      remaining /= factor;
+    }
+  }
+  if (remaining > 1) radices.push_back(remaining);
+
+  int32_t length = half_size_;
+  int32_t stride = 1;
+  for (int32_t radix : radices) {
+    Stage stage = { radix, length, stride, static_cast<int32_t>(twiddle_re_.size()),
+                    static_cast<int32_t>(root_re_.size()) };
+    for (int32_t p = 0; p < length / radix; p++) {
+      for (int32_t j = 1; j < radix; j++) {
+        double angle = -2 * M_PI * j * p / length;
+        twiddle_re_.push_back(static_cast<float>(cos(angle)));
+        twiddle_im_.push_back(static_cast<float>(sin(angle)));
+      }
+    }
+    if (radix > 5) {
+      for (int32_t t = 0; t < radix; t++) {
+        double angle = -2 * M_PI * t / radix;
+        root_re_.push_back(static_cast<float>(cos(angle)));
+        root_im_.push_back(static_cast<float>(sin(angle)));
+      }
+    }
+    stages_.push_back(stage);
+    length /= radix;
+    stride *= radix;
+  }
+
+  for (int32_t k = 0; k <= half_size_; k++) {
+    double angle = -2 * M_PI * k / size_;
+    split_re_.push_back(static_cast<float>(cos(angle)));
+    split_im_.push_back(static_cast<float>(sin(angle)));
+  }
+
+  for (int i = 0; i < 2; i++) {
+    work_re_[i].resize(std::max(half_size_, 1));
+    work_im_[i].resize(std::max(half_size_, 1));
+  }
+}
+
+/**
+ * Stage index of the complex FFT of half_size_ points, from x to y
+ */
+void RealFft::runStage(int32_t index, const float *x_re, const float *x_im, float *y_re,
+                       float *y_im) {
+
+  const Stage &stage = stages_[index];
+  StageArgs args = { x_re, x_im, y_re, y_im, stage.stride, stage.length / stage.radix,
+                     twiddle_re_.data() + stage.twiddle_offset,
+                     twiddle_im_.data() + stage.twiddle_offset,
+                     root_re_.data() + stage.root_offset,
+                     root_im_.data() + stage.root_offset,
+                     stage.radix };
+  switch (stage.radix) {
+    case 2:
+      run_stage<Radix2>(args);
+      break;
+    case 3:
+      run_stage<Radix3>(args);
+      break;
+    case 4:
+      run_stage<Radix4>(args);
+      break;
+    case 5:
+      run_stage<Radix5>(args);
+      break;
+    default:
+      run_any_stage(args);
+      break;
+  }
+}
+
+/**
+ * A pass for each stage of the complex FFT, at least one
+ */
+int32_t RealFft::getPassCount() const {
+  return std::max(1, static_cast<int32_t>(stages_.size()));
+}
+
+void RealFft::forward(const float *input, float *re, float *im) {
+  for (int32_t pass = 0; pass < getPassCount(); pass++) forwardPass(input, re, im, pass);
+}
+
+void RealFft::inverse(const float *re, const float *im, float *output) {
+  for (int32_t pass = 0; pass < getPassCount(); pass++) inversePass(re, im, output, pass);
+}
+
+/**
+ * The first pass loads the complex signal, the even frames as real parts and the odd frames as
+ * imaginary parts. Each pass runs a stage, from one work buffer to the other. With z the
+ * complex FFT, and w = exp(-2 * pi * i / size), the last pass separates bin k of the real FFT as
+ * (z[k] + conj(z[n - k])) / 2 - i * w^k * (z[k] - conj(z[n - k])) / 2.
+ */
+void RealFft::forwardPass(const float *input, float *re, float *im, int32_t pass) {
+
+  if (pass == 0) {
+    float *x_re = work_re_[0].data();
+    float *x_im = work_im_[0].data();
+    for (int32_t k = 0; k < half_size_; k++) {
+      x_re[k] = input[2 * k];
+      x_im[k] = input[2 * k + 1];
+    }
+  }
+  if (pass < static_cast<int32_t>(stages_.size())) {
+    runStage(pass, work_re_[pass % 2].data(), work_im_[pass % 2].data(),
+             work_re_[(pass + 1) % 2].data(), work_im_[(pass + 1) % 2].data());
+  }
+  if (pass < getPassCount() - 1) return;
+
+  const float *z_re = work_re_[stages_.size() % 2].data();
+  const float *z_im = work_im_[stages_.size() % 2].data();
+  for (int32_t k = 0; k <= half_size_; k++) {
+    int32_t index = (k == half_size_) ? 0 : k;
+    int32_t mirror = (k == 0) ? 0 : half_size_ - k;
+    float conj_re = z_re[mirror];
+    float conj_im = -z_im[mirror];
+    float even_re = 0.5f * (z_re[index] + conj_re);
+    float even_im = 0.5f * (z_im[index] + conj_im);
+    float odd_re = 0.5f * (z_im[index] - conj_im);
+    float odd_im = -0.5f * (z_re[index] - conj_re);
+    re[k] = even_re + odd_re * split_re_[k] - odd_im * split_im_[k];
+    im[k] = even_im + odd_re * split_im_[k] + odd_im * split_re_[k];
+  }
+  std::fill(re + half_size_ + 1, re + spectrum_stride_, 0.0f);
+  std::fill(im + half_size_ + 1, im + spectrum_stride_, 0.0f);
+}
+
+/**
+ * The reverse of forwardPass. The first pass combines the bins back into a complex spectrum,
+ * doubled, then the complex inverse FFT is the forward one with the real and imaginary parts
+ * swapped.
+ */
+void RealFft::inversePass(const float *re, const float *im, float *output, int32_t pass) {
+
+  if (pass == 0) {
+    float *z_re = work_re_[0].data();
+    float *z_im = work_im_[0].data();
+    for (int32_t k = 0; k < half_size_; k++) {
+      float conj_re = re[half_size_ - k];
+      float conj_im = -im[half_size_ - k];
+      float even_re = re[k] + conj_re;
+      float even_im = im[k] + conj_im;
+      float diff_re = re[k] - conj_re;
+      float diff_im = im[k] - conj_im;
+      float odd_re = diff_re * split_re_[k] + diff_im * split_im_[k];
+      float odd_im = diff_im * split_re_[k] - diff_re * split_im_[k];
+      z_re[k] = even_re - odd_im;
+      z_im[k] = even_im + odd_re;
+    }
+  }
+  if (pass < static_cast<int32_t>(stages_.size())) {
+    runStage(pass, work_im_[pass % 2].data(), work_re_[pass % 2].data(),
+             work_im_[(pass + 1) % 2].data(), work_re_[(pass + 1) % 2].data());
+  }
+  if (pass < getPassCount() - 1) return;
+
+  const float *x_re = work_re_[stages_.size() % 2].data();
+  const float *x_im = work_im_[stages_.size() % 2].data();
+  for (int32_t k = 0; k < half_size_; k++) {
+    output[2 * k] = x_re[k];
+    output[2 * k + 1] = x_im[k];
+  }
+}
+
+void complex_multiply_add(const float *a_re, const float *a_im,
+                          const float *b_re, const float *b_im,
+                          const float *c_re, const float *c_im,
+                          float *out_re, float *out_im,
+                          int32_t count) {
+
+  for (int32_t i = 0; i < count; i += FLOAT_VECTOR_SIZE) {
+    FloatVector ar = vector_load(a_re + i);
+    FloatVector ai = vector_load(a_im + i);
+    FloatVector br = vector_load(b_re + i);
+    FloatVector bi = vector_load(b_im + i);
+    FloatVector re = vector_sub(vector_mul(ar, br), vector_mul(ai, bi));
+    FloatVector im = vector_add(vector_mul(ar, bi), vector_mul(ai, br));
+    vector_store(out_re + i, vector_add(vector_load(c_re + i), re));
+    vector_store(out_im + i, vector_add(vector_load(c_im + i), im));
+  }
+}
@@ -0,0 +1,127 @@
+/*
+ * Copyright 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef DSP_UTILS_REAL_FFT_H
+#define DSP_UTILS_REAL_FFT_H
+
+#include <stdint.h>
+#include <vector>
+
+/**
+ * Forward and inverse FFTs of real signals, for fast convolution.
+ *
+ * A real signal of size frames is transformed as a complex signal of size / 2 frames, with the
+ * even frames as real parts and the odd frames as imaginary parts, and the two spectra are then
+ * separated. The complex FFT is a mixed radix Stockham autosort FFT with radix 4, 2, 3 and 5
+ * butterflies and a plain DFT for any other prime factor, so size / 2 needn't be a power of two
+ * and can be an audio burst such as 192 or 240 frames. Each stage after the first has several
+ * butterflies reading neighbouring data, which it runs FLOAT_VECTOR_SIZE at a time. The inverse
+ * complex FFT is the forward one with the real and imaginary parts swapped.
+ *
+ * Spectra are split into arrays of real and imaginary parts of size / 2 + 1 bins, from 0 Hz to
+ * the Nyquist frequency, padded with zeros to getSpectrumStride() bins so they can be processed
+ * FLOAT_VECTOR_SIZE bins at a time. Neither transform is scaled, so inverse(forward(x)) is
+ * size * x.
+ *
+ * A transform can also be run a pass at a time, each about the same amount of work, to spread it
+ * over several audio callbacks. A RealFft can only be partway through one transform at a time.
+ *
+ * The constructor allocates everything, so a RealFft may be used on an audio thread, but by only
+ * one thread at a time.
+ */
+class RealFft {
+
+public:
+  /**
+   * @param size frames in the signal, even
+   */
+  explicit RealFft(int32_t size);
+
+  int32_t getSize() const { return size_; }
+
+  /**
+   * Floats in the real or the imaginary parts of a spectrum, size / 2 + 1 rounded up to a
+   * multiple of FLOAT_VECTOR_SIZE
+   */
+  int32_t getSpectrumStride() const { return spectrum_stride_; }
+
+  /**
+   * @param input size frames
+   * @param re real parts, getSpectrumStride() floats
+   * @param im imaginary parts, getSpectrumStride() floats
+   */
+  void forward(const float *input, float *re, float *im);
+
+  /**
+   * @param re real parts, size / 2 + 1 bins
+   * @param im imaginary parts, size / 2 + 1 bins. Those of the first and last bins should be 0
+   *     as they are in the spectrum of any real signal.
+   * @param output size frames
+   */
+  void inverse(const float *re, const float *im, float *output);
+
+  /**
+   * The passes of a transform, the same for forward and inverse
+   */
+  int32_t getPassCount() const;
+
+  /**
+   * Run one pass of forward. Passes must be run in order, with the same arguments.
+   */
+  void forwardPass(const float *input, float *re, float *im, int32_t pass);
+  void inversePass(const float *re, const float *im, float *output, int32_t pass);
+
+private:
+  struct Stage {
+    int32_t radix;
+    int32_t length;               // Of each sub-transform the stage splits
+    int32_t stride;               // Number of sub-transforms, interleaved
+    int32_t twiddle_offset;       // Of the stage's (radix - 1) * length / radix twiddles
+    int32_t root_offset;          // Of the radix roots of unity, for radices without a butterfly
+  };
+
+  int32_t size_;
+  int32_t half_size_;
+  int32_t spectrum_stride_;
+  std::vector<Stage> stages_;
+  std::vector<float> twiddle_re_;
+  std::vector<float> twiddle_im_;
+  std::vector<float> root_re_;
+  std::vector<float> root_im_;
+
+  // exp(-2 * pi * i * k / size) for k up to size / 2, to separate the two spectra
+  std::vector<float> split_re_;
+  std::vector<float> split_im_;
+
+  // The complex signal and the buffer the stages ping-pong with
+  std::vector<float> work_re_[2];
+  std::vector<float> work_im_[2];
+
+  void runStage(int32_t index, const float *x_re, const float *x_im, float *y_re, float *y_im);
+};
+
+/**
+ * out = a * b + c for count complex bins of split spectra. count must be a multiple of
+ * FLOAT_VECTOR_SIZE and out may be c.
+ */
+void complex_multiply_add(const float *a_re, const float *a_im,
+                          const float *b_re, const float *b_im,
+                          const float *c_re, const float *c_im,
+                          float *out_re, float *out_im,
+                          int32_t count);
+
+#endif //DSP_UTILS_REAL_FFT_H
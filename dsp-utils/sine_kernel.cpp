@@ -0,0 +1,145 @@
+/*
+ * Copyright 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <math.h>
+#include "float_vector.h"
+#include "sine_kernel.h"
+
+// Number of frames rendered by each rotation of the phasor vector
+#define FRAMES_PER_VECTOR FLOAT_VECTOR_SIZE
+
+static const double RADIANS_PER_PHASE_UNIT = 2 * M_PI / 4294967296.0; // 2 * pi / 2^32
+
+struct Phasor {
+  double re;
+  double im;
+};
+
+static inline Phasor multiply(Phasor a, Phasor b) {
+  Phasor result = { a.re * b.re - a.im * b.im, a.re * b.im + a.im * b.re };
+  return result;
+}
+
+static inline Phasor phase_to_phasor(uint32_t phase) {
+  double radians = phase * RADIANS_PER_PHASE_UNIT;
+  Phasor result = { cos(radians), sin(radians) };
+  return result;
+}
+
+static inline void write_samples(float *buffer, int32_t channel_stride, FloatVector samples,
+                                 int num_samples) {
+  if (channel_stride == 1 && num_samples == FRAMES_PER_VECTOR) {
+    vector_store(buffer, samples);
+    return;
+  }
+  float values[FRAMES_PER_VECTOR];
+  vector_store(values, samples);
+  for (int i = 0; i < num_samples; i++) buffer[i * channel_stride] = values[i];
+}
+
+static inline void write_samples(int16_t *buffer, int32_t channel_stride, FloatVector samples,
+                                 int num_samples) {
+  float values[FRAMES_PER_VECTOR];
+  vector_store(values, samples);
+  for (int i = 0; i < num_samples; i++) buffer[i * channel_stride] = (int16_t) values[i];
+}
+
+/**
+ * The phasors are scaled by the output scale so that their imaginary parts can be written out
+ * directly
+ */
+template <typename T>
+static uint32_t render(T *buffer,
+                       int32_t channel_stride,
+                       int32_t num_frames,
+                       uint32_t phase,
+                       uint32_t phase_increment,
+                       float scale) {
+
+  if (num_frames <= 0) return phase;
+
+  // Rotations by one to three frames for the lanes, by a vector and by a renormalization block
+  const Phasor frame_step = phase_to_phasor(phase_increment);
+  Phasor lane_steps[FRAMES_PER_VECTOR];
+  lane_steps[0] = Phasor { 1, 0 };
+  for (int i = 1; i < FRAMES_PER_VECTOR; i++) {
+    lane_steps[i] = multiply(lane_steps[i - 1], frame_step);
+  }
+  const Phasor vector_step = multiply(lane_steps[FRAMES_PER_VECTOR - 1], frame_step);
+  Phasor block_step = vector_step;
+  for (int i = FRAMES_PER_VECTOR; i < SINE_KERNEL_RENORMALIZE_FRAMES; i *= 2) {
+    block_step = multiply(block_step, block_step);
+  }
+
+  const FloatVector step_re = vector_dup((float) vector_step.re);
+  const FloatVector step_im = vector_dup((float) vector_step.im);
+
+  Phasor block_start = phase_to_phasor(phase);
+  int32_t frame = 0;
+  while (frame < num_frames) {
+
+    float lanes_re[FRAMES_PER_VECTOR];
+    float lanes_im[FRAMES_PER_VECTOR];
+    for (int i = 0; i < FRAMES_PER_VECTOR; i++) {
+      Phasor lane = multiply(block_start, lane_steps[i]);
+      lanes_re[i] = (float) (lane.re * scale);
+      lanes_im[i] = (float) (lane.im * scale);
+    }
+    FloatVector re = vector_load(lanes_re);
+    FloatVector im = vector_load(lanes_im);
+
+    int32_t block_end = frame + SINE_KERNEL_RENORMALIZE_FRAMES;
+    if (block_end > num_frames) block_end = num_frames;
+    for (; frame + FRAMES_PER_VECTOR <= block_end; frame += FRAMES_PER_VECTOR) {
+      write_samples(buffer + frame * channel_stride, channel_stride, im, FRAMES_PER_VECTOR);
+      FloatVector next_re = vector_sub(vector_mul(re, step_re), vector_mul(im, step_im));
+      im = vector_add(vector_mul(re, step_im), vector_mul(im, step_re));
+      re = next_re;
+    }
+
+    // Only the last block can end part way through a vector
+    if (frame < block_end) {
+      write_samples(buffer + frame * channel_stride, channel_stride, im, block_end - frame);
+      frame = block_end;
+    }
+
+    // One Newton step towards unit magnitude is plenty, the error per block is tiny
+    block_start = multiply(block_start, block_step);
+    double gain = 1.5 - 0.5 * (block_start.re * block_start.re + block_start.im * block_start.im);
+    block_start.re *= gain;
+    block_start.im *= gain;
+  }
+
+  return phase + phase_increment * (uint32_t) num_frames;
+}
+
+uint32_t render_sine(float *buffer,
+                     int32_t channel_stride,
+                     int32_t num_frames,
+                     uint32_t phase,
+                     uint32_t phase_increment,
+                     float amplitude) {
+  return render(buffer, channel_stride, num_frames, phase, phase_increment, amplitude);
+}
+
+uint32_t render_sine(int16_t *buffer,
+                     int32_t channel_stride,
+                     int32_t num_frames,
+                     uint32_t phase,
+                     uint32_t phase_increment,
+                     float amplitude) {
+  return render(buffer, channel_stride, num_frames, phase, phase_increment, 32767 * amplitude);
+}
@@ -0,0 +1,66 @@
+/*
+ * Copyright 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef DSP_UTILS_SINE_KERNEL_H
+#define DSP_UTILS_SINE_KERNEL_H
+
+#include <stdint.h>
+
+// Frames rendered from the float phasors before they are set again from the double precision
+// phasor. Must be a power of two and at least 4.
+#define SINE_KERNEL_RENORMALIZE_FRAMES 64
+
+// Largest difference between render_sine's float output and sin(2 * pi * phase / 2^32), as a
+// fraction of the amplitude
+#define SINE_KERNEL_MAX_ERROR 1e-6f
+
+/**
+ * Render a sine wave by complex rotation instead of calling sin() or reading a table per frame.
+ *
+ * Four consecutive frames are held as four float phasors in a FloatVector. Each vector step
+ * writes their imaginary parts and rotates all four by four frames' phase increment, which is one
+ * complex multiply per frame. Every SINE_KERNEL_RENORMALIZE_FRAMES frames the float phasors are
+ * set again from a double precision phasor, which is renormalized to unit magnitude at the same
+ * time, so rounding errors can't build up. The phase is a 32-bit fixed point fraction of a cycle,
+ * as used by Wavetable, and the double precision phasor is computed from it on every call.
+ *
+ * Samples are written to every channel_stride'th element of buffer. int16 samples are
+ * (int16_t) (32767 * amplitude * sine), truncated towards zero, and can differ from that value
+ * computed with an exact sine by 1.
+ *
+ * @param buffer output buffer, at least num_frames * channel_stride samples
+ * @param channel_stride distance between frames, e.g. 2 for one channel of a stereo buffer
+ * @param num_frames number of frames to render
+ * @param phase phase of the first frame
+ * @param phase_increment phase increment per frame, see Wavetable::frequencyToPhaseIncrement
+ * @param amplitude peak amplitude, at most 1
+ * @return phase of the frame after the last one rendered
+ */
+uint32_t render_sine(float *buffer,
+                     int32_t channel_stride,
+                     int32_t num_frames,
+                     uint32_t phase,
+                     uint32_t phase_increment,
+                     float amplitude);
+
+uint32_t render_sine(int16_t *buffer,
+                     int32_t channel_stride,
+                     int32_t num_frames,
+                     uint32_t phase,
+                     uint32_t phase_increment,
+                     float amplitude);
+
+#endif //DSP_UTILS_SINE_KERNEL_H
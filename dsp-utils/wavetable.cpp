@@ -0,0 +1,117 @@
+/*
+ * Copyright 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <math.h>
+#include <mutex>
+#include "wavetable.h"
+
+// Harmonics in the first (richest) level, limited by the number of points in the table
+static const int MAX_HARMONICS = WAVETABLE_SIZE / 2;
+
+static const double PHASE_UNITS_PER_CYCLE = 4294967296.0; // 2^32
+
+constexpr float Wavetable::kFractionScale;
+
+float Wavetable::tables_[WAVEFORM_COUNT][WAVETABLE_NUM_LEVELS][WAVETABLE_SIZE + 1];
+
+void Wavetable::initialize() {
+
+  static std::once_flag is_built;
+  std::call_once(is_built, buildTables);
+}
+
+/**
+ * Each table is built by additive synthesis from its Fourier series, truncated to the number of
+ * harmonics allowed at that level. The harmonics are read from a single sine cycle using
+ * sin(2 * pi * h * n / N) = sine[(h * n) mod N], which avoids calling sin() for every term.
+ */
+void Wavetable::buildTables() {
+
+  static double sine[WAVETABLE_SIZE];
+  for (int n = 0; n < WAVETABLE_SIZE; n++) {
+    sine[n] = sin(2 * M_PI * n / WAVETABLE_SIZE);
+  }
+
+  static double accumulator[WAVETABLE_SIZE];
+
+  for (int waveform = 0; waveform < WAVEFORM_COUNT; waveform++) {
+    for (int level = 0; level < WAVETABLE_NUM_LEVELS; level++) {
+
+      int num_harmonics = MAX_HARMONICS >> level;
+
+      for (int n = 0; n < WAVETABLE_SIZE; n++) accumulator[n] = 0;
+
+      for (int h = 1; h <= num_harmonics; h++) {
+
+        double amplitude = 0;
+        switch (waveform) {
+          case WAVEFORM_SINE:
+            amplitude = (h == 1) ? 1 : 0;
+            break;
+          case WAVEFORM_SAW:
+            amplitude = ((h % 2) ? 1.0 : -1.0) / h;
+            break;
+          case WAVEFORM_SQUARE:
+            amplitude = (h % 2) ? 1.0 / h : 0;
+            break;
+          case WAVEFORM_TRIANGLE:
+            amplitude = (h % 2) ? (((h / 2) % 2) ? -1.0 : 1.0) / ((double) h * h) : 0;
+            break;
+        }
+        if (amplitude == 0) continue;
+
+        // Lanczos sigma factor, this reduces the Gibbs ringing caused by truncating the series
+        if (h > 1) {
+          double x = M_PI * h / (num_harmonics + 1);
+          amplitude *= sin(x) / x;
+        }
+
+        for (int n = 0; n < WAVETABLE_SIZE; n++) {
+          accumulator[n] += amplitude * sine[((int64_t) h * n) & (WAVETABLE_SIZE - 1)];
+        }
+      }
+
+      // Normalize so that every table peaks at full scale
+      double peak = 0;
+      for (int n = 0; n < WAVETABLE_SIZE; n++) {
+        if (fabs(accumulator[n]) > peak) peak = fabs(accumulator[n]);
+      }
+
+      float *table = tables_[waveform][level];
+      for (int n = 0; n < WAVETABLE_SIZE; n++) {
+        table[n] = (float) (accumulator[n] / peak);
+      }
+      // Guard point so that interpolation never has to wrap the index
+      table[WAVETABLE_SIZE] = table[0];
+    }
+  }
+}
+
+const float *Wavetable::getTable(Waveform waveform, uint32_t phase_increment) {
+
+  // Find the first level whose highest harmonic is below the Nyquist frequency, which is half a
+  // cycle per frame
+  int level = 0;
+  while (level < WAVETABLE_NUM_LEVELS - 1 &&
+         (uint64_t) (MAX_HARMONICS >> level) * phase_increment > (1u << 31)) {
+    level++;
+  }
+  return tables_[waveform][level];
+}
+
+uint32_t Wavetable::frequencyToPhaseIncrement(double frequency, double frame_rate) {
+  return (uint32_t) (fmod(frequency / frame_rate, 1.0) * PHASE_UNITS_PER_CYCLE);
+}
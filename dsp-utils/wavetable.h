@@ -0,0 +1,86 @@
+/*
+ * Copyright 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef DSP_UTILS_WAVETABLE_H
+#define DSP_UTILS_WAVETABLE_H
+
+#include <stdint.h>
+
+// Number of points in one cycle of a table, must be a power of two
+#define WAVETABLE_SIZE_BITS 11
+#define WAVETABLE_SIZE (1 << WAVETABLE_SIZE_BITS)
+
+// Each level holds half as many harmonics as the previous one, so one level covers an octave.
+// The last level holds only the fundamental.
+#define WAVETABLE_NUM_LEVELS (WAVETABLE_SIZE_BITS)
+
+enum Waveform {
+  WAVEFORM_SINE = 0,
+  WAVEFORM_SAW,
+  WAVEFORM_SQUARE,
+  WAVEFORM_TRIANGLE,
+  WAVEFORM_COUNT
+};
+
+/**
+ * Band-limited, mip-mapped single cycle wavetables.
+ *
+ * Phase is a 32-bit fixed point fraction of a cycle, so a phase accumulator wraps around
+ * naturally when it overflows. The top WAVETABLE_SIZE_BITS bits index the table and the
+ * remaining bits are used to interpolate between neighbouring points.
+ */
+class Wavetable {
+
+public:
+  /**
+   * Build the tables. This is slow, so call it once at startup from a non-audio thread.
+   * Subsequent calls return immediately.
+   */
+  static void initialize();
+
+  /**
+   * Get the table for the given waveform which has as many harmonics as possible without any
+   * of them exceeding the Nyquist frequency.
+   *
+   * @param waveform the waveform
+   * @param phase_increment phase increment per frame, see frequencyToPhaseIncrement
+   * @return a table of WAVETABLE_SIZE + 1 points, the last point repeats the first
+   */
+  static const float *getTable(Waveform waveform, uint32_t phase_increment);
+
+  static uint32_t frequencyToPhaseIncrement(double frequency, double frame_rate);
+
+  /**
+   * Linearly interpolated table lookup
+   */
+  static inline float lookup(const float *table, uint32_t phase) {
+    const uint32_t index = phase >> kFractionBits;
+    const float fraction = (phase & kFractionMask) * kFractionScale;
+    const float a = table[index];
+    return a + (table[index + 1] - a) * fraction;
+  }
+
+private:
+  static const int kFractionBits = 32 - WAVETABLE_SIZE_BITS;
+  static const uint32_t kFractionMask = (1u << kFractionBits) - 1;
+  static constexpr float kFractionScale = 1.0f / (1u << kFractionBits);
+
+  static void buildTables();
+
+  static float tables_[WAVEFORM_COUNT][WAVETABLE_NUM_LEVELS][WAVETABLE_SIZE + 1];
+};
+
+#endif //DSP_UTILS_WAVETABLE_H